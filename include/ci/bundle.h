@@ -0,0 +1,33 @@
+#ifndef CI_BUNDLE_H
+#define CI_BUNDLE_H
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/**
+ * @brief Writes a self-contained executable made of the running interpreter
+ * with a program image appended to it.
+ *
+ * The image is followed by a fixed size trailer recording its size, which is
+ * how `bundle_read` finds it again when the executable is launched. If the
+ * running interpreter already carries a payload, it is replaced.
+ *
+ * @param path The path of the executable to create.
+ * @param image The serialized program image.
+ * @param size The size of the image in bytes.
+ * @return True if the executable was written, false otherwise.
+ */
+bool bundle_write(const char *path, const uint8_t *image, size_t size);
+
+/**
+ * @brief Reads the program image appended to the running executable, if any.
+ *
+ * @param size Set to the size of the image in bytes when one is found.
+ * @return A heap allocated copy of the image, or NULL if the executable does
+ * not carry one.
+ *
+ * @note The caller is responsible for freeing the returned buffer.
+ */
+uint8_t *bundle_read(size_t *size);
+
+#endif
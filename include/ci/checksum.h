@@ -0,0 +1,41 @@
+#ifndef CI_CHECKSUM_H
+#define CI_CHECKSUM_H
+#include <stddef.h>
+#include <stdint.h>
+#include "scan.h"
+
+/**
+ * @brief Selects the CRC32C implementation. Must be called before any other
+ * thread starts; until then the table driven one is used.
+ *
+ * The SSE4.2 `crc32` instruction is used when the host has it, unless the
+ * scalar tier was asked for.
+ *
+ * @param tier The tier passed to `scan_select`.
+ */
+void checksum_select(CpuTier tier);
+
+/**
+ * @brief Computes the CRC32C (Castagnoli) checksum of a buffer, with the
+ * usual all ones initial value and final inversion.
+ *
+ * @param bytes The buffer.
+ * @param length The length of the buffer.
+ * @return The checksum.
+ */
+uint32_t checksum_crc32c(const uint8_t *bytes, size_t length);
+
+/**
+ * @brief Computes a fast non-cryptographic 64-bit hash of a buffer.
+ *
+ * The hash is built like xxHash64, with four lanes over 32-byte blocks, but
+ * does not produce the same values. It is the same on every host of the same
+ * byte order.
+ *
+ * @param bytes The buffer.
+ * @param length The length of the buffer.
+ * @return The hash.
+ */
+uint64_t checksum_hash64(const uint8_t *bytes, size_t length);
+
+#endif
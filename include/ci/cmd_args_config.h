@@ -1,13 +1,33 @@
 #ifndef CI_CMD_ARGS_CONFIG_H
 #define CI_CMD_ARGS_CONFIG_H
 #include <stdbool.h>
+#include <stdint.h>
+#include "mem.h"
+#include "output.h"
+#include "scan.h"
 
 typedef struct {
-    bool  print_lex;     // Lex; do not parse
-    bool  print_parse;   // Print result of parsing. Implicitly performs lexing
-    bool  repl;          // Set when no arguments are supplied
-    char *in_filename;   // What are we running?
-    char *out_filename;  // File to output to
+    bool         print_lex;        // Lex; do not parse
+    bool         print_parse;      // Print result of parsing. Implicitly performs lexing
+    bool         repl;             // Set when no arguments are supplied
+    char       **in_filenames;     // What are we running? More than one runs them concurrently
+    int          in_count;         // The number of entries in `in_filenames`
+    char        *out_filename;     // File to output to; the executable to write when bundling
+    bool         bundle;           // Write a self-contained executable instead of running
+    int          workers;          // Worker threads for concurrent programs; 0 when not given
+    uint64_t     quantum;          // Commands per time slice for concurrent programs; 0 if not given
+    bool         stats;            // Print run statistics to stderr after running
+    int          repeat;           // Run the program this many times in-process; 0 when not given
+    OutputFormat output_format;    // How `print` writes values to stdout
+    bool         no_vectorize;     // Run every loop through the scalar interpreter
+    CpuTier      cpu;              // The instruction set tier of the byte scans; CPU_AUTO by default
+    bool         watch;            // Rerun the program whenever its file changes
+    MemOptions   memory;           // How guest memory is allocated, and which range is shared
+    int          fork_workers;     // Threads running forked calls; 0 (none) when not given
+    bool         pipeline;         // Lex, parse and run the program on separate threads at once
+    int          segment_workers;  // Threads splitting straight-line code; 0 (none) when not given
+    char        *metrics_file;     // Shared-memory segment runs add metrics to; NULL if not given
+    bool         print_metrics;    // Print the metrics segment instead of running
 } CmdArgsConfig;
 
 void config_free(CmdArgsConfig *conf);
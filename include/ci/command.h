@@ -4,6 +4,8 @@
 #include <stdint.h>
 #include "command_type.h"
 
+#define FLAGS_MASK (1ULL << 32)  // Stands for the flags in register masks, above the 32 registers.
+
 /**
  * @brief Enum representing different branching conditions for commands.
  */
@@ -27,9 +29,29 @@ typedef union {
     char    base;
 } Operand;
 
+/**
+ * @brief The plan of a loop the vectorizer recognized, see `vectorize.h`.
+ */
+typedef struct vector_loop VectorLoop;
+
+/**
+ * @brief The plan of a call whose sibling call may run in parallel, see
+ * `fork.h`.
+ */
+typedef struct fork_site ForkSite;
+
+/**
+ * @brief The plan of a straight-line region whose parts may run in parallel,
+ * see `segment.h`.
+ */
+typedef struct segment_plan SegmentPlan;
+
 /**
  * @brief Represents a command with operands, branching conditions, and
  * metadata.
+ *
+ * The source line of a command is kept out of the command itself, see
+ * `command_line`.
  */
 typedef struct cmd {
     CommandType type;                  // The type of the command.
@@ -44,6 +66,13 @@ typedef struct cmd {
     bool            is_a_string;       // Indicates if the first operand is a string.
     bool            is_b_string;       // Indicates if the second operand is a string.
     BranchCondition branch_condition;  // The branching condition for the command.
+    union {                            // Set by later passes; which one depends on `type`.
+        struct cmd  *target;           // CMD_LOOP: where it jumps, resolved once all labels
+                                       // are known; NULL to look the label up instead.
+        VectorLoop  *vector;           // CMD_VLOOP: the plan of the loop, owned by it.
+        ForkSite    *fork;             // CMD_CALL: the plan of a sibling call, owned by it.
+        SegmentPlan *segments;         // CMD_SEGMENTS: the plan of the region, owned by it.
+    };
 } Command;
 
 /**
@@ -53,6 +82,38 @@ typedef struct cmd {
  */
 void free_command(Command *command);
 
+/**
+ * @brief Records the source line of a command.
+ *
+ * Lines live in a table of their own, shared by every thread, so the commands
+ * the interpreter walks stay small; they are only read to report where
+ * something happened. `free_command` forgets the line of a freed command.
+ *
+ * @param command The command.
+ * @param line The source line, 0 if unknown. A line the table has no room
+ * for is left unknown.
+ */
+void command_set_line(const Command *command, uint32_t line);
+
+/**
+ * @brief Returns the source line of a command.
+ *
+ * @param command The command.
+ * @return The line recorded by `command_set_line`, 0 if there is none.
+ */
+uint32_t command_line(const Command *command);
+
+/**
+ * @brief Finds the registers and flags an arithmetic, logic, shift or compare
+ * command reads and writes.
+ *
+ * @param cmd The command.
+ * @param uses Set to the mask of registers read, with `FLAGS_MASK` for the flags.
+ * @param defs Set to the mask of registers written, with `FLAGS_MASK` for the flags.
+ * @return True if the command is one of those, false otherwise.
+ */
+bool command_registers(const Command *cmd, uint64_t *uses, uint64_t *defs);
+
 /**
  * @brief Prints the details of a command.
  *
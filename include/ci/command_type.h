@@ -89,6 +89,161 @@ typedef enum {
     // sub x0 x1 5
     // Can either be variable variable variable or variable variable number
     CMD_SUB,
+
+    // Map commands are numbered after the original set so the numbering of
+    // existing commands stays stable
+
+    // hnew x0
+    // Creates an empty map and writes its handle to the variable
+    CMD_HNEW,
+
+    // hput x0 x1 x2
+    // hput x0 5 100
+    // Always handle-variable key value; the handle is kept in `destination`
+    CMD_HPUT,
+
+    // hget x3 x0 x1
+    // hget x3 x0 5
+    // Always variable handle-variable key; sets the equal flag if the key exists
+    CMD_HGET,
+
+    // hdel x0 x1
+    // hdel x0 5
+    // Always handle-variable key; sets the equal flag if the key existed
+    CMD_HDEL,
+
+    // loop x0 .label
+    // Decrements the variable and branches to the label if it is not zero;
+    // leaves the flags untouched
+    CMD_LOOP,
+
+    // rep 10 {
+    // rep x0 {
+    // Runs the block up to the matching `}` the given number of times; the
+    // count is read once on entry and a non-positive count skips the block
+    CMD_REP,
+
+    // }
+    // Closes the innermost `rep` block, jumping back to its start while
+    // iterations remain
+    CMD_REP_END,
+
+    // Never written in source; inserted by the vectorizer in front of a loop it
+    // recognized. Runs the whole loop at once when its ranges allow, otherwise
+    // falls through to the scalar loop
+    CMD_VLOOP,
+
+    // strlen x0 x1
+    // strlen x0 64
+    // Always variable address; the string ends at its terminator or at the end
+    // of memory
+    CMD_STRLEN,
+
+    // strchr x0 x1 x2
+    // strchr x0 64 0x2c
+    // Always variable address byte; writes the address of the first matching
+    // byte, or of the string's end, and sets the equal flag if the byte was found
+    CMD_STRCHR,
+
+    // strcmp x0 x1 x2
+    // strcmp x0 64 128
+    // Always variable address address; writes the difference of the first
+    // differing bytes and sets the flags as `cmp` of that result with 0 does
+    CMD_STRCMP,
+
+    // strcpy x0 x1
+    // strcpy 128 64
+    // Always address address; copies the string and its terminator
+    CMD_STRCPY,
+
+    // ldp x0 x1 x2
+    // ldp x0 x1 64
+    // Always variable variable address; loads the 8-byte words at the address
+    // and the one after it into the two variables
+    CMD_LDP,
+
+    // stp x0 x1 x2
+    // stp x0 x1 64
+    // Always variable variable address; stores the two variables as
+    // consecutive 8-byte words
+    CMD_STP,
+
+    // ldm x0 x7 x8
+    // ldm x0 x7 64
+    // Always variable variable address; loads consecutive 8-byte words into
+    // every variable from the first to the last named, in order
+    CMD_LDM,
+
+    // stm x0 x7 x8
+    // stm x0 x7 64
+    // Always variable variable address; stores every variable from the first
+    // to the last named as consecutive 8-byte words
+    CMD_STM,
+
+    // loads x0 2 100
+    // loads x8 1 x0
+    // Like `load`, but the width is 1, 2 or 4 and the value is sign-extended
+    CMD_LOADS,
+
+    // crc32c x0 x1 x2
+    // crc32c x0 64 16
+    // Always variable address length; writes the CRC32C of the range
+    CMD_CRC32C,
+
+    // hash64 x0 x1 x2
+    // hash64 x0 64 16
+    // Always variable address length; writes a 64-bit hash of the range
+    CMD_HASH64,
+
+    // Never written in source; ends the part of the program a pipelined run
+    // has parsed so far. Stops the interpreter while more of the program may
+    // follow, and falls through once it does
+    CMD_AWAIT,
+
+    // Never written in source; inserted in front of a long run of straight-line
+    // commands that splits into independent parts. Runs the parts as parallel
+    // tasks and continues after the run, or falls through to run it in turn
+    CMD_SEGMENTS,
+
+    // add w0 w1 w2
+    // cmp w0 0xffff
+    // Not keywords of their own; `add`, `sub`, `mov`, `and`, `orr`, `eor`,
+    // `lsl`, `lsr`, `asr`, `cmp` and `cmp_u` on w0-w31 decode to these. They
+    // work on the low 32 bits of their operands, wrap around at 32 bits and
+    // zero-extend what they write. Every register operand must be a w register
+    CMD_ADD_W,
+    CMD_SUB_W,
+    CMD_MOV_W,
+    CMD_AND_W,
+    CMD_ORR_W,
+    CMD_EOR_W,
+    CMD_LSL_W,
+    CMD_LSR_W,
+    CMD_ASR_W,
+    CMD_CMP_W,
+    CMD_CMP_U_W,
+
+    // ubfx x0 x1 8 4
+    // sbfx x0 x1 8 4
+    // Always variable variable position width; writes the `width` bits of the
+    // second variable starting at bit `position`, zero- or sign-extended. The
+    // parser packs the field into `val_b` as position | width << 8
+    CMD_UBFX,
+    CMD_SBFX,
+
+    // bfi x0 x1 8 4
+    // Always variable variable position width; replaces the `width` bits of the
+    // first variable starting at bit `position` with the low bits of the second
+    CMD_BFI,
+
+    // bfxil x0 x1 8 4
+    // Always variable variable position width; replaces the low `width` bits of
+    // the first variable with the bits of the second starting at `position`
+    CMD_BFXIL,
+
+    // ror x0 x1 8
+    // Is always variable variable number
+    CMD_ROR,
 } CommandType;
 
 #endif
@@ -0,0 +1,97 @@
+#ifndef CI_FORK_H
+#define CI_FORK_H
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "command.h"
+#include "interpreter.h"
+#include "label_map.h"
+
+/**
+ * @brief A pair of sibling calls whose second callee may run as a task while
+ * the first one runs on the calling thread:
+ *
+ *     call f               (the command holding this plan)
+ *     <arithmetic, logic, shift and compare commands>
+ *     call g
+ *
+ * The second callee, and everything it calls, only computes on registers: it
+ * touches no memory, prints nothing and never ends the program. It does not
+ * read the flags before setting them, and none of the registers it reads
+ * depend on the x0 the first call returns. Since `ret` restores every
+ * register but x0, the second call then returns the same x0 and flags
+ * whether it starts before or after the first one.
+ */
+struct fork_site {
+    Command *between;  // Copies of the commands between the calls, ending in NULL; NULL if none.
+    Command *second;   // The sibling `call`, which joins the task.
+    Command *entry;    // The first command of the second callee.
+};
+
+/**
+ * @brief Sets the number of threads that run forked calls. Must be called
+ * before `fork_calls`.
+ *
+ * @param workers The number of threads; 0 disables forking.
+ */
+void fork_configure(int workers);
+
+/**
+ * @brief Finds the sibling calls that can run in parallel and attaches a
+ * `ForkSite` to the first call of each pair. Starts the worker threads if
+ * any pair was found.
+ *
+ * @param commands The first command of the program.
+ * @param map The label map of the program.
+ */
+void fork_calls(Command *commands, LabelMap *map);
+
+/**
+ * @brief Frees the plans `fork_calls` attached and stops the worker threads.
+ * No interpreter may be running the program.
+ *
+ * @param commands The first command of the program.
+ */
+void unfork_calls(Command *commands);
+
+/**
+ * @brief Starts the second call of a site as a task, unless the interpreter
+ * already has as many tasks outstanding on its call path as are worth it.
+ *
+ * Must be called as the first call of the site starts. The task starts from
+ * the interpreter's registers with the commands between the calls applied.
+ *
+ * @param site The plan of the first call.
+ * @param intr The interpreter running the first call.
+ * @return The task, or NULL if the second call should simply run in turn.
+ */
+ForkTask *fork_spawn(const ForkSite *site, Interpreter *intr);
+
+/**
+ * @brief Determines whether a task stands in for the given call.
+ *
+ * @param task The task.
+ * @param call The `call` command about to run.
+ * @return True if `call` is the second call of the task's site.
+ */
+bool fork_is_for(const ForkTask *task, const Command *call);
+
+/**
+ * @brief Waits for a task, running it on this thread if no worker took it
+ * yet, and leaves x0 and the flags as the call it stands in for would. Frees
+ * the task.
+ *
+ * @param task The task.
+ * @param intr The interpreter that spawned the task.
+ */
+void fork_join(ForkTask *task, Interpreter *intr);
+
+/**
+ * @brief Stops a task whose result is no longer needed and frees it.
+ *
+ * @param task The task.
+ * @param intr The interpreter that spawned the task.
+ */
+void fork_cancel(ForkTask *task, Interpreter *intr);
+
+#endif
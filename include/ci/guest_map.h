@@ -0,0 +1,90 @@
+#ifndef CI_GUEST_MAP_H
+#define CI_GUEST_MAP_H
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#define MAP_EMPTY_KEY INT64_MIN  // The key value that marks a free slot.
+
+/**
+ * @brief A single slot of a guest map. Keys and values are interleaved so a
+ * probe touches one cache line for up to four consecutive slots.
+ */
+typedef struct {
+    int64_t key;    // The key, or `MAP_EMPTY_KEY` if the slot is free.
+    int64_t value;  // The value stored under `key`.
+} MapSlot;
+
+/**
+ * @brief An open-addressing hash map from 64-bit keys to 64-bit values, backing
+ * the `hnew`, `hput`, `hget` and `hdel` commands.
+ *
+ * Collisions are resolved by linear probing and deletions shift later entries
+ * back, so there are no tombstones and lookups never scan dead slots. One key
+ * value is reserved to mark free slots; an entry with that key is kept outside
+ * the table.
+ */
+typedef struct {
+    MapSlot *slots;            // The table; its size is always a power of two.
+    size_t   capacity;         // The number of slots.
+    size_t   count;            // The number of entries stored in `slots`.
+    bool     has_empty_key;    // Whether an entry with key `MAP_EMPTY_KEY` exists.
+    int64_t  empty_key_value;  // The value of that entry.
+} GuestMap;
+
+/**
+ * @brief Initializes an empty map.
+ *
+ * @param map Pointer to the `GuestMap` to initialize.
+ * @return True if the map was initialized, false if memory ran out.
+ */
+bool guest_map_init(GuestMap *map);
+
+/**
+ * @brief Frees the table owned by a map.
+ *
+ * @param map Pointer to the `GuestMap` to free.
+ */
+void guest_map_free(GuestMap *map);
+
+/**
+ * @brief Inserts or replaces the value stored under a key.
+ *
+ * @param map Pointer to the map.
+ * @param key The key.
+ * @param value The value to store.
+ * @param probes Incremented by the number of slots inspected.
+ * @return True if the value was stored, false if memory ran out.
+ */
+bool guest_map_put(GuestMap *map, int64_t key, int64_t value, uint64_t *probes);
+
+/**
+ * @brief Looks up the value stored under a key.
+ *
+ * @param map Pointer to the map.
+ * @param key The key.
+ * @param value Set to the stored value if the key is present.
+ * @param probes Incremented by the number of slots inspected.
+ * @return True if the key is present, false otherwise.
+ */
+bool guest_map_get(const GuestMap *map, int64_t key, int64_t *value, uint64_t *probes);
+
+/**
+ * @brief Removes a key from the map.
+ *
+ * @param map Pointer to the map.
+ * @param key The key.
+ * @param probes Incremented by the number of slots inspected.
+ * @return True if the key was present, false otherwise.
+ */
+bool guest_map_delete(GuestMap *map, int64_t key, uint64_t *probes);
+
+/**
+ * @brief Returns the number of bytes allocated by a map.
+ *
+ * @param map Pointer to the map.
+ * @return The size of the map's table in bytes.
+ */
+size_t guest_map_bytes(const GuestMap *map);
+
+#endif
@@ -0,0 +1,65 @@
+#ifndef CI_IMAGE_H
+#define CI_IMAGE_H
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "command.h"
+#include "label_map.h"
+
+/**
+ * @brief A parsed program decoded from a serialized image.
+ *
+ * Unlike the output of the parser, the commands live in a single contiguous
+ * array and their string operands point into one shared string table, so the
+ * whole program is released with `image_free` rather than `free_command`.
+ */
+typedef struct {
+    Command *commands;  // The commands, linked in program order through `next`.
+    size_t   count;     // The number of commands.
+    char    *strings;   // The string table the string operands point into.
+} ProgramImage;
+
+/**
+ * @brief Serializes a parsed program and its labels into a flat image.
+ *
+ * Operands are stored in as few bytes as their values need. Numbers beyond 16
+ * bits go to a constant pool and strings to a string table, each of which
+ * stores every distinct value once.
+ *
+ * @param commands Pointer to the first command of the program.
+ * @param map The label map the program was parsed with.
+ * @param data Set to a heap allocated buffer holding the image on success.
+ * @param size Set to the size of the image in bytes on success.
+ * @return True if the image was built, false if memory ran out.
+ *
+ * @note The caller is responsible for freeing `*data`.
+ */
+bool image_serialize(Command *commands, LabelMap *map, uint8_t **data, size_t *size);
+
+/**
+ * @brief Decodes an image produced by `image_serialize`.
+ *
+ * @param img Pointer to the `ProgramImage` to fill in.
+ * @param data The serialized image.
+ * @param size The size of the serialized image in bytes.
+ * @param map An initialized label map that receives the program's labels.
+ * @return True if the image was valid and decoded, false otherwise.
+ */
+bool image_load(ProgramImage *img, const uint8_t *data, size_t size, LabelMap *map);
+
+/**
+ * @brief Prints the size of an image and of each of its sections to stderr.
+ *
+ * @param data The serialized image.
+ * @param size The size of the serialized image in bytes.
+ */
+void image_print_stats(const uint8_t *data, size_t size);
+
+/**
+ * @brief Frees the commands and strings owned by an image.
+ *
+ * @param img Pointer to the `ProgramImage` to free.
+ */
+void image_free(ProgramImage *img);
+
+#endif
@@ -1,19 +1,67 @@
 #ifndef CI_INTERPRETER_H
 #define CI_INTERPRETER_H
+#include <stdint.h>
+#include <stdio.h>
 #include "command.h"
+#include "guest_map.h"
 #include "label_map.h"
+#include "mem.h"
+#include "output.h"
 
 #define NUM_VARIABLES 32  // Maximum number of defined variables.
 
+/**
+ * @brief A sibling call running in parallel, see `fork.h`.
+ */
+typedef struct fork_task ForkTask;
+
 /**
  * @brief Represents a single entry in the interpreter's call stack.
  */
 typedef struct st_entry {
     Command         *command;                   // The command stored in this stack entry.
     int64_t          variables[NUM_VARIABLES];  // Variables in this stack frame.
+    size_t           rep_depth;                 // `rep` blocks open in the caller.
+    ForkTask        *fork;                      // The sibling of this call, if it was forked.
     struct st_entry *next;                      // Pointer to the next stack entry.
 } StackEntry;
 
+/**
+ * @brief The hidden counter of a running `rep` block.
+ */
+typedef struct {
+    int64_t  remaining;  // Iterations left, including the current one.
+    Command *body;       // The first command of the block.
+} RepCounter;
+
+/**
+ * @brief Counters describing a run, reported with `--stats`.
+ *
+ * Page faults are counted by whoever runs the program, around the whole run
+ * and only when the statistics are reported. Programs run together on the
+ * scheduler move between threads and report none.
+ */
+typedef struct {
+    uint64_t commands;           // The number of commands executed.
+    uint64_t maps_created;       // The number of `hnew` commands executed.
+    uint64_t map_puts;           // The number of `hput` commands executed.
+    uint64_t map_gets;           // The number of `hget` commands executed.
+    uint64_t map_hits;           // The number of `hget` commands that found their key.
+    uint64_t map_deletes;        // The number of `hdel` commands executed.
+    uint64_t map_probes;         // Slots inspected by all map commands together.
+    uint64_t map_peak_bytes;     // The largest number of bytes held by maps at once.
+    uint64_t vector_loops;       // Loops run whole by a host SIMD kernel.
+    uint64_t vector_iterations;  // Iterations those loops replaced.
+    uint64_t string_commands;    // The number of string commands executed.
+    uint64_t string_bytes;       // Bytes of guest memory those commands scanned.
+    uint64_t minor_faults;       // Page faults served without I/O while running.
+    uint64_t major_faults;       // Page faults that needed I/O while running.
+    uint64_t forked_calls;       // Calls whose callee ran as a parallel task.
+    uint64_t segment_regions;    // Straight-line regions run as parallel tasks.
+    uint64_t segment_tasks;      // The tasks those regions were split into.
+    uint64_t output_bytes;       // Bytes written by `print` commands.
+} RunStats;
+
 /**
  * @brief Represents the state of the interpreter during execution.
  */
@@ -28,6 +76,23 @@ typedef struct {
     bool        is_less;               // Flag indicating the result of the last comparison (less).
     bool        is_equal;              // Flag indicating the result of the last comparison (equal).
     StackEntry *the_stack;             // Pointer to the top of the interpreter's stack.
+    StackEntry *free_frames;           // Frames released by `ret`, reused by `call`.
+    Command    *pc;                    // The next command to execute; NULL once finished.
+    Memory      memory;                // The guest memory of this instance.
+    RepCounter *reps;                  // Counters of the open `rep` blocks, innermost last.
+    size_t      rep_depth;             // The number of open `rep` blocks.
+    size_t      rep_capacity;          // The number of counters `reps` can hold.
+    ForkTask   *joining;               // The task standing in for the next call, if any.
+    size_t      fork_depth;            // Forked tasks outstanding on the current call path.
+    bool        awaiting_code;         // More of the program may still be parsed; see `CMD_AWAIT`.
+    // Maps, counters and output follow, off the cache lines every command reads
+    GuestMap    *maps;                 // The maps created by `hnew`, indexed by handle.
+    size_t       map_count;            // The number of maps created.
+    size_t       map_capacity;         // The number of maps `maps` can hold.
+    size_t       map_bytes;            // The number of bytes currently held by maps.
+    RunStats     stats;                // Counters for this run.
+    OutputFormat output_format;        // How `print` commands write values.
+    FILE        *output;               // Where `print` commands write; stdout by default.
 } Interpreter;
 
 /**
@@ -38,6 +103,38 @@ typedef struct {
  */
 void interpreter_init(Interpreter *intr, LabelMap *map);
 
+/**
+ * @brief Initializes an interpreter that runs a forked call for `fork.h`.
+ *
+ * It starts with the registers and flags of `parent` and shares its label
+ * map, but has no guest memory, which forked calls never touch.
+ *
+ * @param intr Pointer to the `Interpreter` to initialize.
+ * @param parent Pointer to the interpreter that forks the call.
+ */
+void interpreter_init_task(Interpreter *intr, const Interpreter *parent);
+
+/**
+ * @brief Returns the interpreter to the state `interpreter_init` leaves it in,
+ * so the same program can be run again.
+ *
+ * Unlike a fresh `interpreter_init`, only the memory written by the previous
+ * run is cleared, and call stack frames are kept for reuse instead of being
+ * freed.
+ *
+ * @param intr Pointer to the `Interpreter` to reset.
+ */
+void interpreter_reset(Interpreter *intr);
+
+/**
+ * @brief Frees everything the interpreter holds: its call stack, the frames
+ * kept for reuse, its `rep` counters and its maps. The interpreter must be initialized again
+ * before it is reused.
+ *
+ * @param intr Pointer to the `Interpreter` to free.
+ */
+void interpreter_free(Interpreter *intr);
+
 /**
  * @brief Executes a list of commands using the interpreter.
  *
@@ -47,6 +144,41 @@ void interpreter_init(Interpreter *intr, LabelMap *map);
  */
 void interpret(Interpreter *intr, Command *commands);
 
+/**
+ * @brief Points the interpreter at the first command of a program without
+ * running it, so it can be driven with `interpret_slice`.
+ *
+ * @param intr Pointer to an initialized `Interpreter`.
+ * @param commands Pointer to the first `Command` of the program.
+ */
+void interpreter_start(Interpreter *intr, Command *commands);
+
+/**
+ * @brief Runs the program from where it last stopped for roughly `quantum`
+ * commands.
+ *
+ * The budget is only checked on taken branches, loop back-edges, calls and
+ * returns, so every loop iteration is a preemption point while straight-line
+ * code runs without the check. A slice may therefore overrun `quantum` by one basic block.
+ *
+ * @param intr Pointer to the `Interpreter` to run.
+ * @param quantum The number of commands after which to stop at the next
+ * control transfer.
+ * @return True if the program has finished or failed, false if it was
+ * preempted and should be resumed with another call. While `awaiting_code` is
+ * set, also false when the program needs a command or label not parsed yet;
+ * `pc` is then the command to run again once more of the program is linked.
+ */
+bool interpret_slice(Interpreter *intr, uint64_t quantum);
+
+/**
+ * @brief Prints the run statistics of the interpreter to stderr, keeping them
+ * apart from the program's own output.
+ *
+ * @param intr Pointer to the `Interpreter` whose statistics are to be printed.
+ */
+void print_run_stats(Interpreter *intr);
+
 /**
  * @brief Prints the current state of the interpreter.
  *
@@ -65,4 +65,16 @@ bool put_label(LabelMap *map, char *id, Command *command);
  */
 Entry *get_label(LabelMap *map, char *id);
 
+/**
+ * @brief Points every `loop` command at the command its label names, so taking
+ * the loop needs no lookup.
+ *
+ * Loops whose label is missing or names the end of the program keep a NULL
+ * target and fall back to looking the label up when taken.
+ *
+ * @param map Pointer to the label map holding all labels of the program.
+ * @param commands Pointer to the first command of the program.
+ */
+void resolve_loop_targets(LabelMap *map, Command *commands);
+
 #endif
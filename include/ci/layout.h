@@ -0,0 +1,65 @@
+#ifndef CI_LAYOUT_H
+#define CI_LAYOUT_H
+#include <stddef.h>
+#include "command.h"
+#include "label_map.h"
+
+/**
+ * @brief How the layout pass should treat a command.
+ */
+typedef enum {
+    HINT_NONE,
+    HINT_LIKELY,    // A conditional branch that is usually taken.
+    HINT_UNLIKELY,  // A conditional branch that is rarely taken.
+    HINT_COLD,      // The first command of a block marked with `.cold`.
+} LayoutHint;
+
+/**
+ * @brief The hints of a program, collected by the parser in source order.
+ */
+typedef struct {
+    Command   **commands;  // The hinted commands.
+    LayoutHint *hints;     // The hint of each command; a later one overrides an earlier.
+    size_t      count;     // The number of hints.
+    size_t      capacity;  // The number of hints the arrays can hold.
+} LayoutHints;
+
+/**
+ * @brief Records a hint for a command. A hint that cannot be stored is
+ * dropped, as hints never change what a program does.
+ *
+ * @param hints Pointer to the hints, zeroed before the first hint is added.
+ * @param command The command.
+ * @param hint The hint.
+ */
+void layout_hints_add(LayoutHints *hints, Command *command, LayoutHint hint);
+
+/**
+ * @brief Frees the hints, leaving them empty.
+ *
+ * @param hints Pointer to the hints.
+ */
+void layout_hints_free(LayoutHints *hints);
+
+/**
+ * @brief Reorders a program so the paths its hints mark as expected fall
+ * through and rarely run blocks sit after everything else.
+ *
+ * - A block starting at a `.cold` label or at the target of a `b.cond.unlikely`
+ *   branch runs up to the first unconditional `b` or `ret`. It is moved to the
+ *   end of the program unless the command before it falls into it.
+ * - A `b.cond.likely` branch whose target follows it is inverted, and the
+ *   commands it skipped are moved to the end of the program.
+ *
+ * Blocks holding part of a `rep` block are never moved. Moved blocks are
+ * closed with a branch to whatever used to follow them, and branches reach
+ * them through labels starting with `$`, which no program can name. A program
+ * without hints is left as it is.
+ *
+ * @param commands Pointer to the first command of the program; it never moves.
+ * @param map Pointer to the label map holding all labels of the program.
+ * @param hints The hints of the program's commands.
+ */
+void layout_program(Command *commands, LabelMap *map, const LayoutHints *hints);
+
+#endif
@@ -1,6 +1,9 @@
 #ifndef CI_LEXER_H
 #define CI_LEXER_H
+#include <stdbool.h>
+#include <stddef.h>
 #include "token.h"
+#include "token_buffer.h"
 
 /**
  * @brief Represents the state of a lexical analyzer.
@@ -15,6 +18,8 @@ typedef struct {
     int current_line;  // The current line number in the source string.
 
     int current_column;  // The current column number in the source string.
+
+    TokenError error;  // The error of the last TOK_ERR this lexer returned.
 } Lexer;
 
 /**
@@ -33,6 +38,31 @@ void lexer_init(Lexer *lex, const char *text);
  */
 Token lexer_next_token(Lexer *lex);
 
+/**
+ * @brief Lexes the whole input stream into a token buffer.
+ *
+ * Runs the lexer to completion in a single loop, decoding numeric literals as
+ * it goes, so parsing can proceed over the packed buffer afterwards. The last
+ * token in the buffer is always TOK_EOF. Numeric literals that cannot be
+ * decoded are stored as TOK_ERR.
+ *
+ * @param lex A pointer to the lexer, the input stream. Its text must be the
+ * source `buf` was initialized with.
+ * @param buf A pointer to an initialized token buffer to append to.
+ * @return True if every token was stored, false if memory ran out.
+ */
+bool lexer_tokenize(Lexer *lex, TokenBuffer *buf);
+
+/**
+ * @brief Returns how much a line of source changes the `rep` block depth,
+ * ignoring braces in strings and comments.
+ *
+ * @param line The line, without its newline.
+ * @param length The length of the line.
+ * @return The number of braces the line opens minus the number it closes.
+ */
+int lexer_brace_change(const char *line, size_t length);
+
 /**
  * @brief Prints the lexed tokens, consuming the input stream.
  *
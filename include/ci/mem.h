@@ -4,31 +4,248 @@
 #include <stddef.h>
 #include <stdint.h>
 
-#define MEM_CAPACITY 1024  // Maximum capacity of available memory.
+#define MEM_DEFAULT_CAPACITY 1024  // Size of guest memory unless `--mem-size` is given.
+
+/**
+ * @brief The kinds of pages guest memory can be backed with.
+ */
+typedef enum {
+    HUGE_PAGES_OFF,          // Normal pages.
+    HUGE_PAGES_TRANSPARENT,  // Normal pages the kernel may merge into huge ones.
+    HUGE_PAGES_EXPLICIT,     // Pages from the reserved huge page pool.
+} HugePages;
+
+/**
+ * @brief A range of guest memory backed by a named shared-memory object
+ * instead of private pages, so that every interpreter and every process
+ * mapping the object sees the same bytes.
+ *
+ * The object is created if it does not exist and grown to `length` if it is
+ * shorter; it outlives the process, keeping its contents for the next run.
+ *
+ * Only naturally aligned 1, 2, 4 and 8-byte accesses through `mem_load` and
+ * `mem_store` are atomic in the range. Everything else copies plain bytes:
+ * `put`, `ldp`, `stp`, `ldm`, `stm`, the string commands, `crc32c`, `hash64`
+ * and vectorized copies. Another process may see part of such a write, or
+ * change part of such a read.
+ */
+typedef struct {
+    const char *name;     // A POSIX shared-memory name, or a path if it has a '/'; NULL if none.
+    size_t      address;  // The guest address of the range, a multiple of the page size.
+    size_t      length;   // The length of the range, a multiple of the page size.
+} SharedRegion;
+
+/**
+ * @brief How the guest memory of every interpreter instance is allocated.
+ */
+typedef struct {
+    size_t       capacity;    // The number of bytes guests may address.
+    HugePages    huge_pages;  // What backs the memory.
+    bool         prefault;    // Fault every page in before the program runs.
+    bool         numa_bind;   // Keep the memory on the NUMA node of the allocating thread.
+    SharedRegion shared;      // The range backed by a shared-memory object, if any.
+} MemOptions;
+
+/**
+ * @brief The guest memory of a single interpreter instance.
+ */
+typedef struct {
+    uint8_t *bytes;         // The contents of memory, zeroed on start but for the shared range.
+    size_t   capacity;      // The number of bytes in `bytes`.
+    size_t   mapped;        // The length of the mapping holding `bytes`.
+    size_t   dirty_start;   // Offset of the first byte written since the last reset.
+    size_t   dirty_end;     // One past the last byte written since the last reset.
+    size_t   shared_start;  // Offset of the first byte backed by the shared object.
+    size_t   shared_end;    // One past the last byte backed by the shared object;
+                            // equal to `shared_start` if there is none.
+} Memory;
+
+/**
+ * @brief Sets how guest memory is allocated from now on. Must be called before
+ * any other thread starts; until then `MEM_DEFAULT_CAPACITY` bytes of normal
+ * pages are used.
+ *
+ * Options the host cannot honour are reported once on stderr and dropped.
+ *
+ * @param options The allocation options.
+ */
+void mem_configure(const MemOptions *options);
+
+/**
+ * @brief Opens a shared-memory object named as in `SharedRegion`.
+ *
+ * @param name A POSIX shared-memory name, or a path if it has a '/'.
+ * @param length The length to grow the object to if it is shorter.
+ * @param writable Whether to open the object for reading and writing,
+ * creating and growing it as needed, or only for reading an existing one.
+ * @return The file descriptor, or -1 after reporting the failure on stderr.
+ */
+int mem_open_object(const char *name, size_t length, bool writable);
+
+/**
+ * @brief Allocates zeroed memory as configured with `mem_configure`, then maps
+ * the shared-memory object over its range, which keeps whatever the object
+ * holds.
+ *
+ * @param m The memory to initialize.
+ * @return True if the memory was allocated, false otherwise. A shared range
+ * that is not page-aligned, does not fit in memory or whose object cannot be
+ * opened or mapped is reported on stderr and fails the allocation.
+ */
+bool mem_init(Memory *m);
+
+/**
+ * @brief Releases the given memory.
+ *
+ * @param m The memory to free.
+ */
+void mem_free(Memory *m);
+
+/**
+ * @brief Clears the given memory again after a run, touching only the range
+ * written since it was last initialized or reset. The shared range is left
+ * alone, as it belongs to every process mapping it.
+ *
+ * @param m The memory to clear.
+ */
+void mem_reset(Memory *m);
+
+/**
+ * @brief Reads the page fault counters of the calling thread.
+ *
+ * @param minor Set to the number of faults served without I/O.
+ * @param major Set to the number of faults that needed I/O.
+ */
+void mem_thread_faults(uint64_t *minor, uint64_t *major);
 
 /**
  * @brief Loads the value from memory into the given destination.
  *
+ * A naturally aligned load from the shared range is a single atomic access
+ * with acquire ordering, so it never sees half of a store another process
+ * makes, and sees everything that process stored before it.
+ *
+ * @param m The memory to load from.
  * @param destination The buffer to load values into.
  * @param offset The offset in memory where to start loading from.
  * @param bytes The amount of bytes to load starting from the given offset.
  * @return True if the value could be loaded, false otherwise.
  */
-bool mem_load(uint8_t *destination, size_t offset, size_t bytes);
+bool mem_load(const Memory *m, uint8_t *destination, size_t offset, size_t bytes);
 
 /**
  * @brief Stores the given value at the specified memory address.
  *
+ * A naturally aligned store to the shared range is a single atomic access
+ * with release ordering; see `mem_load`.
+ *
+ * @param m The memory to store to.
  * @param source The buffer to read the value from.
  * @param offset The offset in memory where to start storing.
  * @param bytes The amount of bytes to store starting at `offset`.
  * @return True if the value was stored, false otherwise.
  */
-bool mem_store(uint8_t *source, size_t offset, size_t bytes);
+bool mem_store(Memory *m, uint8_t *source, size_t offset, size_t bytes);
+
+/**
+ * @brief Stores a NUL-terminated string at the specified memory address.
+ *
+ * The terminator is written as well. Nothing is written if the string does not
+ * fit in memory.
+ *
+ * @param m The memory to store to.
+ * @param str The string to store.
+ * @param offset The offset in memory where to start storing.
+ * @return True if the string was stored, false otherwise.
+ */
+bool mem_put_string(Memory *m, const char *str, size_t offset);
+
+/**
+ * @brief Returns a range of memory for the caller to write directly, marking
+ * it as modified.
+ *
+ * Writes through the span are not atomic, even in the shared range.
+ *
+ * @param m The memory holding the range.
+ * @param offset The offset of the first byte of the range.
+ * @param bytes The length of the range.
+ * @return A pointer to the first byte, or NULL if the range does not fit in
+ * memory.
+ */
+uint8_t *mem_write_span(Memory *m, size_t offset, size_t bytes);
+
+/**
+ * @brief Returns a range of memory for the caller to read directly.
+ *
+ * Reads through the span are not atomic, even in the shared range.
+ *
+ * @param m The memory holding the range.
+ * @param offset The offset of the first byte of the range.
+ * @param bytes The length of the range.
+ * @return A pointer to the first byte, or NULL if the range does not fit in
+ * memory.
+ */
+const uint8_t *mem_read_span(const Memory *m, size_t offset, size_t bytes);
+
+/**
+ * @brief Locates the NUL-terminated string stored at the given address.
+ *
+ * The string ends at the end of memory if no terminator is found.
+ *
+ * @param m The memory holding the string.
+ * @param offset The offset in memory where the string starts.
+ * @param str Set to the first byte of the string.
+ * @param length Set to the length of the string, excluding the terminator.
+ * @return True if `offset` lies within memory, false otherwise.
+ */
+bool mem_get_string(const Memory *m, size_t offset, const char **str, size_t *length);
+
+/**
+ * @brief Finds a byte in the NUL-terminated string stored at the given address,
+ * as `strchr` does. Looking for 0 finds the terminator.
+ *
+ * @param m The memory holding the string.
+ * @param offset The offset in memory where the string starts.
+ * @param c The byte to look for.
+ * @param position Set to the offset of the byte, or to the offset where the
+ * string ends if it does not contain the byte.
+ * @param found Set to whether the byte was found.
+ * @return True if `offset` lies within memory, false otherwise.
+ */
+bool mem_find_byte(const Memory *m, size_t offset, uint8_t c, size_t *position, bool *found);
+
+/**
+ * @brief Compares the NUL-terminated strings stored at two addresses, as
+ * `strcmp` does. The end of memory ends a string like a terminator.
+ *
+ * @param m The memory holding the strings.
+ * @param a The offset of the first string.
+ * @param b The offset of the second string.
+ * @param order Set to the difference of the first differing bytes as unsigned
+ * values, or 0 if the strings are equal.
+ * @return True if both offsets lie within memory, false otherwise.
+ */
+bool mem_compare_strings(const Memory *m, size_t a, size_t b, int *order);
+
+/**
+ * @brief Copies the NUL-terminated string stored at one address to another,
+ * including the terminator. The ranges may overlap.
+ *
+ * Nothing is written if the copy does not fit in memory.
+ *
+ * @param m The memory holding the strings.
+ * @param destination The offset to copy to.
+ * @param source The offset of the string to copy.
+ * @param length Set to the length of the string, excluding the terminator.
+ * @return True if the string was copied, false otherwise.
+ */
+bool mem_copy_string(Memory *m, size_t destination, size_t source, size_t *length);
 
 /**
  * @brief Prints the memory state to the console
+ *
+ * @param m The memory to print.
  */
-void mem_print(void);
+void mem_print(const Memory *m);
 
 #endif
@@ -0,0 +1,68 @@
+#ifndef CI_METRICS_H
+#define CI_METRICS_H
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include "interpreter.h"
+
+/**
+ * @brief Opens the metrics segment that every run of this process adds to: a
+ * shared-memory object, named as in `SharedRegion`, that many processes
+ * update at once. It is created on first use and keeps accumulating until it
+ * is removed.
+ *
+ * Every update is a relaxed atomic addition to a counter in the segment, so
+ * no process ever waits for another, and one killed halfway through a run
+ * leaves the counters consistent.
+ *
+ * Until a segment is open, and if opening it fails, runs are not recorded.
+ *
+ * @param name The name of the segment.
+ * @return True if the segment was opened, false after reporting the failure on
+ * stderr.
+ */
+bool metrics_open(const char *name);
+
+/**
+ * @brief Unmaps the metrics segment, if one is open.
+ */
+void metrics_close(void);
+
+/**
+ * @brief Returns the time to pass to `metrics_parsed` or `metrics_ran`.
+ *
+ * @return A monotonic time in nanoseconds, or 0 if no segment is open.
+ */
+uint64_t metrics_now(void);
+
+/**
+ * @brief Records the time taken to lex and parse a program. A program that
+ * failed to parse is recorded as a failed run.
+ *
+ * @param start The time parsing started, from `metrics_now`.
+ * @param parsed Whether the program parsed without errors.
+ */
+void metrics_parsed(uint64_t start, bool parsed);
+
+/**
+ * @brief Records one run of a program: its execution time, the commands it
+ * executed, the bytes it printed and whether it failed.
+ *
+ * @param intr The interpreter that ran the program.
+ * @param start The time the run started, from `metrics_now`.
+ * @param failed Whether the run stopped on an error or its program did not
+ * parse completely.
+ */
+void metrics_ran(const Interpreter *intr, uint64_t start, bool failed);
+
+/**
+ * @brief Prints the metrics segment in the OpenMetrics text format.
+ *
+ * @param name The name of the segment.
+ * @param out The stream to print to.
+ * @return True if the segment was printed, false after reporting on stderr
+ * that it does not exist or is not a metrics segment.
+ */
+bool metrics_print(const char *name, FILE *out);
+
+#endif
@@ -0,0 +1,45 @@
+#ifndef CI_OUTPUT_H
+#define CI_OUTPUT_H
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+
+#define PRINT_RECORD_SIZE 16  // Size of a binary print record, excluding string bytes.
+
+/**
+ * @brief How `print` commands write their values.
+ */
+typedef enum {
+    OUTPUT_TEXT,    // One formatted value per line, as in `print x0 d`.
+    OUTPUT_BINARY,  // Fixed-width little-endian records, see `output_print`.
+    OUTPUT_CSV,     // One `site,base,value` row per print.
+} OutputFormat;
+
+/**
+ * @brief Writes the value of a single `print` command in the given format.
+ *
+ * A binary record is `PRINT_RECORD_SIZE` bytes, all little-endian:
+ *   bytes 0-3   the print site, the source line of the print command
+ *   byte  4     the base character: 'd', 'x', 'b' or 's'
+ *   bytes 5-7   zero
+ *   bytes 8-15  the value as a two's complement 64-bit integer
+ * For base 's' the value is the length of the string, whose bytes follow the
+ * record directly without a terminator.
+ *
+ * A CSV row holds the site, the base character and the value formatted as in
+ * text mode; strings are quoted with embedded quotes doubled.
+ *
+ * @param out The stream to write to.
+ * @param format The output format.
+ * @param site The source line of the print command.
+ * @param base The base character of the print command.
+ * @param value The value to print. Ignored for base 's'.
+ * @param str The string to print for base 's', NULL otherwise.
+ * @param length The length of `str`.
+ * @return The number of bytes written, 0 if `base` is invalid.
+ */
+size_t output_print(FILE *out, OutputFormat format, uint32_t site, char base, int64_t value,
+                    const char *str, size_t length);
+
+#endif
@@ -1,39 +1,60 @@
 #ifndef CI_PARSER_H
 #define CI_PARSER_H
+#include <stdbool.h>
+#include <stddef.h>
 #include "command.h"
 #include "label_map.h"
-#include "lexer.h"
+#include "layout.h"
 #include "token.h"
+#include "token_buffer.h"
 
 /**
  * @brief Represents a parser for processing tokens and generating commands.
  *
- * The `Parser` structure is responsible for consuming tokens from a `Lexer`,
+ * The `Parser` structure walks a `TokenBuffer` produced by the lexer by index,
  * maintaining state during parsing, and handling label-to-command mapping.
  */
 typedef struct {
-    Lexer    *lexer;      // Pointer to the lexer providing tokens.
-    bool      had_error;  // Flag indicating if an error occurred during parsing.
-    Token     current;    // The current token being processed.
-    Token     next;       // The next token to be processed.
-    LabelMap *label_map;  // Pointer to the label map mapping labels to commands.
+    const TokenBuffer *tokens;     // The lexed tokens to parse.
+    size_t             pos;        // Index of the current token within `tokens`.
+    bool               had_error;  // Flag indicating if an error occurred during parsing.
+    LabelMap          *label_map;  // Pointer to the label map mapping labels to commands.
+    size_t             rep_depth;  // Number of `rep` blocks open at the current position.
+    bool               quiet;      // Set to only flag errors, leaving the report to the caller.
+    bool               recovered;  // Set once parsing has gone on past an error.
+    bool               word_regs;  // Set while a command on w0-w31 instead of x0-x31 parses.
+    LayoutHint         hint;       // The hint of the command being parsed.
+    LayoutHints       *hints;      // Receives the hints of the parsed commands; NULL to drop them.
 } Parser;
 
 /**
  * @brief Initializes a `Parser` structure.
  *
  * @param parser Pointer to the `Parser` structure to initialize.
- * @param lexer Pointer to the `Lexer` to be used for tokenizing input.
+ * @param tokens Pointer to the `TokenBuffer` holding the lexed input. It must
+ * end with a TOK_EOF token, as produced by `lexer_tokenize`.
  * @param map Pointer to the `LabelMap` for associating labels with commands.
  */
-void parser_init(Parser *parser, Lexer *lexer, LabelMap *map);
+void parser_init(Parser *parser, const TokenBuffer *tokens, LabelMap *map);
+
+/**
+ * @brief Returns the token the parser is currently looking at.
+ *
+ * Intended for diagnostics; see `token_buffer_get`.
+ *
+ * @param parser Pointer to the initialized `Parser` structure.
+ * @return The current token.
+ */
+Token parser_current_token(const Parser *parser);
 
 /**
  * @brief Parses commands from the input token stream.
  *
- * Reads tokens from the associated `Lexer` and builds a linked list of
+ * Walks the associated `TokenBuffer` and builds a linked list of
  * commands. Updates the label map for any labels encountered during parsing. If
- * an error occurs, sets `parser->had_error` to `true`.
+ * an error occurs, sets `parser->had_error` to `true`; a `rep` block left open
+ * at the end of the input always leaves it set. A command that fails to parse
+ * is reported and skipped, which sets `parser->recovered` instead.
  *
  * @param parser Pointer to the initialized `Parser` structure.
  * @return Pointer to the head of a linked list of parsed `Command` objects.
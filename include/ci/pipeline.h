@@ -0,0 +1,32 @@
+#ifndef CI_PIPELINE_H
+#define CI_PIPELINE_H
+#include <stdbool.h>
+#include "command.h"
+#include "interpreter.h"
+
+/**
+ * @brief Lexes, parses and runs a program at the same time, so that it starts
+ * running long before the end of a large source has been parsed.
+ *
+ * A lexer thread cuts the source into batches of lines, never inside a `rep`
+ * block, and lexes each one. A parser thread parses the batches, and the
+ * calling thread links every parsed batch into the program and runs it. The
+ * stages hand batches on through bounded single-producer, single-consumer
+ * queues. When the program runs past the commands parsed so far, or branches
+ * to or calls a label that is not defined yet, the interpreter stalls until
+ * the batch it needs arrives.
+ *
+ * Unlike a normal run, the commands before a parse error have already run
+ * when the error is reported, and layout hints, loop vectorization and forked
+ * calls are not applied.
+ *
+ * @param src The source of the program.
+ * @param intr An initialized interpreter, whose label map receives the labels
+ * of the program.
+ * @param commands Set to the commands of the program, which the caller frees
+ * with `free_command` once the interpreter is done with them.
+ * @return True if the whole program parsed, false otherwise.
+ */
+bool pipeline_run(const char *src, Interpreter *intr, Command **commands);
+
+#endif
@@ -0,0 +1,105 @@
+#ifndef CI_SCAN_H
+#define CI_SCAN_H
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/**
+ * @brief The instruction set tiers the byte scans are implemented for.
+ */
+typedef enum {
+    CPU_AUTO,    // The best tier the host supports.
+    CPU_SCALAR,  // Portable byte-at-a-time loops.
+    CPU_SSE2,    // 16 bytes per step.
+    CPU_AVX2,    // 32 bytes per step.
+} CpuTier;
+
+/**
+ * @brief Returns the best tier the host CPU and operating system support.
+ *
+ * @return The detected tier, never `CPU_AUTO`.
+ */
+CpuTier scan_detect(void);
+
+/**
+ * @brief Selects the implementation used by every scan. Must be called before
+ * any other thread starts; until then the scalar tier is used.
+ *
+ * @param tier The tier to use, or `CPU_AUTO` for the detected one.
+ * @return True if the tier was selected, false if the host does not support it.
+ */
+bool scan_select(CpuTier tier);
+
+/**
+ * @brief Returns the name of a tier as accepted by `--cpu=`.
+ *
+ * @param tier The tier.
+ * @return The name of the tier.
+ */
+const char *scan_tier_name(CpuTier tier);
+
+/**
+ * @brief Counts the separators (space, tab, comma, carriage return) at the
+ * start of a NUL-terminated string.
+ */
+size_t scan_blanks(const char *s);
+
+/**
+ * @brief Counts the identifier characters (letters, digits, `_` and `.`) at
+ * the start of a NUL-terminated string.
+ */
+size_t scan_ident(const char *s);
+
+/**
+ * @brief Returns the offset of the first `"`, newline or NUL in a string.
+ */
+size_t scan_string_end(const char *s);
+
+/**
+ * @brief Returns the offset of the first newline or NUL in a string.
+ */
+size_t scan_line_end(const char *s);
+
+/**
+ * @brief Returns the offset of the first non-zero byte of a buffer.
+ *
+ * @param bytes The buffer.
+ * @param length The length of the buffer.
+ * @return The offset, or `length` if every byte is zero.
+ */
+size_t scan_nonzero(const uint8_t *bytes, size_t length);
+
+/**
+ * @brief Returns one past the offset of the last non-zero byte of a buffer.
+ *
+ * @param bytes The buffer.
+ * @param length The length of the buffer.
+ * @return The offset plus one, or 0 if every byte is zero.
+ */
+size_t scan_nonzero_end(const uint8_t *bytes, size_t length);
+
+/**
+ * @brief Returns the offset of the first byte of a buffer equal to either of
+ * two values.
+ *
+ * @param bytes The buffer.
+ * @param length The length of the buffer.
+ * @param a The first value to look for.
+ * @param b The second value to look for; pass `a` again to look for one value.
+ * @return The offset, or `length` if neither value occurs.
+ */
+size_t scan_either(const uint8_t *bytes, size_t length, uint8_t a, uint8_t b);
+
+/**
+ * @brief Returns the offset of the first byte at which two strings differ or
+ * the first one ends.
+ *
+ * @param a The first string.
+ * @param b The second string.
+ * @param length The number of bytes both buffers hold.
+ * @return The offset, or `length` if the first `length` bytes are equal and
+ * non-zero.
+ */
+size_t scan_string_diff(const uint8_t *a, const uint8_t *b, size_t length);
+
+#endif
@@ -0,0 +1,29 @@
+#ifndef CI_SCHEDULER_H
+#define CI_SCHEDULER_H
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "interpreter.h"
+
+#define DEFAULT_QUANTUM 10000  // Commands a guest may run before it can be preempted.
+
+/**
+ * @brief Runs many interpreter instances to completion as cooperative green
+ * threads on a pool of worker threads.
+ *
+ * Each instance runs for a slice of `quantum` commands (see `interpret_slice`)
+ * and then goes to the back of its worker's run queue, so long-running guests
+ * take turns with short ones instead of starving them. Idle workers steal
+ * instances from busy ones.
+ *
+ * @param instances The interpreters to run. Each must have been started with
+ * `interpreter_start`.
+ * @param count The number of interpreters.
+ * @param workers The number of worker threads, at least 1.
+ * @param quantum The number of commands per slice, at least 1.
+ * @return True if every instance ran to completion (successfully or not),
+ * false if the scheduler could not be set up.
+ */
+bool scheduler_run(Interpreter *instances, size_t count, int workers, uint64_t quantum);
+
+#endif
@@ -0,0 +1,79 @@
+#ifndef CI_SEGMENT_H
+#define CI_SEGMENT_H
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "command.h"
+#include "interpreter.h"
+
+/**
+ * @brief One part of a straight-line region, run as a single task.
+ */
+typedef struct {
+    Command *head;  // A private copy of the part's commands, ending in NULL.
+    uint64_t defs;  // The registers the part writes, with `FLAGS_MASK` if it sets the flags.
+} SegmentTask;
+
+/**
+ * @brief A run of arithmetic, logic, shift, compare and `print` commands,
+ * split into parts such that no part reads a register or the flags that an
+ * earlier part writes. Every part can therefore start from the registers the
+ * region starts with, and the region ends with each register as the last
+ * part that writes it leaves it.
+ *
+ * The plan, its parts and their copies of the commands are one allocation.
+ */
+struct segment_plan {
+    Command    *exit;        // The command following the region.
+    size_t      task_count;  // The number of entries in `tasks`, at least two.
+    SegmentTask tasks[];     // The parts in program order.
+};
+
+/**
+ * @brief Sets the number of threads that run the parts of straight-line
+ * regions. Must be called before `segment_program`.
+ *
+ * @param workers The number of threads; 0 disables splitting regions.
+ */
+void segment_configure(int workers);
+
+/**
+ * @brief Finds the straight-line regions long enough to be worth splitting
+ * and inserts a CMD_SEGMENTS command in front of each. Starts the worker
+ * threads if any region was found.
+ *
+ * Only entering a region by falling into it runs the parts in parallel; a
+ * branch to a label in the region still runs its commands in turn.
+ *
+ * @param commands The first command of the program.
+ * @return The first command of the program, which changes if the program
+ * starts with a region.
+ */
+Command *segment_program(Command *commands);
+
+/**
+ * @brief Removes and frees the CMD_SEGMENTS commands `segment_program`
+ * inserted and stops the worker threads. No interpreter may be running the
+ * program.
+ *
+ * @param commands The first command of the program.
+ * @return The first command of the original program.
+ */
+Command *unsegment_program(Command *commands);
+
+/**
+ * @brief Runs the parts of a region in parallel, each with its own copy of
+ * the interpreter's registers and flags and its own output buffer. Once all
+ * of them are done, writes their output in program order and applies the
+ * registers and flags they wrote.
+ *
+ * @param plan The plan of the region.
+ * @param intr The interpreter reaching the region.
+ * @param executed Set to the number of commands the parts ran.
+ * @return True if the region ran, false if it must run in turn instead: no
+ * workers are running, memory ran out or a part failed. Nothing has been
+ * written or changed then.
+ */
+bool segments_run(const SegmentPlan *plan, Interpreter *intr, uint64_t *executed);
+
+#endif
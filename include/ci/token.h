@@ -13,6 +13,16 @@ typedef struct {
     int         column;  // The column number where this token starts (1-based).
 } Token;
 
+/**
+ * @brief The problems an error token reports. The lexeme of a TOK_ERR is the
+ * message of its error rather than source text.
+ */
+typedef enum {
+    TOKEN_ERR_UNEXPECTED_CHAR,  // A character that starts no token.
+    TOKEN_ERR_BAD_BASE,         // A 0b or 0x prefix without a valid digit after it.
+    TOKEN_ERR_BAD_NUMBER,       // A numeric literal that cannot be decoded.
+} TokenError;
+
 /**
  * @brief Initializes a `Token` structure.
  *
@@ -26,6 +36,14 @@ typedef struct {
 void token_init(Token *tok, TokenType tok_type, const char *lexeme, int lexeme_length, int line,
                 int column);
 
+/**
+ * @brief Returns the message of a lexical error.
+ *
+ * @param error The error.
+ * @return A static, NUL-terminated message.
+ */
+const char *token_error_message(TokenError error);
+
 /**
  * @brief Prints a `Token` for debugging purposes.
  *
@@ -0,0 +1,95 @@
+#ifndef CI_TOKEN_BUFFER_H
+#define CI_TOKEN_BUFFER_H
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "token.h"
+
+/**
+ * @brief A packed, structure-of-arrays buffer holding every token of a source
+ * text.
+ *
+ * The lexer fills the buffer in a single pass before parsing starts, so the
+ * parser walks it by index instead of pulling and copying one `Token` at a
+ * time. Line and column are not stored per token; they are recovered from a
+ * per-line table only when a diagnostic needs them.
+ */
+typedef struct {
+    const char *source;         // The source text the offsets refer to.
+    uint8_t    *types;          // The `TokenType` of each token.
+    uint32_t   *offsets;        // Byte offset of each lexeme from the start of `source`.
+    uint32_t   *lengths;        // Length of each lexeme.
+    int64_t    *values;         // Pre-decoded value of each TOK_NUM. For TOK_ERR, the
+                                // `TokenError` it reports.
+    size_t      count;          // The number of tokens in the buffer.
+    size_t      capacity;       // The number of tokens the arrays can hold.
+    uint32_t   *line_starts;    // Offset of the first character of each line after the first.
+    size_t      line_count;     // The number of entries in `line_starts`.
+    size_t      line_capacity;  // The number of entries `line_starts` can hold.
+    uint32_t    first_line;     // The line number of the first line of `source`; 1 by default.
+} TokenBuffer;
+
+/**
+ * @brief Initializes an empty token buffer over the given source text.
+ *
+ * @param buf Pointer to the `TokenBuffer` to initialize.
+ * @param source The source text the tokens will refer to.
+ * @return True if the buffer was successfully initialized, false otherwise.
+ */
+bool token_buffer_init(TokenBuffer *buf, const char *source);
+
+/**
+ * @brief Frees the arrays owned by a token buffer.
+ *
+ * Does not free the source text nor the pointer itself.
+ *
+ * @param buf Pointer to the `TokenBuffer` to free.
+ */
+void token_buffer_free(TokenBuffer *buf);
+
+/**
+ * @brief Appends a token to the end of the buffer, growing it if needed.
+ *
+ * @param buf Pointer to the token buffer.
+ * @param type The type of the token.
+ * @param offset The byte offset of the lexeme within the source.
+ * @param length The length of the lexeme.
+ * @param value The pre-decoded value of the token.
+ * @return True if the token was appended, false if memory ran out.
+ */
+bool token_buffer_push(TokenBuffer *buf, TokenType type, uint32_t offset, uint32_t length,
+                       int64_t value);
+
+/**
+ * @brief Records that a new line starts at the given offset.
+ *
+ * Offsets must be pushed in increasing order.
+ *
+ * @param buf Pointer to the token buffer.
+ * @param offset The offset of the first character of the new line.
+ * @return True if the line was recorded, false if memory ran out.
+ */
+bool token_buffer_push_line(TokenBuffer *buf, uint32_t offset);
+
+/**
+ * @brief Returns the source line a token starts on.
+ *
+ * @param buf Pointer to the token buffer.
+ * @param index The index of the token, which must be less than `buf->count`.
+ * @return The 1-based line number of the token.
+ */
+uint32_t token_buffer_line(const TokenBuffer *buf, size_t index);
+
+/**
+ * @brief Materializes the token at the given index as a `Token`.
+ *
+ * Line and column are looked up in the line table, so this is meant for
+ * diagnostics and debugging output rather than the parsing hot path.
+ *
+ * @param buf Pointer to the token buffer.
+ * @param index The index of the token, which must be less than `buf->count`.
+ * @return The token at `index`.
+ */
+Token token_buffer_get(const TokenBuffer *buf, size_t index);
+
+#endif
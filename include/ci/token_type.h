@@ -38,6 +38,33 @@ typedef enum {
     TOK_STORE,       // store
     TOK_STR,         // "string"
     TOK_SUB,         // sub
+    TOK_HNEW,        // hnew
+    TOK_HPUT,        // hput
+    TOK_HGET,        // hget
+    TOK_HDEL,        // hdel
+    TOK_LOOP,        // loop
+    TOK_REP,         // rep
+    TOK_LBRACE,      // {
+    TOK_RBRACE,      // }
+    TOK_STRLEN,      // strlen
+    TOK_STRCHR,      // strchr
+    TOK_STRCMP,      // strcmp
+    TOK_STRCPY,      // strcpy
+    TOK_LIKELY,      // .likely, a branch hint
+    TOK_UNLIKELY,    // .unlikely, a branch hint
+    TOK_COLD,        // .cold
+    TOK_LDP,         // ldp
+    TOK_STP,         // stp
+    TOK_LDM,         // ldm
+    TOK_STM,         // stm
+    TOK_LOADS,       // loads
+    TOK_CRC32C,      // crc32c
+    TOK_HASH64,      // hash64
+    TOK_UBFX,        // ubfx
+    TOK_SBFX,        // sbfx
+    TOK_BFI,         // bfi
+    TOK_BFXIL,       // bfxil
+    TOK_ROR,         // ror
 } TokenType;
 
 #endif
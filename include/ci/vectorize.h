@@ -0,0 +1,103 @@
+#ifndef CI_VECTORIZE_H
+#define CI_VECTORIZE_H
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "command.h"
+#include "label_map.h"
+#include "mem.h"
+
+#define VECTOR_MAX_OPS 4  // Most arithmetic commands between the load and the store.
+
+/**
+ * @brief The element-wise operations a vectorized loop may apply. All of them
+ * only move carries and bits towards the top of a value, so the low bytes of
+ * the result depend on the low bytes of the inputs alone.
+ */
+typedef enum {
+    VECTOR_ADD,
+    VECTOR_SUB,
+    VECTOR_AND,
+    VECTOR_ORR,
+    VECTOR_EOR,
+    VECTOR_LSL,
+} VectorOpKind;
+
+/**
+ * @brief One arithmetic command of a vectorized loop body, applied to the
+ * loaded value with a loop-invariant operand.
+ */
+typedef struct {
+    VectorOpKind kind;          // The operation.
+    bool         is_immediate;  // Whether `operand` is a value or a variable index.
+    int64_t      operand;       // The immediate, or the variable holding the operand.
+} VectorOp;
+
+/**
+ * @brief A loop of the form
+ *
+ *     .l:  load xT W xS
+ *          <op> xT xT <invariant>     (up to VECTOR_MAX_OPS times)
+ *          store xT xD W
+ *          add xS xS W                (once if xS is xD)
+ *          add xD xD W
+ *          loop xC .l                 (or: sub xC xC 1, cmp xC 0, b.ne .l)
+ *
+ * which copies `xC` elements of `W` bytes from `xS` to `xD`, transforming each
+ * on the way.
+ */
+struct vector_loop {
+    int      width;                // The element size in bytes: 1, 2, 4 or 8.
+    int      value_reg;            // xT, the variable each element passes through.
+    int      src_reg;              // xS, the source pointer.
+    int      dst_reg;              // xD, the destination pointer.
+    int      count_reg;            // xC, the remaining iteration count.
+    bool     sets_flags;           // Whether the back-edge compares xC with zero.
+    size_t   op_count;             // The number of entries in `ops`.
+    VectorOp ops[VECTOR_MAX_OPS];  // The operations, in program order.
+    uint64_t body_length;          // Commands the scalar loop executes per iteration.
+    Command *exit;                 // The command following the loop.
+};
+
+/**
+ * @brief Finds loops that can run as whole-block host SIMD kernels and inserts
+ * a CMD_VLOOP command in front of each.
+ *
+ * Only entering a loop by falling into it runs the vectorized form; the loop's
+ * own back-edge, and any branch to its label, still reach the scalar body.
+ *
+ * @param commands The first command of the program.
+ * @param map The label map of the program.
+ * @return The first command of the program, which changes if the program
+ * starts with a vectorized loop.
+ */
+Command *vectorize_loops(Command *commands, LabelMap *map);
+
+/**
+ * @brief Removes and frees the CMD_VLOOP commands `vectorize_loops` inserted,
+ * restoring the original program.
+ *
+ * @param commands The first command of the program.
+ * @return The first command of the original program.
+ */
+Command *unvectorize_loops(Command *commands);
+
+/**
+ * @brief Runs every iteration of a vectorized loop, leaving variables and
+ * memory as the scalar loop would.
+ *
+ * The loop only runs if the count is positive and both ranges fit in memory,
+ * and if the ranges are either identical or disjoint. A partial overlap makes
+ * later iterations read what earlier ones wrote, which only the scalar loop
+ * reproduces.
+ *
+ * @param loop The plan of the loop.
+ * @param variables The interpreter's variables.
+ * @param memory The interpreter's memory.
+ * @param iterations Set to the number of iterations run.
+ * @return True if the loop ran, false if the scalar loop must run instead.
+ */
+bool vector_loop_run(const VectorLoop *loop, int64_t *variables, Memory *memory,
+                     uint64_t *iterations);
+
+#endif
@@ -0,0 +1,122 @@
+#ifndef CI_WATCH_H
+#define CI_WATCH_H
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "command.h"
+#include "label_map.h"
+
+/**
+ * @brief A piece of a program's source that is parsed on its own, together
+ * with the result of parsing it.
+ *
+ * A chunk starts at a label that does not begin with a dot, outside of any
+ * `rep` block, so a chunk usually holds one function together with its local
+ * labels.
+ */
+typedef struct {
+    char     *text;        // The source of the chunk, NUL-terminated.
+    size_t    length;      // The length of `text`.
+    uint64_t  hash;        // FNV-1a hash of `text`.
+    uint32_t  first_line;  // The source line the chunk starts on.
+    Command  *head;        // The first command of the chunk, NULL if it has none.
+    Command  *tail;        // The last command of the chunk.
+    LabelMap  labels;      // The chunk's labels; NULL ones name whatever follows the chunk.
+} Chunk;
+
+/**
+ * @brief The parsed chunks of the previous version of a program, reused for
+ * every chunk whose text has not changed.
+ */
+typedef struct {
+    Chunk *chunks;  // The chunks in source order.
+    size_t count;   // The number of entries in `chunks`.
+} ChunkCache;
+
+/**
+ * @brief Watches a single file for changes with inotify.
+ *
+ * The directory is watched rather than the file, so editors that save by
+ * replacing the file are noticed as well.
+ */
+typedef struct {
+    int   fd;    // The inotify instance.
+    char *name;  // The name of the file within its directory.
+} FileWatch;
+
+/**
+ * @brief Initializes an empty chunk cache.
+ *
+ * @param cache Pointer to the cache to initialize.
+ */
+void chunk_cache_init(ChunkCache *cache);
+
+/**
+ * @brief Frees every chunk in the cache and its commands. The chunks must not
+ * be linked.
+ *
+ * @param cache Pointer to the cache to free.
+ */
+void chunk_cache_free(ChunkCache *cache);
+
+/**
+ * @brief Splits a new version of the program into chunks, reusing the parsed
+ * commands of unchanged chunks and parsing the rest.
+ *
+ * Parse errors are reported as a full parse reports them. A chunk that fails
+ * to parse is left out of the cache, and so is parsed again next time.
+ *
+ * @param cache Pointer to the cache, which must not be linked.
+ * @param src The new source of the program.
+ * @param parsed Set to the number of chunks that had to be parsed.
+ * @return True if every chunk parsed, false otherwise.
+ */
+bool chunk_cache_update(ChunkCache *cache, const char *src, size_t *parsed);
+
+/**
+ * @brief Links the chunks' commands into one program and collects their
+ * labels.
+ *
+ * Calls and branches find their target by name, so relinking is all that
+ * callers of a changed chunk need.
+ *
+ * @param cache Pointer to the cache.
+ * @param map Pointer to an initialized, empty label map receiving every label.
+ * @return The first command of the program.
+ */
+Command *chunk_cache_link(ChunkCache *cache, LabelMap *map);
+
+/**
+ * @brief Undoes `chunk_cache_link`, so each chunk holds its own commands
+ * again.
+ *
+ * @param cache Pointer to the cache.
+ */
+void chunk_cache_unlink(ChunkCache *cache);
+
+/**
+ * @brief Starts watching a file.
+ *
+ * @param watch Pointer to the watch to initialize.
+ * @param path The path of the file.
+ * @return True if the watch was started, false otherwise.
+ */
+bool file_watch_init(FileWatch *watch, const char *path);
+
+/**
+ * @brief Blocks until the watched file has been written, then waits for
+ * writes to settle.
+ *
+ * @param watch Pointer to the watch.
+ * @return True once the file changed, false if watching failed.
+ */
+bool file_watch_wait(FileWatch *watch);
+
+/**
+ * @brief Stops watching and frees the watch.
+ *
+ * @param watch Pointer to the watch to free.
+ */
+void file_watch_free(FileWatch *watch);
+
+#endif
@@ -0,0 +1,99 @@
+#ifndef CI_WORKER_POOL_H
+#define CI_WORKER_POOL_H
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+/**
+ * @brief A unit of work run by the pool.
+ *
+ * @param arg The argument the task was submitted with.
+ * @return True if the task has finished, false if it yielded and should be
+ * run again later.
+ */
+typedef bool (*PoolTaskFn)(void *arg);
+
+/**
+ * @brief A task waiting in a work queue.
+ */
+typedef struct {
+    PoolTaskFn fn;   // The function to run.
+    void      *arg;  // The argument to run it with.
+} PoolTask;
+
+/**
+ * @brief A worker's double ended queue of tasks.
+ *
+ * The owning worker takes tasks from the front and appends yielded tasks to
+ * the back, which gives round-robin order among its tasks. Other workers
+ * steal from the back.
+ */
+typedef struct {
+    pthread_mutex_t lock;      // Guards every other field.
+    PoolTask       *tasks;     // Ring buffer of tasks.
+    size_t          head;      // Index of the front task.
+    size_t          count;     // The number of queued tasks.
+    size_t          capacity;  // The number of tasks the ring buffer can hold.
+} WorkQueue;
+
+/**
+ * @brief A fixed set of worker threads with per-worker queues and work
+ * stealing.
+ */
+typedef struct {
+    WorkQueue      *queues;        // One queue per worker.
+    pthread_t      *threads;       // The worker threads.
+    int             worker_count;  // The number of workers.
+    int             thread_count;  // The number of worker threads started so far.
+    atomic_size_t   queued;        // The number of tasks sitting in queues.
+    atomic_size_t   pending;       // The number of submitted tasks not yet finished.
+    atomic_int      sleeping;      // The number of workers waiting for work.
+    atomic_bool     stop;          // Set when the pool is shutting down.
+    atomic_uint     next_queue;    // Round-robin cursor for submissions from outside.
+    pthread_mutex_t idle_lock;     // Guards sleeping on `idle_cond` and `done_cond`.
+    pthread_cond_t  idle_cond;     // Signalled when work is queued or the pool stops.
+    pthread_cond_t  done_cond;     // Signalled when `pending` drops to zero.
+} WorkerPool;
+
+/**
+ * @brief Starts a pool with the given number of worker threads.
+ *
+ * @param pool Pointer to the `WorkerPool` to initialize.
+ * @param workers The number of worker threads, at least 1.
+ * @return True if every worker was started, false otherwise.
+ */
+bool pool_init(WorkerPool *pool, int workers);
+
+/**
+ * @brief Stops the workers and frees the pool's resources.
+ *
+ * Tasks still queued are dropped without being run.
+ *
+ * @param pool Pointer to the `WorkerPool` to free.
+ */
+void pool_free(WorkerPool *pool);
+
+/**
+ * @brief Queues a task.
+ *
+ * Called from a worker, the task goes to that worker's own queue; otherwise
+ * submissions are spread round-robin over all queues.
+ *
+ * @param pool Pointer to the worker pool.
+ * @param fn The function to run.
+ * @param arg The argument to pass to `fn`.
+ * @return True if the task was queued, false if memory ran out.
+ */
+bool pool_submit(WorkerPool *pool, PoolTaskFn fn, void *arg);
+
+/**
+ * @brief Blocks until every submitted task has finished.
+ *
+ * Must not be called from a worker thread.
+ *
+ * @param pool Pointer to the worker pool.
+ */
+void pool_wait(WorkerPool *pool);
+
+#endif
@@ -0,0 +1,720 @@
+#define _GNU_SOURCE
+#include <fcntl.h>
+#include <inttypes.h>
+#include <linux/perf_event.h>
+#include <math.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "checksum.h"
+#include "command.h"
+#include "command_type.h"
+#include "interpreter.h"
+#include "label_map.h"
+#include "scan.h"
+
+#define DEFAULT_LENGTH 20000  // Measured commands per synthetic stream.
+#define DEFAULT_REPS   15     // Timed runs per case.
+#define LABEL_DIGITS   21     // Room for a size_t in decimal plus the terminator.
+#define MAP_KEYS       64     // Keys inserted before the map cases run.
+
+/**
+ * @brief The operand shape a benchmark case exercises.
+ */
+typedef enum {
+    SHAPE_NONE,       // No operand variation (call/ret, put, print).
+    SHAPE_REG,        // Operands are variables.
+    SHAPE_IMM,        // The last operand (or the address) is an immediate.
+    SHAPE_TAKEN,      // Branch whose condition holds.
+    SHAPE_NOT_TAKEN,  // Branch whose condition does not hold.
+} Shape;
+
+/**
+ * @brief Describes a single microbenchmark: one command type in one shape.
+ */
+typedef struct {
+    const char     *name;   // The name printed in the report.
+    CommandType     type;   // The command being measured.
+    Shape           shape;  // How its operands are formed.
+    int             width;  // Bytes accessed by loads, stores and checksums.
+    BranchCondition cond;   // Condition for branches.
+    char            base;   // Base for prints.
+} BenchCase;
+
+/**
+ * @brief Summary statistics of one case across all timed runs.
+ */
+typedef struct {
+    double ns_median;     // Median nanoseconds per measured command.
+    double ns_min;        // Fastest run, in nanoseconds per measured command.
+    double ns_stddev;     // Standard deviation of nanoseconds per measured command.
+    double insns_median;  // Median host instructions per measured command, or NAN.
+    bool   had_error;     // Whether the interpreter reported an error.
+} BenchResult;
+
+static const BenchCase cases[] = {
+    {"add reg", CMD_ADD, SHAPE_REG, 0, BRANCH_NONE, 0},
+    {"add imm", CMD_ADD, SHAPE_IMM, 0, BRANCH_NONE, 0},
+    {"sub reg", CMD_SUB, SHAPE_REG, 0, BRANCH_NONE, 0},
+    {"sub imm", CMD_SUB, SHAPE_IMM, 0, BRANCH_NONE, 0},
+    {"mov imm", CMD_MOV, SHAPE_IMM, 0, BRANCH_NONE, 0},
+    {"and reg", CMD_AND, SHAPE_REG, 0, BRANCH_NONE, 0},
+    {"orr reg", CMD_ORR, SHAPE_REG, 0, BRANCH_NONE, 0},
+    {"eor reg", CMD_EOR, SHAPE_REG, 0, BRANCH_NONE, 0},
+    {"lsl imm", CMD_LSL, SHAPE_IMM, 0, BRANCH_NONE, 0},
+    {"lsr imm", CMD_LSR, SHAPE_IMM, 0, BRANCH_NONE, 0},
+    {"asr imm", CMD_ASR, SHAPE_IMM, 0, BRANCH_NONE, 0},
+    {"cmp reg", CMD_CMP, SHAPE_REG, 0, BRANCH_NONE, 0},
+    {"cmp imm", CMD_CMP, SHAPE_IMM, 0, BRANCH_NONE, 0},
+    {"cmp_u reg", CMD_CMP_U, SHAPE_REG, 0, BRANCH_NONE, 0},
+    {"cmp_u imm", CMD_CMP_U, SHAPE_IMM, 0, BRANCH_NONE, 0},
+    {"add w reg", CMD_ADD_W, SHAPE_REG, 0, BRANCH_NONE, 0},
+    {"sub w imm", CMD_SUB_W, SHAPE_IMM, 0, BRANCH_NONE, 0},
+    {"mov w imm", CMD_MOV_W, SHAPE_IMM, 0, BRANCH_NONE, 0},
+    {"eor w reg", CMD_EOR_W, SHAPE_REG, 0, BRANCH_NONE, 0},
+    {"lsl w imm", CMD_LSL_W, SHAPE_IMM, 0, BRANCH_NONE, 0},
+    {"asr w imm", CMD_ASR_W, SHAPE_IMM, 0, BRANCH_NONE, 0},
+    {"cmp w reg", CMD_CMP_W, SHAPE_REG, 0, BRANCH_NONE, 0},
+    {"cmp_u w imm", CMD_CMP_U_W, SHAPE_IMM, 0, BRANCH_NONE, 0},
+    {"ror imm", CMD_ROR, SHAPE_IMM, 0, BRANCH_NONE, 0},
+    {"ubfx imm", CMD_UBFX, SHAPE_IMM, 0, BRANCH_NONE, 0},
+    {"sbfx imm", CMD_SBFX, SHAPE_IMM, 0, BRANCH_NONE, 0},
+    {"bfi imm", CMD_BFI, SHAPE_IMM, 0, BRANCH_NONE, 0},
+    {"bfxil imm", CMD_BFXIL, SHAPE_IMM, 0, BRANCH_NONE, 0},
+    {"load 1 reg", CMD_LOAD, SHAPE_REG, 1, BRANCH_NONE, 0},
+    {"load 2 reg", CMD_LOAD, SHAPE_REG, 2, BRANCH_NONE, 0},
+    {"load 4 reg", CMD_LOAD, SHAPE_REG, 4, BRANCH_NONE, 0},
+    {"load 8 reg", CMD_LOAD, SHAPE_REG, 8, BRANCH_NONE, 0},
+    {"load 8 imm", CMD_LOAD, SHAPE_IMM, 8, BRANCH_NONE, 0},
+    {"loads 1 reg", CMD_LOADS, SHAPE_REG, 1, BRANCH_NONE, 0},
+    {"loads 2 reg", CMD_LOADS, SHAPE_REG, 2, BRANCH_NONE, 0},
+    {"loads 4 reg", CMD_LOADS, SHAPE_REG, 4, BRANCH_NONE, 0},
+    {"store 1 reg", CMD_STORE, SHAPE_REG, 1, BRANCH_NONE, 0},
+    {"store 2 reg", CMD_STORE, SHAPE_REG, 2, BRANCH_NONE, 0},
+    {"store 4 reg", CMD_STORE, SHAPE_REG, 4, BRANCH_NONE, 0},
+    {"store 8 reg", CMD_STORE, SHAPE_REG, 8, BRANCH_NONE, 0},
+    {"store 8 imm", CMD_STORE, SHAPE_IMM, 8, BRANCH_NONE, 0},
+    {"ldp reg", CMD_LDP, SHAPE_REG, 16, BRANCH_NONE, 0},
+    {"stp reg", CMD_STP, SHAPE_REG, 16, BRANCH_NONE, 0},
+    {"ldm 8 reg", CMD_LDM, SHAPE_REG, 64, BRANCH_NONE, 0},
+    {"stm 8 reg", CMD_STM, SHAPE_REG, 64, BRANCH_NONE, 0},
+    {"put", CMD_PUT, SHAPE_NONE, 0, BRANCH_NONE, 0},
+    {"print d", CMD_PRINT, SHAPE_NONE, 0, BRANCH_NONE, 'd'},
+    {"print x", CMD_PRINT, SHAPE_NONE, 0, BRANCH_NONE, 'x'},
+    {"print b", CMD_PRINT, SHAPE_NONE, 0, BRANCH_NONE, 'b'},
+    {"print s", CMD_PRINT, SHAPE_NONE, 0, BRANCH_NONE, 's'},
+    {"b", CMD_BRANCH, SHAPE_TAKEN, 0, BRANCH_ALWAYS, 0},
+    {"b.eq taken", CMD_BRANCH, SHAPE_TAKEN, 0, BRANCH_EQUAL, 0},
+    {"b.eq not", CMD_BRANCH, SHAPE_NOT_TAKEN, 0, BRANCH_EQUAL, 0},
+    {"b.ne taken", CMD_BRANCH, SHAPE_TAKEN, 0, BRANCH_NOT_EQUAL, 0},
+    {"b.ne not", CMD_BRANCH, SHAPE_NOT_TAKEN, 0, BRANCH_NOT_EQUAL, 0},
+    {"b.gt taken", CMD_BRANCH, SHAPE_TAKEN, 0, BRANCH_GREATER, 0},
+    {"b.gt not", CMD_BRANCH, SHAPE_NOT_TAKEN, 0, BRANCH_GREATER, 0},
+    {"b.lt taken", CMD_BRANCH, SHAPE_TAKEN, 0, BRANCH_LESS, 0},
+    {"b.lt not", CMD_BRANCH, SHAPE_NOT_TAKEN, 0, BRANCH_LESS, 0},
+    {"b.ge taken", CMD_BRANCH, SHAPE_TAKEN, 0, BRANCH_GREATER_EQUAL, 0},
+    {"b.ge not", CMD_BRANCH, SHAPE_NOT_TAKEN, 0, BRANCH_GREATER_EQUAL, 0},
+    {"b.le taken", CMD_BRANCH, SHAPE_TAKEN, 0, BRANCH_LESS_EQUAL, 0},
+    {"b.le not", CMD_BRANCH, SHAPE_NOT_TAKEN, 0, BRANCH_LESS_EQUAL, 0},
+    {"call+ret", CMD_CALL, SHAPE_NONE, 0, BRANCH_NONE, 0},
+    {"hput imm", CMD_HPUT, SHAPE_IMM, 0, BRANCH_NONE, 0},
+    {"hget imm", CMD_HGET, SHAPE_IMM, 0, BRANCH_NONE, 0},
+    {"hdel imm", CMD_HDEL, SHAPE_IMM, 0, BRANCH_NONE, 0},
+    {"strlen reg", CMD_STRLEN, SHAPE_REG, 0, BRANCH_NONE, 0},
+    {"strchr reg", CMD_STRCHR, SHAPE_REG, 0, BRANCH_NONE, 0},
+    {"strcmp reg", CMD_STRCMP, SHAPE_REG, 0, BRANCH_NONE, 0},
+    {"strcpy reg", CMD_STRCPY, SHAPE_REG, 0, BRANCH_NONE, 0},
+    {"crc32c 256", CMD_CRC32C, SHAPE_IMM, 256, BRANCH_NONE, 0},
+    {"hash64 256", CMD_HASH64, SHAPE_IMM, 256, BRANCH_NONE, 0},
+};
+
+static const int num_cases = sizeof(cases) / sizeof(cases[0]);
+
+static Command *new_command(CommandType type);
+static char    *new_label(const char *prefix, size_t index);
+static Command *flag_setup(const BenchCase *bc);
+static Command *build_measured(const BenchCase *bc, size_t index);
+static Command *build_stream(const BenchCase *bc, size_t length, LabelMap *map, size_t *ops);
+static int      open_instruction_counter(void);
+static int      compare_doubles(const void *a, const void *b);
+static bool     run_case(const BenchCase *bc, size_t length, int reps, int counter,
+                         BenchResult *result);
+
+int main(int argc, char **argv) {
+    size_t      length = DEFAULT_LENGTH;
+    int         reps   = DEFAULT_REPS;
+    const char *filter = NULL;
+
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "-n") == 0 && i + 1 < argc) {
+            length = strtoull(argv[++i], NULL, 10);
+        } else if (strcmp(argv[i], "-r") == 0 && i + 1 < argc) {
+            reps = atoi(argv[++i]);
+        } else if (argv[i][0] != '-') {
+            filter = argv[i];
+        } else {
+            printf("Usage: %s [-n stream_length] [-r repetitions] [case_filter]\n", argv[0]);
+            return 1;
+        }
+    }
+
+    if (length == 0 || reps <= 0) {
+        printf("Stream length and repetitions must be positive\n");
+        return 1;
+    }
+
+    scan_select(CPU_AUTO);
+    checksum_select(CPU_AUTO);
+    int counter = open_instruction_counter();
+    printf("%zu commands per stream, %d runs per case, %s scans%s\n\n", length, reps,
+           scan_tier_name(scan_detect()),
+           counter < 0 ? ", host instruction counter unavailable" : "");
+    printf("%-14s %10s %10s %10s %12s\n", "case", "ns/op", "min", "stddev", "insns/op");
+
+    int status = 0;
+    for (int i = 0; i < num_cases; i++) {
+        if (filter && !strstr(cases[i].name, filter)) {
+            continue;
+        }
+
+        BenchResult result;
+        if (!run_case(&cases[i], length, reps, counter, &result)) {
+            printf("%-14s failed to build stream\n", cases[i].name);
+            status = 1;
+            continue;
+        }
+
+        printf("%-14s %10.2f %10.2f %10.2f ", cases[i].name, result.ns_median, result.ns_min,
+               result.ns_stddev);
+        if (isnan(result.insns_median)) {
+            printf("%12s", "-");
+        } else {
+            printf("%12.1f", result.insns_median);
+        }
+        printf("%s\n", result.had_error ? "  (interpreter error)" : "");
+    }
+
+    if (counter >= 0) {
+        close(counter);
+    }
+    return status;
+}
+
+/**
+ * @brief Allocates a zeroed command of the given type.
+ *
+ * @param type The type of the command to create.
+ * @return A pointer to the new command, or NULL if allocation failed.
+ */
+static Command *new_command(CommandType type) {
+    Command *cmd = (Command *) calloc(1, sizeof(Command));
+    if (!cmd) {
+        return NULL;
+    }
+
+    cmd->type             = type;
+    cmd->branch_condition = BRANCH_NONE;
+    return cmd;
+}
+
+/**
+ * @brief Builds a heap allocated label name such as "t42".
+ *
+ * @param prefix The prefix of the label.
+ * @param index The number appended to the prefix.
+ * @return The label, or NULL if allocation failed.
+ */
+static char *new_label(const char *prefix, size_t index) {
+    size_t size  = strlen(prefix) + LABEL_DIGITS;
+    char  *label = (char *) malloc(size);
+    if (label) {
+        snprintf(label, size, "%s%zu", prefix, index);
+    }
+    return label;
+}
+
+/**
+ * @brief Builds the comparison that makes a branch case taken or not taken.
+ *
+ * The prologue leaves x1 = 12345 and x2 = 7, so comparing them in either order,
+ * or x2 with itself, yields every flag combination.
+ *
+ * @param bc The branch case.
+ * @return A CMP command setting the flags, or NULL if allocation failed.
+ */
+static Command *flag_setup(const BenchCase *bc) {
+    enum { EQUAL, GREATER, LESS } flags;
+    bool taken = bc->shape == SHAPE_TAKEN;
+
+    switch (bc->cond) {
+        case BRANCH_EQUAL:
+        case BRANCH_LESS_EQUAL:
+            flags = taken ? EQUAL : GREATER;
+            break;
+        case BRANCH_GREATER_EQUAL:
+            flags = taken ? EQUAL : LESS;
+            break;
+        case BRANCH_NOT_EQUAL:
+            flags = taken ? GREATER : EQUAL;
+            break;
+        case BRANCH_GREATER:
+            flags = taken ? GREATER : LESS;
+            break;
+        case BRANCH_LESS:
+            flags = taken ? LESS : GREATER;
+            break;
+        default:
+            flags = EQUAL;
+            break;
+    }
+
+    Command *cmp = new_command(CMD_CMP);
+    if (!cmp) {
+        return NULL;
+    }
+
+    // EQUAL: cmp x2 x2, GREATER: cmp x1 x2, LESS: cmp x2 x1
+    cmp->val_a.base = flags == GREATER ? 1 : 2;
+    cmp->val_b.base = flags == LESS ? 1 : 2;
+    return cmp;
+}
+
+/**
+ * @brief Builds the `index`-th measured command of a stream.
+ *
+ * @param bc The case being built.
+ * @param index The position of the command within the stream.
+ * @return The command, or NULL if allocation failed.
+ */
+static Command *build_measured(const BenchCase *bc, size_t index) {
+    Command *cmd = new_command(bc->type);
+    if (!cmd) {
+        return NULL;
+    }
+
+    // Rotate destinations over x8..x15 so consecutive commands are independent
+    cmd->destination.base = (char) (8 + index % 8);
+    bool imm              = bc->shape == SHAPE_IMM;
+
+    switch (bc->type) {
+        case CMD_ADD:
+        case CMD_SUB:
+        case CMD_AND:
+        case CMD_ORR:
+        case CMD_EOR:
+        case CMD_ADD_W:
+        case CMD_SUB_W:
+        case CMD_AND_W:
+        case CMD_ORR_W:
+        case CMD_EOR_W:
+            cmd->val_a.base     = 1;
+            cmd->is_b_immediate = imm;
+            if (imm) {
+                cmd->val_b.num_val = 3;
+            } else {
+                cmd->val_b.base = 2;
+            }
+            break;
+        case CMD_LSL:
+        case CMD_LSR:
+        case CMD_ASR:
+        case CMD_LSL_W:
+        case CMD_LSR_W:
+        case CMD_ASR_W:
+        case CMD_ROR:
+            cmd->val_a.base     = 1;
+            cmd->val_b.num_val  = 3;
+            cmd->is_b_immediate = true;
+            break;
+        case CMD_UBFX:
+        case CMD_SBFX:
+        case CMD_BFI:
+        case CMD_BFXIL:
+            // A 12-bit field at bit 4
+            cmd->val_a.base     = 1;
+            cmd->val_b.num_val  = 4 | 12 << 8;
+            cmd->is_b_immediate = true;
+            break;
+        case CMD_MOV:
+        case CMD_MOV_W:
+            // mov only takes an immediate source
+            cmd->is_a_immediate = true;
+            cmd->val_a.num_val  = 0x1234;
+            break;
+        case CMD_CMP:
+        case CMD_CMP_U:
+        case CMD_CMP_W:
+        case CMD_CMP_U_W:
+            cmd->val_a.base     = 1;
+            cmd->is_b_immediate = imm;
+            if (imm) {
+                cmd->val_b.num_val = 99;
+            } else {
+                cmd->val_b.base = 2;
+            }
+            break;
+        case CMD_LOAD:
+        case CMD_LOADS:
+            cmd->val_a.num_val  = bc->width;
+            cmd->is_a_immediate = true;
+            cmd->is_b_immediate = imm;
+            if (imm) {
+                cmd->val_b.num_val = 64;
+            } else {
+                cmd->val_b.base = 3;
+            }
+            break;
+        case CMD_STORE:
+            cmd->destination.base = 1;
+            cmd->is_a_immediate   = imm;
+            if (imm) {
+                cmd->val_a.num_val = 64;
+            } else {
+                cmd->val_a.base = 3;
+            }
+            cmd->val_b.num_val  = bc->width;
+            cmd->is_b_immediate = true;
+            break;
+        case CMD_LDP:
+        case CMD_STP:
+        case CMD_LDM:
+        case CMD_STM:
+            // Transfer x8 onwards, `width` bytes worth, at the prologue's address
+            cmd->destination.base = 8;
+            cmd->val_a.base       = (char) (8 + bc->width / 8 - 1);
+            cmd->val_b.base       = 3;
+            break;
+        case CMD_PUT:
+            cmd->val_a.str_val  = strdup("hello");
+            cmd->is_a_string    = true;
+            cmd->val_b.num_val  = 64;
+            cmd->is_b_immediate = true;
+            if (!cmd->val_a.str_val) {
+                free_command(cmd);
+                return NULL;
+            }
+            break;
+        case CMD_PRINT:
+            // Strings are printed from address 0, which the prologue fills
+            cmd->val_a.base = bc->base == 's' ? 4 : 1;
+            cmd->val_b.base = bc->base;
+            break;
+        case CMD_HPUT:
+            // Keys cycle over the MAP_KEYS keys the prologue inserted
+            cmd->destination.base = 5;
+            cmd->val_a.num_val    = (int64_t) (index % MAP_KEYS);
+            cmd->is_a_immediate   = true;
+            cmd->val_b.base       = 1;
+            break;
+        case CMD_HGET:
+        case CMD_HDEL:
+            // After the first MAP_KEYS deletions, hdel only measures misses
+            cmd->val_a.base     = 5;
+            cmd->val_b.num_val  = (int64_t) (index % MAP_KEYS);
+            cmd->is_b_immediate = true;
+            break;
+        case CMD_STRLEN:
+        case CMD_STRCHR:
+        case CMD_STRCMP:
+        case CMD_STRCPY:
+            // Work on the prologue's string at address 0; strchr misses, so it
+            // scans all of it, and strcmp and strcpy pair it with address 64
+            cmd->destination.base = 5;
+            cmd->val_a.base       = bc->type == CMD_STRCPY ? 3 : 4;
+            cmd->val_b.base       = bc->type == CMD_STRCHR ? 2 : bc->type == CMD_STRCPY ? 4 : 3;
+            break;
+        case CMD_CRC32C:
+        case CMD_HASH64:
+            cmd->destination.base = 5;
+            cmd->val_a.base       = 3;
+            cmd->val_b.num_val    = bc->width;
+            cmd->is_b_immediate   = true;
+            break;
+        case CMD_BRANCH:
+        case CMD_CALL:
+            // Taken branches target the next command; not taken ones never jump
+            cmd->branch_condition = bc->type == CMD_BRANCH ? bc->cond : BRANCH_NONE;
+            cmd->val_a.str_val    = bc->type == CMD_CALL          ? new_label("f", 0)
+                                    : bc->shape == SHAPE_TAKEN ? new_label("t", index)
+                                                               : new_label("end", 0);
+            cmd->is_a_string = true;
+            if (!cmd->val_a.str_val) {
+                free_command(cmd);
+                return NULL;
+            }
+            break;
+        default:
+            break;
+    }
+
+    return cmd;
+}
+
+/**
+ * @brief Builds the synthetic command stream for a case.
+ *
+ * The stream is a short prologue that initializes the operands, followed by
+ * `length` measured commands, followed by a `ret` ending the program. Call
+ * cases append the callee after it.
+ *
+ * @param bc The case to build.
+ * @param length The number of measured commands.
+ * @param map The label map receiving branch and call targets.
+ * @param ops Set to the number of measured dispatches per run.
+ * @return The head of the stream, or NULL if allocation failed.
+ */
+static Command *build_stream(const BenchCase *bc, size_t length, LabelMap *map, size_t *ops) {
+    Command *head = NULL;
+    Command *tail = NULL;
+    bool     ok   = true;
+
+#define APPEND(cmd_expr)          \
+    do {                          \
+        Command *c_ = (cmd_expr); \
+        if (!c_) {                \
+            ok = false;           \
+            break;                \
+        }                         \
+        if (tail) {               \
+            tail->next = c_;      \
+        } else {                  \
+            head = c_;            \
+        }                         \
+        tail = c_;                \
+    } while (0)
+
+    // Prologue: x1 = 12345, x2 = 7, x3 = 64 (an address), x4 = 0 (a string)
+    static const int64_t init[][2] = {{1, 12345}, {2, 7}, {3, 64}, {4, 0}};
+    for (size_t i = 0; ok && i < sizeof(init) / sizeof(init[0]); i++) {
+        Command *mov = new_command(CMD_MOV);
+        if (mov) {
+            mov->destination.base = (char) init[i][0];
+            mov->val_a.num_val    = init[i][1];
+            mov->is_a_immediate   = true;
+        }
+        APPEND(mov);
+    }
+
+    if (ok) {
+        Command *put = new_command(CMD_PUT);
+        if (put) {
+            put->val_a.str_val  = strdup("benchmark");
+            put->is_a_string    = true;
+            put->is_b_immediate = true;
+            if (!put->val_a.str_val) {
+                free_command(put);
+                put = NULL;
+            }
+        }
+        APPEND(put);
+    }
+
+    if (ok && bc->type == CMD_BRANCH) {
+        APPEND(flag_setup(bc));
+    }
+
+    // Map cases get a map in x5 holding keys 0..MAP_KEYS-1
+    bool is_map = bc->type == CMD_HPUT || bc->type == CMD_HGET || bc->type == CMD_HDEL;
+    if (ok && is_map) {
+        Command *hnew = new_command(CMD_HNEW);
+        if (hnew) {
+            hnew->destination.base = 5;
+        }
+        APPEND(hnew);
+    }
+    for (size_t i = 0; ok && is_map && i < MAP_KEYS; i++) {
+        Command *hput = new_command(CMD_HPUT);
+        if (hput) {
+            hput->destination.base = 5;
+            hput->val_a.num_val    = (int64_t) i;
+            hput->is_a_immediate   = true;
+            hput->val_b.base       = 2;
+        }
+        APPEND(hput);
+    }
+
+    for (size_t i = 0; ok && i < length; i++) {
+        Command *cmd = build_measured(bc, i);
+        APPEND(cmd);
+        if (ok && bc->type == CMD_BRANCH && bc->shape == SHAPE_TAKEN && i > 0) {
+            char *label = new_label("t", i - 1);
+            ok          = label && put_label(map, label, cmd);
+            free(label);
+        }
+    }
+
+    if (ok) {
+        Command *end = new_command(CMD_RET);
+        APPEND(end);
+        if (ok && bc->type == CMD_BRANCH && bc->shape == SHAPE_TAKEN) {
+            char *label = new_label("t", length - 1);
+            ok          = label && put_label(map, label, end);
+            free(label);
+        }
+        char end_label[] = "end0";
+        ok               = ok && put_label(map, end_label, end);
+    }
+
+    if (ok && bc->type == CMD_CALL) {
+        Command *callee = new_command(CMD_RET);
+        APPEND(callee);
+        char callee_label[] = "f0";
+        ok                  = ok && put_label(map, callee_label, callee);
+    }
+
+#undef APPEND
+
+    if (!ok) {
+        free_command(head);
+        return NULL;
+    }
+
+    *ops = bc->type == CMD_CALL ? 2 * length : length;
+    return head;
+}
+
+/**
+ * @brief Opens a counter of user-space instructions retired by this thread.
+ *
+ * @return The counter's file descriptor, or -1 if performance counters are
+ * unavailable (e.g. in containers or with a restrictive perf_event_paranoid).
+ */
+static int open_instruction_counter(void) {
+    struct perf_event_attr attr;
+    memset(&attr, 0, sizeof(attr));
+    attr.type           = PERF_TYPE_HARDWARE;
+    attr.size           = sizeof(attr);
+    attr.config         = PERF_COUNT_HW_INSTRUCTIONS;
+    attr.disabled       = 1;
+    attr.exclude_kernel = 1;
+    attr.exclude_hv     = 1;
+
+    return (int) syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0);
+}
+
+/**
+ * @brief qsort comparator for doubles in ascending order.
+ */
+static int compare_doubles(const void *a, const void *b) {
+    double x = *(const double *) a;
+    double y = *(const double *) b;
+    return (x > y) - (x < y);
+}
+
+/**
+ * @brief Builds, runs and measures one case.
+ *
+ * Guest output is sent to /dev/null while the stream runs so that print cases
+ * measure formatting rather than the terminal.
+ *
+ * @param bc The case to run.
+ * @param length The number of measured commands in the stream.
+ * @param reps The number of timed runs.
+ * @param counter The instruction counter, or -1 if unavailable.
+ * @param result Receives the statistics.
+ * @return True if the case ran, false if its stream could not be built.
+ */
+static bool run_case(const BenchCase *bc, size_t length, int reps, int counter,
+                     BenchResult *result) {
+    LabelMap map;
+    if (!label_map_init(&map, 100)) {
+        return false;
+    }
+
+    size_t   ops    = 0;
+    Command *stream = build_stream(bc, length, &map, &ops);
+    double  *ns     = (double *) malloc(reps * sizeof(double));
+    double  *insns  = (double *) malloc(reps * sizeof(double));
+    if (!stream || !ns || !insns) {
+        free_command(stream);
+        free(ns);
+        free(insns);
+        label_map_free(&map);
+        return false;
+    }
+
+    fflush(stdout);
+    int saved_stdout = dup(STDOUT_FILENO);
+    int devnull      = open("/dev/null", O_WRONLY);
+    if (saved_stdout >= 0 && devnull >= 0) {
+        dup2(devnull, STDOUT_FILENO);
+    }
+
+    Interpreter intr;
+    interpreter_init(&intr, &map);
+    result->had_error = false;
+
+    // One untimed run warms caches and the branch predictor
+    for (int r = -1; r < reps; r++) {
+        interpreter_reset(&intr);
+
+        struct timespec start, end;
+        if (counter >= 0) {
+            ioctl(counter, PERF_EVENT_IOC_RESET, 0);
+            ioctl(counter, PERF_EVENT_IOC_ENABLE, 0);
+        }
+        clock_gettime(CLOCK_MONOTONIC, &start);
+        interpret(&intr, stream);
+        clock_gettime(CLOCK_MONOTONIC, &end);
+        if (counter >= 0) {
+            ioctl(counter, PERF_EVENT_IOC_DISABLE, 0);
+        }
+
+        result->had_error = result->had_error || intr.had_error;
+        if (r < 0) {
+            continue;
+        }
+
+        double elapsed = (end.tv_sec - start.tv_sec) * 1e9 + (end.tv_nsec - start.tv_nsec);
+        ns[r]          = elapsed / ops;
+
+        uint64_t count = 0;
+        insns[r]       = NAN;
+        if (counter >= 0 && read(counter, &count, sizeof(count)) == sizeof(count)) {
+            insns[r] = (double) count / ops;
+        }
+    }
+
+    interpreter_free(&intr);
+
+    fflush(stdout);
+    if (saved_stdout >= 0 && devnull >= 0) {
+        dup2(saved_stdout, STDOUT_FILENO);
+    }
+    if (saved_stdout >= 0) {
+        close(saved_stdout);
+    }
+    if (devnull >= 0) {
+        close(devnull);
+    }
+
+    double sum = 0;
+    for (int r = 0; r < reps; r++) {
+        sum += ns[r];
+    }
+    double mean = sum / reps;
+    double var  = 0;
+    for (int r = 0; r < reps; r++) {
+        var += (ns[r] - mean) * (ns[r] - mean);
+    }
+
+    qsort(ns, reps, sizeof(double), compare_doubles);
+    qsort(insns, reps, sizeof(double), compare_doubles);
+    result->ns_median    = ns[reps / 2];
+    result->ns_min       = ns[0];
+    result->ns_stddev    = sqrt(var / reps);
+    result->insns_median = insns[reps / 2];
+
+    free(ns);
+    free(insns);
+    free_command(stream);
+    label_map_free(&map);
+    return true;
+}
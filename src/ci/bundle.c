@@ -0,0 +1,139 @@
+#define _GNU_SOURCE
+#include "bundle.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+
+#define SELF_PATH         "/proc/self/exe"
+#define BUNDLE_MAGIC      "CIBUNDLE"
+#define BUNDLE_MAGIC_SIZE 8
+#define COPY_CHUNK        65536
+
+/**
+ * @brief Trailer at the very end of a bundled executable.
+ */
+typedef struct {
+    uint64_t image_size;                // The size of the image right before the trailer.
+    char     magic[BUNDLE_MAGIC_SIZE];  // Always `BUNDLE_MAGIC`.
+} BundleTrailer;
+
+static bool find_payload(FILE *self, long *exe_size, uint64_t *image_size);
+
+/**
+ * @brief Locates the payload of a (possibly) bundled executable.
+ *
+ * @param self The executable, opened for reading.
+ * @param exe_size Set to the size of the executable without its payload.
+ * @param image_size Set to the size of the image, or 0 if there is none.
+ * @return False if the file could not be inspected.
+ */
+static bool find_payload(FILE *self, long *exe_size, uint64_t *image_size) {
+    if (fseek(self, 0L, SEEK_END) != 0) {
+        return false;
+    }
+    long file_size = ftell(self);
+    if (file_size < 0) {
+        return false;
+    }
+
+    *exe_size   = file_size;
+    *image_size = 0;
+    if ((size_t) file_size < sizeof(BundleTrailer)) {
+        return true;
+    }
+
+    BundleTrailer trailer;
+    if (fseek(self, file_size - (long) sizeof(trailer), SEEK_SET) != 0 ||
+        fread(&trailer, sizeof(trailer), 1, self) != 1) {
+        return false;
+    }
+
+    uint64_t room = (uint64_t) file_size - sizeof(trailer);
+    if (memcmp(trailer.magic, BUNDLE_MAGIC, BUNDLE_MAGIC_SIZE) != 0 ||
+        trailer.image_size > room) {
+        return true;
+    }
+
+    *exe_size   = (long) (room - trailer.image_size);
+    *image_size = trailer.image_size;
+    return true;
+}
+
+bool bundle_write(const char *path, const uint8_t *image, size_t size) {
+    FILE *self = fopen(SELF_PATH, "rb");
+    if (!self) {
+        printf("Failed to open the running executable\n");
+        return false;
+    }
+
+    long     exe_size;
+    uint64_t old_size;
+    if (!find_payload(self, &exe_size, &old_size) || fseek(self, 0L, SEEK_SET) != 0) {
+        printf("Failed to inspect the running executable\n");
+        fclose(self);
+        return false;
+    }
+
+    FILE *out = fopen(path, "wb");
+    if (!out) {
+        printf("Failed to open file %s\n", path);
+        fclose(self);
+        return false;
+    }
+
+    bool  ok    = true;
+    char *chunk = malloc(COPY_CHUNK);
+    if (!chunk) {
+        ok = false;
+    }
+
+    long remaining = exe_size;
+    while (ok && remaining > 0) {
+        size_t want = (remaining < COPY_CHUNK) ? (size_t) remaining : COPY_CHUNK;
+        size_t got  = fread(chunk, 1, want, self);
+        ok          = got == want && fwrite(chunk, 1, got, out) == got;
+        remaining -= (long) got;
+    }
+    free(chunk);
+    fclose(self);
+
+    BundleTrailer trailer = {size, BUNDLE_MAGIC};
+    ok = ok && fwrite(image, 1, size, out) == size;
+    ok = ok && fwrite(&trailer, sizeof(trailer), 1, out) == 1;
+    ok = (fclose(out) == 0) && ok;
+    ok = ok && chmod(path, 0755) == 0;
+
+    if (!ok) {
+        printf("Failed to write %s\n", path);
+        remove(path);
+    }
+    return ok;
+}
+
+uint8_t *bundle_read(size_t *size) {
+    FILE *self = fopen(SELF_PATH, "rb");
+    if (!self) {
+        return NULL;
+    }
+
+    long     exe_size;
+    uint64_t image_size;
+    if (!find_payload(self, &exe_size, &image_size) || image_size == 0 ||
+        fseek(self, exe_size, SEEK_SET) != 0) {
+        fclose(self);
+        return NULL;
+    }
+
+    uint8_t *image = malloc(image_size);
+    if (image && fread(image, 1, image_size, self) != image_size) {
+        free(image);
+        image = NULL;
+    }
+
+    fclose(self);
+    if (image) {
+        *size = image_size;
+    }
+    return image;
+}
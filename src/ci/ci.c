@@ -1,31 +1,132 @@
+#define _GNU_SOURCE
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include "bundle.h"
+#include "checksum.h"
 #include "cmd_args_config.h"
 #include "command.h"
+#include "fork.h"
+#include "image.h"
 #include "interpreter.h"
 #include "label_map.h"
+#include "layout.h"
 #include "lexer.h"
 #include "mem.h"
+#include "metrics.h"
 #include "parser.h"
+#include "pipeline.h"
+#include "scan.h"
+#include "scheduler.h"
+#include "segment.h"
 #include "token.h"
+#include "token_buffer.h"
 #include "token_type.h"
+#include "vectorize.h"
+#include "watch.h"
 #include <ctype.h>
 
 #define CAPACITY 50
+#define OUTPUT_BUFFER_SIZE (1 << 16)  // stdout buffer size for structured output.
+
+/**
+ * @brief A program loaded for concurrent execution.
+ */
+typedef struct {
+    char     *src;       // The source text.
+    LabelMap  lbm;       // The program's labels.
+    Command  *commands;  // The parsed program.
+} LoadedProgram;
 
 static int   run_interpreter(CmdArgsConfig *conf);
 static char *run_repl(void);
 static char *read_file(const char *path);
-static int   run_file(const char *src, bool print_lex, bool print_parse);
+static bool  compile(const char *src, bool print_lex, bool print_parse, LabelMap *lbm,
+                     Command **commands);
+static int   run_file(const char *src, CmdArgsConfig *conf);
+static int   run_pipelined(const char *src, CmdArgsConfig *conf);
+static void  run_program(Interpreter *intr, Command *commands, bool stats);
+static void  add_faults(Interpreter *intr, uint64_t minor, uint64_t major);
+static void  run_repeated(Interpreter *intr, Command *commands, int repeat, bool stats);
+static int   compare_doubles(const void *a, const void *b);
+static int   run_concurrent(CmdArgsConfig *conf);
+static int   bundle_file(const char *src, const char *out_path, bool stats);
+static int   run_bundled(const uint8_t *image, size_t size);
+static int   run_watch(CmdArgsConfig *conf);
+static void  run_watch_cycle(ChunkCache *cache, const char *src, CmdArgsConfig *conf);
 
 int main(int argc, char **argv) {
-    CmdArgsConfig conf = {false, false, false, NULL, NULL};
+    CmdArgsConfig conf = {.output_format = OUTPUT_TEXT,
+                          .cpu           = CPU_AUTO,
+                          .memory        = {.capacity = MEM_DEFAULT_CAPACITY}};
     if (!parse_cmd_args(&conf, argv + 1, argc - 1)) {
         printf("Aborting\n");
         config_free(&conf);
         return 1;
     }
+
+    // A bundled executable runs its embedded program; of its arguments only the
+    // memory options apply
+    size_t   image_size;
+    uint8_t *image = bundle_read(&image_size);
+    if (image) {
+        scan_select(CPU_AUTO);
+        checksum_select(CPU_AUTO);
+        mem_configure(&conf.memory);
+        const char *metrics = getenv("CI_METRICS");
+        if (metrics) {
+            metrics_open(metrics);
+        }
+        int status = run_bundled(image, image_size);
+        metrics_close();
+        free(image);
+        config_free(&conf);
+        return status;
+    }
+
+    if (!scan_select(conf.cpu)) {
+        printf("CPU tier %s is not supported on this host.\n", scan_tier_name(conf.cpu));
+        config_free(&conf);
+        return 1;
+    }
+    // Recording is opt-in, either per invocation or for every run in an environment
+    const char *metrics = conf.metrics_file ? conf.metrics_file : getenv("CI_METRICS");
+    if (conf.print_metrics) {
+        int status = -1;
+        if (!metrics) {
+            printf("No metrics segment specified.\n");
+        } else if (metrics_print(metrics, stdout)) {
+            status = 0;
+        }
+        config_free(&conf);
+        return status;
+    }
+    checksum_select(conf.cpu);
+    mem_configure(&conf.memory);
+    fork_configure(conf.fork_workers);
+    segment_configure(conf.segment_workers);
+    if (conf.bundle) {
+        if (conf.out_filename == NULL) {
+            printf("No output executable specified.\n");
+            config_free(&conf);
+            return 1;
+        }
+
+        if (conf.in_count != 1) {
+            printf("Exactly one program can be bundled.\n");
+            config_free(&conf);
+            return 1;
+        }
+
+        char *src    = read_file(conf.in_filenames[0]);
+        int   status = src ? bundle_file(src, conf.out_filename, conf.stats) : -1;
+        free(src);
+        config_free(&conf);
+        return status;
+    }
+
     FILE *file = NULL;
     if (conf.out_filename != NULL) {
         file = freopen(conf.out_filename, "w", stdout);
@@ -34,8 +135,17 @@ int main(int argc, char **argv) {
             return 1;
         }
     }
+    // Structured output is meant for pipes and files, so batch it in large writes
+    if (conf.output_format != OUTPUT_TEXT) {
+        setvbuf(stdout, NULL, _IOFBF, OUTPUT_BUFFER_SIZE);
+    }
 
+    // Runs go unrecorded if the segment cannot be opened, rather than not run at all
+    if (metrics) {
+        metrics_open(metrics);
+    }
     int status = run_interpreter(&conf);
+    metrics_close();
     config_free(&conf);
     if (file) {
         fclose(file);
@@ -53,16 +163,26 @@ static int run_interpreter(CmdArgsConfig *conf) {
             return -1;
         }
     } else {
-        if (conf->in_filename == NULL) {
+        if (conf->in_count == 0) {
             printf("No file specified.\n");
             return -1;
         }
-        src = read_file(conf->in_filename);
+        if (conf->watch) {
+            if (conf->in_count > 1 || conf->workers > 0) {
+                printf("Only a single program can be watched.\n");
+                return -1;
+            }
+            return run_watch(conf);
+        }
+        if (conf->in_count > 1 || conf->workers > 0) {
+            return run_concurrent(conf);
+        }
+        src = read_file(conf->in_filenames[0]);
         if (!src) {
             return -1;
         }
     }
-    status = run_file(src, conf->print_lex, conf->print_parse);
+    status = run_file(src, conf);
     free(src);
     return status;
 }
@@ -151,8 +271,23 @@ static char *read_file(const char *path) {
     return buffer;
 }
 
-static int run_file(const char *src, bool print_lex, bool print_parse) {
-    Lexer l;
+/**
+ * @brief Lexes and parses the source text.
+ *
+ * On failure the parser's diagnostics are printed and everything allocated
+ * here is released again, except for the label map which the caller owns.
+ *
+ * @param src The source text.
+ * @param print_lex Whether to print the lexed tokens first.
+ * @param print_parse Whether to print the parsed commands.
+ * @param lbm An initialized label map that receives the program's labels.
+ * @param commands Set to the first parsed command on success.
+ * @return True if the program parsed without errors, false otherwise.
+ */
+static bool compile(const char *src, bool print_lex, bool print_parse, LabelMap *lbm,
+                    Command **commands) {
+    uint64_t start = metrics_now();
+    Lexer    l;
     lexer_init(&l, src);
     if (print_lex) {
         print_lexed_tokens(&l);
@@ -160,38 +295,466 @@ static int run_file(const char *src, bool print_lex, bool print_parse) {
         lexer_init(&l, src);
     }
 
-    LabelMap lbm;
-    if (!label_map_init(&lbm, 100)) {
-        printf("Unable to allocate label hashmap. Aborting\n");
-        return -1;
+    TokenBuffer tokens;
+    if (!token_buffer_init(&tokens, src) || !lexer_tokenize(&l, &tokens)) {
+        printf("Unable to allocate token buffer. Aborting\n");
+        token_buffer_free(&tokens);
+        metrics_parsed(start, false);
+        return false;
     }
 
-    Parser p;
-    parser_init(&p, &l, &lbm);
-    Command *commands = parse_commands(&p);
+    Parser      p;
+    LayoutHints hints = {0};
+    parser_init(&p, &tokens, lbm);
+    p.hints   = &hints;
+    *commands = parse_commands(&p);
+    if (!p.had_error) {
+        layout_program(*commands, lbm, &hints);
+    }
+    layout_hints_free(&hints);
     if (print_parse) {
-        print_commands(commands);
+        print_commands(*commands);
     }
 
     if (p.had_error) {
         printf("Parser encountered an error:\n");
         printf("At ");
-        print_token(p.current);
+        print_token(parser_current_token(&p));
         printf("\nParsed commands up to this point:\n");
-        print_commands(commands);
-        free_command(commands);
+        print_commands(*commands);
+        free_command(*commands);
+        *commands = NULL;
+        token_buffer_free(&tokens);
+        metrics_parsed(start, false);
+        return false;
+    }
+
+    token_buffer_free(&tokens);
+    metrics_parsed(start, true);
+    return true;
+}
+
+/**
+ * @brief Runs a program, then reruns it every time its file changes until
+ * watching fails. Only the chunks of the program that changed are parsed
+ * again; each cycle reports how many and how long compiling took to stderr.
+ *
+ * @param conf The configuration naming the program.
+ * @return -1 if the file could not be watched or watching failed.
+ */
+static int run_watch(CmdArgsConfig *conf) {
+    const char *path = conf->in_filenames[0];
+    FileWatch   watch;
+    if (!file_watch_init(&watch, path)) {
+        perror("Unable to watch file");
+        return -1;
+    }
+
+    ChunkCache cache;
+    chunk_cache_init(&cache);
+    do {
+        char *src = read_file(path);
+        if (src) {
+            run_watch_cycle(&cache, src, conf);
+            free(src);
+        }
+        fflush(stdout);
+    } while (file_watch_wait(&watch));
+
+    chunk_cache_free(&cache);
+    file_watch_free(&watch);
+    return -1;
+}
+
+/**
+ * @brief Compiles a new version of a watched program incrementally and runs
+ * it.
+ *
+ * @param cache The chunks of the previous version.
+ * @param src The source of the new version.
+ * @param conf The configuration to run with.
+ */
+static void run_watch_cycle(ChunkCache *cache, const char *src, CmdArgsConfig *conf) {
+    struct timespec start, end;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+
+    uint64_t parse_start = metrics_now();
+    size_t   parsed;
+    bool     ok = chunk_cache_update(cache, src, &parsed);
+    metrics_parsed(parse_start, ok);
+
+    // Most chunks start with a label, so size the map by them
+    LabelMap lbm;
+    if (!label_map_init(&lbm, cache->count > 50 ? (int) cache->count * 2 : 100)) {
+        printf("Unable to allocate label hashmap. Aborting\n");
+        return;
+    }
+    Command *commands = chunk_cache_link(cache, &lbm);
+    if (ok && !conf->no_vectorize) {
+        commands = vectorize_loops(commands, &lbm);
+    }
+
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    double ms = (end.tv_sec - start.tv_sec) * 1e3 + (end.tv_nsec - start.tv_nsec) / 1e6;
+    fprintf(stderr, "Compiled %zu of %zu chunks in %.3f ms\n", parsed, cache->count, ms);
+
+    if (ok) {
+        Interpreter i;
+        interpreter_init(&i, &lbm);
+        i.output_format    = conf->output_format;
+        uint64_t run_start = metrics_now();
+        run_program(&i, commands, conf->stats);
+        metrics_ran(&i, run_start, i.had_error);
+        if (conf->stats) {
+            print_run_stats(&i);
+        }
+        interpreter_free(&i);
+        unvectorize_loops(commands);
+    } else {
+        fprintf(stderr, "Waiting for the errors to be fixed\n");
+    }
+
+    chunk_cache_unlink(cache);
+    label_map_free(&lbm);
+}
+
+static int run_file(const char *src, CmdArgsConfig *conf) {
+    if (conf->pipeline && !conf->print_lex && !conf->print_parse && conf->repeat == 0) {
+        return run_pipelined(src, conf);
+    }
+
+    LabelMap lbm;
+    if (!label_map_init(&lbm, 100)) {
+        printf("Unable to allocate label hashmap. Aborting\n");
+        return -1;
+    }
+
+    Command *commands;
+    if (!compile(src, conf->print_lex, conf->print_parse, &lbm, &commands)) {
         label_map_free(&lbm);
         return -1;
     }
+    if (!conf->no_vectorize) {
+        commands = vectorize_loops(commands, &lbm);
+    }
+    fork_calls(commands, &lbm);
+    commands = segment_program(commands);
 
     Interpreter i;
     interpreter_init(&i, &lbm);
-    interpret(&i, commands);
+    i.output_format = conf->output_format;
+    if (conf->repeat > 0) {
+        run_repeated(&i, commands, conf->repeat, conf->stats);
+    } else {
+        uint64_t start = metrics_now();
+        run_program(&i, commands, conf->stats);
+        metrics_ran(&i, start, i.had_error);
+    }
+    if (conf->stats) {
+        print_run_stats(&i);
+    }
     // print_interpreter_state(&i);
-    // mem_print();
+    // mem_print(&i.memory);
 
+    bool had_error = i.had_error;
+    interpreter_free(&i);
+    unfork_calls(commands);
+    commands = unsegment_program(commands);
     free_command(commands);
     label_map_free(&lbm);
 
-    return (i.had_error) ? -1 : 0;
+    return had_error ? -1 : 0;
+}
+
+/**
+ * @brief Runs a program while it is still being lexed and parsed.
+ *
+ * @param src The source of the program.
+ * @param conf The configuration to run it with.
+ * @return 0 if the program parsed and ran without error, -1 otherwise.
+ */
+static int run_pipelined(const char *src, CmdArgsConfig *conf) {
+    LabelMap lbm;
+    if (!label_map_init(&lbm, 100)) {
+        printf("Unable to allocate label hashmap. Aborting\n");
+        return -1;
+    }
+
+    Interpreter i;
+    interpreter_init(&i, &lbm);
+    i.output_format = conf->output_format;
+    // Parsing overlaps the run, so it all counts as run time
+    uint64_t minor = 0, major = 0;
+    if (conf->stats) {
+        mem_thread_faults(&minor, &major);
+    }
+    uint64_t start = metrics_now();
+    Command *commands;
+    bool     parsed = pipeline_run(src, &i, &commands);
+    metrics_ran(&i, start, i.had_error || !parsed);
+    if (conf->stats) {
+        add_faults(&i, minor, major);
+        print_run_stats(&i);
+    }
+
+    bool had_error = i.had_error || !parsed;
+    interpreter_free(&i);
+    free_command(commands);
+    label_map_free(&lbm);
+
+    return had_error ? -1 : 0;
+}
+
+/**
+ * @brief Runs a program from its first command to the end.
+ *
+ * Reading the page fault counters costs a system call, so they are read only
+ * when the statistics are reported, once before and once after the run.
+ *
+ * @param intr Pointer to an initialized `Interpreter`.
+ * @param commands Pointer to the first `Command` of the program.
+ * @param stats Whether to add the page faults of the run to the statistics.
+ */
+static void run_program(Interpreter *intr, Command *commands, bool stats) {
+    uint64_t minor = 0, major = 0;
+    if (stats) {
+        mem_thread_faults(&minor, &major);
+    }
+    interpret(intr, commands);
+    if (stats) {
+        add_faults(intr, minor, major);
+    }
+}
+
+/**
+ * @brief Adds the page faults the calling thread took since `mem_thread_faults`
+ * returned `minor` and `major` to the statistics of an interpreter.
+ */
+static void add_faults(Interpreter *intr, uint64_t minor, uint64_t major) {
+    uint64_t minor_after, major_after;
+    mem_thread_faults(&minor_after, &major_after);
+    intr->stats.minor_faults += minor_after - minor;
+    intr->stats.major_faults += major_after - major;
+}
+
+static int compare_doubles(const void *a, const void *b) {
+    double x = *(const double *) a;
+    double y = *(const double *) b;
+    return (x > y) - (x < y);
+}
+
+/**
+ * @brief Runs an already parsed program `repeat` times on the same
+ * interpreter, resetting it in between, and reports the time of every run on
+ * stderr.
+ *
+ * Stops early if a run fails, leaving the interpreter in its failed state.
+ *
+ * @param intr Pointer to an initialized `Interpreter`.
+ * @param commands Pointer to the first `Command` of the program.
+ * @param repeat The number of runs.
+ * @param stats Whether to add the page faults of each run to its statistics.
+ */
+static void run_repeated(Interpreter *intr, Command *commands, int repeat, bool stats) {
+    double *times = calloc((size_t) repeat, sizeof(double));
+    int     runs  = 0;
+
+    for (; runs < repeat; runs++) {
+        if (runs > 0) {
+            interpreter_reset(intr);
+        }
+
+        struct timespec start, end;
+        uint64_t        run_start = metrics_now();
+        clock_gettime(CLOCK_MONOTONIC, &start);
+        run_program(intr, commands, stats);
+        clock_gettime(CLOCK_MONOTONIC, &end);
+        metrics_ran(intr, run_start, intr->had_error);
+
+        double ms = (end.tv_sec - start.tv_sec) * 1e3 + (end.tv_nsec - start.tv_nsec) / 1e6;
+        fprintf(stderr, "Run %d: %.3f ms\n", runs + 1, ms);
+        if (times) {
+            times[runs] = ms;
+        }
+        if (intr->had_error) {
+            runs++;
+            break;
+        }
+    }
+
+    if (times && runs > 0) {
+        double total = 0;
+        for (int r = 0; r < runs; r++) {
+            total += times[r];
+        }
+        qsort(times, (size_t) runs, sizeof(double), compare_doubles);
+        fprintf(stderr, "%d runs: min %.3f ms, median %.3f ms, mean %.3f ms\n", runs, times[0],
+                times[runs / 2], total / runs);
+    }
+    free(times);
+}
+
+/**
+ * @brief Runs every input file as its own guest on the green-thread
+ * scheduler.
+ *
+ * All programs are parsed up front; if any of them fails to parse, none is
+ * run.
+ *
+ * @param conf The parsed command line.
+ * @return 0 if every program ran without errors, -1 otherwise.
+ */
+static int run_concurrent(CmdArgsConfig *conf) {
+    size_t         count     = (size_t) conf->in_count;
+    LoadedProgram *programs  = calloc(count, sizeof(LoadedProgram));
+    Interpreter   *instances = calloc(count, sizeof(Interpreter));
+    size_t         loaded    = 0;
+    int            status    = 0;
+
+    if (!programs || !instances) {
+        printf("Unable to allocate interpreters. Aborting\n");
+        status = -1;
+    }
+
+    for (; status == 0 && loaded < count; loaded++) {
+        LoadedProgram *prog = &programs[loaded];
+        prog->src           = read_file(conf->in_filenames[loaded]);
+        if (!prog->src) {
+            status = -1;
+            break;
+        }
+        if (!label_map_init(&prog->lbm, 100)) {
+            printf("Unable to allocate label hashmap. Aborting\n");
+            free(prog->src);
+            status = -1;
+            break;
+        }
+        if (!compile(prog->src, conf->print_lex, conf->print_parse, &prog->lbm,
+                     &prog->commands)) {
+            label_map_free(&prog->lbm);
+            free(prog->src);
+            status = -1;
+            break;
+        }
+        if (!conf->no_vectorize) {
+            prog->commands = vectorize_loops(prog->commands, &prog->lbm);
+        }
+
+        interpreter_init(&instances[loaded], &prog->lbm);
+        instances[loaded].output_format = conf->output_format;
+        interpreter_start(&instances[loaded], prog->commands);
+    }
+
+    if (status == 0) {
+        long     cpus    = sysconf(_SC_NPROCESSORS_ONLN);
+        int      workers = conf->workers ? conf->workers : (cpus > 0 ? (int) cpus : 1);
+        uint64_t quantum = conf->quantum ? conf->quantum : DEFAULT_QUANTUM;
+        uint64_t start   = metrics_now();
+        if (!scheduler_run(instances, count, workers, quantum)) {
+            printf("Unable to start the scheduler. Aborting\n");
+            status = -1;
+        }
+        for (size_t i = 0; i < count; i++) {
+            // The programs share the workers, so each is charged the time they all took
+            metrics_ran(&instances[i], start, instances[i].had_error);
+            if (instances[i].had_error) {
+                status = -1;
+            }
+            if (conf->stats) {
+                fprintf(stderr, "%s:\n", conf->in_filenames[i]);
+                print_run_stats(&instances[i]);
+            }
+        }
+    }
+
+    for (size_t i = 0; i < loaded; i++) {
+        interpreter_free(&instances[i]);
+        free_command(programs[i].commands);
+        label_map_free(&programs[i].lbm);
+        free(programs[i].src);
+    }
+    free(programs);
+    free(instances);
+    return status;
+}
+
+/**
+ * @brief Parses the source text once and writes it, together with this
+ * interpreter, to a self-contained executable.
+ *
+ * @param src The source text.
+ * @param out_path The path of the executable to write.
+ * @param stats Whether to print the size of the program image to stderr.
+ * @return 0 on success, -1 otherwise.
+ */
+static int bundle_file(const char *src, const char *out_path, bool stats) {
+    LabelMap lbm;
+    if (!label_map_init(&lbm, 100)) {
+        printf("Unable to allocate label hashmap. Aborting\n");
+        return -1;
+    }
+
+    Command *commands;
+    if (!compile(src, false, false, &lbm, &commands)) {
+        label_map_free(&lbm);
+        return -1;
+    }
+
+    uint8_t *image = NULL;
+    size_t   size  = 0;
+    bool     ok    = image_serialize(commands, &lbm, &image, &size);
+    if (!ok) {
+        printf("Unable to allocate program image. Aborting\n");
+    } else if (stats) {
+        image_print_stats(image, size);
+    }
+    ok = ok && bundle_write(out_path, image, size);
+
+    free(image);
+    free_command(commands);
+    label_map_free(&lbm);
+    return ok ? 0 : -1;
+}
+
+/**
+ * @brief Runs the program image embedded in a bundled executable.
+ *
+ * @param image The serialized program image.
+ * @param size The size of the image in bytes.
+ * @return 0 on success, -1 otherwise.
+ */
+static int run_bundled(const uint8_t *image, size_t size) {
+    LabelMap lbm;
+    if (!label_map_init(&lbm, 100)) {
+        printf("Unable to allocate label hashmap. Aborting\n");
+        return -1;
+    }
+
+    ProgramImage program;
+    if (!image_load(&program, image, size, &lbm)) {
+        printf("Embedded program image is corrupt. Aborting\n");
+        label_map_free(&lbm);
+        return -1;
+    }
+
+    // The image holds the program as written; vectorize the loaded copy
+    Command *commands = vectorize_loops(program.commands, &lbm);
+    fork_calls(commands, &lbm);
+    commands = segment_program(commands);
+
+    Interpreter i;
+    interpreter_init(&i, &lbm);
+    uint64_t start = metrics_now();
+    interpret(&i, commands);
+    metrics_ran(&i, start, i.had_error);
+
+    bool had_error = i.had_error;
+    interpreter_free(&i);
+    unfork_calls(commands);
+    commands = unsegment_program(commands);
+    unvectorize_loops(commands);
+    image_free(&program);
+    label_map_free(&lbm);
+
+    return had_error ? -1 : 0;
 }
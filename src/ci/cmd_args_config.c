@@ -1,17 +1,216 @@
+#define _GNU_SOURCE
 #include "cmd_args_config.h"
+#include <errno.h>
 #include <stdlib.h>
 #include <stdio.h>
 #include <string.h>
 
+static bool add_in_filename(CmdArgsConfig *conf, const char *filename);
+static bool parse_count(const char *arg, unsigned long long max, unsigned long long *count);
+static bool parse_output_format(const char *arg, OutputFormat *format);
+static bool parse_cpu_tier(const char *arg, CpuTier *tier);
+static bool parse_size(const char *arg, size_t *size);
+static bool parse_huge_pages(const char *arg, HugePages *huge_pages);
+static bool parse_shared_region(const char *arg, SharedRegion *region);
+
 void config_free(CmdArgsConfig *conf) {
     if (!conf) {
         return;
     }
 
-    free(conf->in_filename);
+    for (int i = 0; i < conf->in_count; i++) {
+        free(conf->in_filenames[i]);
+    }
+    free(conf->in_filenames);
     free(conf->out_filename);
-    conf->in_filename  = NULL;
-    conf->out_filename = NULL;
+    free((char *) conf->memory.shared.name);
+    free(conf->metrics_file);
+    conf->in_filenames       = NULL;
+    conf->in_count           = 0;
+    conf->out_filename       = NULL;
+    conf->memory.shared.name = NULL;
+    conf->metrics_file       = NULL;
+}
+
+/**
+ * @brief Appends a copy of the given filename to the input files.
+ *
+ * @param conf The config to add the file to.
+ * @param filename The filename to copy.
+ * @return True if the filename was added, false if memory ran out.
+ */
+static bool add_in_filename(CmdArgsConfig *conf, const char *filename) {
+    char **filenames = realloc(conf->in_filenames, (conf->in_count + 1) * sizeof(char *));
+    if (!filenames) {
+        printf("Failed to allocate space for filename\n");
+        return false;
+    }
+    conf->in_filenames = filenames;
+
+    conf->in_filenames[conf->in_count] = calloc(strlen(filename) + 1, sizeof(char));
+    if (!conf->in_filenames[conf->in_count]) {
+        printf("Failed to allocate space for filename\n");
+        return false;
+    }
+
+    strcpy(conf->in_filenames[conf->in_count], filename);
+    conf->in_count++;
+    return true;
+}
+
+/**
+ * @brief Parses a positive decimal count.
+ *
+ * @param arg The argument to parse.
+ * @param max The largest accepted value.
+ * @param count Set to the parsed value on success.
+ * @return True if `arg` is a number between 1 and `max`, false otherwise.
+ */
+static bool parse_count(const char *arg, unsigned long long max, unsigned long long *count) {
+    char *end;
+    errno                    = 0;
+    unsigned long long value = strtoull(arg, &end, 10);
+    if (errno != 0 || end == arg || *end != '\0' || arg[0] == '-' || value == 0 || value > max) {
+        printf("Invalid count: %s\n", arg);
+        return false;
+    }
+
+    *count = value;
+    return true;
+}
+
+/**
+ * @brief Parses the name of an output format.
+ *
+ * @param arg The argument to parse: `text`, `binary` or `csv`.
+ * @param format Set to the parsed format on success.
+ * @return True if `arg` names a format, false otherwise.
+ */
+static bool parse_output_format(const char *arg, OutputFormat *format) {
+    if (strcmp(arg, "text") == 0) {
+        *format = OUTPUT_TEXT;
+    } else if (strcmp(arg, "binary") == 0) {
+        *format = OUTPUT_BINARY;
+    } else if (strcmp(arg, "csv") == 0) {
+        *format = OUTPUT_CSV;
+    } else {
+        printf("Invalid output format: %s\n", arg);
+        return false;
+    }
+    return true;
+}
+
+/**
+ * @brief Parses the name of a CPU tier.
+ *
+ * @param arg The argument to parse: `auto`, `scalar`, `sse2` or `avx2`.
+ * @param tier Set to the parsed tier on success.
+ * @return True if `arg` names a tier, false otherwise.
+ */
+static bool parse_cpu_tier(const char *arg, CpuTier *tier) {
+    for (CpuTier t = CPU_AUTO; t <= CPU_AVX2; t++) {
+        if (strcmp(arg, scan_tier_name(t)) == 0) {
+            *tier = t;
+            return true;
+        }
+    }
+    printf("Invalid CPU tier: %s\n", arg);
+    return false;
+}
+
+/**
+ * @brief Parses a positive size in bytes, optionally followed by a `K`, `M` or
+ * `G` suffix.
+ *
+ * @param arg The argument to parse.
+ * @param size Set to the parsed size on success.
+ * @return True if `arg` is a valid size, false otherwise.
+ */
+static bool parse_size(const char *arg, size_t *size) {
+    char *end;
+    errno                    = 0;
+    unsigned long long value = strtoull(arg, &end, 10);
+    int                shift = 0;
+    if (*end == 'K' || *end == 'M' || *end == 'G') {
+        shift = *end == 'K' ? 10 : *end == 'M' ? 20 : 30;
+        end++;
+    }
+    if (errno != 0 || end == arg || *end != '\0' || arg[0] == '-' || value == 0 ||
+        value > (SIZE_MAX >> shift)) {
+        printf("Invalid size: %s\n", arg);
+        return false;
+    }
+
+    *size = (size_t) value << shift;
+    return true;
+}
+
+/**
+ * @brief Parses the kind of pages to back guest memory with.
+ *
+ * @param arg The argument to parse: `off`, `thp` or `explicit`.
+ * @param huge_pages Set to the parsed kind on success.
+ * @return True if `arg` names a kind, false otherwise.
+ */
+static bool parse_huge_pages(const char *arg, HugePages *huge_pages) {
+    if (strcmp(arg, "off") == 0) {
+        *huge_pages = HUGE_PAGES_OFF;
+    } else if (strcmp(arg, "thp") == 0) {
+        *huge_pages = HUGE_PAGES_TRANSPARENT;
+    } else if (strcmp(arg, "explicit") == 0) {
+        *huge_pages = HUGE_PAGES_EXPLICIT;
+    } else {
+        printf("Invalid huge page mode: %s\n", arg);
+        return false;
+    }
+    return true;
+}
+
+/**
+ * @brief Parses a shared-memory region given as `name@address:length`.
+ *
+ * The address may be decimal or hexadecimal with a `0x` prefix; the length is
+ * a size as `parse_size` takes it. Alignment is checked once memory is
+ * allocated. Only aligned single loads and stores of up to 8 bytes are atomic
+ * in the region; see `SharedRegion`.
+ *
+ * @param arg The argument to parse.
+ * @param region Set to the parsed region on success; its name is a copy that
+ * `config_free` frees.
+ * @return True if `arg` is a valid region, false otherwise.
+ */
+static bool parse_shared_region(const char *arg, SharedRegion *region) {
+    const char *at    = strrchr(arg, '@');
+    const char *colon = at ? strchr(at, ':') : NULL;
+    if (!colon || at == arg) {
+        printf("Invalid shared memory region: %s\n", arg);
+        return false;
+    }
+
+    char *end;
+    errno                      = 0;
+    unsigned long long address = strtoull(at + 1, &end, 0);
+    if (errno != 0 || end == at + 1 || end != colon || at[1] == '-' || address > SIZE_MAX) {
+        printf("Invalid shared memory address: %s\n", arg);
+        return false;
+    }
+
+    size_t length;
+    if (!parse_size(colon + 1, &length)) {
+        return false;
+    }
+
+    char *name = strndup(arg, (size_t) (at - arg));
+    if (!name) {
+        printf("Failed to allocate space for shared memory name\n");
+        return false;
+    }
+
+    free((char *) region->name);
+    region->name    = name;
+    region->address = (size_t) address;
+    region->length  = length;
+    return true;
 }
 
 bool parse_cmd_args(CmdArgsConfig *conf, char **args, int arg_count) {
@@ -24,7 +223,131 @@ bool parse_cmd_args(CmdArgsConfig *conf, char **args, int arg_count) {
     }
 
     for (int i = 0; i < arg_count; i++) {
-        if (strncmp(args[i], "-l", 2) == 0) {
+        if (strcmp(args[i], "--bundle") == 0) {
+            conf->bundle = true;
+            i++;
+            if (i >= arg_count) {
+                printf("Filename not specified\n");
+                return false;
+            }
+
+            if (!add_in_filename(conf, args[i])) {
+                return false;
+            }
+        } else if (strcmp(args[i], "--stats") == 0) {
+            conf->stats = true;
+        } else if (strcmp(args[i], "--watch") == 0) {
+            conf->watch = true;
+        } else if (strcmp(args[i], "--no-vectorize") == 0) {
+            conf->no_vectorize = true;
+        } else if (strncmp(args[i], "--output-format=", 16) == 0) {
+            if (!parse_output_format(args[i] + 16, &conf->output_format)) {
+                return false;
+            }
+        } else if (strncmp(args[i], "--cpu=", 6) == 0) {
+            if (!parse_cpu_tier(args[i] + 6, &conf->cpu)) {
+                return false;
+            }
+        } else if (strncmp(args[i], "--mem-size=", 11) == 0) {
+            if (!parse_size(args[i] + 11, &conf->memory.capacity)) {
+                return false;
+            }
+        } else if (strncmp(args[i], "--huge-pages=", 13) == 0) {
+            if (!parse_huge_pages(args[i] + 13, &conf->memory.huge_pages)) {
+                return false;
+            }
+        } else if (strcmp(args[i], "--prefault") == 0) {
+            conf->memory.prefault = true;
+        } else if (strcmp(args[i], "--numa-bind") == 0) {
+            conf->memory.numa_bind = true;
+        } else if (strcmp(args[i], "--shm") == 0) {
+            i++;
+            if (i >= arg_count) {
+                printf("Shared memory region not specified\n");
+                return false;
+            }
+
+            if (!parse_shared_region(args[i], &conf->memory.shared)) {
+                return false;
+            }
+        } else if (strcmp(args[i], "--metrics") == 0) {
+            conf->print_metrics = true;
+        } else if (strcmp(args[i], "--metrics-file") == 0) {
+            i++;
+            if (i >= arg_count) {
+                printf("Metrics segment not specified\n");
+                return false;
+            }
+
+            free(conf->metrics_file);
+            conf->metrics_file = strdup(args[i]);
+            if (!conf->metrics_file) {
+                printf("Failed to allocate space for metrics segment name\n");
+                return false;
+            }
+        } else if (strcmp(args[i], "--pipeline") == 0) {
+            conf->pipeline = true;
+        } else if (strcmp(args[i], "--segment-workers") == 0) {
+            i++;
+            if (i >= arg_count) {
+                printf("Segment worker count not specified\n");
+                return false;
+            }
+
+            unsigned long long workers;
+            if (!parse_count(args[i], 1024, &workers)) {
+                return false;
+            }
+            conf->segment_workers = (int) workers;
+        } else if (strcmp(args[i], "--fork-workers") == 0) {
+            i++;
+            if (i >= arg_count) {
+                printf("Fork worker count not specified\n");
+                return false;
+            }
+
+            unsigned long long workers;
+            if (!parse_count(args[i], 1024, &workers)) {
+                return false;
+            }
+            conf->fork_workers = (int) workers;
+        } else if (strcmp(args[i], "--repeat") == 0) {
+            i++;
+            if (i >= arg_count) {
+                printf("Repeat count not specified\n");
+                return false;
+            }
+
+            unsigned long long repeat;
+            if (!parse_count(args[i], INT32_MAX, &repeat)) {
+                return false;
+            }
+            conf->repeat = (int) repeat;
+        } else if (strcmp(args[i], "--quantum") == 0) {
+            i++;
+            if (i >= arg_count) {
+                printf("Quantum not specified\n");
+                return false;
+            }
+
+            unsigned long long quantum;
+            if (!parse_count(args[i], UINT64_MAX, &quantum)) {
+                return false;
+            }
+            conf->quantum = (uint64_t) quantum;
+        } else if (strncmp(args[i], "-j", 2) == 0) {
+            i++;
+            if (i >= arg_count) {
+                printf("Worker count not specified\n");
+                return false;
+            }
+
+            unsigned long long workers;
+            if (!parse_count(args[i], 1024, &workers)) {
+                return false;
+            }
+            conf->workers = (int) workers;
+        } else if (strncmp(args[i], "-l", 2) == 0) {
             conf->print_lex = true;
         } else if (strncmp(args[i], "-p", 2) == 0) {
             conf->print_parse = true;
@@ -35,13 +358,9 @@ bool parse_cmd_args(CmdArgsConfig *conf, char **args, int arg_count) {
                 return false;
             }
 
-            conf->in_filename = calloc(strlen(args[i]) + 1, sizeof(char));
-            if (!conf->in_filename) {
-                printf("Failed to allocate space for filename\n");
+            if (!add_in_filename(conf, args[i])) {
                 return false;
             }
-
-            strcpy(conf->in_filename, args[i]);
         } else if (strncmp(args[i], "-o", 2) == 0) {
             i++;
             if (i >= arg_count) {
@@ -1,8 +1,28 @@
 #include "command.h"
 #include <inttypes.h>
+#include <pthread.h>
 #include <stdio.h>
 #include <stdlib.h>
 
+/**
+ * @brief The source line of one command.
+ */
+typedef struct {
+    const Command *command;  // The command, NULL for an empty slot.
+    uint32_t       line;     // Its source line.
+} LineSlot;
+
+static size_t   line_home(const Command *command);
+static size_t   line_slot_of(const Command *command);
+static void     line_remove(size_t slot);
+static bool     line_grow(void);
+static uint64_t operand_bit(Operand op, bool is_immediate);
+
+static pthread_mutex_t line_lock       = PTHREAD_MUTEX_INITIALIZER;  // Guards the line table.
+static LineSlot       *line_slots      = NULL;  // Open addressed by command, see `line_slot_of`.
+static size_t          line_slot_count = 0;     // The number of slots, 0 or a power of two.
+static size_t          line_count      = 0;     // The number of slots in use.
+
 void free_command(Command *command) {
     while (command) {
         Command *next = command->next;
@@ -13,12 +33,178 @@ void free_command(Command *command) {
         if (command->is_b_string && command->val_b.str_val) {
             free(command->val_b.str_val);
         }
+        switch (command->type) {
+            case CMD_VLOOP:
+                free(command->vector);
+                break;
+            case CMD_CALL:
+                free(command->fork);
+                break;
+            case CMD_SEGMENTS:
+                free(command->segments);
+                break;
+            default:
+                break;
+        }
+        command_set_line(command, 0);
 
         free(command);
         command = next;
     }
 }
 
+/**
+ * @brief Returns the slot the search for a command starts at. The table must
+ * have slots.
+ */
+static size_t line_home(const Command *command) {
+    return (size_t) (((uintptr_t) command >> 4) * 0x9e3779b97f4a7c15ULL) & (line_slot_count - 1);
+}
+
+/**
+ * @brief Returns the slot holding the line of a command, or the empty slot
+ * where it would go. The table must have slots and the lock must be held.
+ */
+static size_t line_slot_of(const Command *command) {
+    size_t mask = line_slot_count - 1;
+    size_t slot = line_home(command);
+    while (line_slots[slot].command && line_slots[slot].command != command) {
+        slot = (slot + 1) & mask;
+    }
+    return slot;
+}
+
+/**
+ * @brief Empties a slot, moving back the entries that probed past it so every
+ * entry stays reachable from its home slot. The lock must be held.
+ */
+static void line_remove(size_t slot) {
+    size_t mask = line_slot_count - 1;
+    size_t hole = slot;
+    for (size_t next = (slot + 1) & mask; line_slots[next].command; next = (next + 1) & mask) {
+        size_t home = line_home(line_slots[next].command);
+        // Move the entry unless its home lies cyclically after the hole
+        if (((next - home) & mask) >= ((next - hole) & mask)) {
+            line_slots[hole] = line_slots[next];
+            hole             = next;
+        }
+    }
+    line_slots[hole] = (LineSlot) {NULL, 0};
+    line_count--;
+}
+
+/**
+ * @brief Doubles the number of slots, rehashing every entry. The lock must be
+ * held.
+ *
+ * @return True on success, false if allocating failed.
+ */
+static bool line_grow(void) {
+    size_t    old_count = line_slot_count;
+    LineSlot *old_slots = line_slots;
+    size_t    new_count = old_count ? old_count * 2 : 256;
+    LineSlot *new_slots = calloc(new_count, sizeof(LineSlot));
+    if (!new_slots) {
+        return false;
+    }
+
+    line_slots      = new_slots;
+    line_slot_count = new_count;
+    for (size_t i = 0; i < old_count; i++) {
+        if (old_slots[i].command) {
+            line_slots[line_slot_of(old_slots[i].command)] = old_slots[i];
+        }
+    }
+    free(old_slots);
+    return true;
+}
+
+void command_set_line(const Command *command, uint32_t line) {
+    pthread_mutex_lock(&line_lock);
+    if (line == 0) {
+        if (line_count > 0) {
+            size_t slot = line_slot_of(command);
+            if (line_slots[slot].command) {
+                line_remove(slot);
+            }
+        }
+    } else if ((line_count + 1) * 2 <= line_slot_count || line_grow()) {
+        size_t slot = line_slot_of(command);
+        if (!line_slots[slot].command) {
+            line_slots[slot].command = command;
+            line_count++;
+        }
+        line_slots[slot].line = line;
+    }
+    pthread_mutex_unlock(&line_lock);
+}
+
+uint32_t command_line(const Command *command) {
+    uint32_t line = 0;
+    pthread_mutex_lock(&line_lock);
+    if (line_count > 0) {
+        line = line_slots[line_slot_of(command)].line;
+    }
+    pthread_mutex_unlock(&line_lock);
+    return line;
+}
+
+/**
+ * @brief Returns the mask bit of the register an operand names, or 0 for an
+ * immediate.
+ */
+static uint64_t operand_bit(Operand op, bool is_immediate) {
+    return is_immediate ? 0 : 1ULL << op.base;
+}
+
+bool command_registers(const Command *cmd, uint64_t *uses, uint64_t *defs) {
+    switch (cmd->type) {
+        case CMD_ADD:
+        case CMD_SUB:
+        case CMD_AND:
+        case CMD_ORR:
+        case CMD_EOR:
+        case CMD_ADD_W:
+        case CMD_SUB_W:
+        case CMD_AND_W:
+        case CMD_ORR_W:
+        case CMD_EOR_W:
+            *uses = operand_bit(cmd->val_a, cmd->is_a_immediate) |
+                    operand_bit(cmd->val_b, cmd->is_b_immediate);
+            *defs = operand_bit(cmd->destination, false);
+            return true;
+        case CMD_MOV:
+        case CMD_LSL:
+        case CMD_LSR:
+        case CMD_ASR:
+        case CMD_MOV_W:
+        case CMD_LSL_W:
+        case CMD_LSR_W:
+        case CMD_ASR_W:
+        case CMD_UBFX:
+        case CMD_SBFX:
+        case CMD_ROR:
+            *uses = operand_bit(cmd->val_a, cmd->is_a_immediate);
+            *defs = operand_bit(cmd->destination, false);
+            return true;
+        case CMD_BFI:
+        case CMD_BFXIL:
+            *uses = operand_bit(cmd->val_a, false) | operand_bit(cmd->destination, false);
+            *defs = operand_bit(cmd->destination, false);
+            return true;
+        case CMD_CMP:
+        case CMD_CMP_U:
+        case CMD_CMP_W:
+        case CMD_CMP_U_W:
+            *uses = operand_bit(cmd->val_a, cmd->is_a_immediate) |
+                    operand_bit(cmd->val_b, cmd->is_b_immediate);
+            *defs = FLAGS_MASK;
+            return true;
+        default:
+            return false;
+    }
+}
+
 void print_command(Command *cmd) {
     printf("Command type: %u\n", cmd->type);
     printf("Destination: %" PRId64 "\n", cmd->destination.num_val);
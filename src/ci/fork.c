@@ -0,0 +1,409 @@
+#include "fork.h"
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdlib.h>
+#include <string.h>
+#include "command_type.h"
+#include "worker_pool.h"
+
+#define TASK_QUANTUM 100000  // Commands a task runs between cancellation checks.
+#define EXTRA_DEPTH  3       // Fork levels beyond one per worker, for balance.
+
+/**
+ * @brief How far a task has come.
+ */
+typedef enum {
+    TASK_QUEUED,   // Waiting in the pool; whoever claims it first runs it.
+    TASK_RUNNING,  // Claimed by a worker or by the joining thread.
+    TASK_DONE,     // Finished, or cancelled before it ran.
+} TaskState;
+
+struct fork_task {
+    const ForkSite *site;    // The site that spawned the task.
+    atomic_int      state;   // A `TaskState`.
+    atomic_int      refs;    // Held by the pool's queue and by the spawning interpreter.
+    atomic_bool     cancel;  // Set when the result is no longer needed.
+    pthread_mutex_t lock;    // Guards waiting on `done`.
+    pthread_cond_t  done;    // Signalled when the task ends, for the interpreter joining it.
+    Interpreter     intr;    // Runs the second callee.
+};
+
+/**
+ * @brief What the analysis knows about running the program from one command
+ * until the function it belongs to returns.
+ */
+typedef struct {
+    Command *cmd;     // The command.
+    uint64_t live;    // Registers and flags that may be read before they are written.
+    bool     impure;  // Whether anything but registers and flags may be touched.
+} CommandInfo;
+
+/**
+ * @brief Every command of a program, with a hash from command to its entry.
+ */
+typedef struct {
+    CommandInfo *infos;       // One entry per command, in program order.
+    size_t       count;       // The number of commands.
+    size_t      *slots;       // Indices into `infos` plus one, 0 for an empty slot.
+    size_t       slot_count;  // The number of slots, a power of two.
+} Analysis;
+
+static bool         analysis_init(Analysis *a, Command *commands);
+static void         analysis_free(Analysis *a);
+static size_t       slot_of(const Analysis *a, const Command *cmd);
+static CommandInfo *info_of(const Analysis *a, const Command *cmd);
+static Command     *resolve(LabelMap *map, const Command *cmd);
+static bool         update(Analysis *a, CommandInfo *info, LabelMap *map);
+static ForkSite    *plan_site(const Analysis *a, Command *first, LabelMap *map);
+static bool         claim(ForkTask *task);
+static void         execute(ForkTask *task);
+static void         wait_for(ForkTask *task);
+static void         release(ForkTask *task);
+static bool         run_task(void *arg);
+
+static int        configured_workers = 0;      // Set by `fork_configure`.
+static size_t     max_depth          = 0;      // Tasks allowed on one call path.
+static WorkerPool pool;                        // Runs the tasks once started.
+static bool       pool_running       = false;  // Whether `pool` is started.
+
+static bool analysis_init(Analysis *a, Command *commands) {
+    a->count = 0;
+    for (Command *cmd = commands; cmd; cmd = cmd->next) {
+        a->count++;
+    }
+
+    a->slot_count = 16;
+    while (a->slot_count < a->count * 2) {
+        a->slot_count *= 2;
+    }
+    a->infos = calloc(a->count ? a->count : 1, sizeof(CommandInfo));
+    a->slots = calloc(a->slot_count, sizeof(size_t));
+    if (!a->infos || !a->slots) {
+        analysis_free(a);
+        return false;
+    }
+
+    size_t i = 0;
+    for (Command *cmd = commands; cmd; cmd = cmd->next, i++) {
+        a->infos[i].cmd           = cmd;
+        a->slots[slot_of(a, cmd)] = i + 1;
+    }
+    return true;
+}
+
+static void analysis_free(Analysis *a) {
+    free(a->infos);
+    free(a->slots);
+    a->infos = NULL;
+    a->slots = NULL;
+}
+
+/**
+ * @brief Returns the slot holding a command, or the empty slot where it would
+ * go.
+ */
+static size_t slot_of(const Analysis *a, const Command *cmd) {
+    size_t mask = a->slot_count - 1;
+    size_t slot = (size_t) (((uintptr_t) cmd >> 4) * 0x9e3779b97f4a7c15ULL) & mask;
+    while (a->slots[slot] && a->infos[a->slots[slot] - 1].cmd != cmd) {
+        slot = (slot + 1) & mask;
+    }
+    return slot;
+}
+
+static CommandInfo *info_of(const Analysis *a, const Command *cmd) {
+    size_t index = a->slots[slot_of(a, cmd)];
+    return index ? &a->infos[index - 1] : NULL;
+}
+
+/**
+ * @brief Returns the command a branch or call jumps to, or NULL if its label
+ * is unknown or ends the program.
+ */
+static Command *resolve(LabelMap *map, const Command *cmd) {
+    Entry *label = get_label(map, cmd->val_a.str_val);
+    return label ? label->command : NULL;
+}
+
+/**
+ * @brief Recomputes what is known about a command from what is known about
+ * the commands that may run after it.
+ *
+ * A call reads what its callee reads, and afterwards everything the caller
+ * had but x0 and the flags is restored. A return hands x0 and the flags back.
+ *
+ * @return True if anything changed.
+ */
+static bool update(Analysis *a, CommandInfo *info, LabelMap *map) {
+    const Command *cmd    = info->cmd;
+    uint64_t       live   = 0;
+    bool           impure = false;
+
+    const CommandInfo *next   = cmd->next ? info_of(a, cmd->next) : NULL;
+    const CommandInfo *target = NULL;
+    if (cmd->type == CMD_BRANCH || cmd->type == CMD_CALL) {
+        Command *jump = resolve(map, cmd);
+        target        = jump ? info_of(a, jump) : NULL;
+    }
+
+    uint64_t uses, defs;
+    if (command_registers(cmd, &uses, &defs)) {
+        impure = !next || next->impure;
+        live   = uses | (next ? next->live & ~defs : 0);
+    } else if (cmd->type == CMD_BRANCH && cmd->branch_condition == BRANCH_ALWAYS) {
+        impure = !target || target->impure;
+        live   = target ? target->live : 0;
+    } else if (cmd->type == CMD_BRANCH) {
+        impure = !target || target->impure || !next || next->impure;
+        live   = FLAGS_MASK | (target ? target->live : 0) | (next ? next->live : 0);
+    } else if (cmd->type == CMD_CALL) {
+        impure = !target || target->impure || !next || next->impure;
+        live   = (target ? target->live : 0) | (next ? next->live & ~(1ULL | FLAGS_MASK) : 0);
+    } else if (cmd->type == CMD_RET) {
+        live = 1ULL | FLAGS_MASK;
+    } else {
+        impure = true;
+    }
+
+    live |= info->live;
+    impure |= info->impure;
+    bool changed = live != info->live || impure != info->impure;
+    info->live   = live;
+    info->impure = impure;
+    return changed;
+}
+
+/**
+ * @brief Checks whether the call after `first` can run while `first` does.
+ *
+ * @return The plan of the pair, or NULL if there is no such call, it is not
+ * safe to fork or memory ran out.
+ */
+static ForkSite *plan_site(const Analysis *a, Command *first, LabelMap *map) {
+    // Registers that may hold the first call's x0, which the task cannot know
+    uint64_t tainted = 1ULL;
+    Command *second  = first->next;
+    uint64_t uses, defs;
+    while (second && command_registers(second, &uses, &defs)) {
+        tainted = (uses & tainted) ? tainted | defs : tainted & ~defs;
+        second  = second->next;
+    }
+    if (!second || second->type != CMD_CALL) {
+        return NULL;
+    }
+
+    Command     *entry = resolve(map, second);
+    CommandInfo *info  = entry ? info_of(a, entry) : NULL;
+    if (!info || info->impure || (info->live & (tainted | FLAGS_MASK))) {
+        return NULL;
+    }
+
+    // The task runs its own copies of the commands in between, ending before the call
+    size_t length = 0;
+    for (Command *cmd = first->next; cmd != second; cmd = cmd->next) {
+        length++;
+    }
+    ForkSite *site = malloc(sizeof(ForkSite) + length * sizeof(Command));
+    if (site) {
+        Command *copies = (Command *) (site + 1);
+        Command *cmd    = first->next;
+        for (size_t k = 0; k < length; k++, cmd = cmd->next) {
+            copies[k]      = *cmd;
+            copies[k].next = k + 1 < length ? &copies[k + 1] : NULL;
+        }
+        site->between = length ? copies : NULL;
+        site->second  = second;
+        site->entry   = entry;
+    }
+    return site;
+}
+
+void fork_configure(int workers) {
+    configured_workers = workers;
+    max_depth          = EXTRA_DEPTH;
+    for (int w = workers; w > 0; w >>= 1) {
+        max_depth++;
+    }
+}
+
+void fork_calls(Command *commands, LabelMap *map) {
+    Analysis a;
+    if (configured_workers <= 0 || !analysis_init(&a, commands)) {
+        return;
+    }
+
+    // Backwards, as most information flows from later commands to earlier ones
+    bool changed = true;
+    while (changed) {
+        changed = false;
+        for (size_t i = a.count; i-- > 0;) {
+            changed |= update(&a, &a.infos[i], map);
+        }
+    }
+
+    bool found = false;
+    for (size_t i = 0; i < a.count; i++) {
+        Command *cmd = a.infos[i].cmd;
+        if (cmd->type == CMD_CALL) {
+            cmd->fork = plan_site(&a, cmd, map);
+            found |= cmd->fork != NULL;
+        }
+    }
+    analysis_free(&a);
+
+    if (found && !pool_running) {
+        pool_running = pool_init(&pool, configured_workers);
+    }
+}
+
+void unfork_calls(Command *commands) {
+    for (Command *cmd = commands; cmd; cmd = cmd->next) {
+        if (cmd->type == CMD_CALL) {
+            free(cmd->fork);
+            cmd->fork = NULL;
+        }
+    }
+    if (pool_running) {
+        // Cancelled tasks still sit in the queues until a worker drops them
+        pool_wait(&pool);
+        pool_free(&pool);
+        pool_running = false;
+    }
+}
+
+ForkTask *fork_spawn(const ForkSite *site, Interpreter *intr) {
+    if (!pool_running || intr->fork_depth >= max_depth) {
+        return NULL;
+    }
+
+    ForkTask *task = malloc(sizeof(ForkTask));
+    if (!task) {
+        return NULL;
+    }
+    task->site = site;
+    atomic_init(&task->state, TASK_QUEUED);
+    atomic_init(&task->refs, 2);
+    atomic_init(&task->cancel, false);
+    pthread_mutex_init(&task->lock, NULL);
+    pthread_cond_init(&task->done, NULL);
+    interpreter_init_task(&task->intr, intr);
+    if (site->between) {
+        // The spawning interpreter counts these commands when it runs them itself
+        interpreter_start(&task->intr, site->between);
+        interpret_slice(&task->intr, UINT64_MAX);
+        task->intr.stats.commands = 0;
+    }
+    task->intr.fork_depth = intr->fork_depth + 1;
+    interpreter_start(&task->intr, site->entry);
+
+    if (!pool_submit(&pool, run_task, task)) {
+        pthread_cond_destroy(&task->done);
+        pthread_mutex_destroy(&task->lock);
+        interpreter_free(&task->intr);
+        free(task);
+        return NULL;
+    }
+    intr->fork_depth++;
+    return task;
+}
+
+bool fork_is_for(const ForkTask *task, const Command *call) {
+    return task->site->second == call;
+}
+
+/**
+ * @brief Takes a queued task so this thread runs it.
+ *
+ * @return True if the task was claimed, false if another thread has it.
+ */
+static bool claim(ForkTask *task) {
+    int expected = TASK_QUEUED;
+    return atomic_compare_exchange_strong(&task->state, &expected, TASK_RUNNING);
+}
+
+/**
+ * @brief Runs a claimed task until its callee returns or it is cancelled.
+ */
+static void execute(ForkTask *task) {
+    while (!atomic_load(&task->cancel) && !interpret_slice(&task->intr, TASK_QUANTUM)) {
+    }
+
+    // Only the interpreter that spawned the task ever waits for it
+    pthread_mutex_lock(&task->lock);
+    atomic_store(&task->state, TASK_DONE);
+    pthread_cond_signal(&task->done);
+    pthread_mutex_unlock(&task->lock);
+}
+
+/**
+ * @brief Blocks until a task another thread claimed has finished.
+ *
+ * Only ever waits on a task the thread spawned itself, which in turn only
+ * waits on tasks it spawned, so the waits cannot form a cycle.
+ */
+static void wait_for(ForkTask *task) {
+    if (atomic_load(&task->state) == TASK_DONE) {
+        return;
+    }
+
+    pthread_mutex_lock(&task->lock);
+    while (atomic_load(&task->state) != TASK_DONE) {
+        pthread_cond_wait(&task->done, &task->lock);
+    }
+    pthread_mutex_unlock(&task->lock);
+}
+
+/**
+ * @brief Drops one reference to a task, freeing it with the last one.
+ */
+static void release(ForkTask *task) {
+    if (atomic_fetch_sub(&task->refs, 1) == 1) {
+        pthread_cond_destroy(&task->done);
+        pthread_mutex_destroy(&task->lock);
+        interpreter_free(&task->intr);
+        free(task);
+    }
+}
+
+/**
+ * @brief Runs a task from the pool, unless the joining thread claimed it
+ * first.
+ */
+static bool run_task(void *arg) {
+    ForkTask *task = arg;
+    if (claim(task)) {
+        execute(task);
+    }
+    release(task);
+    return true;
+}
+
+void fork_join(ForkTask *task, Interpreter *intr) {
+    if (claim(task)) {
+        execute(task);
+    } else {
+        wait_for(task);
+    }
+
+    intr->variables[0] = task->intr.variables[0];
+    intr->is_greater   = task->intr.is_greater;
+    intr->is_equal     = task->intr.is_equal;
+    intr->is_less      = task->intr.is_less;
+    intr->stats.commands += task->intr.stats.commands;
+    intr->stats.forked_calls += task->intr.stats.forked_calls + 1;
+    intr->had_error |= task->intr.had_error;
+
+    intr->fork_depth--;
+    release(task);
+}
+
+void fork_cancel(ForkTask *task, Interpreter *intr) {
+    atomic_store(&task->cancel, true);
+    int expected = TASK_QUEUED;
+    if (!atomic_compare_exchange_strong(&task->state, &expected, TASK_DONE)) {
+        wait_for(task);
+    }
+
+    intr->fork_depth--;
+    release(task);
+}
@@ -0,0 +1,191 @@
+#include "guest_map.h"
+#include <stdlib.h>
+
+#define INITIAL_CAPACITY 16
+
+static size_t home_slot(const GuestMap *map, int64_t key);
+static bool   find_slot(const GuestMap *map, int64_t key, size_t *slot, uint64_t *probes);
+static bool   grow(GuestMap *map);
+
+bool guest_map_init(GuestMap *map) {
+    if (!map) {
+        return false;
+    }
+
+    map->slots = malloc(INITIAL_CAPACITY * sizeof(MapSlot));
+    if (!map->slots) {
+        map->capacity = 0;
+        return false;
+    }
+
+    for (size_t i = 0; i < INITIAL_CAPACITY; i++) {
+        map->slots[i].key = MAP_EMPTY_KEY;
+    }
+    map->capacity        = INITIAL_CAPACITY;
+    map->count           = 0;
+    map->has_empty_key   = false;
+    map->empty_key_value = 0;
+    return true;
+}
+
+void guest_map_free(GuestMap *map) {
+    if (!map) {
+        return;
+    }
+
+    free(map->slots);
+    map->slots    = NULL;
+    map->capacity = 0;
+    map->count    = 0;
+}
+
+/**
+ * @brief Returns the slot a key hashes to.
+ *
+ * Guest keys are often small consecutive integers, so they are mixed with the
+ * MurmurHash3 finalizer before being masked down to the table size.
+ */
+static size_t home_slot(const GuestMap *map, int64_t key) {
+    uint64_t h = (uint64_t) key;
+    h ^= h >> 33;
+    h *= 0xff51afd7ed558ccdULL;
+    h ^= h >> 33;
+    h *= 0xc4ceb9fe1a85ec53ULL;
+    h ^= h >> 33;
+    return (size_t) h & (map->capacity - 1);
+}
+
+/**
+ * @brief Finds the slot holding `key`, or the free slot where it would go.
+ *
+ * @return True if `key` is stored in `*slot`, false if `*slot` is free.
+ */
+static bool find_slot(const GuestMap *map, int64_t key, size_t *slot, uint64_t *probes) {
+    size_t mask = map->capacity - 1;
+    size_t i    = home_slot(map, key);
+    while (true) {
+        (*probes)++;
+        if (map->slots[i].key == key) {
+            *slot = i;
+            return true;
+        }
+        if (map->slots[i].key == MAP_EMPTY_KEY) {
+            *slot = i;
+            return false;
+        }
+        i = (i + 1) & mask;
+    }
+}
+
+/**
+ * @brief Doubles the table and reinserts every entry.
+ */
+static bool grow(GuestMap *map) {
+    size_t   new_capacity = map->capacity * 2;
+    MapSlot *slots        = malloc(new_capacity * sizeof(MapSlot));
+    if (!slots) {
+        return false;
+    }
+    for (size_t i = 0; i < new_capacity; i++) {
+        slots[i].key = MAP_EMPTY_KEY;
+    }
+
+    MapSlot *old          = map->slots;
+    size_t   old_capacity = map->capacity;
+    map->slots            = slots;
+    map->capacity         = new_capacity;
+
+    uint64_t ignored = 0;
+    for (size_t i = 0; i < old_capacity; i++) {
+        if (old[i].key != MAP_EMPTY_KEY) {
+            size_t slot;
+            find_slot(map, old[i].key, &slot, &ignored);
+            map->slots[slot] = old[i];
+        }
+    }
+
+    free(old);
+    return true;
+}
+
+bool guest_map_put(GuestMap *map, int64_t key, int64_t value, uint64_t *probes) {
+    if (key == MAP_EMPTY_KEY) {
+        map->has_empty_key   = true;
+        map->empty_key_value = value;
+        return true;
+    }
+
+    size_t slot;
+    if (find_slot(map, key, &slot, probes)) {
+        map->slots[slot].value = value;
+        return true;
+    }
+
+    // Keep the load factor at or below 3/4 so probe sequences stay short
+    if ((map->count + 1) * 4 > map->capacity * 3) {
+        if (!grow(map)) {
+            return false;
+        }
+        find_slot(map, key, &slot, probes);
+    }
+
+    map->slots[slot].key   = key;
+    map->slots[slot].value = value;
+    map->count++;
+    return true;
+}
+
+bool guest_map_get(const GuestMap *map, int64_t key, int64_t *value, uint64_t *probes) {
+    if (key == MAP_EMPTY_KEY) {
+        if (map->has_empty_key) {
+            *value = map->empty_key_value;
+        }
+        return map->has_empty_key;
+    }
+
+    size_t slot;
+    if (!find_slot(map, key, &slot, probes)) {
+        return false;
+    }
+
+    *value = map->slots[slot].value;
+    return true;
+}
+
+bool guest_map_delete(GuestMap *map, int64_t key, uint64_t *probes) {
+    if (key == MAP_EMPTY_KEY) {
+        bool found         = map->has_empty_key;
+        map->has_empty_key = false;
+        return found;
+    }
+
+    size_t hole;
+    if (!find_slot(map, key, &hole, probes)) {
+        return false;
+    }
+
+    // Shift back every later entry of the cluster whose home slot does not lie
+    // between the hole and its current slot, so no lookup runs into the hole
+    size_t mask = map->capacity - 1;
+    size_t i    = hole;
+    while (true) {
+        i = (i + 1) & mask;
+        if (map->slots[i].key == MAP_EMPTY_KEY) {
+            break;
+        }
+
+        size_t home = home_slot(map, map->slots[i].key);
+        if (((i - home) & mask) >= ((i - hole) & mask)) {
+            map->slots[hole] = map->slots[i];
+            hole             = i;
+        }
+    }
+
+    map->slots[hole].key = MAP_EMPTY_KEY;
+    map->count--;
+    return true;
+}
+
+size_t guest_map_bytes(const GuestMap *map) {
+    return map->capacity * sizeof(MapSlot);
+}
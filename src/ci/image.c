@@ -0,0 +1,635 @@
+#include "image.h"
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define IMAGE_MAGIC      "CIIMAGE3"
+#define IMAGE_MAGIC_SIZE 8
+#define NO_COMMAND       -1
+
+#define FLAG_A_IMMEDIATE 0x1
+#define FLAG_B_IMMEDIATE 0x2
+#define FLAG_A_STRING    0x4
+#define FLAG_B_STRING    0x8
+#define FLAG_A_POOLED    0x10
+#define FLAG_B_POOLED    0x20
+
+#define INLINE_MIN       INT16_MIN  // Numbers from INLINE_MIN to INLINE_MAX are stored
+#define INLINE_MAX       INT16_MAX  // in the command rather than the constant pool.
+#define VARINT_MAX_BYTES 10         // The longest encoding of a 64 bit varint.
+
+/**
+ * @brief Header at the start of every image. It is followed by `constant_count`
+ * 64 bit constants, `record_bytes` bytes of encoded commands, `label_count`
+ * `ImageLabel`s and `string_bytes` bytes of NUL terminated strings.
+ *
+ * Each command is encoded as its type, `FLAG_*` bits, destination register and
+ * branch condition, one byte each, followed by varints: the difference between
+ * its source line and the previous command's, then both operands. A string
+ * operand is stored as its offset in the string table, a pooled operand as its
+ * index in the constant pool, and any other operand as its value, which then
+ * lies between `INLINE_MIN` and `INLINE_MAX`. Signed values are zigzag encoded.
+ */
+typedef struct {
+    char     magic[IMAGE_MAGIC_SIZE];  // Always `IMAGE_MAGIC`.
+    uint32_t command_count;            // The number of commands in the image.
+    uint32_t label_count;              // The number of labels in the image.
+    uint32_t constant_count;           // The number of constants in the pool.
+    uint32_t record_bytes;             // The size of the encoded commands.
+    uint32_t string_bytes;             // The size of the string table.
+    uint32_t reserved;                 // Keeps the constant pool 8 byte aligned.
+} ImageHeader;
+
+/**
+ * @brief A label as stored in an image.
+ */
+typedef struct {
+    uint32_t name;     // Offset of the label's name in the string table.
+    int32_t  command;  // Index of the labelled command, or `NO_COMMAND`.
+} ImageLabel;
+
+/**
+ * @brief Maps a command's address to its index in the program, so labels can
+ * be stored as indices.
+ */
+typedef struct {
+    const Command *command;  // The address of the command.
+    int32_t        index;    // Its position in the program.
+} CommandIndex;
+
+/**
+ * @brief A growable byte buffer.
+ */
+typedef struct {
+    uint8_t *data;      // The bytes.
+    size_t   size;      // The number of bytes used.
+    size_t   capacity;  // The number of bytes allocated.
+} ByteBuffer;
+
+/**
+ * @brief A growable string table that stores each distinct string once.
+ */
+typedef struct {
+    ByteBuffer bytes;       // The strings, each NUL terminated.
+    uint32_t  *slots;       // Open addressed hash of the strings' offsets plus one; 0 if free.
+    size_t     slot_count;  // The number of entries in `slots`, a power of two.
+    size_t     count;       // The number of distinct strings.
+} StringTable;
+
+/**
+ * @brief A growable pool of 64 bit constants that stores each distinct value
+ * once.
+ */
+typedef struct {
+    int64_t  *values;      // The constants in the order they were added.
+    size_t    count;       // The number of entries in `values`.
+    size_t    capacity;    // The number of entries allocated in `values`.
+    uint32_t *slots;       // Open addressed hash of the values' indices plus one; 0 if free.
+    size_t    slot_count;  // The number of entries in `slots`, a power of two.
+} ConstantPool;
+
+/**
+ * @brief Walks the encoded commands of an image, never past their end.
+ */
+typedef struct {
+    const uint8_t *pos;  // The next byte to read.
+    const uint8_t *end;  // One past the last encoded byte.
+} Reader;
+
+static bool     reserve_bytes(ByteBuffer *buf, size_t extra);
+static bool     put_varint(ByteBuffer *buf, uint64_t value);
+static uint64_t zigzag(int64_t value);
+static int64_t  unzigzag(uint64_t value);
+static uint64_t hash_string(const char *str);
+static uint64_t hash_constant(int64_t value);
+static bool     grow_slots(uint32_t **slots, size_t *slot_count, size_t used);
+static bool     add_string(StringTable *table, const char *str, int64_t *offset);
+static bool     add_constant(ConstantPool *pool, int64_t value, uint64_t *index);
+static int      compare_command_index(const void *a, const void *b);
+static int32_t  find_command_index(const CommandIndex *index, size_t count, const Command *cmd);
+static bool     encode_operand(StringTable *strings, ConstantPool *pool, Operand op, bool is_str,
+                               bool *pooled, uint64_t *payload);
+static bool     read_varint(Reader *r, uint64_t *value);
+static bool     decode_operand(Reader *r, bool is_str, bool pooled, const ProgramImage *img,
+                               size_t string_bytes, const uint8_t *constants,
+                               size_t constant_count, Operand *out);
+
+/**
+ * @brief Makes room for `extra` more bytes in a buffer.
+ *
+ * @return True if the room was made, false if memory ran out.
+ */
+static bool reserve_bytes(ByteBuffer *buf, size_t extra) {
+    if (buf->size + extra <= buf->capacity) {
+        return true;
+    }
+
+    size_t new_capacity = buf->capacity ? buf->capacity * 2 : 256;
+    while (new_capacity < buf->size + extra) {
+        new_capacity *= 2;
+    }
+    uint8_t *data = realloc(buf->data, new_capacity);
+    if (!data) {
+        return false;
+    }
+    buf->data     = data;
+    buf->capacity = new_capacity;
+    return true;
+}
+
+/**
+ * @brief Appends an unsigned LEB128 varint to a buffer.
+ */
+static bool put_varint(ByteBuffer *buf, uint64_t value) {
+    if (!reserve_bytes(buf, VARINT_MAX_BYTES)) {
+        return false;
+    }
+    while (value >= 0x80) {
+        buf->data[buf->size++] = (uint8_t) (value | 0x80);
+        value >>= 7;
+    }
+    buf->data[buf->size++] = (uint8_t) value;
+    return true;
+}
+
+/**
+ * @brief Maps signed values to unsigned ones so small magnitudes stay small.
+ */
+static uint64_t zigzag(int64_t value) {
+    return ((uint64_t) value << 1) ^ (uint64_t) (value >> 63);
+}
+
+static int64_t unzigzag(uint64_t value) {
+    return (int64_t) (value >> 1) ^ -(int64_t) (value & 1);
+}
+
+/**
+ * @brief FNV-1a hash of a NUL terminated string.
+ */
+static uint64_t hash_string(const char *str) {
+    uint64_t hash = 14695981039346656037ULL;
+    for (; *str; str++) {
+        hash = (hash ^ (uint8_t) *str) * 1099511628211ULL;
+    }
+    return hash;
+}
+
+static uint64_t hash_constant(int64_t value) {
+    uint64_t hash = (uint64_t) value * 0x9E3779B97F4A7C15ULL;
+    return hash ^ (hash >> 32);
+}
+
+/**
+ * @brief Doubles a slot array once it is half full. The caller reinserts its
+ * entries, as the slots only hold positions of entries kept elsewhere.
+ *
+ * @param slots The slot array, replaced by an empty, larger one when grown.
+ * @param slot_count The number of entries in `*slots`.
+ * @param used The number of entries about to be stored, counting the new one.
+ * @return True if the slots have room, false if memory ran out.
+ */
+static bool grow_slots(uint32_t **slots, size_t *slot_count, size_t used) {
+    if (used * 2 <= *slot_count) {
+        return true;
+    }
+
+    size_t    new_count = *slot_count ? *slot_count * 2 : 256;
+    uint32_t *new_slots = calloc(new_count, sizeof(uint32_t));
+    if (!new_slots) {
+        return false;
+    }
+    free(*slots);
+    *slots      = new_slots;
+    *slot_count = new_count;
+    return true;
+}
+
+/**
+ * @brief Adds a string to the table unless it is there already.
+ *
+ * @param table The table to add to.
+ * @param str The string to add.
+ * @param offset Set to the offset of the string within the table.
+ * @return True if the string is in the table, false if memory ran out.
+ */
+static bool add_string(StringTable *table, const char *str, int64_t *offset) {
+    size_t old_slots = table->slot_count;
+    if (!grow_slots(&table->slots, &table->slot_count, table->count + 1)) {
+        return false;
+    }
+
+    size_t mask = table->slot_count - 1;
+    if (table->slot_count != old_slots) {
+        for (size_t at = 0; at < table->bytes.size;) {
+            const char *s = (const char *) table->bytes.data + at;
+            size_t      i = hash_string(s) & mask;
+            while (table->slots[i]) {
+                i = (i + 1) & mask;
+            }
+            table->slots[i] = (uint32_t) at + 1;
+            at += strlen(s) + 1;
+        }
+    }
+
+    size_t i = hash_string(str) & mask;
+    for (; table->slots[i]; i = (i + 1) & mask) {
+        const char *s = (const char *) table->bytes.data + table->slots[i] - 1;
+        if (strcmp(s, str) == 0) {
+            *offset = table->slots[i] - 1;
+            return true;
+        }
+    }
+
+    size_t length = strlen(str) + 1;
+    if (!reserve_bytes(&table->bytes, length)) {
+        return false;
+    }
+    memcpy(table->bytes.data + table->bytes.size, str, length);
+    *offset         = (int64_t) table->bytes.size;
+    table->slots[i] = (uint32_t) table->bytes.size + 1;
+    table->bytes.size += length;
+    table->count++;
+    return true;
+}
+
+/**
+ * @brief Adds a constant to the pool unless it is there already.
+ *
+ * @param pool The pool to add to.
+ * @param value The constant to add.
+ * @param index Set to the index of the constant within the pool.
+ * @return True if the constant is in the pool, false if memory ran out.
+ */
+static bool add_constant(ConstantPool *pool, int64_t value, uint64_t *index) {
+    size_t old_slots = pool->slot_count;
+    if (!grow_slots(&pool->slots, &pool->slot_count, pool->count + 1)) {
+        return false;
+    }
+
+    size_t mask = pool->slot_count - 1;
+    if (pool->slot_count != old_slots) {
+        for (size_t c = 0; c < pool->count; c++) {
+            size_t i = hash_constant(pool->values[c]) & mask;
+            while (pool->slots[i]) {
+                i = (i + 1) & mask;
+            }
+            pool->slots[i] = (uint32_t) c + 1;
+        }
+    }
+
+    size_t i = hash_constant(value) & mask;
+    for (; pool->slots[i]; i = (i + 1) & mask) {
+        if (pool->values[pool->slots[i] - 1] == value) {
+            *index = pool->slots[i] - 1;
+            return true;
+        }
+    }
+
+    if (pool->count == pool->capacity) {
+        size_t   new_capacity = pool->capacity ? pool->capacity * 2 : 64;
+        int64_t *values       = realloc(pool->values, new_capacity * sizeof(int64_t));
+        if (!values) {
+            return false;
+        }
+        pool->values   = values;
+        pool->capacity = new_capacity;
+    }
+    pool->values[pool->count] = value;
+    pool->slots[i]            = (uint32_t) pool->count + 1;
+    *index                    = pool->count++;
+    return true;
+}
+
+static int compare_command_index(const void *a, const void *b) {
+    const Command *x = ((const CommandIndex *) a)->command;
+    const Command *y = ((const CommandIndex *) b)->command;
+    return (x > y) - (x < y);
+}
+
+/**
+ * @brief Looks up the index of a command in a sorted `CommandIndex` array.
+ *
+ * @return The index of `cmd`, or `NO_COMMAND` if `cmd` is NULL or unknown.
+ */
+static int32_t find_command_index(const CommandIndex *index, size_t count, const Command *cmd) {
+    if (!cmd) {
+        return NO_COMMAND;
+    }
+
+    CommandIndex        key   = {cmd, 0};
+    const CommandIndex *found = bsearch(&key, index, count, sizeof(CommandIndex),
+                                        compare_command_index);
+    return found ? found->index : NO_COMMAND;
+}
+
+/**
+ * @brief Encodes an operand, moving strings into the string table and numbers
+ * too large to store inline into the constant pool.
+ *
+ * @param pooled Set to whether the operand was moved into the constant pool.
+ * @param payload Set to the varint to store for the operand.
+ */
+static bool encode_operand(StringTable *strings, ConstantPool *pool, Operand op, bool is_str,
+                           bool *pooled, uint64_t *payload) {
+    *pooled = false;
+    if (is_str) {
+        int64_t offset = 0;
+        bool    ok     = add_string(strings, op.str_val ? op.str_val : "", &offset);
+        *payload       = (uint64_t) offset;
+        return ok;
+    }
+    if (op.num_val >= INLINE_MIN && op.num_val <= INLINE_MAX) {
+        *payload = zigzag(op.num_val);
+        return true;
+    }
+    *pooled = true;
+    return add_constant(pool, op.num_val, payload);
+}
+
+bool image_serialize(Command *commands, LabelMap *map, uint8_t **data, size_t *size) {
+    size_t command_count = 0;
+    for (Command *cmd = commands; cmd; cmd = cmd->next) {
+        command_count++;
+    }
+
+    size_t label_count = 0;
+    for (int i = 0; i < map->capacity; i++) {
+        for (Entry *e = map->entries[i]; e; e = e->next) {
+            label_count++;
+        }
+    }
+
+    ImageLabel   *labels    = calloc(label_count ? label_count : 1, sizeof(ImageLabel));
+    CommandIndex *index     = calloc(command_count ? command_count : 1, sizeof(CommandIndex));
+    ByteBuffer    records   = {NULL, 0, 0};
+    StringTable   strings   = {{NULL, 0, 0}, NULL, 0, 0};
+    ConstantPool  constants = {NULL, 0, 0, NULL, 0};
+    bool          ok        = labels && index;
+
+    size_t   i    = 0;
+    uint32_t line = 0;
+    for (Command *cmd = commands; ok && cmd; cmd = cmd->next, i++) {
+        bool     a_pooled, b_pooled;
+        uint64_t a, b;
+        ok = encode_operand(&strings, &constants, cmd->val_a, cmd->is_a_string, &a_pooled, &a) &&
+             encode_operand(&strings, &constants, cmd->val_b, cmd->is_b_string, &b_pooled, &b) &&
+             reserve_bytes(&records, 4);
+        if (!ok) {
+            break;
+        }
+
+        uint8_t *rec = records.data + records.size;
+        rec[0]       = (uint8_t) cmd->type;
+        rec[1]       = (uint8_t) ((cmd->is_a_immediate ? FLAG_A_IMMEDIATE : 0) |
+                            (cmd->is_b_immediate ? FLAG_B_IMMEDIATE : 0) |
+                            (cmd->is_a_string ? FLAG_A_STRING : 0) |
+                            (cmd->is_b_string ? FLAG_B_STRING : 0) | (a_pooled ? FLAG_A_POOLED : 0) |
+                            (b_pooled ? FLAG_B_POOLED : 0));
+        rec[2]       = (uint8_t) cmd->destination.num_val;
+        rec[3]       = (uint8_t) (int8_t) cmd->branch_condition;
+        records.size += 4;
+
+        uint32_t cmd_line = command_line(cmd);
+        ok = put_varint(&records, zigzag((int64_t) cmd_line - line)) &&
+             put_varint(&records, a) && put_varint(&records, b);
+        line = cmd_line;
+
+        index[i].command = cmd;
+        index[i].index   = (int32_t) i;
+    }
+
+    if (ok) {
+        qsort(index, command_count, sizeof(CommandIndex), compare_command_index);
+    }
+
+    size_t l = 0;
+    for (int b = 0; ok && b < map->capacity; b++) {
+        for (Entry *e = map->entries[b]; ok && e; e = e->next, l++) {
+            int64_t name = 0;
+            ok                = add_string(&strings, e->id, &name);
+            labels[l].name    = (uint32_t) name;
+            labels[l].command = find_command_index(index, command_count, e->command);
+        }
+    }
+
+    size_t   constants_size = constants.count * sizeof(int64_t);
+    size_t   total = sizeof(ImageHeader) + constants_size + records.size +
+                   label_count * sizeof(ImageLabel) + strings.bytes.size;
+    uint8_t *out   = ok ? malloc(total) : NULL;
+    if (out) {
+        ImageHeader header = {IMAGE_MAGIC,
+                              (uint32_t) command_count,
+                              (uint32_t) label_count,
+                              (uint32_t) constants.count,
+                              (uint32_t) records.size,
+                              (uint32_t) strings.bytes.size,
+                              0};
+        uint8_t    *p      = out;
+        memcpy(p, &header, sizeof(header));
+        p += sizeof(header);
+        if (constants_size) {
+            memcpy(p, constants.values, constants_size);
+        }
+        p += constants_size;
+        if (records.size) {
+            memcpy(p, records.data, records.size);
+        }
+        p += records.size;
+        memcpy(p, labels, label_count * sizeof(ImageLabel));
+        p += label_count * sizeof(ImageLabel);
+        if (strings.bytes.size) {
+            memcpy(p, strings.bytes.data, strings.bytes.size);
+        }
+
+        *data = out;
+        *size = total;
+    }
+
+    free(labels);
+    free(index);
+    free(records.data);
+    free(strings.bytes.data);
+    free(strings.slots);
+    free(constants.values);
+    free(constants.slots);
+    return out != NULL;
+}
+
+/**
+ * @brief Reads an unsigned LEB128 varint.
+ *
+ * @return True if a complete varint was read, false if it ran past the end of
+ * the records or was too long.
+ */
+static bool read_varint(Reader *r, uint64_t *value) {
+    uint64_t result = 0;
+    for (int shift = 0; shift < 7 * VARINT_MAX_BYTES && r->pos < r->end; shift += 7) {
+        uint8_t byte = *r->pos++;
+        result |= (uint64_t) (byte & 0x7F) << shift;
+        if (!(byte & 0x80)) {
+            *value = result;
+            return true;
+        }
+    }
+    return false;
+}
+
+/**
+ * @brief Decodes an operand, resolving string offsets against the table and
+ * pool indices against the constant pool.
+ */
+static bool decode_operand(Reader *r, bool is_str, bool pooled, const ProgramImage *img,
+                           size_t string_bytes, const uint8_t *constants,
+                           size_t constant_count, Operand *out) {
+    uint64_t value;
+    if (!read_varint(r, &value)) {
+        return false;
+    }
+
+    if (is_str) {
+        if (value >= string_bytes) {
+            return false;
+        }
+        out->str_val = img->strings + value;
+    } else if (pooled) {
+        if (value >= constant_count) {
+            return false;
+        }
+        memcpy(&out->num_val, constants + value * sizeof(int64_t), sizeof(int64_t));
+    } else {
+        out->num_val = unzigzag(value);
+    }
+    return true;
+}
+
+bool image_load(ProgramImage *img, const uint8_t *data, size_t size, LabelMap *map) {
+    ImageHeader header;
+    img->commands = NULL;
+    img->count    = 0;
+    img->strings  = NULL;
+
+    if (size < sizeof(header)) {
+        return false;
+    }
+    memcpy(&header, data, sizeof(header));
+    if (memcmp(header.magic, IMAGE_MAGIC, IMAGE_MAGIC_SIZE) != 0) {
+        return false;
+    }
+
+    size_t constants_size = (size_t) header.constant_count * sizeof(int64_t);
+    size_t labels_size    = (size_t) header.label_count * sizeof(ImageLabel);
+    if (size != sizeof(header) + constants_size + header.record_bytes + labels_size +
+                    header.string_bytes) {
+        return false;
+    }
+
+    const uint8_t *constants = data + sizeof(header);
+    const uint8_t *records   = constants + constants_size;
+    const uint8_t *labels    = records + header.record_bytes;
+    const uint8_t *strings   = labels + labels_size;
+
+    // The table is copied with an extra NUL so an image with a truncated last
+    // string still cannot run past the end of it
+    img->strings  = malloc((size_t) header.string_bytes + 1);
+    img->commands = calloc(header.command_count ? header.command_count : 1, sizeof(Command));
+    if (!img->strings || !img->commands) {
+        image_free(img);
+        return false;
+    }
+    memcpy(img->strings, strings, header.string_bytes);
+    img->strings[header.string_bytes] = '\0';
+    img->count                        = header.command_count;
+
+    Reader   r    = {records, labels};
+    uint32_t line = 0;
+    for (size_t i = 0; i < img->count; i++) {
+        Command *cmd = &img->commands[i];
+        uint64_t line_delta;
+        if (r.end - r.pos < 4) {
+            image_free(img);
+            return false;
+        }
+        uint8_t flags = r.pos[1];
+
+        cmd->type                = (CommandType) r.pos[0];
+        cmd->next                = (i + 1 < img->count) ? &img->commands[i + 1] : NULL;
+        cmd->destination.num_val = r.pos[2];
+        cmd->is_a_immediate      = flags & FLAG_A_IMMEDIATE;
+        cmd->is_b_immediate      = flags & FLAG_B_IMMEDIATE;
+        cmd->is_a_string         = flags & FLAG_A_STRING;
+        cmd->is_b_string         = flags & FLAG_B_STRING;
+        cmd->branch_condition    = (BranchCondition) (int8_t) r.pos[3];
+        r.pos += 4;
+
+        if (!read_varint(&r, &line_delta) ||
+            !decode_operand(&r, cmd->is_a_string, flags & FLAG_A_POOLED, img,
+                            header.string_bytes, constants, header.constant_count,
+                            &cmd->val_a) ||
+            !decode_operand(&r, cmd->is_b_string, flags & FLAG_B_POOLED, img,
+                            header.string_bytes, constants, header.constant_count,
+                            &cmd->val_b)) {
+            image_free(img);
+            return false;
+        }
+        line = (uint32_t) ((int64_t) line + unzigzag(line_delta));
+        command_set_line(cmd, line);
+    }
+    if (r.pos != r.end) {
+        image_free(img);
+        return false;
+    }
+
+    for (size_t i = 0; i < header.label_count; i++) {
+        ImageLabel label;
+        memcpy(&label, labels + i * sizeof(label), sizeof(label));
+        bool bad_target = label.command != NO_COMMAND &&
+                          (label.command < 0 || (size_t) label.command >= img->count);
+        if (label.name >= header.string_bytes || bad_target) {
+            image_free(img);
+            return false;
+        }
+
+        Command *target = (label.command == NO_COMMAND) ? NULL : &img->commands[label.command];
+        if (!put_label(map, img->strings + label.name, target)) {
+            image_free(img);
+            return false;
+        }
+    }
+
+    resolve_loop_targets(map, img->commands);
+    return true;
+}
+
+void image_print_stats(const uint8_t *data, size_t size) {
+    ImageHeader header;
+    if (size < sizeof(header)) {
+        return;
+    }
+    memcpy(&header, data, sizeof(header));
+
+    double per_command = header.command_count ? (double) size / header.command_count : 0.0;
+    fprintf(stderr, "Image stats:\n");
+    fprintf(stderr, "Image bytes: %zu (%.1f per command)\n", size, per_command);
+    fprintf(stderr, "Commands: %" PRIu32 " (%" PRIu32 " bytes)\n", header.command_count,
+            header.record_bytes);
+    fprintf(stderr, "Constants: %" PRIu32 " (%zu bytes)\n", header.constant_count,
+            (size_t) header.constant_count * sizeof(int64_t));
+    fprintf(stderr, "Labels: %" PRIu32 "\n", header.label_count);
+    fprintf(stderr, "String bytes: %" PRIu32 "\n", header.string_bytes);
+}
+
+void image_free(ProgramImage *img) {
+    if (!img) {
+        return;
+    }
+
+    for (size_t i = 0; i < img->count; i++) {
+        command_set_line(&img->commands[i], 0);
+    }
+    free(img->commands);
+    free(img->strings);
+    img->commands = NULL;
+    img->count    = 0;
+    img->strings  = NULL;
+}
@@ -3,43 +3,148 @@
 #include <stddef.h>
 #include <stdint.h>
 #include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
 
+#include "checksum.h"
 #include "command_type.h"
+#include "fork.h"
 #include "mem.h"
+#include "output.h"
+#include "segment.h"
+#include "vectorize.h"
 
-static bool    cond_holds(Interpreter *intr, BranchCondition cond);
-static int64_t fetch_number_value(Interpreter *intr, Operand *op, bool is_im);
-static bool    print_base(Interpreter *intr, Command *cmd);
+static void      init_state(Interpreter *intr, LabelMap *map);
+static bool      cond_holds(Interpreter *intr, BranchCondition cond);
+static int64_t   fetch_number_value(Interpreter *intr, Operand *op, bool is_im);
+static bool      print_base(Interpreter *intr, Command *cmd);
+static GuestMap *map_from_handle(Interpreter *intr, int64_t handle);
+static bool      new_map(Interpreter *intr, int64_t *handle);
+static void      track_map_bytes(Interpreter *intr, size_t before, size_t after);
+static bool      push_rep(Interpreter *intr, int64_t count, Command *body);
+static Command  *skip_rep_block(Command *rep);
+static void      finish(Interpreter *intr);
+static void      free_maps(Interpreter *intr);
+static void      free_frame_list(StackEntry *entry);
 
 void interpreter_init(Interpreter *intr, LabelMap *map) {
     if (!intr) {
         return;
     }
 
+    init_state(intr, map);
+    if (!mem_init(&intr->memory)) {
+        printf("Unable to allocate guest memory.\n");
+        intr->had_error = true;
+    }
+}
+
+void interpreter_init_task(Interpreter *intr, const Interpreter *parent) {
+    init_state(intr, parent->label_map);
+    memcpy(intr->variables, parent->variables, sizeof(intr->variables));
+    intr->is_greater    = parent->is_greater;
+    intr->is_equal      = parent->is_equal;
+    intr->is_less       = parent->is_less;
+    intr->output_format = parent->output_format;
+    memset(&intr->memory, 0, sizeof(intr->memory));
+}
+
+/**
+ * @brief Sets up everything `interpreter_init` does but the guest memory.
+ */
+static void init_state(Interpreter *intr, LabelMap *map) {
     intr->had_error  = false;
     intr->label_map  = map;
     intr->is_greater = false;
     intr->is_equal   = false;
     intr->is_less    = false;
-    intr->the_stack  = NULL;
+
+    intr->the_stack   = NULL;
+    intr->free_frames = NULL;
+    intr->pc          = NULL;
+
+    intr->maps         = NULL;
+    intr->map_count    = 0;
+    intr->map_capacity = 0;
+    intr->map_bytes    = 0;
+    intr->reps         = NULL;
+    intr->rep_depth    = 0;
+    intr->rep_capacity = 0;
+    memset(&intr->stats, 0, sizeof(intr->stats));
+    intr->output_format = OUTPUT_TEXT;
+    intr->output        = stdout;
+    intr->joining       = NULL;
+    intr->fork_depth    = 0;
+    intr->awaiting_code = false;
 
     for (size_t i = 0; i < NUM_VARIABLES; i++) {
         intr->variables[i] = 0;
     }
 }
 
+void interpreter_reset(Interpreter *intr) {
+    if (!intr) {
+        return;
+    }
+
+    finish(intr);
+    free_maps(intr);
+    mem_reset(&intr->memory);
+
+    intr->had_error  = false;
+    intr->is_greater = false;
+    intr->is_equal   = false;
+    intr->is_less    = false;
+    memset(intr->variables, 0, sizeof(intr->variables));
+    memset(&intr->stats, 0, sizeof(intr->stats));
+}
+
+void interpreter_free(Interpreter *intr) {
+    if (!intr) {
+        return;
+    }
+
+    finish(intr);
+    free_maps(intr);
+    free_frame_list(intr->free_frames);
+    intr->free_frames = NULL;
+    free(intr->reps);
+    intr->reps         = NULL;
+    intr->rep_capacity = 0;
+    mem_free(&intr->memory);
+}
+
 void interpret(Interpreter *intr, Command *commands) {
     if (!intr || !commands) {
         return;
     }
 
-    Command *current = commands;
+    interpreter_start(intr, commands);
+    interpret_slice(intr, UINT64_MAX);
+}
+
+void interpreter_start(Interpreter *intr, Command *commands) {
+    if (!intr) {
+        return;
+    }
+
+    intr->pc = commands;
+}
+
+bool interpret_slice(Interpreter *intr, uint64_t quantum) {
+    if (!intr) {
+        return true;
+    }
+
+    Command *current  = intr->pc;
+    uint64_t executed = 0;
     while (current && !intr->had_error) {
+        executed++;
         switch (current->type) {
             case CMD_ADD: {
                 int64_t val_a = current->is_a_immediate ? current->val_a.num_val : intr->variables[(int) current->val_a.base];
                 int64_t val_b = current->is_b_immediate ? current->val_b.num_val : intr->variables[(int) current->val_b.base];
-                intr->variables[(int) current->destination.base] = val_a + val_b;
+                intr->variables[(int) current->destination.base] = (int64_t) ((uint64_t) val_a + (uint64_t) val_b);
 
                 current = current->next;
                 break;
@@ -48,7 +153,7 @@ void interpret(Interpreter *intr, Command *commands) {
             case CMD_SUB: {
                 int64_t val_a = current->is_a_immediate ? current->val_a.num_val : intr->variables[(int) current->val_a.base];
                 int64_t val_b = current->is_b_immediate? current->val_b.num_val : intr->variables[(int) current->val_b.base];
-                intr->variables[(int) current->destination.base] = val_a - val_b;
+                intr->variables[(int) current->destination.base] = (int64_t) ((uint64_t) val_a - (uint64_t) val_b);
 
                 current = current->next;
                 break;
@@ -62,6 +167,54 @@ void interpret(Interpreter *intr, Command *commands) {
                 break;
             }
 
+            case CMD_AND: {
+                intr->variables[(int) current->destination.base] =
+                    intr->variables[(int) current->val_a.base] & intr->variables[(int) current->val_b.base];
+
+                current = current->next;
+                break;
+            }
+
+            case CMD_ORR: {
+                intr->variables[(int) current->destination.base] =
+                    intr->variables[(int) current->val_a.base] | intr->variables[(int) current->val_b.base];
+
+                current = current->next;
+                break;
+            }
+
+            case CMD_EOR: {
+                intr->variables[(int) current->destination.base] =
+                    intr->variables[(int) current->val_a.base] ^ intr->variables[(int) current->val_b.base];
+
+                current = current->next;
+                break;
+            }
+
+            case CMD_LSL: {
+                uint64_t value = (uint64_t) intr->variables[(int) current->val_a.base];
+                intr->variables[(int) current->destination.base] = (int64_t) (value << (current->val_b.num_val & 63));
+
+                current = current->next;
+                break;
+            }
+
+            case CMD_LSR: {
+                uint64_t value = (uint64_t) intr->variables[(int) current->val_a.base];
+                intr->variables[(int) current->destination.base] = (int64_t) (value >> (current->val_b.num_val & 63));
+
+                current = current->next;
+                break;
+            }
+
+            case CMD_ASR: {
+                int64_t value = intr->variables[(int) current->val_a.base];
+                intr->variables[(int) current->destination.base] = value >> (current->val_b.num_val & 63);
+
+                current = current->next;
+                break;
+            }
+
             case CMD_CMP: {
                 int64_t val_a = current->is_a_immediate ? current->val_a.num_val : intr->variables[(int) current->val_a.base];
                 int64_t val_b = current->is_b_immediate ? current->val_b.num_val : intr->variables[(int) current->val_b.base];
@@ -86,27 +239,671 @@ void interpret(Interpreter *intr, Command *commands) {
                 break;
             }
 
+            // The 32-bit variants read the low halves of their operands and
+            // zero-extend what they write
+            case CMD_ADD_W: {
+                uint32_t val_a = (uint32_t) (current->is_a_immediate ? current->val_a.num_val : intr->variables[(int) current->val_a.base]);
+                uint32_t val_b = (uint32_t) (current->is_b_immediate ? current->val_b.num_val : intr->variables[(int) current->val_b.base]);
+                intr->variables[(int) current->destination.base] = (uint32_t) (val_a + val_b);
+
+                current = current->next;
+                break;
+            }
+
+            case CMD_SUB_W: {
+                uint32_t val_a = (uint32_t) (current->is_a_immediate ? current->val_a.num_val : intr->variables[(int) current->val_a.base]);
+                uint32_t val_b = (uint32_t) (current->is_b_immediate ? current->val_b.num_val : intr->variables[(int) current->val_b.base]);
+                intr->variables[(int) current->destination.base] = (uint32_t) (val_a - val_b);
+
+                current = current->next;
+                break;
+            }
+
+            case CMD_MOV_W: {
+                uint32_t value = (uint32_t) (current->is_a_immediate ? current->val_a.num_val : intr->variables[(int) current->val_a.base]);
+                intr->variables[(int) current->destination.base] = value;
+
+                current = current->next;
+                break;
+            }
+
+            case CMD_AND_W: {
+                intr->variables[(int) current->destination.base] =
+                    (uint32_t) (intr->variables[(int) current->val_a.base] & intr->variables[(int) current->val_b.base]);
+
+                current = current->next;
+                break;
+            }
+
+            case CMD_ORR_W: {
+                intr->variables[(int) current->destination.base] =
+                    (uint32_t) (intr->variables[(int) current->val_a.base] | intr->variables[(int) current->val_b.base]);
+
+                current = current->next;
+                break;
+            }
+
+            case CMD_EOR_W: {
+                intr->variables[(int) current->destination.base] =
+                    (uint32_t) (intr->variables[(int) current->val_a.base] ^ intr->variables[(int) current->val_b.base]);
+
+                current = current->next;
+                break;
+            }
+
+            case CMD_LSL_W: {
+                uint32_t value = (uint32_t) intr->variables[(int) current->val_a.base];
+                intr->variables[(int) current->destination.base] = (uint32_t) (value << (current->val_b.num_val & 31));
+
+                current = current->next;
+                break;
+            }
+
+            case CMD_LSR_W: {
+                uint32_t value = (uint32_t) intr->variables[(int) current->val_a.base];
+                intr->variables[(int) current->destination.base] = value >> (current->val_b.num_val & 31);
+
+                current = current->next;
+                break;
+            }
+
+            case CMD_ASR_W: {
+                int32_t value = (int32_t) intr->variables[(int) current->val_a.base];
+                intr->variables[(int) current->destination.base] = (uint32_t) (value >> (current->val_b.num_val & 31));
+
+                current = current->next;
+                break;
+            }
+
+            case CMD_CMP_W: {
+                int32_t val_a = (int32_t) (current->is_a_immediate ? current->val_a.num_val : intr->variables[(int) current->val_a.base]);
+                int32_t val_b = (int32_t) (current->is_b_immediate ? current->val_b.num_val : intr->variables[(int) current->val_b.base]);
+
+                intr->is_greater = (val_a > val_b);
+                intr->is_equal   = (val_a == val_b);
+                intr->is_less    = (val_a < val_b);
+
+                current = current->next;
+                break;
+            }
+
+            case CMD_CMP_U_W: {
+                uint32_t val_a = (uint32_t) (current->is_a_immediate ? current->val_a.num_val : intr->variables[(int) current->val_a.base]);
+                uint32_t val_b = (uint32_t) (current->is_b_immediate ? current->val_b.num_val : intr->variables[(int) current->val_b.base]);
+
+                intr->is_greater = (val_a > val_b);
+                intr->is_equal   = (val_a == val_b);
+                intr->is_less    = (val_a < val_b);
+
+                current = current->next;
+                break;
+            }
+
+            // The parser checked that each field fits in 64 bits, so every
+            // shift count below is less than 64
+            case CMD_UBFX: {
+                uint64_t value    = (uint64_t) intr->variables[(int) current->val_a.base];
+                int      position = (int) (current->val_b.num_val & 0xff);
+                int      width    = (int) (current->val_b.num_val >> 8);
+                intr->variables[(int) current->destination.base] = (int64_t) ((value << (64 - position - width)) >> (64 - width));
+
+                current = current->next;
+                break;
+            }
+
+            case CMD_SBFX: {
+                uint64_t value    = (uint64_t) intr->variables[(int) current->val_a.base];
+                int      position = (int) (current->val_b.num_val & 0xff);
+                int      width    = (int) (current->val_b.num_val >> 8);
+                intr->variables[(int) current->destination.base] = (int64_t) (value << (64 - position - width)) >> (64 - width);
+
+                current = current->next;
+                break;
+            }
+
+            case CMD_BFI: {
+                uint64_t value    = (uint64_t) intr->variables[(int) current->val_a.base];
+                uint64_t field    = (uint64_t) intr->variables[(int) current->destination.base];
+                int      position = (int) (current->val_b.num_val & 0xff);
+                uint64_t mask     = (UINT64_MAX >> (64 - (current->val_b.num_val >> 8))) << position;
+                intr->variables[(int) current->destination.base] = (int64_t) ((field & ~mask) | ((value << position) & mask));
+
+                current = current->next;
+                break;
+            }
+
+            case CMD_BFXIL: {
+                uint64_t value    = (uint64_t) intr->variables[(int) current->val_a.base];
+                uint64_t field    = (uint64_t) intr->variables[(int) current->destination.base];
+                int      position = (int) (current->val_b.num_val & 0xff);
+                uint64_t mask     = UINT64_MAX >> (64 - (current->val_b.num_val >> 8));
+                intr->variables[(int) current->destination.base] = (int64_t) ((field & ~mask) | ((value >> position) & mask));
+
+                current = current->next;
+                break;
+            }
+
+            case CMD_ROR: {
+                uint64_t value  = (uint64_t) intr->variables[(int) current->val_a.base];
+                int      amount = (int) (current->val_b.num_val & 63);
+                intr->variables[(int) current->destination.base] = (int64_t) ((value >> amount) | (value << ((64 - amount) & 63)));
+
+                current = current->next;
+                break;
+            }
+
+            case CMD_LOAD: {
+                uint64_t value   = 0;
+                int64_t  address = fetch_number_value(intr, &current->val_b, current->is_b_immediate);
+                if (address < 0 || !mem_load(&intr->memory, (uint8_t *) &value, (size_t) address, (size_t) current->val_a.num_val)) {
+                    intr->had_error = true;
+                    break;
+                }
+                intr->variables[(int) current->destination.base] = (int64_t) value;
+
+                current = current->next;
+                break;
+            }
+
+            // Loaded like `load`, so an aligned load from the shared range stays atomic
+            case CMD_LOADS: {
+                uint64_t value   = 0;
+                int64_t  width   = current->val_a.num_val;
+                int64_t  address = fetch_number_value(intr, &current->val_b, current->is_b_immediate);
+                if (address < 0 || !mem_load(&intr->memory, (uint8_t *) &value, (size_t) address, (size_t) width)) {
+                    intr->had_error = true;
+                    break;
+                }
+
+                // The width was checked by the parser to be 1, 2 or 4 bytes
+                int shift = 64 - (int) width * 8;
+                intr->variables[(int) current->destination.base] = (int64_t) (value << shift) >> shift;
+
+                current = current->next;
+                break;
+            }
+
+            case CMD_STORE: {
+                int64_t value   = intr->variables[(int) current->destination.base];
+                int64_t address = fetch_number_value(intr, &current->val_a, current->is_a_immediate);
+                if (address < 0 || !mem_store(&intr->memory, (uint8_t *) &value, (size_t) address, (size_t) current->val_b.num_val)) {
+                    intr->had_error = true;
+                    break;
+                }
+
+                current = current->next;
+                break;
+            }
+
+            case CMD_PUT: {
+                int64_t address = fetch_number_value(intr, &current->val_b, current->is_b_immediate);
+                if (address < 0 || !mem_put_string(&intr->memory, current->val_a.str_val, (size_t) address)) {
+                    intr->had_error = true;
+                    break;
+                }
+
+                current = current->next;
+                break;
+            }
+
             case CMD_PRINT: {
-                const char *base = current->val_a.str_val;
-                int64_t value = current->is_b_immediate ? current->val_b.num_val : intr->variables[(int) current->val_b.base];
-
-                if (base[0] == 'd') {
-                    printf("%" PRId64 "\n", value); 
-                } else if (base[0] == 'x') {
-                    printf("%" PRIx64 "\n", (uint64_t) value); 
-                } else if (base[0] == 'b') {
-                    for (int i = 63; i >= 0; i--) {
-                        printf("%c", (value & ((int64_t) 1 << i)) ? '1' : '0');
+                if (!print_base(intr, current)) {
+                    intr->had_error = true;
+                }
+
+                current = current->next;
+                break;
+            }
+
+            case CMD_BRANCH: {
+                if (!cond_holds(intr, current->branch_condition)) {
+                    current = current->next;
+                    break;
+                }
+
+                Entry *label = get_label(intr->label_map, current->val_a.str_val);
+                if (!label && intr->awaiting_code) {
+                    // The label may be defined in a part of the program yet to be parsed
+                    intr->pc = current;
+                    intr->stats.commands += executed - 1;
+                    return false;
+                }
+                if (!label) {
+                    printf("Label not found: %s\n", current->val_a.str_val);
+                    intr->had_error = true;
+                    break;
+                }
+
+                current = label->command;
+                if (executed >= quantum) {
+                    intr->pc = current;
+                    intr->stats.commands += executed;
+                    return false;
+                }
+                break;
+            }
+
+            case CMD_CALL: {
+                // The sibling of the call that just returned may already have run
+                if (intr->joining) {
+                    ForkTask *task = intr->joining;
+                    intr->joining  = NULL;
+                    if (fork_is_for(task, current)) {
+                        fork_join(task, intr);
+                        current = current->next;
+                        break;
                     }
-                    printf("\n");
+                    fork_cancel(task, intr);
+                }
+
+                Entry *label = get_label(intr->label_map, current->val_a.str_val);
+                if (!label && intr->awaiting_code) {
+                    // The label may be defined in a part of the program yet to be parsed
+                    intr->pc = current;
+                    intr->stats.commands += executed - 1;
+                    return false;
+                }
+                if (!label) {
+                    printf("Label not found: %s\n", current->val_a.str_val);
+                    intr->had_error = true;
+                    break;
+                }
+
+                StackEntry *entry = intr->free_frames;
+                if (entry) {
+                    intr->free_frames = entry->next;
+                } else {
+                    entry = (StackEntry *) malloc(sizeof(StackEntry));
+                }
+                if (!entry) {
+                    intr->had_error = true;
+                    break;
+                }
+
+                // Save the caller's registers; `ret` restores all of them but x0
+                entry->command = current->next;
+                memcpy(entry->variables, intr->variables, sizeof(intr->variables));
+                entry->rep_depth = intr->rep_depth;
+                entry->fork      = current->fork ? fork_spawn(current->fork, intr) : NULL;
+                entry->next      = intr->the_stack;
+                intr->the_stack  = entry;
+
+                current = label->command;
+                if (executed >= quantum) {
+                    intr->pc = current;
+                    intr->stats.commands += executed;
+                    return false;
+                }
+                break;
+            }
+
+            case CMD_RET: {
+                StackEntry *entry = intr->the_stack;
+                if (!entry) {
+                    // Returning from the outermost frame ends the program
+                    current = NULL;
+                    break;
+                }
+
+                int64_t result = intr->variables[0];
+                memcpy(intr->variables, entry->variables, sizeof(intr->variables));
+                intr->variables[0] = result;
+
+                // Returning from inside a `rep` block abandons its counter
+                intr->rep_depth = entry->rep_depth;
+                intr->joining   = entry->fork;
+
+                intr->the_stack   = entry->next;
+                current           = entry->command;
+                entry->next       = intr->free_frames;
+                intr->free_frames = entry;
+                if (executed >= quantum) {
+                    intr->pc = current;
+                    intr->stats.commands += executed;
+                    return false;
+                }
+                break;
+            }
+
+            case CMD_HNEW: {
+                int64_t handle;
+                if (!new_map(intr, &handle)) {
+                    intr->had_error = true;
+                    break;
+                }
+                intr->variables[(int) current->destination.base] = handle;
+
+                current = current->next;
+                break;
+            }
+
+            case CMD_HPUT: {
+                GuestMap *map   = map_from_handle(intr, intr->variables[(int) current->destination.base]);
+                int64_t   key   = fetch_number_value(intr, &current->val_a, current->is_a_immediate);
+                int64_t   value = fetch_number_value(intr, &current->val_b, current->is_b_immediate);
+                size_t    bytes = map ? guest_map_bytes(map) : 0;
+                if (!map || !guest_map_put(map, key, value, &intr->stats.map_probes)) {
+                    intr->had_error = true;
+                    break;
+                }
+                track_map_bytes(intr, bytes, guest_map_bytes(map));
+                intr->stats.map_puts++;
+
+                current = current->next;
+                break;
+            }
+
+            case CMD_HGET: {
+                GuestMap *map = map_from_handle(intr, intr->variables[(int) current->val_a.base]);
+                int64_t   key = fetch_number_value(intr, &current->val_b, current->is_b_immediate);
+                if (!map) {
+                    intr->had_error = true;
+                    break;
+                }
+
+                // A missing key reads as zero; the equal flag tells the cases apart
+                int64_t value = 0;
+                bool    found = guest_map_get(map, key, &value, &intr->stats.map_probes);
+                intr->variables[(int) current->destination.base] = value;
+                intr->is_greater = false;
+                intr->is_equal   = found;
+                intr->is_less    = false;
+                intr->stats.map_gets++;
+                intr->stats.map_hits += found;
+
+                current = current->next;
+                break;
+            }
+
+            case CMD_HDEL: {
+                GuestMap *map = map_from_handle(intr, intr->variables[(int) current->val_a.base]);
+                int64_t   key = fetch_number_value(intr, &current->val_b, current->is_b_immediate);
+                if (!map) {
+                    intr->had_error = true;
+                    break;
+                }
+
+                bool found       = guest_map_delete(map, key, &intr->stats.map_probes);
+                intr->is_greater = false;
+                intr->is_equal   = found;
+                intr->is_less    = false;
+                intr->stats.map_deletes++;
+
+                current = current->next;
+                break;
+            }
+
+            case CMD_LOOP: {
+                int64_t *counter = &intr->variables[(int) current->destination.base];
+                *counter = (int64_t) ((uint64_t) *counter - 1);
+                if (*counter == 0) {
+                    current = current->next;
+                    break;
+                }
+
+                if (current->target) {
+                    current = current->target;
                 } else {
+                    Entry *label = get_label(intr->label_map, current->val_a.str_val);
+                    if (!label && intr->awaiting_code) {
+                        // Run again once the label is parsed, so undo the decrement
+                        *counter = (int64_t) ((uint64_t) *counter + 1);
+                        intr->pc = current;
+                        intr->stats.commands += executed - 1;
+                        return false;
+                    }
+                    if (!label) {
+                        printf("Label not found: %s\n", current->val_a.str_val);
+                        intr->had_error = true;
+                        break;
+                    }
+                    current = label->command;
+                }
+
+                if (executed >= quantum) {
+                    intr->pc = current;
+                    intr->stats.commands += executed;
+                    return false;
+                }
+                break;
+            }
+
+            case CMD_REP: {
+                int64_t count = fetch_number_value(intr, &current->val_a, current->is_a_immediate);
+                if (count <= 0) {
+                    current = skip_rep_block(current);
+                    break;
+                }
+                if (!push_rep(intr, count, current->next)) {
+                    intr->had_error = true;
+                    break;
+                }
+
+                current = current->next;
+                break;
+            }
+
+            case CMD_REP_END: {
+                if (intr->rep_depth == 0) {
+                    // Reached by a branch into a block; there is nothing to repeat
+                    current = current->next;
+                    break;
+                }
+
+                RepCounter *rep = &intr->reps[intr->rep_depth - 1];
+                if (--rep->remaining == 0) {
+                    intr->rep_depth--;
+                    current = current->next;
+                    break;
+                }
+
+                current = rep->body;
+                if (executed >= quantum) {
+                    intr->pc = current;
+                    intr->stats.commands += executed;
+                    return false;
+                }
+                break;
+            }
+
+            case CMD_VLOOP: {
+                // Not a program command; only the iterations it replaces count
+                executed--;
+                const VectorLoop *loop = current->vector;
+                uint64_t          iterations;
+                if (!vector_loop_run(loop, intr->variables, &intr->memory, &iterations)) {
+                    current = current->next;
+                    break;
+                }
+                if (loop->sets_flags) {
+                    intr->is_greater = false;
+                    intr->is_equal   = true;
+                    intr->is_less    = false;
+                }
+                executed += iterations * loop->body_length;
+                intr->stats.vector_loops++;
+                intr->stats.vector_iterations += iterations;
+
+                current = loop->exit;
+                break;
+            }
+
+            case CMD_STRLEN: {
+                int64_t     address = fetch_number_value(intr, &current->val_a, current->is_a_immediate);
+                const char *str;
+                size_t      length;
+                if (address < 0 || !mem_get_string(&intr->memory, (size_t) address, &str, &length)) {
+                    intr->had_error = true;
+                    break;
+                }
+                intr->variables[(int) current->destination.base] = (int64_t) length;
+                intr->stats.string_commands++;
+                intr->stats.string_bytes += length;
+
+                current = current->next;
+                break;
+            }
+
+            case CMD_STRCHR: {
+                int64_t address = fetch_number_value(intr, &current->val_a, current->is_a_immediate);
+                int64_t c       = fetch_number_value(intr, &current->val_b, current->is_b_immediate);
+                size_t  position;
+                bool    found;
+                if (address < 0 || !mem_find_byte(&intr->memory, (size_t) address, (uint8_t) c, &position, &found)) {
+                    intr->had_error = true;
+                    break;
+                }
+                intr->variables[(int) current->destination.base] = (int64_t) position;
+                intr->is_greater = false;
+                intr->is_equal   = found;
+                intr->is_less    = false;
+                intr->stats.string_commands++;
+                intr->stats.string_bytes += position - (size_t) address;
+
+                current = current->next;
+                break;
+            }
+
+            case CMD_STRCMP: {
+                int64_t a = fetch_number_value(intr, &current->val_a, current->is_a_immediate);
+                int64_t b = fetch_number_value(intr, &current->val_b, current->is_b_immediate);
+                int     order;
+                if (a < 0 || b < 0 || !mem_compare_strings(&intr->memory, (size_t) a, (size_t) b, &order)) {
+                    intr->had_error = true;
+                    break;
+                }
+                intr->variables[(int) current->destination.base] = order;
+                intr->is_greater = order > 0;
+                intr->is_equal   = order == 0;
+                intr->is_less    = order < 0;
+                intr->stats.string_commands++;
+
+                current = current->next;
+                break;
+            }
+
+            case CMD_STRCPY: {
+                int64_t destination = fetch_number_value(intr, &current->val_a, current->is_a_immediate);
+                int64_t source      = fetch_number_value(intr, &current->val_b, current->is_b_immediate);
+                size_t  length;
+                if (destination < 0 || source < 0 ||
+                    !mem_copy_string(&intr->memory, (size_t) destination, (size_t) source, &length)) {
+                    intr->had_error = true;
+                    break;
+                }
+                intr->stats.string_commands++;
+                intr->stats.string_bytes += length + 1;
+
+                current = current->next;
+                break;
+            }
+
+            case CMD_CRC32C:
+            case CMD_HASH64: {
+                int64_t        address = fetch_number_value(intr, &current->val_a, current->is_a_immediate);
+                int64_t        length  = fetch_number_value(intr, &current->val_b, current->is_b_immediate);
+                const uint8_t *span    = address < 0 || length < 0 ? NULL : mem_read_span(&intr->memory, (size_t) address, (size_t) length);
+                if (!span) {
+                    intr->had_error = true;
+                    break;
+                }
+                intr->variables[(int) current->destination.base] =
+                    current->type == CMD_CRC32C ? (int64_t) checksum_crc32c(span, (size_t) length)
+                                                : (int64_t) checksum_hash64(span, (size_t) length);
+
+                current = current->next;
+                break;
+            }
+
+            case CMD_LDP: {
+                int64_t        address = fetch_number_value(intr, &current->val_b, current->is_b_immediate);
+                const uint8_t *span    = address < 0 ? NULL : mem_read_span(&intr->memory, (size_t) address, 16);
+                if (!span) {
+                    intr->had_error = true;
+                    break;
+                }
+                memcpy(&intr->variables[(int) current->destination.base], span, 8);
+                memcpy(&intr->variables[(int) current->val_a.base], span + 8, 8);
+
+                current = current->next;
+                break;
+            }
+
+            case CMD_STP: {
+                int64_t  address = fetch_number_value(intr, &current->val_b, current->is_b_immediate);
+                uint8_t *span    = address < 0 ? NULL : mem_write_span(&intr->memory, (size_t) address, 16);
+                if (!span) {
+                    intr->had_error = true;
+                    break;
+                }
+                memcpy(span, &intr->variables[(int) current->destination.base], 8);
+                memcpy(span + 8, &intr->variables[(int) current->val_a.base], 8);
+
+                current = current->next;
+                break;
+            }
+
+            // The range is contiguous in `variables`, so it moves in one copy
+            case CMD_LDM: {
+                int            first   = current->destination.base;
+                size_t         bytes   = (size_t) (current->val_a.base - first + 1) * 8;
+                int64_t        address = fetch_number_value(intr, &current->val_b, current->is_b_immediate);
+                const uint8_t *span    = address < 0 ? NULL : mem_read_span(&intr->memory, (size_t) address, bytes);
+                if (!span) {
+                    intr->had_error = true;
+                    break;
+                }
+                memcpy(&intr->variables[first], span, bytes);
+
+                current = current->next;
+                break;
+            }
+
+            case CMD_STM: {
+                int      first   = current->destination.base;
+                size_t   bytes   = (size_t) (current->val_a.base - first + 1) * 8;
+                int64_t  address = fetch_number_value(intr, &current->val_b, current->is_b_immediate);
+                uint8_t *span    = address < 0 ? NULL : mem_write_span(&intr->memory, (size_t) address, bytes);
+                if (!span) {
                     intr->had_error = true;
+                    break;
                 }
+                memcpy(span, &intr->variables[first], bytes);
 
                 current = current->next;
                 break;
             }
 
+            case CMD_SEGMENTS: {
+                // Not a program command; only the commands it replaces count
+                executed--;
+                const SegmentPlan *plan = current->segments;
+                uint64_t           ran;
+                if (!segments_run(plan, intr, &ran)) {
+                    current = current->next;
+                    break;
+                }
+                executed += ran;
+                intr->stats.segment_regions++;
+                intr->stats.segment_tasks += plan->task_count;
+
+                current = plan->exit;
+                break;
+            }
+
+            case CMD_AWAIT: {
+                // Not a program command
+                executed--;
+                if (current->next || !intr->awaiting_code) {
+                    current = current->next;
+                    break;
+                }
+
+                intr->pc = current;
+                intr->stats.commands += executed;
+                return false;
+            }
+
             default:
                 intr->had_error = true;
                 current = current->next;
@@ -114,7 +911,36 @@ void interpret(Interpreter *intr, Command *commands) {
         }
     }
 
-    // Week 4: free the stack at the end
+    intr->stats.commands += executed;
+    finish(intr);
+    return true;
+}
+
+void print_run_stats(Interpreter *intr) {
+    if (!intr) {
+        return;
+    }
+
+    const RunStats *stats = &intr->stats;
+    fprintf(stderr, "Run stats:\n");
+    fprintf(stderr, "Commands executed: %" PRIu64 "\n", stats->commands);
+    fprintf(stderr, "Maps created: %" PRIu64 "\n", stats->maps_created);
+    fprintf(stderr, "Map puts: %" PRIu64 "\n", stats->map_puts);
+    fprintf(stderr, "Map gets: %" PRIu64 " (%" PRIu64 " hits)\n", stats->map_gets,
+            stats->map_hits);
+    fprintf(stderr, "Map deletes: %" PRIu64 "\n", stats->map_deletes);
+    fprintf(stderr, "Map probes: %" PRIu64 "\n", stats->map_probes);
+    fprintf(stderr, "Map peak bytes: %" PRIu64 "\n", stats->map_peak_bytes);
+    fprintf(stderr, "Vectorized loops: %" PRIu64 " (%" PRIu64 " iterations)\n",
+            stats->vector_loops, stats->vector_iterations);
+    fprintf(stderr, "String commands: %" PRIu64 " (%" PRIu64 " bytes)\n", stats->string_commands,
+            stats->string_bytes);
+    fprintf(stderr, "Page faults: %" PRIu64 " minor, %" PRIu64 " major\n", stats->minor_faults,
+            stats->major_faults);
+    fprintf(stderr, "Forked calls: %" PRIu64 "\n", stats->forked_calls);
+    fprintf(stderr, "Parallel regions: %" PRIu64 " (%" PRIu64 " tasks)\n", stats->segment_regions,
+            stats->segment_tasks);
+    fprintf(stderr, "Output bytes: %" PRIu64 "\n", stats->output_bytes);
 }
 
 void print_interpreter_state(Interpreter *intr) {
@@ -163,6 +989,167 @@ static int64_t fetch_number_value(Interpreter *intr, Operand *op, bool is_im) {
     }
 }
 
+/**
+ * @brief Looks up the map a guest handle refers to.
+ *
+ * @param intr The pointer to the interpreter owning the maps.
+ * @param handle The handle, as returned by `hnew`.
+ * @return The map, or NULL if the handle is invalid.
+ */
+static GuestMap *map_from_handle(Interpreter *intr, int64_t handle) {
+    if (handle < 0 || (uint64_t) handle >= intr->map_count) {
+        return NULL;
+    }
+    return &intr->maps[handle];
+}
+
+/**
+ * @brief Creates an empty map owned by the interpreter.
+ *
+ * @param intr The pointer to the interpreter to own the map.
+ * @param handle Set to the new map's handle.
+ * @return True if the map was created, false if memory ran out.
+ */
+static bool new_map(Interpreter *intr, int64_t *handle) {
+    if (intr->map_count == intr->map_capacity) {
+        size_t    new_capacity = intr->map_capacity ? intr->map_capacity * 2 : 4;
+        GuestMap *maps         = realloc(intr->maps, new_capacity * sizeof(GuestMap));
+        if (!maps) {
+            return false;
+        }
+        intr->maps         = maps;
+        intr->map_capacity = new_capacity;
+    }
+
+    GuestMap *map = &intr->maps[intr->map_count];
+    if (!guest_map_init(map)) {
+        return false;
+    }
+
+    *handle = (int64_t) intr->map_count++;
+    intr->stats.maps_created++;
+    track_map_bytes(intr, 0, guest_map_bytes(map));
+    return true;
+}
+
+/**
+ * @brief Accounts for a map changing size and updates the peak.
+ *
+ * @param intr The pointer to the interpreter owning the map.
+ * @param before The size of the map before the change.
+ * @param after The size of the map after the change.
+ */
+static void track_map_bytes(Interpreter *intr, size_t before, size_t after) {
+    intr->map_bytes = intr->map_bytes - before + after;
+    if (intr->map_bytes > intr->stats.map_peak_bytes) {
+        intr->stats.map_peak_bytes = intr->map_bytes;
+    }
+}
+
+/**
+ * @brief Opens a `rep` block, growing the counter stack if needed.
+ *
+ * @param intr The pointer to the interpreter running the block.
+ * @param count The number of iterations, at least one.
+ * @param body The first command of the block.
+ * @return True if the counter was pushed, false if memory ran out.
+ */
+static bool push_rep(Interpreter *intr, int64_t count, Command *body) {
+    if (intr->rep_depth == intr->rep_capacity) {
+        size_t      capacity = intr->rep_capacity ? intr->rep_capacity * 2 : 8;
+        RepCounter *reps     = realloc(intr->reps, capacity * sizeof(RepCounter));
+        if (!reps) {
+            return false;
+        }
+        intr->reps         = reps;
+        intr->rep_capacity = capacity;
+    }
+
+    intr->reps[intr->rep_depth].remaining = count;
+    intr->reps[intr->rep_depth].body      = body;
+    intr->rep_depth++;
+    return true;
+}
+
+/**
+ * @brief Finds the command following the `}` that closes a `rep` block.
+ *
+ * Only used when the block runs zero times, so the walk is not on the hot
+ * path.
+ *
+ * @param rep The `rep` command opening the block.
+ * @return The command after the matching `}`, or NULL if the program ends.
+ */
+static Command *skip_rep_block(Command *rep) {
+    size_t   depth = 0;
+    Command *cmd   = rep->next;
+    while (cmd) {
+        if (cmd->type == CMD_REP) {
+            depth++;
+        } else if (cmd->type == CMD_REP_END) {
+            if (depth == 0) {
+                return cmd->next;
+            }
+            depth--;
+        }
+        cmd = cmd->next;
+    }
+    return NULL;
+}
+
+/**
+ * @brief Stops the program and rewinds its call stack, keeping the frames for
+ * reuse by a later run. Sibling calls still running in parallel are stopped.
+ *
+ * @param intr The pointer to the interpreter that finished.
+ */
+static void finish(Interpreter *intr) {
+    intr->pc        = NULL;
+    intr->rep_depth = 0;
+    while (intr->the_stack) {
+        StackEntry *entry = intr->the_stack;
+        intr->the_stack   = entry->next;
+        entry->next       = intr->free_frames;
+        intr->free_frames = entry;
+        if (entry->fork) {
+            fork_cancel(entry->fork, intr);
+        }
+    }
+    if (intr->joining) {
+        fork_cancel(intr->joining, intr);
+        intr->joining = NULL;
+    }
+}
+
+/**
+ * @brief Frees the maps created by the program.
+ *
+ * @param intr The pointer to the interpreter owning the maps.
+ */
+static void free_maps(Interpreter *intr) {
+    for (size_t i = 0; i < intr->map_count; i++) {
+        guest_map_free(&intr->maps[i]);
+    }
+    free(intr->maps);
+    intr->maps         = NULL;
+    intr->map_count    = 0;
+    intr->map_capacity = 0;
+    intr->map_bytes    = 0;
+}
+
+/**
+ * @brief Frees a list of stack frames.
+ *
+ * @param entry The first frame of the list.
+ */
+static void free_frame_list(StackEntry *entry) {
+    while (entry) {
+        StackEntry *next = entry->next;
+        free(entry);
+        entry = next;
+    }
+}
+
 /**
  * @brief Determines whether a given branch condition holds.
  *
@@ -172,8 +1159,24 @@ static int64_t fetch_number_value(Interpreter *intr, Operand *op, bool is_im) {
  * @return True if the given condition holds, false otherwise.
  */
 static bool cond_holds(Interpreter *intr, BranchCondition cond) {
-    // STUDENT TODO: Determine whether a given condition holds using the interpreter's state
-    return false;
+    switch (cond) {
+        case BRANCH_ALWAYS:
+            return true;
+        case BRANCH_EQUAL:
+            return intr->is_equal;
+        case BRANCH_NOT_EQUAL:
+            return !intr->is_equal;
+        case BRANCH_GREATER:
+            return intr->is_greater;
+        case BRANCH_LESS:
+            return intr->is_less;
+        case BRANCH_GREATER_EQUAL:
+            return intr->is_greater || intr->is_equal;
+        case BRANCH_LESS_EQUAL:
+            return intr->is_less || intr->is_equal;
+        default:
+            return false;
+    }
 }
 
 /**
@@ -184,6 +1187,21 @@ static bool cond_holds(Interpreter *intr, BranchCondition cond) {
  * @return True whether the print was successful, false otherwise.
  */
 static bool print_base(Interpreter *intr, Command *cmd) {
-    // STUDENT TODO: Print the given value respecting the appropriate base
-    return false;
+    int64_t value = fetch_number_value(intr, &cmd->val_a, cmd->is_a_immediate);
+    char    base  = (char) cmd->val_b.base;
+
+    const char *str    = NULL;
+    size_t      length = 0;
+    if (base == 's') {
+        if (value < 0 || !mem_get_string(&intr->memory, (size_t) value, &str, &length)) {
+            return false;
+        }
+    }
+
+    // Only the other formats print where a value came from
+    uint32_t site    = intr->output_format == OUTPUT_TEXT ? 0 : command_line(cmd);
+    size_t   written = output_print(intr->output, intr->output_format, site, base, value, str,
+                                    length);
+    intr->stats.output_bytes += written;
+    return written > 0;
 }
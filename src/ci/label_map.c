@@ -1,6 +1,7 @@
 #include <stdbool.h>
 #include <stddef.h>
 #include <stdlib.h>
+#include <string.h>
 #include "label_map.h"
 
 static void          free_entry(Entry *e);
@@ -9,7 +10,17 @@ static unsigned long hash_function(char *s);
 static Entry        *entry_init(char *id, Command *command);
 
 bool label_map_init(LabelMap *map, int capacity) {
-    // STUDENT TODO: Initialize the fields of the label map
+    if (!map || capacity <= 0) {
+        return false;
+    }
+
+    map->entries = (Entry **) calloc(capacity, sizeof(Entry *));
+    if (!map->entries) {
+        map->capacity = 0;
+        return false;
+    }
+
+    map->capacity = capacity;
     return true;
 }
 
@@ -19,8 +30,12 @@ bool label_map_init(LabelMap *map, int capacity) {
  * @param e The pointer to the entry to free.
  */
 static void free_entry(Entry *e) {
-    // STUDENT TODO: Free a *singular* entry
-    // Do not free children; see below
+    if (!e) {
+        return;
+    }
+
+    free(e->id);
+    free(e);
 }
 
 /**
@@ -29,12 +44,25 @@ static void free_entry(Entry *e) {
  * @param e A pointer to the first entry to free.
  */
 static void free_entries(Entry *e) {
-    // STUDENT TODO: Free an entry and its children
+    while (e) {
+        Entry *next = e->next;
+        free_entry(e);
+        e = next;
+    }
 }
 
 void label_map_free(LabelMap *map) {
-    // STUDENT TODO: Free the entries associated with this hashmap
-    // Do not free the pointer itself, as you do not know whether it was allocated on the heap
+    if (!map || !map->entries) {
+        return;
+    }
+
+    for (int i = 0; i < map->capacity; i++) {
+        free_entries(map->entries[i]);
+    }
+
+    free(map->entries);
+    map->entries  = NULL;
+    map->capacity = 0;
 }
 
 /**
@@ -60,17 +88,68 @@ static unsigned long hash_function(char *s) {
  * @return True if the entry was initialized successfully, false otherwise.
  */
 static Entry *entry_init(char *id, Command *command) {
-    // STUDENT TODO: Initialize the entry and its fields
-    return NULL;
+    Entry *e = (Entry *) malloc(sizeof(Entry));
+    if (!e) {
+        return NULL;
+    }
+
+    e->id = (char *) malloc(strlen(id) + 1);
+    if (!e->id) {
+        free(e);
+        return NULL;
+    }
+
+    strcpy(e->id, id);
+    e->command = command;
+    e->next    = NULL;
+    return e;
 }
 
 bool put_label(LabelMap *map, char *id, Command *command) {
-    // STUDENT TODO: Put the given command into the bucket associated with this label
-    // It is okay for the command to be null
-    return false;
+    if (!map || !map->entries || !id) {
+        return false;
+    }
+
+    unsigned long bucket = hash_function(id) % map->capacity;
+    for (Entry *e = map->entries[bucket]; e; e = e->next) {
+        if (strcmp(e->id, id) == 0) {
+            e->command = command;
+            return true;
+        }
+    }
+
+    Entry *e = entry_init(id, command);
+    if (!e) {
+        return false;
+    }
+
+    e->next              = map->entries[bucket];
+    map->entries[bucket] = e;
+    return true;
 }
 
 Entry *get_label(LabelMap *map, char *id) {
-    // STUDENT TODO: Retrieve the value associated with this label
+    if (!map || !map->entries || !id) {
+        return NULL;
+    }
+
+    unsigned long bucket = hash_function(id) % map->capacity;
+    for (Entry *e = map->entries[bucket]; e; e = e->next) {
+        if (strcmp(e->id, id) == 0) {
+            return e;
+        }
+    }
+
     return NULL;
 }
+
+void resolve_loop_targets(LabelMap *map, Command *commands) {
+    for (Command *cmd = commands; cmd; cmd = cmd->next) {
+        if (cmd->type != CMD_LOOP) {
+            continue;
+        }
+
+        Entry *label = get_label(map, cmd->val_a.str_val);
+        cmd->target  = label ? label->command : NULL;
+    }
+}
@@ -0,0 +1,391 @@
+#define _GNU_SOURCE
+#include "layout.h"
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "command_type.h"
+
+// Names the end of the program once moved blocks follow it
+static char END_LABEL[] = "$end";
+
+/**
+ * @brief The blocks moved out of the way so far, in the order they were moved.
+ */
+typedef struct {
+    Command *head;   // The first command of the first block, NULL if none moved.
+    Command *tail;   // The last command of the last block.
+    size_t   count;  // The number of labels made for moved blocks.
+} ColdList;
+
+/**
+ * @brief A command of the program and how layout treats it.
+ */
+typedef struct {
+    Command   *command;  // The command.
+    LayoutHint hint;     // Its hint.
+} Placement;
+
+/**
+ * @brief Every command of the program in its original order, with a hash from
+ * command to its position.
+ */
+typedef struct {
+    Placement *entries;     // The commands in program order.
+    size_t     count;       // The number of commands.
+    size_t    *slots;       // Positions in `entries` plus one, 0 for an empty slot.
+    size_t     slot_count;  // The number of slots, a power of two.
+} BlockTable;
+
+static bool            table_init(BlockTable *table, Command *commands, const LayoutHints *hints);
+static void            table_free(BlockTable *table);
+static size_t          slot_of(const BlockTable *table, const Command *cmd);
+static size_t          position_of(const BlockTable *table, const Command *cmd);
+static LayoutHint      hint_of(const BlockTable *table, const Command *cmd);
+static void            mark_unlikely_targets(BlockTable *table, LabelMap *map);
+static bool            ends_block(const Command *cmd);
+static bool            is_rep(const Command *cmd);
+static Command        *make_branch(const char *label);
+static BranchCondition invert(BranchCondition cond);
+static bool            move_block(ColdList *cold, Command *before, Command *end, const char *follow);
+static bool            move_cold_block(ColdList *cold, Command *before);
+static void            invert_likely_branch(ColdList *cold, BlockTable *table, Command *branch,
+                                            LabelMap *map);
+
+void layout_hints_add(LayoutHints *hints, Command *command, LayoutHint hint) {
+    if (hints->count == hints->capacity) {
+        size_t      new_capacity = hints->capacity ? hints->capacity * 2 : 16;
+        Command   **new_commands = realloc(hints->commands, new_capacity * sizeof(Command *));
+        if (!new_commands) {
+            return;
+        }
+        hints->commands = new_commands;
+
+        LayoutHint *new_hints = realloc(hints->hints, new_capacity * sizeof(LayoutHint));
+        if (!new_hints) {
+            return;
+        }
+        hints->hints    = new_hints;
+        hints->capacity = new_capacity;
+    }
+
+    hints->commands[hints->count] = command;
+    hints->hints[hints->count++]  = hint;
+}
+
+void layout_hints_free(LayoutHints *hints) {
+    free(hints->commands);
+    free(hints->hints);
+    *hints = (LayoutHints) {0};
+}
+
+/**
+ * @brief Numbers the commands of a program and gives each its hint.
+ *
+ * @return True on success, false if allocating failed.
+ */
+static bool table_init(BlockTable *table, Command *commands, const LayoutHints *hints) {
+    table->count = 0;
+    for (Command *cmd = commands; cmd; cmd = cmd->next) {
+        table->count++;
+    }
+
+    table->slot_count = 16;
+    while (table->slot_count < table->count * 2) {
+        table->slot_count *= 2;
+    }
+    table->entries = malloc(table->count * sizeof(Placement));
+    table->slots   = calloc(table->slot_count, sizeof(size_t));
+    if (!table->entries || !table->slots) {
+        table_free(table);
+        return false;
+    }
+
+    size_t i = 0;
+    for (Command *cmd = commands; cmd; cmd = cmd->next, i++) {
+        table->entries[i]                 = (Placement) {cmd, HINT_NONE};
+        table->slots[slot_of(table, cmd)] = i + 1;
+    }
+    for (size_t h = 0; h < hints->count; h++) {
+        size_t position = position_of(table, hints->commands[h]);
+        if (position) {
+            table->entries[position - 1].hint = hints->hints[h];
+        }
+    }
+    return true;
+}
+
+static void table_free(BlockTable *table) {
+    free(table->entries);
+    free(table->slots);
+    table->entries = NULL;
+    table->slots   = NULL;
+}
+
+/**
+ * @brief Returns the slot holding a command, or the empty slot where it would
+ * go.
+ */
+static size_t slot_of(const BlockTable *table, const Command *cmd) {
+    size_t mask = table->slot_count - 1;
+    size_t slot = (size_t) (((uintptr_t) cmd >> 4) * 0x9e3779b97f4a7c15ULL) & mask;
+    while (table->slots[slot] && table->entries[table->slots[slot] - 1].command != cmd) {
+        slot = (slot + 1) & mask;
+    }
+    return slot;
+}
+
+/**
+ * @brief Returns the position of a command in the original program plus one,
+ * or 0 for a command layout made.
+ */
+static size_t position_of(const BlockTable *table, const Command *cmd) {
+    return table->slots[slot_of(table, cmd)];
+}
+
+/**
+ * @brief Returns the hint of a command, HINT_NONE for a command layout made.
+ */
+static LayoutHint hint_of(const BlockTable *table, const Command *cmd) {
+    size_t position = position_of(table, cmd);
+    return position ? table->entries[position - 1].hint : HINT_NONE;
+}
+
+/**
+ * @brief Marks the targets of `b.cond.unlikely` branches as cold, unless they
+ * carry a hint of their own.
+ */
+static void mark_unlikely_targets(BlockTable *table, LabelMap *map) {
+    for (size_t i = 0; i < table->count; i++) {
+        const Placement *entry = &table->entries[i];
+        if (entry->command->type != CMD_BRANCH || entry->hint != HINT_UNLIKELY) {
+            continue;
+        }
+
+        Entry *label    = get_label(map, entry->command->val_a.str_val);
+        size_t position = label && label->command ? position_of(table, label->command) : 0;
+        if (position && table->entries[position - 1].hint == HINT_NONE) {
+            table->entries[position - 1].hint = HINT_COLD;
+        }
+    }
+}
+
+/**
+ * @brief Determines if a command never continues with the next one.
+ */
+static bool ends_block(const Command *cmd) {
+    return cmd->type == CMD_RET ||
+           (cmd->type == CMD_BRANCH && cmd->branch_condition == BRANCH_ALWAYS);
+}
+
+/**
+ * @brief Determines if a command opens or closes a `rep` block, which finds
+ * its other half by walking the list and so must stay where it is.
+ */
+static bool is_rep(const Command *cmd) {
+    return cmd->type == CMD_REP || cmd->type == CMD_REP_END;
+}
+
+/**
+ * @brief Creates an unconditional branch to a label.
+ *
+ * @return The branch, or NULL if allocating it failed.
+ */
+static Command *make_branch(const char *label) {
+    Command *cmd = calloc(1, sizeof(Command));
+    if (!cmd) {
+        return NULL;
+    }
+
+    cmd->val_a.str_val = strdup(label);
+    if (!cmd->val_a.str_val) {
+        free(cmd);
+        return NULL;
+    }
+    cmd->type             = CMD_BRANCH;
+    cmd->is_a_string      = true;
+    cmd->branch_condition = BRANCH_ALWAYS;
+    return cmd;
+}
+
+/**
+ * @brief Returns the condition that holds exactly when `cond` does not.
+ */
+static BranchCondition invert(BranchCondition cond) {
+    switch (cond) {
+        case BRANCH_EQUAL:
+            return BRANCH_NOT_EQUAL;
+        case BRANCH_NOT_EQUAL:
+            return BRANCH_EQUAL;
+        case BRANCH_GREATER:
+            return BRANCH_LESS_EQUAL;
+        case BRANCH_LESS_EQUAL:
+            return BRANCH_GREATER;
+        case BRANCH_LESS:
+            return BRANCH_GREATER_EQUAL;
+        case BRANCH_GREATER_EQUAL:
+            return BRANCH_LESS;
+        default:
+            return cond;
+    }
+}
+
+/**
+ * @brief Moves the commands after `before` up to and including `end` to the
+ * cold list.
+ *
+ * @param cold Pointer to the cold list.
+ * @param before The command preceding the block; it must not fall into it.
+ * @param end The last command of the block.
+ * @param follow The label naming what used to follow `end`, branched to at
+ * the end of the moved block if `end` can continue with the next command.
+ * @return True if the block was moved, false if allocating failed.
+ */
+static bool move_block(ColdList *cold, Command *before, Command *end, const char *follow) {
+    Command *start = before->next;
+    if (!ends_block(end)) {
+        Command *jump = make_branch(follow);
+        if (!jump) {
+            return false;
+        }
+        command_set_line(jump, command_line(end));
+        jump->next = end->next;
+        end->next  = jump;
+        end        = jump;
+    }
+
+    before->next = end->next;
+    end->next    = NULL;
+    if (cold->tail) {
+        cold->tail->next = start;
+    } else {
+        cold->head = start;
+    }
+    cold->tail = end;
+    return true;
+}
+
+/**
+ * @brief Moves the cold block following a command that never falls into it.
+ *
+ * The block ends at the first unconditional branch or return, or at the end
+ * of the program.
+ *
+ * @param cold Pointer to the cold list.
+ * @param before The command preceding the cold block.
+ * @return True if the block was moved, false otherwise.
+ */
+static bool move_cold_block(ColdList *cold, Command *before) {
+    for (Command *cmd = before->next; cmd; cmd = cmd->next) {
+        if (is_rep(cmd)) {
+            return false;
+        }
+        if (ends_block(cmd) || !cmd->next) {
+            return move_block(cold, before, cmd, END_LABEL);
+        }
+    }
+    return false;
+}
+
+/**
+ * @brief Turns a `b.cond.likely` branch over the commands up to its target
+ * into a branch to those commands under the inverse condition, and moves them
+ * to the cold list so the target follows the branch.
+ *
+ * Only the commands up to the target are walked: a target before the branch,
+ * or one already moved to the cold list, is recognised by its position.
+ *
+ * @param cold Pointer to the cold list.
+ * @param table The commands of the original program; receives the new hint of
+ * the branch.
+ * @param branch The branch.
+ * @param map Pointer to the label map, which receives the label of the moved
+ * commands.
+ */
+static void invert_likely_branch(ColdList *cold, BlockTable *table, Command *branch,
+                                 LabelMap *map) {
+    Entry *label = get_label(map, branch->val_a.str_val);
+    if (!label || !label->command || label->command == branch->next) {
+        return;
+    }
+    size_t target = position_of(table, label->command);
+    if (target <= position_of(table, branch)) {
+        return;
+    }
+
+    // The target must still follow the branch, with no `rep` block in between
+    Command *end = branch->next;
+    while (end && end->next != label->command && !is_rep(end) &&
+           position_of(table, end) < target) {
+        end = end->next;
+    }
+    if (!end || end->next != label->command || is_rep(end)) {
+        return;
+    }
+
+    char name[32];
+    snprintf(name, sizeof(name), "$cold.%zu", cold->count);
+    char *skipped = strdup(name);
+    if (!skipped || !put_label(map, skipped, branch->next)) {
+        free(skipped);
+        return;
+    }
+    cold->count++;
+
+    if (!move_block(cold, branch, end, branch->val_a.str_val)) {
+        free(skipped);
+        return;
+    }
+    free(branch->val_a.str_val);
+    branch->val_a.str_val    = skipped;
+    branch->branch_condition = invert(branch->branch_condition);
+    table->entries[position_of(table, branch) - 1].hint = HINT_UNLIKELY;
+}
+
+void layout_program(Command *commands, LabelMap *map, const LayoutHints *hints) {
+    BlockTable table;
+    if (!commands || hints->count == 0 || !table_init(&table, commands, hints)) {
+        return;
+    }
+    if (!put_label(map, END_LABEL, NULL)) {
+        table_free(&table);
+        return;
+    }
+    mark_unlikely_targets(&table, map);
+
+    // Made up front: once blocks have moved, the program must be able to stop
+    // before running into them
+    Command *stop = make_branch(END_LABEL);
+    if (!stop) {
+        table_free(&table);
+        return;
+    }
+
+    ColdList cold = {NULL, NULL, 0};
+    Command *tail = commands;
+    for (Command *cmd = commands; cmd;) {
+        if (ends_block(cmd) && cmd->next && hint_of(&table, cmd->next) == HINT_COLD &&
+            move_cold_block(&cold, cmd)) {
+            continue;  // Whatever followed the block may be cold as well
+        }
+        if (cmd->type == CMD_BRANCH && hint_of(&table, cmd) == HINT_LIKELY) {
+            invert_likely_branch(&cold, &table, cmd, map);
+        }
+        tail = cmd;
+        cmd  = cmd->next;
+    }
+
+    if (!cold.head || ends_block(tail)) {
+        free_command(stop);
+    } else {
+        command_set_line(stop, command_line(tail));
+        tail->next = stop;
+        tail       = stop;
+    }
+    if (cold.head) {
+        tail->next = cold.head;
+    }
+    table_free(&table);
+}
@@ -1,13 +1,13 @@
 #include "lexer.h"
 
 #include <stdbool.h>
+#include <stdint.h>
 #include <stdio.h>
 #include <string.h>
 
+#include "scan.h"
 #include "token_type.h"
 
-static const char *BAD_BASE_MSG = "Either no or invalid digit in the specified base";
-
 /**
  * @brief Structure representing a keyword and its corresponding token type.
  */
@@ -29,21 +29,32 @@ static const Keyword keywords[] = {
     {"lsl", 3, TOK_LSL},         {"lsr", 3, TOK_LSR},        {"mov", 3, TOK_MOV},
     {"orr", 3, TOK_ORR},         {"print", 5, TOK_PRINT},    {"put", 3, TOK_PUT},
     {"ret", 3, TOK_RET},         {"store", 5, TOK_STORE},    {"sub", 3, TOK_SUB},
+    {"hnew", 4, TOK_HNEW},       {"hput", 4, TOK_HPUT},      {"hget", 4, TOK_HGET},
+    {"hdel", 4, TOK_HDEL},       {"loop", 4, TOK_LOOP},      {"rep", 3, TOK_REP},
+    {"strlen", 6, TOK_STRLEN},   {"strchr", 6, TOK_STRCHR},  {"strcmp", 6, TOK_STRCMP},
+    {"strcpy", 6, TOK_STRCPY},   {".likely", 7, TOK_LIKELY}, {".unlikely", 9, TOK_UNLIKELY},
+    {".cold", 5, TOK_COLD},      {"ldp", 3, TOK_LDP},        {"stp", 3, TOK_STP},
+    {"ldm", 3, TOK_LDM},         {"stm", 3, TOK_STM},        {"loads", 5, TOK_LOADS},
+    {"crc32c", 6, TOK_CRC32C},   {"hash64", 6, TOK_HASH64},  {"ubfx", 4, TOK_UBFX},
+    {"sbfx", 4, TOK_SBFX},       {"bfi", 3, TOK_BFI},        {"bfxil", 5, TOK_BFXIL},
+    {"ror", 3, TOK_ROR},
 };
 
 // Calculate on the fly so you only have to modify the array
 static const int num_keywords = sizeof(keywords) / sizeof(keywords[0]);
 
 static char advance(Lexer *lex);
+static void advance_by(Lexer *lex, size_t count);
 static bool is_at_end(Lexer *lex);
 static char peek(Lexer *lex);
 static char peek_next(Lexer *lex);
 static void skip_whitespace(Lexer *lex);
 
 static Token make_token(Lexer *lex, TokenType tok_type);
-static Token error_token(Lexer *lex, const char *message);
+static Token error_token(Lexer *lex, TokenError error);
 
 static Token     make_ident(Lexer *lex);
+static void      split_branch_hint(Lexer *lex);
 static TokenType ident_type(Lexer *lex);
 static Token     make_number(Lexer *lex, char first_digit);
 static Token     make_binary(Lexer *lex);
@@ -55,6 +66,9 @@ static bool is_digit(char c);
 static bool is_hex(char c);
 static bool is_binary(char c);
 
+static int  digit_value(char c, int base);
+static bool decode_number(const char *lexeme, int length, int64_t *result);
+
 void lexer_init(Lexer *lex, const char *text) {
     if (!lex) {
         return;
@@ -64,6 +78,7 @@ void lexer_init(Lexer *lex, const char *text) {
     lex->current_position = text;
     lex->current_line     = 1;
     lex->current_column   = 1;
+    lex->error            = TOKEN_ERR_UNEXPECTED_CHAR;
 }
 
 /**
@@ -78,6 +93,17 @@ static char advance(Lexer *lex) {
     return lex->current_position[-1];
 }
 
+/**
+ * @brief Advances the lexer over a run of characters on the current line.
+ *
+ * @param lex A pointer to the lexer, the input stream.
+ * @param count The number of characters to consume.
+ */
+static void advance_by(Lexer *lex, size_t count) {
+    lex->current_position += count;
+    lex->current_column += (int) count;
+}
+
 /**
  * @brief Determines if the lexer is at the end of the given string.
  *
@@ -104,14 +130,17 @@ static Token make_token(Lexer *lex, TokenType tok_type) {
 }
 
 /**
- * @brief Creates an error token with the given message.
+ * @brief Creates an error token whose lexeme is the message of the given
+ * error, and records the error in the lexer.
  *
  * @param lex A pointer to the lexer, the input stream.
- * @param message The error message this token should contain.
+ * @param error The error this token reports.
  * @return The error token.
  */
-static Token error_token(Lexer *lex, const char *message) {
-    Token token;
+static Token error_token(Lexer *lex, TokenError error) {
+    Token       token;
+    const char *message = token_error_message(error);
+    lex->error          = error;
     token_init(&token, TOK_ERR, message, strlen(message), lex->current_line,
                lex->current_column - 1);
     return token;
@@ -126,28 +155,10 @@ static Token error_token(Lexer *lex, const char *message) {
  * @param lex A pointer to the lexer, the input stream.
  */
 static void skip_whitespace(Lexer *lex) {
-    for (;;) {
-        char c = peek(lex);
-        switch (c) {
-            case ' ':
-            case ',':
-            case '\r':
-            case '\t':
-                advance(lex);
-                break;
-            case '/':
-                if (peek_next(lex) == '/') {
-                    // Go to end of line
-                    while (peek(lex) != '\n' && !is_at_end(lex)) {
-                        advance(lex);
-                    }
-                } else {
-                    // Found *only* one slash
-                    return;
-                }
-            default:
-                return;
-        }
+    advance_by(lex, scan_blanks(lex->current_position));
+    if (peek(lex) == '/' && peek_next(lex) == '/') {
+        // Go to end of line
+        advance_by(lex, scan_line_end(lex->current_position));
     }
 }
 
@@ -172,11 +183,15 @@ Token lexer_next_token(Lexer *lex) {
         return t;
     } else if (c == ':') {
         return make_token(lex, TOK_COLON);
+    } else if (c == '{') {
+        return make_token(lex, TOK_LBRACE);
+    } else if (c == '}') {
+        return make_token(lex, TOK_RBRACE);
     } else if (c == '"') {
         return make_string(lex);
     }
 
-    return error_token(lex, "Unexpected character");
+    return error_token(lex, TOKEN_ERR_UNEXPECTED_CHAR);
 }
 
 /**
@@ -255,13 +270,33 @@ static bool is_binary(char c) {
  * Returns an appropriate type if this is the case.
  */
 static Token make_ident(Lexer *lex) {
-    while (is_alpha(peek(lex)) || is_digit(peek(lex))) {
-        advance(lex);
-    }
+    advance_by(lex, scan_ident(lex->current_position));
+    split_branch_hint(lex);
 
     return make_token(lex, ident_type(lex));
 }
 
+/**
+ * @brief Ends a conditional branch keyword before a `.likely` or `.unlikely`
+ * suffix, so `b.eq.likely` lexes as `b.eq` followed by the hint.
+ *
+ * @param lex A pointer to the lexer positioned after the identifier.
+ */
+static void split_branch_hint(Lexer *lex) {
+    const char *start  = lex->start_position;
+    size_t      length = lex->current_position - start;
+    if (length <= 4 || start[0] != 'b' || start[1] != '.' || start[4] != '.') {
+        return;
+    }
+
+    size_t suffix = length - 4;
+    if ((suffix == 7 && memcmp(start + 4, ".likely", 7) == 0) ||
+        (suffix == 9 && memcmp(start + 4, ".unlikely", 9) == 0)) {
+        lex->current_position -= suffix;
+        lex->current_column -= (int) suffix;
+    }
+}
+
 /**
  * @brief Determines whether the given identifier (word) is reserved.
  *
@@ -328,7 +363,7 @@ static Token make_binary(Lexer *lex) {
 
     // Handle empty binary
     if (!is_binary(c)) {
-        return error_token(lex, BAD_BASE_MSG);
+        return error_token(lex, TOKEN_ERR_BAD_BASE);
     }
 
     while (is_binary(c)) {
@@ -354,7 +389,7 @@ static Token make_hex(Lexer *lex) {
 
     // Handle empty hex
     if (!is_hex(c)) {
-        return error_token(lex, BAD_BASE_MSG);
+        return error_token(lex, TOKEN_ERR_BAD_BASE);
     }
 
     while (is_hex(c)) {
@@ -372,12 +407,13 @@ static Token make_hex(Lexer *lex) {
  * @return A token representing this string, excluding the quotes
  */
 static Token make_string(Lexer *lex) {
-    while (peek(lex) != '"' && !is_at_end(lex)) {
-        if (peek(lex) == '\n') {
-            lex->current_line++;
-            lex->current_column = 1;
+    for (;;) {
+        advance_by(lex, scan_string_end(lex->current_position));
+        if (peek(lex) != '\n') {
+            break;
         }
-
+        lex->current_line++;
+        lex->current_column = 1;
         advance(lex);
     }
 
@@ -388,6 +424,132 @@ static Token make_string(Lexer *lex) {
     return t;
 }
 
+/**
+ * @brief Returns the value of a single digit in the given base.
+ *
+ * @param c The character to convert.
+ * @param base The base the digit is written in (2, 10 or 16).
+ * @return The digit's value, or -1 if `c` is not a digit in `base`.
+ */
+static int digit_value(char c, int base) {
+    int value = -1;
+    if (c >= '0' && c <= '9') {
+        value = c - '0';
+    } else if (c >= 'a' && c <= 'f') {
+        value = c - 'a' + 10;
+    } else if (c >= 'A' && c <= 'F') {
+        value = c - 'A' + 10;
+    }
+
+    return value < base ? value : -1;
+}
+
+/**
+ * @brief Decodes the text of a numeric token into its value.
+ *
+ * Accepts decimal, binary (`0b` prefix) and hexadecimal (`0x` prefix)
+ * literals. Like `strtoll`, values above INT64_MAX saturate to INT64_MAX.
+ *
+ * @param lexeme The start of the numeric token.
+ * @param length The length of the numeric token.
+ * @param result A pointer to the value to modify on success.
+ * @return True if `result` was successfully modified, false otherwise.
+ */
+static bool decode_number(const char *lexeme, int length, int64_t *result) {
+    int base  = 10;
+    int start = 0;
+    if (length >= 2 && lexeme[0] == '0') {
+        if (lexeme[1] == 'x' || lexeme[1] == 'X') {
+            base = 16;
+        } else if (lexeme[1] == 'b' || lexeme[1] == 'B') {
+            base = 2;
+        } else {
+            return false;
+        }
+        start = 2;
+    }
+
+    int64_t value = 0;
+    for (int i = start; i < length; i++) {
+        int digit = digit_value(lexeme[i], base);
+        if (digit < 0) {
+            return false;
+        }
+
+        if (value > (INT64_MAX - digit) / base) {
+            value = INT64_MAX;
+        } else if (value != INT64_MAX) {
+            value = value * base + digit;
+        }
+    }
+
+    *result = value;
+    return true;
+}
+
+bool lexer_tokenize(Lexer *lex, TokenBuffer *buf) {
+    const char *source = buf->source;
+
+    for (;;) {
+        Token    t = lexer_next_token(lex);
+        uint32_t offset;
+        int64_t  value = 0;
+
+        if (t.type == TOK_ERR) {
+            // The lexeme is the message; point the offset at the offending character
+            offset = (uint32_t) (lex->current_position - 1 - source);
+            value  = lex->error;
+        } else {
+            offset = (uint32_t) (t.lexeme - source);
+            if (t.type == TOK_NUM && !decode_number(t.lexeme, t.length, &value)) {
+                t.type = TOK_ERR;
+                value  = TOKEN_ERR_BAD_NUMBER;
+            }
+        }
+
+        if (!token_buffer_push(buf, t.type, offset, (uint32_t) t.length, value)) {
+            return false;
+        }
+
+        // Mirror the lexer's line accounting: newline tokens and strings spanning lines
+        if (t.type == TOK_NL && t.lexeme[0] == '\n') {
+            if (!token_buffer_push_line(buf, offset + 1)) {
+                return false;
+            }
+        } else if (t.type == TOK_STR) {
+            for (int i = 0; i < t.length; i++) {
+                if (t.lexeme[i] == '\n' && !token_buffer_push_line(buf, offset + i + 1)) {
+                    return false;
+                }
+            }
+        }
+
+        if (t.type == TOK_EOF) {
+            return true;
+        }
+    }
+}
+
+int lexer_brace_change(const char *line, size_t length) {
+    int  change    = 0;
+    bool in_string = false;
+    for (size_t i = 0; i < length; i++) {
+        char c = line[i];
+        if (c == '"') {
+            in_string = !in_string;
+        } else if (in_string) {
+            continue;
+        } else if (c == '/' && i + 1 < length && line[i + 1] == '/') {
+            break;
+        } else if (c == '{') {
+            change++;
+        } else if (c == '}') {
+            change--;
+        }
+    }
+    return change;
+}
+
 void print_lexed_tokens(Lexer *lex) {
     bool should_stop = false;
     while (!should_stop) {
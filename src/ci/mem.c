@@ -1,10 +1,37 @@
+#define _GNU_SOURCE
 #include "mem.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <stdint.h>
 #include <stdio.h>
 #include <string.h>
+#include <sys/mman.h>
+#include <sys/resource.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#include "scan.h"
 
-static uint8_t mem[MEM_CAPACITY];
+#define HUGE_PAGE_SIZE ((size_t) 2 << 20)  // The huge page size of x86-64 and most other hosts.
 
-static bool validate_bytes(size_t bytes);
+#ifndef MPOL_BIND
+#define MPOL_BIND 2  // From <numaif.h>, which only comes with libnuma.
+#endif
+
+static MemOptions options = {.capacity = MEM_DEFAULT_CAPACITY, .huge_pages = HUGE_PAGES_OFF};
+
+static bool     validate_bytes(size_t bytes);
+static void     mark_dirty(Memory *m, size_t offset, size_t bytes);
+static size_t   round_up(size_t value, size_t alignment);
+static void     warn_once(bool *warned, const char *message);
+static uint8_t *map_huge_pages(size_t capacity, int flags, size_t *length);
+static uint8_t *map_transparent(size_t capacity, int flags, size_t *length);
+static void     bind_to_local_node(uint8_t *bytes, size_t length);
+static void     prefault(uint8_t *bytes, size_t length);
+static bool     map_shared(Memory *m);
+static bool     is_shared_access(const Memory *m, size_t offset, size_t bytes);
+static void     clear(Memory *m, size_t start, size_t end);
 
 /**
  * @brief Verifies that the given amount of `bytes` is valid to load.
@@ -18,60 +45,473 @@ static bool validate_bytes(size_t bytes) {
     return bytes == 1 || bytes == 2 || bytes == 4 || bytes == 8;
 }
 
-bool mem_load(uint8_t *destination, size_t offset, size_t bytes) {
-    if (!validate_bytes(bytes) || !destination || offset + bytes > MEM_CAPACITY) {
+/**
+ * @brief Widens the dirty range to cover a write.
+ *
+ * @param m The memory being written.
+ * @param offset The offset of the first byte written.
+ * @param bytes The number of bytes written.
+ */
+static void mark_dirty(Memory *m, size_t offset, size_t bytes) {
+    if (offset < m->dirty_start) {
+        m->dirty_start = offset;
+    }
+    if (offset + bytes > m->dirty_end) {
+        m->dirty_end = offset + bytes;
+    }
+}
+
+/**
+ * @brief Rounds a value up to a multiple of a power of two.
+ */
+static size_t round_up(size_t value, size_t alignment) {
+    return (value + alignment - 1) & ~(alignment - 1);
+}
+
+/**
+ * @brief Prints a warning to stderr unless it was printed before.
+ */
+static void warn_once(bool *warned, const char *message) {
+    if (!*warned) {
+        *warned = true;
+        fprintf(stderr, "Warning: %s\n", message);
+    }
+}
+
+/**
+ * @brief Maps memory from the reserved huge page pool.
+ *
+ * @return The memory, or NULL if the pool could not provide it.
+ */
+static uint8_t *map_huge_pages(size_t capacity, int flags, size_t *length) {
+    *length = round_up(capacity, HUGE_PAGE_SIZE);
+    void *p = mmap(NULL, *length, PROT_READ | PROT_WRITE, flags | MAP_HUGETLB, -1, 0);
+    return p == MAP_FAILED ? NULL : p;
+}
+
+/**
+ * @brief Maps memory starting on a huge page boundary and asks the kernel to
+ * back it with transparent huge pages.
+ *
+ * @return The memory, or NULL if it could not be mapped.
+ */
+static uint8_t *map_transparent(size_t capacity, int flags, size_t *length) {
+    // Map one huge page extra, then trim the region to start on a boundary
+    size_t   len = round_up(capacity, HUGE_PAGE_SIZE);
+    uint8_t *raw = mmap(NULL, len + HUGE_PAGE_SIZE, PROT_READ | PROT_WRITE, flags, -1, 0);
+    if (raw == MAP_FAILED) {
+        return NULL;
+    }
+
+    uint8_t *start = (uint8_t *) round_up((uintptr_t) raw, HUGE_PAGE_SIZE);
+    if (start > raw) {
+        munmap(raw, (size_t) (start - raw));
+    }
+    munmap(start + len, (size_t) (raw + HUGE_PAGE_SIZE - start));
+
+    static bool warned = false;
+    if (madvise(start, len, MADV_HUGEPAGE) != 0) {
+        warn_once(&warned, "transparent huge pages are unavailable; using normal pages");
+    }
+    *length = len;
+    return start;
+}
+
+/**
+ * @brief Binds memory to the NUMA node of the CPU the calling thread runs on.
+ * Must be called before the memory is first touched.
+ */
+static void bind_to_local_node(uint8_t *bytes, size_t length) {
+    static bool warned = false;
+#if defined(SYS_mbind) && defined(SYS_getcpu)
+    unsigned int cpu, node;
+    if (syscall(SYS_getcpu, &cpu, &node, NULL) != 0 || node >= 63) {
+        warn_once(&warned, "cannot determine the NUMA node; memory is not bound");
+        return;
+    }
+
+    // The kernel reads one bit less than `maxnode` says
+    unsigned long nodes = 1UL << node;
+    if (syscall(SYS_mbind, bytes, length, MPOL_BIND, &nodes, sizeof(nodes) * 8, 0) != 0) {
+        warn_once(&warned, "mbind failed; memory is not bound to a NUMA node");
+    }
+#else
+    (void) bytes;
+    (void) length;
+    warn_once(&warned, "NUMA binding is not supported on this host");
+#endif
+}
+
+/**
+ * @brief Faults in every page of a mapping by writing to it.
+ */
+static void prefault(uint8_t *bytes, size_t length) {
+#ifdef MADV_POPULATE_WRITE
+    if (madvise(bytes, length, MADV_POPULATE_WRITE) == 0) {
+        return;
+    }
+#endif
+    long page = sysconf(_SC_PAGESIZE);
+    for (size_t i = 0; i < length; i += page > 0 ? (size_t) page : 4096) {
+        ((volatile uint8_t *) bytes)[i] = 0;
+    }
+}
+
+int mem_open_object(const char *name, size_t length, bool writable) {
+    int fd    = -1;
+    int flags = writable ? O_RDWR | O_CREAT : O_RDONLY;
+    if (strchr(name, '/')) {
+        fd = open(name, flags | O_CLOEXEC, 0600);
+    } else if (strlen(name) >= NAME_MAX) {
+        errno = ENAMETOOLONG;
+    } else {
+        char path[NAME_MAX + 1];
+        snprintf(path, sizeof(path), "/%s", name);
+        fd = shm_open(path, flags, 0600);
+    }
+
+    struct stat st;
+    if (fd < 0 || fstat(fd, &st) != 0 ||
+        (writable && (size_t) st.st_size < length && ftruncate(fd, (off_t) length) != 0)) {
+        fprintf(stderr, "Cannot open shared memory object %s: %s\n", name, strerror(errno));
+        if (fd >= 0) {
+            close(fd);
+        }
+        return -1;
+    }
+    return fd;
+}
+
+/**
+ * @brief Maps the configured shared-memory object over its range of guest
+ * memory.
+ *
+ * @return True if the object was mapped or none is configured, false after
+ * reporting the failure on stderr.
+ */
+static bool map_shared(Memory *m) {
+    const SharedRegion *region = &options.shared;
+    m->shared_start            = 0;
+    m->shared_end              = 0;
+    if (!region->name) {
+        return true;
+    }
+
+    long   page      = sysconf(_SC_PAGESIZE);
+    size_t page_size = page > 0 ? (size_t) page : 4096;
+    if (region->address % page_size != 0 || region->length % page_size != 0 ||
+        region->length == 0 || region->address > m->capacity ||
+        region->length > m->capacity - region->address) {
+        fprintf(stderr, "Shared memory region %s must be page-aligned and lie in guest memory\n",
+                region->name);
+        return false;
+    }
+
+    int fd = mem_open_object(region->name, region->length, true);
+    if (fd < 0) {
         return false;
     }
 
-    memcpy(destination, &mem[offset], bytes);
+    int   flags = MAP_SHARED | MAP_FIXED | (options.prefault ? MAP_POPULATE : 0);
+    void *p     = mmap(m->bytes + region->address, region->length, PROT_READ | PROT_WRITE, flags,
+                       fd, 0);
+    int   error = errno;
+    close(fd);
+    if (p == MAP_FAILED) {
+        fprintf(stderr, "Cannot map shared memory object %s: %s\n", region->name, strerror(error));
+        return false;
+    }
+
+    m->shared_start = region->address;
+    m->shared_end   = region->address + region->length;
     return true;
 }
 
-bool mem_store(uint8_t *source, size_t offset, size_t bytes) {
-    if (!validate_bytes(bytes) || !source || offset + bytes > MEM_CAPACITY) {
+void mem_configure(const MemOptions *opts) {
+    options = *opts;
+}
+
+bool mem_init(Memory *m) {
+    // A bound mapping must not be touched until it is bound, and transparent
+    // huge pages only replace pages faulted in after the advice
+    bool late_prefault = options.prefault &&
+                         (options.numa_bind || options.huge_pages == HUGE_PAGES_TRANSPARENT);
+    int  flags         = MAP_PRIVATE | MAP_ANONYMOUS;
+    if (options.prefault && !late_prefault) {
+        flags |= MAP_POPULATE;
+    }
+
+    uint8_t *bytes  = NULL;
+    size_t   length = 0;
+    if (options.huge_pages == HUGE_PAGES_EXPLICIT) {
+        static bool warned = false;
+        bytes              = map_huge_pages(options.capacity, flags, &length);
+        if (!bytes) {
+            warn_once(&warned, "no explicit huge pages are available; using normal pages");
+        }
+    } else if (options.huge_pages == HUGE_PAGES_TRANSPARENT) {
+        bytes = map_transparent(options.capacity, flags, &length);
+    }
+    if (!bytes) {
+        length = options.capacity;
+        bytes  = mmap(NULL, length, PROT_READ | PROT_WRITE, flags, -1, 0);
+        if (bytes == MAP_FAILED) {
+            bytes = NULL;
+        }
+    }
+
+    m->bytes       = bytes;
+    m->capacity    = bytes ? options.capacity : 0;
+    m->mapped      = bytes ? length : 0;
+    m->dirty_start = m->capacity;
+    m->dirty_end   = 0;
+    if (!bytes) {
         return false;
     }
 
-    memcpy(&mem[offset], source, bytes);
+    if (options.numa_bind) {
+        bind_to_local_node(bytes, length);
+    }
+    if (late_prefault) {
+        prefault(bytes, length);
+    }
+
+    // Mapped last, so that prefaulting never writes to the shared object
+    if (!map_shared(m)) {
+        mem_free(m);
+        return false;
+    }
     return true;
 }
 
-void mem_print(void) {
+void mem_free(Memory *m) {
+    if (m->bytes) {
+        munmap(m->bytes, m->mapped);
+    }
+    m->bytes    = NULL;
+    m->capacity = 0;
+    m->mapped   = 0;
+}
+
+/**
+ * @brief Zeroes the bytes from `start` up to `end`, if there are any.
+ */
+static void clear(Memory *m, size_t start, size_t end) {
+    if (end > start) {
+        memset(&m->bytes[start], 0, end - start);
+    }
+}
+
+void mem_reset(Memory *m) {
+    if (m->shared_end > m->shared_start) {
+        clear(m, m->dirty_start, m->dirty_end < m->shared_start ? m->dirty_end : m->shared_start);
+        clear(m, m->dirty_start > m->shared_end ? m->dirty_start : m->shared_end, m->dirty_end);
+    } else {
+        clear(m, m->dirty_start, m->dirty_end);
+    }
+    m->dirty_start = m->capacity;
+    m->dirty_end   = 0;
+}
+
+void mem_thread_faults(uint64_t *minor, uint64_t *major) {
+    struct rusage usage;
+    if (getrusage(RUSAGE_THREAD, &usage) != 0) {
+        *minor = 0;
+        *major = 0;
+        return;
+    }
+    *minor = (uint64_t) usage.ru_minflt;
+    *major = (uint64_t) usage.ru_majflt;
+}
+
+/**
+ * @brief Determines whether an access of 1, 2, 4 or 8 bytes is a naturally
+ * aligned one to the shared range, which must be a single atomic access.
+ */
+static bool is_shared_access(const Memory *m, size_t offset, size_t bytes) {
+    return offset >= m->shared_start && offset < m->shared_end && offset % bytes == 0;
+}
+
+bool mem_load(const Memory *m, uint8_t *destination, size_t offset, size_t bytes) {
+    if (!validate_bytes(bytes) || !destination || offset + bytes > m->capacity) {
+        return false;
+    }
+
+    if (!is_shared_access(m, offset, bytes)) {
+        memcpy(destination, &m->bytes[offset], bytes);
+        return true;
+    }
+
+    const void *p = &m->bytes[offset];
+    if (bytes == 1) {
+        uint8_t value = __atomic_load_n((const uint8_t *) p, __ATOMIC_ACQUIRE);
+        memcpy(destination, &value, bytes);
+    } else if (bytes == 2) {
+        uint16_t value = __atomic_load_n((const uint16_t *) p, __ATOMIC_ACQUIRE);
+        memcpy(destination, &value, bytes);
+    } else if (bytes == 4) {
+        uint32_t value = __atomic_load_n((const uint32_t *) p, __ATOMIC_ACQUIRE);
+        memcpy(destination, &value, bytes);
+    } else {
+        uint64_t value = __atomic_load_n((const uint64_t *) p, __ATOMIC_ACQUIRE);
+        memcpy(destination, &value, bytes);
+    }
+    return true;
+}
+
+bool mem_store(Memory *m, uint8_t *source, size_t offset, size_t bytes) {
+    if (!validate_bytes(bytes) || !source || offset + bytes > m->capacity) {
+        return false;
+    }
+
+    mark_dirty(m, offset, bytes);
+    if (!is_shared_access(m, offset, bytes)) {
+        memcpy(&m->bytes[offset], source, bytes);
+        return true;
+    }
+
+    void *p = &m->bytes[offset];
+    if (bytes == 1) {
+        uint8_t value;
+        memcpy(&value, source, bytes);
+        __atomic_store_n((uint8_t *) p, value, __ATOMIC_RELEASE);
+    } else if (bytes == 2) {
+        uint16_t value;
+        memcpy(&value, source, bytes);
+        __atomic_store_n((uint16_t *) p, value, __ATOMIC_RELEASE);
+    } else if (bytes == 4) {
+        uint32_t value;
+        memcpy(&value, source, bytes);
+        __atomic_store_n((uint32_t *) p, value, __ATOMIC_RELEASE);
+    } else {
+        uint64_t value;
+        memcpy(&value, source, bytes);
+        __atomic_store_n((uint64_t *) p, value, __ATOMIC_RELEASE);
+    }
+    return true;
+}
+
+bool mem_put_string(Memory *m, const char *str, size_t offset) {
+    if (!str) {
+        return false;
+    }
+
+    size_t bytes = strlen(str) + 1;
+    if (offset > m->capacity || bytes > m->capacity - offset) {
+        return false;
+    }
+
+    memcpy(&m->bytes[offset], str, bytes);
+    mark_dirty(m, offset, bytes);
+    return true;
+}
+
+uint8_t *mem_write_span(Memory *m, size_t offset, size_t bytes) {
+    if (offset > m->capacity || bytes > m->capacity - offset) {
+        return NULL;
+    }
+
+    mark_dirty(m, offset, bytes);
+    return &m->bytes[offset];
+}
+
+const uint8_t *mem_read_span(const Memory *m, size_t offset, size_t bytes) {
+    if (offset > m->capacity || bytes > m->capacity - offset) {
+        return NULL;
+    }
+
+    return &m->bytes[offset];
+}
+
+bool mem_get_string(const Memory *m, size_t offset, const char **str, size_t *length) {
+    if (offset >= m->capacity) {
+        return false;
+    }
+
+    *str    = (const char *) &m->bytes[offset];
+    *length = scan_either(&m->bytes[offset], m->capacity - offset, 0, 0);
+    return true;
+}
+
+bool mem_find_byte(const Memory *m, size_t offset, uint8_t c, size_t *position, bool *found) {
+    if (offset >= m->capacity) {
+        return false;
+    }
+
+    *position = offset + scan_either(&m->bytes[offset], m->capacity - offset, c, 0);
+    *found    = *position < m->capacity && m->bytes[*position] == c;
+    return true;
+}
+
+bool mem_compare_strings(const Memory *m, size_t a, size_t b, int *order) {
+    if (a >= m->capacity || b >= m->capacity) {
+        return false;
+    }
+
+    size_t  length = m->capacity - (a > b ? a : b);
+    size_t  i      = scan_string_diff(&m->bytes[a], &m->bytes[b], length);
+    // A string that runs into the end of memory ends there
+    uint8_t byte_a = a + i < m->capacity ? m->bytes[a + i] : 0;
+    uint8_t byte_b = b + i < m->capacity ? m->bytes[b + i] : 0;
+    *order         = (int) byte_a - (int) byte_b;
+    return true;
+}
+
+bool mem_copy_string(Memory *m, size_t destination, size_t source, size_t *length) {
+    const char *str;
+    if (!mem_get_string(m, source, &str, length)) {
+        return false;
+    }
+
+    uint8_t *span = mem_write_span(m, destination, *length + 1);
+    if (!span) {
+        return false;
+    }
+
+    memmove(span, str, *length);
+    span[*length] = 0;
+    return true;
+}
+
+void mem_print(const Memory *m) {
     printf("Memory state:\n");
 
     // Calculate minimum hex digits needed based on capacity
     int    addr_width = 1;
-    size_t temp       = MEM_CAPACITY - 1;
+    size_t temp       = m->capacity - 1;
     while (temp >>= 4) {
         addr_width++;
     }
 
-    size_t first_modified = 0;
-    while (first_modified < MEM_CAPACITY && mem[first_modified] == 0) {
-        first_modified++;
+    // Everything outside the dirty and shared ranges is still zero, so large
+    // memories need not be scanned, or faulted in, whole
+    size_t start = m->dirty_start;
+    size_t end   = m->dirty_end;
+    if (m->shared_end > m->shared_start) {
+        start = m->shared_start < start ? m->shared_start : start;
+        end   = m->shared_end > end ? m->shared_end : end;
     }
+    size_t dirty          = end > start ? end - start : 0;
+    size_t first_modified = start + scan_nonzero(m->bytes + start, dirty);
 
-    if (first_modified == MEM_CAPACITY) {
+    if (first_modified == start + dirty) {
         printf("Unmodified\n");
         return;
     }
 
-    size_t last_modified = MEM_CAPACITY - 1;
-    while (last_modified > first_modified && mem[last_modified] == 0) {
-        last_modified--;
-    }
+    size_t last_modified = start + scan_nonzero_end(m->bytes + start, dirty) - 1;
 
     size_t display_start = first_modified & ~0xF;
     size_t display_end   = (last_modified + 16) & ~0xF;
-    if (display_end > MEM_CAPACITY)
-        display_end = MEM_CAPACITY;
+    if (display_end > m->capacity)
+        display_end = m->capacity;
 
     printf("0x%0*zx-0x%0*zx:\n", addr_width, display_start, addr_width, display_end - 1);
 
     for (size_t j = display_start; j < display_end; j += 16) {
         printf("    0x%0*zx: ", addr_width, j);
         for (size_t k = 0; k < 16 && j + k < display_end; k++) {
-            printf("%02x", mem[j + k]);
+            printf("%02x", m->bytes[j + k]);
             if ((k + 1) % 4 == 0) {
                 printf(" ");
             }
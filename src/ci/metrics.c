@@ -0,0 +1,215 @@
+#define _GNU_SOURCE
+#include "metrics.h"
+#include <stdatomic.h>
+#include <stddef.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+#include "mem.h"
+
+#define METRICS_MAGIC   0x3173636972746d63ULL  // Marks a segment laid out as below, version 1.
+#define METRICS_BUCKETS 9                      // Bounds of 1 us to 10 s by powers of ten, and +Inf.
+#define NS_PER_SECOND   1000000000ULL
+
+// Atomics that fall back to a lock are not shared between processes
+_Static_assert(ATOMIC_LLONG_LOCK_FREE == 2, "metrics counters must be lock-free");
+
+/**
+ * @brief A latency histogram. Each bucket counts only its own samples, so that
+ * recording one is a single addition; they are summed up when printed.
+ */
+typedef struct {
+    atomic_ullong buckets[METRICS_BUCKETS];  // Samples up to each bound and above the one before.
+    atomic_ullong sum_ns;                    // The sum of all samples in nanoseconds.
+} Histogram;
+
+/**
+ * @brief The layout of the metrics segment. A new, zeroed segment is a valid
+ * empty one.
+ */
+typedef struct {
+    atomic_ullong magic;         // METRICS_MAGIC once a process has opened the segment.
+    atomic_ullong runs;          // Programs run, counting those that failed to parse.
+    atomic_ullong errors;        // Runs that failed to parse or stopped on an error.
+    atomic_ullong commands;      // Commands executed by all runs.
+    atomic_ullong output_bytes;  // Bytes printed by all runs.
+    Histogram     parse;         // Time taken to lex and parse a program.
+    Histogram     exec;          // Time taken to run a program.
+} MetricsSegment;
+
+static const uint64_t bucket_bounds[METRICS_BUCKETS - 1] = {
+    1000ULL, 10000ULL, 100000ULL, 1000000ULL, 10000000ULL, 100000000ULL, 1000000000ULL,
+    10000000000ULL,
+};
+static const char *const bucket_labels[METRICS_BUCKETS] = {
+    "0.000001", "0.00001", "0.0001", "0.001", "0.01", "0.1", "1.0", "10.0", "+Inf",
+};
+
+static MetricsSegment *segment = NULL;  // The segment runs are recorded in; NULL if none.
+
+static MetricsSegment *map_segment(const char *name, bool writable);
+static void            record(Histogram *h, uint64_t ns);
+static void            print_counter(FILE *out, const char *name, const char *unit,
+                                     const char *help, const atomic_ullong *value);
+static void            print_histogram(FILE *out, const char *name, const char *help,
+                                       const Histogram *h);
+
+/**
+ * @brief Maps a metrics segment and checks that it is one.
+ *
+ * @param name The name of the segment.
+ * @param writable Whether to create the segment if needed and map it for
+ * recording, or to map an existing one for reading.
+ * @return The segment, or NULL after reporting the failure on stderr.
+ */
+static MetricsSegment *map_segment(const char *name, bool writable) {
+    int fd = mem_open_object(name, sizeof(MetricsSegment), writable);
+    if (fd < 0) {
+        return NULL;
+    }
+
+    struct stat st;
+    void       *p = MAP_FAILED;
+    if (fstat(fd, &st) == 0 && (size_t) st.st_size >= sizeof(MetricsSegment)) {
+        p = mmap(NULL, sizeof(MetricsSegment), writable ? PROT_READ | PROT_WRITE : PROT_READ,
+                 MAP_SHARED, fd, 0);
+    }
+    close(fd);
+    if (p == MAP_FAILED) {
+        fprintf(stderr, "%s is not a metrics segment\n", name);
+        return NULL;
+    }
+
+    // Whichever process comes first claims a new segment; a zeroed one is valid empty
+    MetricsSegment    *m     = p;
+    unsigned long long magic = 0;
+    if (writable) {
+        atomic_compare_exchange_strong(&m->magic, &magic, METRICS_MAGIC);
+    } else {
+        magic = atomic_load(&m->magic);
+    }
+    if (magic != 0 && magic != METRICS_MAGIC) {
+        fprintf(stderr, "%s is not a metrics segment\n", name);
+        munmap(p, sizeof(MetricsSegment));
+        return NULL;
+    }
+    return m;
+}
+
+/**
+ * @brief Adds a sample to a histogram.
+ */
+static void record(Histogram *h, uint64_t ns) {
+    size_t bucket = 0;
+    while (bucket < METRICS_BUCKETS - 1 && ns > bucket_bounds[bucket]) {
+        bucket++;
+    }
+    atomic_fetch_add_explicit(&h->buckets[bucket], 1, memory_order_relaxed);
+    atomic_fetch_add_explicit(&h->sum_ns, ns, memory_order_relaxed);
+}
+
+bool metrics_open(const char *name) {
+    metrics_close();
+    segment = map_segment(name, true);
+    return segment != NULL;
+}
+
+void metrics_close(void) {
+    if (segment) {
+        munmap(segment, sizeof(MetricsSegment));
+        segment = NULL;
+    }
+}
+
+uint64_t metrics_now(void) {
+    if (!segment) {
+        return 0;
+    }
+
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (uint64_t) now.tv_sec * NS_PER_SECOND + (uint64_t) now.tv_nsec;
+}
+
+void metrics_parsed(uint64_t start, bool parsed) {
+    if (!segment) {
+        return;
+    }
+
+    record(&segment->parse, metrics_now() - start);
+    if (!parsed) {
+        atomic_fetch_add_explicit(&segment->runs, 1, memory_order_relaxed);
+        atomic_fetch_add_explicit(&segment->errors, 1, memory_order_relaxed);
+    }
+}
+
+void metrics_ran(const Interpreter *intr, uint64_t start, bool failed) {
+    if (!segment) {
+        return;
+    }
+
+    record(&segment->exec, metrics_now() - start);
+    atomic_fetch_add_explicit(&segment->runs, 1, memory_order_relaxed);
+    atomic_fetch_add_explicit(&segment->commands, intr->stats.commands, memory_order_relaxed);
+    atomic_fetch_add_explicit(&segment->output_bytes, intr->stats.output_bytes,
+                              memory_order_relaxed);
+    if (failed) {
+        atomic_fetch_add_explicit(&segment->errors, 1, memory_order_relaxed);
+    }
+}
+
+/**
+ * @brief Prints a counter family with its single sample.
+ *
+ * @param unit The unit the name ends in, NULL if it has none.
+ */
+static void print_counter(FILE *out, const char *name, const char *unit, const char *help,
+                          const atomic_ullong *value) {
+    fprintf(out, "# TYPE %s counter\n", name);
+    if (unit) {
+        fprintf(out, "# UNIT %s %s\n", name, unit);
+    }
+    fprintf(out, "# HELP %s %s\n", name, help);
+    fprintf(out, "%s_total %llu\n", name, atomic_load_explicit(value, memory_order_relaxed));
+}
+
+/**
+ * @brief Prints a histogram family in seconds, with cumulative buckets.
+ */
+static void print_histogram(FILE *out, const char *name, const char *help, const Histogram *h) {
+    fprintf(out, "# TYPE %s histogram\n", name);
+    fprintf(out, "# UNIT %s seconds\n", name);
+    fprintf(out, "# HELP %s %s\n", name, help);
+
+    // Other processes keep recording; the count is the buckets as read, not a later total
+    unsigned long long count = 0;
+    for (size_t b = 0; b < METRICS_BUCKETS; b++) {
+        count += atomic_load_explicit(&h->buckets[b], memory_order_relaxed);
+        fprintf(out, "%s_bucket{le=\"%s\"} %llu\n", name, bucket_labels[b], count);
+    }
+    unsigned long long sum = atomic_load_explicit(&h->sum_ns, memory_order_relaxed);
+    fprintf(out, "%s_count %llu\n", name, count);
+    fprintf(out, "%s_sum %llu.%09llu\n", name, sum / NS_PER_SECOND, sum % NS_PER_SECOND);
+}
+
+bool metrics_print(const char *name, FILE *out) {
+    MetricsSegment *m = map_segment(name, false);
+    if (!m) {
+        return false;
+    }
+
+    print_counter(out, "ci_runs", NULL, "Programs run, counting those that failed to parse.",
+                  &m->runs);
+    print_counter(out, "ci_errors", NULL, "Runs that failed to parse or stopped on an error.",
+                  &m->errors);
+    print_counter(out, "ci_commands", NULL, "Commands executed.", &m->commands);
+    print_counter(out, "ci_output_bytes", "bytes", "Bytes written by print commands.",
+                  &m->output_bytes);
+    print_histogram(out, "ci_parse_seconds", "Time taken to lex and parse a program.", &m->parse);
+    print_histogram(out, "ci_exec_seconds", "Time taken to run a program.", &m->exec);
+    fprintf(out, "# EOF\n");
+
+    munmap(m, sizeof(MetricsSegment));
+    return true;
+}
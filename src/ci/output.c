@@ -0,0 +1,114 @@
+#define _GNU_SOURCE
+#include "output.h"
+#include <inttypes.h>
+#include <stdio.h>
+
+#define BINARY_DIGITS 64  // Enough digits for any 64-bit value in base 2.
+
+static void put_le(uint8_t *dst, uint64_t value, size_t bytes);
+static int  format_binary(char *buf, uint64_t value);
+static int  print_csv_string(FILE *out, const char *str, size_t length);
+
+/**
+ * @brief Stores the low `bytes` bytes of `value` little-endian first.
+ */
+static void put_le(uint8_t *dst, uint64_t value, size_t bytes) {
+    for (size_t i = 0; i < bytes; i++) {
+        dst[i] = (uint8_t) (value >> (8 * i));
+    }
+}
+
+/**
+ * @brief Formats a value in base 2 without leading zeros, always writing at
+ * least one digit.
+ *
+ * @param buf A buffer of at least `BINARY_DIGITS` characters. Not terminated.
+ * @param value The value to format.
+ * @return The number of digits written.
+ */
+static int format_binary(char *buf, uint64_t value) {
+    int top = 63;
+    while (top > 0 && !((value >> top) & 1)) {
+        top--;
+    }
+
+    int length = 0;
+    for (int i = top; i >= 0; i--) {
+        buf[length++] = (value >> i) & 1 ? '1' : '0';
+    }
+    return length;
+}
+
+/**
+ * @brief Prints a string as a quoted CSV field.
+ *
+ * @return The number of bytes written.
+ */
+static int print_csv_string(FILE *out, const char *str, size_t length) {
+    int written = 2;
+    putc('"', out);
+    for (size_t i = 0; i < length; i++) {
+        if (str[i] == '"') {
+            putc('"', out);
+            written++;
+        }
+        putc(str[i], out);
+        written++;
+    }
+    putc('"', out);
+    return written;
+}
+
+size_t output_print(FILE *out, OutputFormat format, uint32_t site, char base, int64_t value,
+                    const char *str, size_t length) {
+    if (base != 'd' && base != 'x' && base != 'b' && base != 's') {
+        return 0;
+    }
+
+    if (format == OUTPUT_BINARY) {
+        uint8_t record[PRINT_RECORD_SIZE] = {0};
+        put_le(record, site, 4);
+        record[4] = (uint8_t) base;
+        put_le(record + 8, base == 's' ? (uint64_t) length : (uint64_t) value, 8);
+        // Keep a record and its string together when several guests print at once
+        flockfile(out);
+        fwrite(record, 1, sizeof(record), out);
+        if (base == 's') {
+            fwrite(str, 1, length, out);
+        }
+        funlockfile(out);
+        return sizeof(record) + (base == 's' ? length : 0);
+    }
+
+    int prefix = 0;
+    if (format == OUTPUT_CSV) {
+        prefix = fprintf(out, "%" PRIu32 ",%c,", site, base);
+    }
+
+    // fprintf returns a negative count when the write fails
+    int written;
+    switch (base) {
+        case 'd':
+            written = fprintf(out, "%" PRId64 "\n", value);
+            break;
+        case 'x':
+            written = fprintf(out, "0x%" PRIx64 "\n", (uint64_t) value);
+            break;
+        case 'b': {
+            char digits[BINARY_DIGITS];
+            int  count = format_binary(digits, (uint64_t) value);
+            written    = fprintf(out, "0b%.*s\n", count, digits);
+            break;
+        }
+        default:
+            if (format == OUTPUT_CSV) {
+                written = print_csv_string(out, str, length);
+                putc('\n', out);
+                written++;
+            } else {
+                written = fprintf(out, "%.*s\n", (int) length, str);
+            }
+            break;
+    }
+    return (size_t) (prefix > 0 ? prefix : 0) + (size_t) (written > 0 ? written : 0);
+}
@@ -2,6 +2,7 @@
 #include "parser.h"
 #include "command.h"
 #include "command_type.h"
+#include "token_buffer.h"
 #include "token_type.h"
 #include <stdbool.h>
 #include <stddef.h>
@@ -10,44 +11,95 @@
 #include <stdlib.h>
 #include <string.h>
 
-static Token    advance(Parser *parser);
-static bool     consume(Parser *parser, TokenType type);
-static bool     is_at_end(Parser *parser);
-static void     skip_nls(Parser *parser);
-static bool     consume_newline(Parser *parser);
-static Command *create_command(CommandType type);
-static bool     is_variable(Token token);
-static bool     parse_variable(Token token, int64_t *var_num);
-static bool     parse_number(Token token, int64_t *result);
-static bool     parse_variable_operand(Parser *parser, Operand *op);
-static bool     parse_var_or_imm(Parser *parser, Operand *op, bool *is_immediate);
-static Command *parse_cmd(Parser *parser);
-
-void parser_init(Parser *parser, Lexer *lexer, LabelMap *map) {
+static void        advance(Parser *parser);
+static TokenType   current_type(Parser *parser);
+static const char *current_lexeme(Parser *parser);
+static int         current_length(Parser *parser);
+static bool        consume(Parser *parser, TokenType type);
+static bool        is_at_end(Parser *parser);
+static void        skip_nls(Parser *parser);
+static bool        consume_newline(Parser *parser);
+static Command    *create_command(CommandType type);
+static bool        is_variable(Parser *parser);
+static CommandType word_command(TokenType type);
+static bool        names_word_register(Parser *parser);
+static bool        parse_variable(const char *lexeme, int length, int64_t *var_num);
+static bool        parse_variable_operand(Parser *parser, Operand *op);
+static bool        parse_var_or_imm(Parser *parser, Operand *op, bool *is_immediate);
+static bool        is_label_name(TokenType type);
+static bool        parse_label_operand(Parser *parser, Operand *op);
+static Command    *parse_logic_or_shift(Parser *parser, CommandType type);
+static Command    *parse_map_cmd(Parser *parser, CommandType type);
+static Command    *parse_loop_cmd(Parser *parser);
+static Command    *parse_rep_cmd(Parser *parser);
+static Command    *parse_string_cmd(Parser *parser, CommandType type);
+static Command    *parse_multi_cmd(Parser *parser, CommandType type);
+static Command    *parse_bitfield_cmd(Parser *parser, CommandType type);
+static Command    *parse_cmd(Parser *parser);
+static bool        is_label_definition(Parser *parser);
+static char       *parse_cold_directive(Parser *parser);
+static void        mark_cold_labels(Parser *parser, char **names, size_t count);
+
+void parser_init(Parser *parser, const TokenBuffer *tokens, LabelMap *map) {
     if (!parser) {
         return;
     }
 
-    parser->lexer     = lexer;
+    parser->tokens    = tokens;
+    parser->pos       = 0;
     parser->had_error = false;
     parser->label_map = map;
-    parser->current   = lexer_next_token(parser->lexer);
-    parser->next      = lexer_next_token(parser->lexer);
+    parser->rep_depth = 0;
+    parser->quiet     = false;
+    parser->recovered = false;
+    parser->word_regs = false;
+    parser->hint      = HINT_NONE;
+    parser->hints     = NULL;
+}
+
+Token parser_current_token(const Parser *parser) {
+    return token_buffer_get(parser->tokens, parser->pos);
 }
 
 /**
  * @brief Advances the parser in the token stream.
  *
  * @param parser A pointer to the parser to read tokens from.
- * @return The token that was just consumed.
  */
-static Token advance(Parser *parser) {
-    Token ret_token = parser->current;
+static void advance(Parser *parser) {
     if (!is_at_end(parser)) {
-        parser->current = parser->next;
-        parser->next    = lexer_next_token(parser->lexer);
+        parser->pos++;
     }
-    return ret_token;
+}
+
+/**
+ * @brief Returns the type of the current token.
+ *
+ * @param parser A pointer to the parser to read tokens from.
+ * @return The type of the token at the parser's position.
+ */
+static TokenType current_type(Parser *parser) {
+    return (TokenType) parser->tokens->types[parser->pos];
+}
+
+/**
+ * @brief Returns a pointer to the text of the current token.
+ *
+ * @param parser A pointer to the parser to read tokens from.
+ * @return A pointer into the source text where the current token starts.
+ */
+static const char *current_lexeme(Parser *parser) {
+    return parser->tokens->source + parser->tokens->offsets[parser->pos];
+}
+
+/**
+ * @brief Returns the length of the text of the current token.
+ *
+ * @param parser A pointer to the parser to read tokens from.
+ * @return The length of the current token.
+ */
+static int current_length(Parser *parser) {
+    return (int) parser->tokens->lengths[parser->pos];
 }
 
 /**
@@ -58,7 +110,7 @@ static Token advance(Parser *parser) {
  * otherwise.
  */
 static bool is_at_end(Parser *parser) {
-    return parser->current.type == TOK_EOF;
+    return current_type(parser) == TOK_EOF;
 }
 
 /**
@@ -69,7 +121,7 @@ static bool is_at_end(Parser *parser) {
  * @return True if the token was consumed, false otherwise.
  */
 static bool consume(Parser *parser, TokenType type) {
-    if (parser->current.type == type) {
+    if (current_type(parser) == type) {
         advance(parser);
         return true;
     }
@@ -108,29 +160,87 @@ static Command *create_command(CommandType type) {
 }
 
 /**
- * @brief Determines if the given token is a valid variable.
+ * @brief Determines if the current token is a valid variable.
  *
  * A valid (potential) variable is a token that begins with the prefix "x",
- * followed by any other character(s).
+ * or "w" while a command on 32-bit registers parses, followed by any other
+ * character(s).
  *
- * @param token The token to check.
+ * @param parser A pointer to the parser to read tokens from.
  * @return True if this token could be a variable, false otherwise.
  */
-static bool is_variable(Token token) {
-    return token.length >= 2 && token.lexeme[0] == 'x';
+static bool is_variable(Parser *parser) {
+    char prefix = parser->word_regs ? 'w' : 'x';
+    return current_length(parser) >= 2 && current_lexeme(parser)[0] == prefix;
 }
 
 /**
- * @brief Determines if the given token is a valid base signifier.
+ * @brief Returns the 32-bit variant of the command a token starts, if it has
+ * one.
+ *
+ * @param type The type of the token.
+ * @return The command type, or CMD_ERR if the command only takes x registers.
+ */
+static CommandType word_command(TokenType type) {
+    switch (type) {
+        case TOK_ADD:
+            return CMD_ADD_W;
+        case TOK_SUB:
+            return CMD_SUB_W;
+        case TOK_MOV:
+            return CMD_MOV_W;
+        case TOK_AND:
+            return CMD_AND_W;
+        case TOK_ORR:
+            return CMD_ORR_W;
+        case TOK_EOR:
+            return CMD_EOR_W;
+        case TOK_LSL:
+            return CMD_LSL_W;
+        case TOK_LSR:
+            return CMD_LSR_W;
+        case TOK_ASR:
+            return CMD_ASR_W;
+        case TOK_CMP:
+            return CMD_CMP_W;
+        case TOK_CMP_U:
+            return CMD_CMP_U_W;
+        default:
+            return CMD_ERR;
+    }
+}
+
+/**
+ * @brief Determines if the first register the current line names is a w
+ * register, which makes the command on it a 32-bit one.
+ *
+ * @param parser A pointer to the parser positioned at the command token.
+ * @return True if the first identifier on the line starts with "w", false
+ * otherwise.
+ */
+static bool names_word_register(Parser *parser) {
+    const TokenBuffer *tokens = parser->tokens;
+    for (size_t i = parser->pos + 1; tokens->types[i] != TOK_NL && tokens->types[i] != TOK_EOF;
+         i++) {
+        if (tokens->types[i] == TOK_IDENT) {
+            return tokens->lengths[i] >= 2 && tokens->source[tokens->offsets[i]] == 'w';
+        }
+    }
+    return false;
+}
+
+/**
+ * @brief Determines if the current token is a valid base signifier.
  *
  * A valid base signifier is one of d (decimal), x (hex), b (binary) or s (string).
  *
- * @param token The token to check.
+ * @param parser A pointer to the parser to read tokens from.
  * @return True if this token is a base signifier, false otherwise
  */
-static bool is_base(Token token) {
-    return token.length == 1 && (token.lexeme[0] == 'd' || token.lexeme[0] == 'x' ||
-                                 token.lexeme[0] == 's' || token.lexeme[0] == 'b');
+static bool is_base(Parser *parser) {
+    const char *lexeme = current_lexeme(parser);
+    return current_length(parser) == 1 &&
+           (lexeme[0] == 'd' || lexeme[0] == 'x' || lexeme[0] == 's' || lexeme[0] == 'b');
 }
 
 /**
@@ -143,25 +253,33 @@ static bool is_base(Token token) {
  * @return True if the current token was parsed as a base, false otherwise.
  */
 static bool parse_base(Parser *parser, Operand *op) {
-    // STUDENT TODO: Parse the current token as a base
-    return false;
+    // "b" lexes as the unconditional branch keyword
+    TokenType type = current_type(parser);
+    if ((type != TOK_IDENT && type != TOK_BRANCH) || !is_base(parser)) {
+        return false;
+    }
+
+    op->base = current_lexeme(parser)[0];
+    advance(parser);
+    return true;
 }
 
 /**
- * @brief Parses the given token as a variable.
+ * @brief Parses the given token text as a variable.
  *
- * @param token The token to parse.
+ * @param lexeme The start of the token to parse.
+ * @param length The length of the token to parse.
  * @param var_num a pointer to modify on success.
  * @return True if `var_num` was successfully modified, false otherwise.
  *
  * @note It is assumed that the token already was verified to begin with a valid
- * prefix, "x".
+ * prefix, "x" or "w".
  */
-static bool parse_variable(Token token, int64_t *var_num) {
+static bool parse_variable(const char *lexeme, int length, int64_t *var_num) {
     char   *endptr;
-    int64_t tempnum = strtol(token.lexeme + 1, &endptr, 10);
+    int64_t tempnum = strtol(lexeme + 1, &endptr, 10);
 
-    if ((token.lexeme + token.length) != endptr || tempnum < 0 || tempnum > 31) {
+    if ((lexeme + length) != endptr || tempnum < 0 || tempnum > 31) {
         return false;
     }
 
@@ -169,38 +287,11 @@ static bool parse_variable(Token token, int64_t *var_num) {
     return true;
 }
 
-/**
- * @brief Parses the given value as a number.
- *
- * @param token The token to parse.
- * @param result A pointer to the value to modify on success.
- * @return True if `result` was successfully modified, false otherwise.
- */
-static bool parse_number(Token token, int64_t *result) {
-    const char *parse_start = token.lexeme;
-    int         base        = 10;
-
-    if (token.length > 2 && token.lexeme[0] == '0') {
-        if (token.lexeme[1] == 'x') {
-            parse_start += 2;
-            base = 16;
-        } else if (token.lexeme[1] == 'b') {
-            parse_start += 2;
-            base = 2;
-        }
-    }
-
-    char *endptr;
-    *result = strtoll(parse_start, &endptr, base);
-
-    return (token.lexeme + token.length) == endptr;
-}
-
 /**
  * @brief Conditionally parses the current token as a number.
  *
- * Note that this won't advance the parser if the token cannot be converted to
- * an integer.
+ * Note that this won't advance the parser if the token is not a number. The
+ * value itself was already decoded by the lexer.
  *
  * @param parser A pointer to the parser to read tokens from.
  * @param op A pointer to the operand to modify.
@@ -208,50 +299,11 @@ static bool parse_number(Token token, int64_t *result) {
  * false otherwise.
  */
 static bool parse_imm(Parser *parser, Operand *op) {
-    Token *token = &parser->current;
-    if (token->type != TOK_NUM) {
+    if (current_type(parser) != TOK_NUM) {
         return false;
     }
 
-    uint64_t value = 0;
-    if (token->length >= 2 && token->lexeme[0] == '0') {
-        if (token->lexeme[1] == 'x' || token->lexeme[1] == 'X') {
-            for (int i = 2; i < token->length; i++) {
-                char c = token->lexeme[i];
-                if (c >= '0' && c <= '9') {
-                    value = value * 16 + (c - '0');
-                } else if (c >= 'a' && c <= 'f') {
-                    value = value * 16 + (c - 'a' + 10);
-                } else if (c >= 'A' && c <= 'F') {
-                    value = value * 16 + (c - 'A' + 10);
-                } else {
-                    return false;
-                }
-            }
-        } else if (token->lexeme[1] == 'b' || token->lexeme[1] == 'B') {
-            for (int i = 2; i < token->length; i++) {
-                char c = token->lexeme[i];
-                if (c == '0' || c == '1') {
-                    value = value * 2 + (c - '0');
-                } else {
-                    return false;
-                }
-            }
-        } else {
-            return false;
-        }
-    } else {
-        for (int i = 0; i < token->length; i++) {
-            char c = token->lexeme[i];
-            if (c >= '0' && c <= '9') {
-                value = value * 10 + (c - '0');
-            } else {
-                return false;
-            }
-        }
-    }
-
-    op->num_val = value;
+    op->num_val = parser->tokens->values[parser->pos];
     advance(parser);
     return true;
 }
@@ -267,14 +319,12 @@ static bool parse_imm(Parser *parser, Operand *op) {
  * @return True if this was parsed as a variable, false otherwise.
  */
 static bool parse_variable_operand(Parser *parser, Operand *op) {
-    Token *token = &parser->current;
-
-    if (token->type != TOK_IDENT || !is_variable(*token)) {
+    if (current_type(parser) != TOK_IDENT || !is_variable(parser)) {
         return false;
     }
 
     int64_t var_num = 0;
-    if (!parse_variable(*token, &var_num)) {
+    if (!parse_variable(current_lexeme(parser), current_length(parser), &var_num)) {
         return false;
     }
 
@@ -298,9 +348,9 @@ static bool parse_variable_operand(Parser *parser, Operand *op) {
  * otherwise.
  */
 static bool parse_var_or_imm(Parser *parser, Operand *op, bool *is_immediate) {
-    Token *token = &parser->current;
+    TokenType type = current_type(parser);
 
-    if (token->type == TOK_IDENT) {
+    if (type == TOK_IDENT) {
         // Parse as variable
         if (!parse_variable_operand(parser, op)) {
             return false;
@@ -309,7 +359,7 @@ static bool parse_var_or_imm(Parser *parser, Operand *op, bool *is_immediate) {
         return true;
     }
 
-    if (token->type == TOK_NUM) {
+    if (type == TOK_NUM) {
         // Parse as immediate
         if (!parse_imm(parser, op)) {
             return false;
@@ -322,6 +372,56 @@ static bool parse_var_or_imm(Parser *parser, Operand *op, bool *is_immediate) {
     return false;
 }
 
+/**
+ * @brief Determines if a token of the given type can name a label.
+ *
+ * `loop`, `rep` and the layout hints are only keywords where a command is
+ * expected, so programs using them as label names keep working.
+ *
+ * @param type The type of the token.
+ * @return True if the token can name a label, false otherwise.
+ */
+static bool is_label_name(TokenType type) {
+    return type == TOK_IDENT || type == TOK_LOOP || type == TOK_REP || type == TOK_LIKELY ||
+           type == TOK_UNLIKELY || type == TOK_COLD;
+}
+
+/**
+ * @brief Parses the next token as a label reference.
+ *
+ * A label is any identifier. The label's name is copied into `op->str_val`.
+ *
+ * @param parser A pointer to the parser to read tokens from.
+ * @param op A pointer to the operand to modify.
+ * @return True if this was parsed as a label, false otherwise.
+ */
+static bool parse_label_operand(Parser *parser, Operand *op) {
+    if (!is_label_name(current_type(parser))) {
+        return false;
+    }
+
+    op->str_val = strndup(current_lexeme(parser), current_length(parser));
+    if (!op->str_val) {
+        return false;
+    }
+
+    advance(parser);
+    return true;
+}
+
+/**
+ * @brief Determines if the current token starts a label definition.
+ *
+ * A label definition is an identifier immediately followed by a colon.
+ *
+ * @param parser A pointer to the parser to read tokens from.
+ * @return True if the current token names a label, false otherwise.
+ */
+static bool is_label_definition(Parser *parser) {
+    return is_label_name(current_type(parser)) &&
+           parser->tokens->types[parser->pos + 1] == TOK_COLON;
+}
+
 /**
  * @brief Skips past tokens that signal the start of a new line
  *
@@ -354,34 +454,417 @@ static bool consume_newline(Parser *parser) {
 }
 
 /**
- * @brief Prints detailed error messages for debugging and troubleshooting.
+ * @brief Flags an error and, unless the parser is quiet, prints detailed error
+ * messages for debugging and troubleshooting.
  *
  * @param parser A pointer to the parser to read tokens from.
  * @param message A descriptive error message explaining the issue.
  * @param cmd A pointer to the command being parsed, if any.
  */
 static void print_error(Parser *parser, const char *message, Command *cmd) {
+    parser->had_error = true;
+    if (parser->quiet) {
+        return;
+    }
+
     printf("Parser encountered an error:\n");
 
     // Token details
-    if (parser->current.type == TOK_EOF) {
+    Token current = parser_current_token(parser);
+    if (current.type == TOK_EOF) {
         printf("At Token: EOF\n");
     } else {
-        printf("At Token: %.*s\n", parser->current.length, parser->current.lexeme);
+        printf("At Token: %.*s\n", current.length, current.lexeme);
     }
-    printf("Token type: %u\n", (unsigned int) parser->current.type);
-    printf("Token length: %d\n", (int) parser->current.length);
-    printf("Line: %d:%d\n\n", (int) parser->current.line, (int) parser->current.column);
+    printf("Token type: %u\n", (unsigned int) current.type);
+    printf("Token length: %d\n", (int) current.length);
+    printf("Line: %d:%d\n\n", (int) current.line, (int) current.column);
 
     printf("Parsed commands up to this point:\n");
-    // Set parser's error flag
-    parser->had_error = true;
+}
+
+/**
+ * @brief Parses the operands of a logical or shift command.
+ *
+ * Logical commands (and, orr, eor) always take three variables. Shift commands
+ * (lsl, lsr, asr, ror) take two variables followed by an immediate shift amount.
+ * The command token itself must be the current token.
+ *
+ * @param parser A pointer to the parser to read tokens from.
+ * @param type The type of the command being parsed.
+ * @return A pointer to the parsed command, or NULL if an error occurred.
+ *
+ * @note The caller is responsible for freeing the memory associated with the
+ * returned command.
+ */
+static Command *parse_logic_or_shift(Parser *parser, CommandType type) {
+    advance(parser);
+    Command *cmd = create_command(type);
+    if (!cmd) {
+        print_error(parser, "Failed to allocate memory for command.", NULL);
+        return NULL;
+    }
+
+    if (!parse_variable_operand(parser, &cmd->destination)) {
+        print_error(parser, "Invalid destination operand.", cmd);
+        free_command(cmd);
+        return NULL;
+    }
+
+    if (!parse_variable_operand(parser, &cmd->val_a)) {
+        print_error(parser, "Invalid first operand.", cmd);
+        free_command(cmd);
+        return NULL;
+    }
+
+    bool is_shift = type == CMD_LSL || type == CMD_LSR || type == CMD_ASR || type == CMD_ROR;
+    bool parsed   = is_shift ? parse_imm(parser, &cmd->val_b)
+                             : parse_variable_operand(parser, &cmd->val_b);
+    if (!parsed) {
+        print_error(parser, "Invalid second operand.", cmd);
+        free_command(cmd);
+        return NULL;
+    }
+    cmd->is_b_immediate = is_shift;
+
+    if (!consume_newline(parser)) {
+        print_error(parser, "Unexpected token after command.", cmd);
+        free_command(cmd);
+        return NULL;
+    }
+    return cmd;
+}
+
+/**
+ * @brief Parses the operands of a map command.
+ *
+ * `hnew` takes a destination variable. `hput` takes the handle variable, a key
+ * and a value, `hget` a destination variable, the handle variable and a key,
+ * and `hdel` the handle variable and a key. Keys and values may be variables or
+ * immediates. The command token itself must be the current token.
+ *
+ * @param parser A pointer to the parser to read tokens from.
+ * @param type The type of the command being parsed.
+ * @return A pointer to the parsed command, or NULL if an error occurred.
+ *
+ * @note The caller is responsible for freeing the memory associated with the
+ * returned command.
+ */
+static Command *parse_map_cmd(Parser *parser, CommandType type) {
+    advance(parser);
+    Command *cmd = create_command(type);
+    if (!cmd) {
+        print_error(parser, "Failed to allocate memory for command.", NULL);
+        return NULL;
+    }
+
+    // hput keeps the handle in `destination`, like store keeps its source there
+    if (type != CMD_HDEL && !parse_variable_operand(parser, &cmd->destination)) {
+        print_error(parser, "Invalid first operand.", cmd);
+        free_command(cmd);
+        return NULL;
+    }
+
+    if (type == CMD_HGET || type == CMD_HDEL) {
+        if (!parse_variable_operand(parser, &cmd->val_a)) {
+            print_error(parser, "Invalid map handle operand.", cmd);
+            free_command(cmd);
+            return NULL;
+        }
+    } else if (type == CMD_HPUT) {
+        bool is_immediate = false;
+        if (!parse_var_or_imm(parser, &cmd->val_a, &is_immediate)) {
+            print_error(parser, "Invalid key operand.", cmd);
+            free_command(cmd);
+            return NULL;
+        }
+        cmd->is_a_immediate = is_immediate;
+    }
+
+    if (type != CMD_HNEW) {
+        bool is_immediate = false;
+        if (!parse_var_or_imm(parser, &cmd->val_b, &is_immediate)) {
+            print_error(parser, "Invalid last operand.", cmd);
+            free_command(cmd);
+            return NULL;
+        }
+        cmd->is_b_immediate = is_immediate;
+    }
+
+    if (!consume_newline(parser)) {
+        print_error(parser, "Unexpected token after command.", cmd);
+        free_command(cmd);
+        return NULL;
+    }
+    return cmd;
+}
+
+/**
+ * @brief Parses a `loop` command: a counter variable and a label.
+ *
+ * The command token itself must be the current token.
+ *
+ * @param parser A pointer to the parser to read tokens from.
+ * @return A pointer to the parsed command, or NULL if an error occurred.
+ *
+ * @note The caller is responsible for freeing the memory associated with the
+ * returned command.
+ */
+static Command *parse_loop_cmd(Parser *parser) {
+    advance(parser);
+    Command *cmd = create_command(CMD_LOOP);
+    if (!cmd) {
+        print_error(parser, "Failed to allocate memory for LOOP command.", NULL);
+        return NULL;
+    }
+
+    if (!parse_variable_operand(parser, &cmd->destination)) {
+        print_error(parser, "Invalid counter for LOOP command.", cmd);
+        free_command(cmd);
+        return NULL;
+    }
+
+    if (!parse_label_operand(parser, &cmd->val_a)) {
+        print_error(parser, "Invalid label for LOOP command.", cmd);
+        free_command(cmd);
+        return NULL;
+    }
+    cmd->is_a_string = true;
+
+    if (!consume_newline(parser)) {
+        print_error(parser, "Unexpected token after LOOP command.", cmd);
+        free_command(cmd);
+        return NULL;
+    }
+    return cmd;
+}
+
+/**
+ * @brief Parses the head of a `rep` block: a count followed by `{`.
+ *
+ * The count may be a variable or an immediate. The body follows on the next
+ * lines as ordinary commands and is closed by a `}` on a line of its own. The
+ * command token itself must be the current token.
+ *
+ * @param parser A pointer to the parser to read tokens from.
+ * @return A pointer to the parsed command, or NULL if an error occurred.
+ *
+ * @note The caller is responsible for freeing the memory associated with the
+ * returned command.
+ */
+static Command *parse_rep_cmd(Parser *parser) {
+    advance(parser);
+    Command *cmd = create_command(CMD_REP);
+    if (!cmd) {
+        print_error(parser, "Failed to allocate memory for REP command.", NULL);
+        return NULL;
+    }
+
+    if (!parse_var_or_imm(parser, &cmd->val_a, &cmd->is_a_immediate)) {
+        print_error(parser, "Invalid count for REP command.", cmd);
+        free_command(cmd);
+        return NULL;
+    }
+
+    if (!consume(parser, TOK_LBRACE)) {
+        print_error(parser, "Expected { after REP count.", cmd);
+        free_command(cmd);
+        return NULL;
+    }
+
+    if (!consume_newline(parser)) {
+        print_error(parser, "Unexpected token after REP command.", cmd);
+        free_command(cmd);
+        return NULL;
+    }
+
+    parser->rep_depth++;
+    return cmd;
+}
+
+/**
+ * @brief Parses the operands of a string or checksum command.
+ *
+ * `strlen` takes a destination variable and an address, `strchr` a destination
+ * variable, an address and the byte to find, `strcmp` a destination variable
+ * and two addresses, and `strcpy` the destination and source addresses.
+ * `crc32c` and `hash64` take a destination variable, an address and a length. All
+ * operands but the destination variable may be variables or immediates. The
+ * command token itself must be the current token.
+ *
+ * @param parser A pointer to the parser to read tokens from.
+ * @param type The type of the command being parsed.
+ * @return A pointer to the parsed command, or NULL if an error occurred.
+ *
+ * @note The caller is responsible for freeing the memory associated with the
+ * returned command.
+ */
+static Command *parse_string_cmd(Parser *parser, CommandType type) {
+    advance(parser);
+    Command *cmd = create_command(type);
+    if (!cmd) {
+        print_error(parser, "Failed to allocate memory for command.", NULL);
+        return NULL;
+    }
+
+    if (type != CMD_STRCPY && !parse_variable_operand(parser, &cmd->destination)) {
+        print_error(parser, "Invalid destination operand.", cmd);
+        free_command(cmd);
+        return NULL;
+    }
+
+    if (!parse_var_or_imm(parser, &cmd->val_a, &cmd->is_a_immediate)) {
+        print_error(parser, "Invalid address operand.", cmd);
+        free_command(cmd);
+        return NULL;
+    }
+
+    if (type != CMD_STRLEN && !parse_var_or_imm(parser, &cmd->val_b, &cmd->is_b_immediate)) {
+        print_error(parser, "Invalid last operand.", cmd);
+        free_command(cmd);
+        return NULL;
+    }
+
+    if (!consume_newline(parser)) {
+        print_error(parser, "Unexpected token after command.", cmd);
+        free_command(cmd);
+        return NULL;
+    }
+    return cmd;
+}
+
+/**
+ * @brief Parses a multi-register transfer: `ldp`, `stp`, `ldm` or `stm`.
+ *
+ * All take two variables and an address, which may be a variable or an
+ * immediate. The first variable is kept in `destination` and the second in
+ * `val_a`; for `ldm` and `stm` they are the first and last of a range, which
+ * must not run backwards. The command token itself must be the current token.
+ *
+ * @param parser A pointer to the parser to read tokens from.
+ * @param type The type of the command being parsed.
+ * @return A pointer to the parsed command, or NULL if an error occurred.
+ *
+ * @note The caller is responsible for freeing the memory associated with the
+ * returned command.
+ */
+static Command *parse_multi_cmd(Parser *parser, CommandType type) {
+    advance(parser);
+    Command *cmd = create_command(type);
+    if (!cmd) {
+        print_error(parser, "Failed to allocate memory for command.", NULL);
+        return NULL;
+    }
+
+    if (!parse_variable_operand(parser, &cmd->destination)) {
+        print_error(parser, "Invalid register operand.", cmd);
+        free_command(cmd);
+        return NULL;
+    }
+
+    // A backwards range is reported at its last register, once both are known
+    size_t last_reg = parser->pos;
+    if (!parse_variable_operand(parser, &cmd->val_a)) {
+        print_error(parser, "Invalid register operand.", cmd);
+        free_command(cmd);
+        return NULL;
+    }
+
+    bool is_range = type == CMD_LDM || type == CMD_STM;
+    if (is_range && cmd->val_a.base < cmd->destination.base) {
+        parser->pos = last_reg;
+        print_error(parser, "Register range runs backwards.", cmd);
+        free_command(cmd);
+        return NULL;
+    }
+
+    if (!parse_var_or_imm(parser, &cmd->val_b, &cmd->is_b_immediate)) {
+        print_error(parser, "Invalid address operand.", cmd);
+        free_command(cmd);
+        return NULL;
+    }
+
+    if (!consume_newline(parser)) {
+        print_error(parser, "Unexpected token after command.", cmd);
+        free_command(cmd);
+        return NULL;
+    }
+    return cmd;
+}
+
+/**
+ * @brief Parses a bitfield command: `ubfx`, `sbfx`, `bfi` or `bfxil`.
+ *
+ * All take two variables, the position of the field's lowest bit and its
+ * width, which must both be immediates and describe a field of at least one
+ * bit that ends within 64 bits. The field is packed into `val_b` as
+ * position | width << 8. The command token itself must be the current token.
+ *
+ * @param parser A pointer to the parser to read tokens from.
+ * @param type The type of the command being parsed.
+ * @return A pointer to the parsed command, or NULL if an error occurred.
+ *
+ * @note The caller is responsible for freeing the memory associated with the
+ * returned command.
+ */
+static Command *parse_bitfield_cmd(Parser *parser, CommandType type) {
+    advance(parser);
+    Command *cmd = create_command(type);
+    if (!cmd) {
+        print_error(parser, "Failed to allocate memory for command.", NULL);
+        return NULL;
+    }
+
+    if (!parse_variable_operand(parser, &cmd->destination) ||
+        !parse_variable_operand(parser, &cmd->val_a)) {
+        print_error(parser, "Invalid register operand.", cmd);
+        free_command(cmd);
+        return NULL;
+    }
+
+    // Each immediate is range checked with the parser back at its token, so
+    // the error points at the one that is out of range
+    Operand position, width;
+    size_t  position_token = parser->pos;
+    if (!parse_imm(parser, &position)) {
+        print_error(parser, "Invalid bitfield position or width.", cmd);
+        free_command(cmd);
+        return NULL;
+    }
+    if (position.num_val < 0 || position.num_val > 63) {
+        parser->pos = position_token;
+        print_error(parser, "Bitfield does not fit in 64 bits.", cmd);
+        free_command(cmd);
+        return NULL;
+    }
+
+    size_t width_token = parser->pos;
+    if (!parse_imm(parser, &width)) {
+        print_error(parser, "Invalid bitfield position or width.", cmd);
+        free_command(cmd);
+        return NULL;
+    }
+    if (width.num_val < 1 || position.num_val + width.num_val > 64) {
+        parser->pos = width_token;
+        print_error(parser, "Bitfield does not fit in 64 bits.", cmd);
+        free_command(cmd);
+        return NULL;
+    }
+    cmd->val_b.num_val  = position.num_val | width.num_val << 8;
+    cmd->is_b_immediate = true;
+
+    if (!consume_newline(parser)) {
+        print_error(parser, "Unexpected token after command.", cmd);
+        free_command(cmd);
+        return NULL;
+    }
+    return cmd;
 }
 
 /**
  * @brief Parses a singular command.
  *
- * Reads in the token(s) from the lexer that the parser owns and determines the
+ * Reads in the token(s) from the token buffer the parser walks and determines the
  * appropriate matching command. Updates the parser->had_error if an error
  * occurs.
  *
@@ -401,11 +884,11 @@ static Command *parse_cmd(Parser *parser) {
     }
 
     // EOF looking
-    if (parser->current.type == TOK_EOF) {
+    if (current_type(parser) == TOK_EOF) {
         return NULL;
     }
 
-    switch (parser->current.type) {
+    switch (current_type(parser)) {
         case TOK_ADD: {
             advance(parser);
             Command *cmd = create_command(CMD_ADD);
@@ -420,8 +903,7 @@ static Command *parse_cmd(Parser *parser) {
                 return NULL;
             }
 
-            bool is_immediate_a = false;
-            if (!parse_var_or_imm(parser, &cmd->val_a, &is_immediate_a)) {
+            if (!parse_variable_operand(parser, &cmd->val_a)) {
                 print_error(parser, "Invalid first operand for ADD command.", cmd);
                 free_command(cmd);
                 return NULL;
@@ -434,10 +916,9 @@ static Command *parse_cmd(Parser *parser) {
                 return NULL;
             }
 
-            cmd->is_a_immediate = is_immediate_a;
             cmd->is_b_immediate = is_immediate_b;
 
-            if (parser->current.type != TOK_NL && parser->current.type != TOK_EOF) {
+            if (current_type(parser) != TOK_NL && current_type(parser) != TOK_EOF) {
                 print_error(parser, "Unexpected token after ADD command.", cmd);
                 free_command(cmd);
                 return NULL;
@@ -461,8 +942,7 @@ static Command *parse_cmd(Parser *parser) {
                 return NULL;
             }
 
-            bool is_immediate_a = false;
-            if (!parse_var_or_imm(parser, &cmd->val_a, &is_immediate_a)) {
+            if (!parse_variable_operand(parser, &cmd->val_a)) {
                 print_error(parser, "Invalid first operand for SUB command.", cmd);
                 free_command(cmd);
                 return NULL;
@@ -475,10 +955,9 @@ static Command *parse_cmd(Parser *parser) {
                 return NULL;
             }
 
-            cmd->is_a_immediate = is_immediate_a;
             cmd->is_b_immediate = is_immediate_b;
 
-            if (parser->current.type != TOK_NL && parser->current.type != TOK_EOF) {
+            if (current_type(parser) != TOK_NL && current_type(parser) != TOK_EOF) {
                 print_error(parser, "Unexpected token after SUB command.", cmd);
                 free_command(cmd);
                 return NULL;
@@ -503,16 +982,15 @@ static Command *parse_cmd(Parser *parser) {
                 return NULL;
             }
 
-            bool is_immediate = false;
-            if (!parse_var_or_imm(parser, &cmd->val_a, &is_immediate)) {
+            if (!parse_imm(parser, &cmd->val_a)) {
                 print_error(parser, "Invalid source operand for MOV command.", cmd);
                 free_command(cmd);
                 return NULL;
             }
 
-            cmd->is_a_immediate = is_immediate;
+            cmd->is_a_immediate = true;
 
-            if (parser->current.type != TOK_NL && parser->current.type != TOK_EOF) {
+            if (current_type(parser) != TOK_NL && current_type(parser) != TOK_EOF) {
                 print_error(parser, "Unexpected token after MOV command.", cmd);
                 free_command(cmd);
                 return NULL;
@@ -530,8 +1008,7 @@ static Command *parse_cmd(Parser *parser) {
                 return NULL;
             }
 
-            bool is_immediate_a = false;
-            if (!parse_var_or_imm(parser, &cmd->val_a, &is_immediate_a)) {
+            if (!parse_variable_operand(parser, &cmd->val_a)) {
                 print_error(parser, "Invalid first operand for CMP command.", cmd);
                 free_command(cmd);
                 return NULL;
@@ -544,10 +1021,9 @@ static Command *parse_cmd(Parser *parser) {
                 return NULL;
             }
 
-            cmd->is_a_immediate = is_immediate_a;
             cmd->is_b_immediate = is_immediate_b;
 
-            if (parser->current.type != TOK_NL && parser->current.type != TOK_EOF) {
+            if (current_type(parser) != TOK_NL && current_type(parser) != TOK_EOF) {
                 print_error(parser, "Unexpected token after CMP command.", cmd);
                 free_command(cmd);
                 return NULL;
@@ -565,8 +1041,7 @@ static Command *parse_cmd(Parser *parser) {
                 return NULL;
             }
 
-            bool is_immediate_a = false;
-            if (!parse_var_or_imm(parser, &cmd->val_a, &is_immediate_a)) {
+            if (!parse_variable_operand(parser, &cmd->val_a)) {
                 print_error(parser, "Invalid first operand for CMP_U command.", cmd);
                 free_command(cmd);
                 return NULL;
@@ -579,10 +1054,9 @@ static Command *parse_cmd(Parser *parser) {
                 return NULL;
             }
 
-            cmd->is_a_immediate = is_immediate_a;
             cmd->is_b_immediate = is_immediate_b;
 
-            if (parser->current.type != TOK_NL && parser->current.type != TOK_EOF) {
+            if (current_type(parser) != TOK_NL && current_type(parser) != TOK_EOF) {
                 print_error(parser, "Unexpected token after CMP_U command.", cmd);
                 free_command(cmd);
                 return NULL;
@@ -600,43 +1074,395 @@ static Command *parse_cmd(Parser *parser) {
                 return NULL;
             }
 
-            if (!is_base(parser->current)) {
+            // Unlike parse_var_or_imm, leave an invalid operand as the current token
+            if (parse_variable_operand(parser, &cmd->val_a)) {
+                cmd->is_a_immediate = false;
+            } else if (parse_imm(parser, &cmd->val_a)) {
+                cmd->is_a_immediate = true;
+            } else {
+                print_error(parser, "Invalid operand for PRINT command.", cmd);
+                free_command(cmd);
+                return NULL;
+            }
+
+            if (!parse_base(parser, &cmd->val_b)) {
                 print_error(parser, "Invalid base for PRINT command.", cmd);
                 free_command(cmd);
                 return NULL;
             }
 
-            cmd->val_a.str_val = strdup(parser->current.lexeme);
+            if (current_type(parser) != TOK_NL && current_type(parser) != TOK_EOF) {
+                print_error(parser, "Unexpected token after PRINT command.", cmd);
+                free_command(cmd);
+                return NULL;
+            }
+
+            advance(parser);
+            return cmd;
+        }
+
+        case TOK_AND:
+            return parse_logic_or_shift(parser, CMD_AND);
+        case TOK_ORR:
+            return parse_logic_or_shift(parser, CMD_ORR);
+        case TOK_EOR:
+            return parse_logic_or_shift(parser, CMD_EOR);
+        case TOK_LSL:
+            return parse_logic_or_shift(parser, CMD_LSL);
+        case TOK_LSR:
+            return parse_logic_or_shift(parser, CMD_LSR);
+        case TOK_ASR:
+            return parse_logic_or_shift(parser, CMD_ASR);
+        case TOK_ROR:
+            return parse_logic_or_shift(parser, CMD_ROR);
+
+        case TOK_UBFX:
+            return parse_bitfield_cmd(parser, CMD_UBFX);
+        case TOK_SBFX:
+            return parse_bitfield_cmd(parser, CMD_SBFX);
+        case TOK_BFI:
+            return parse_bitfield_cmd(parser, CMD_BFI);
+        case TOK_BFXIL:
+            return parse_bitfield_cmd(parser, CMD_BFXIL);
+
+        case TOK_HNEW:
+            return parse_map_cmd(parser, CMD_HNEW);
+        case TOK_HPUT:
+            return parse_map_cmd(parser, CMD_HPUT);
+        case TOK_HGET:
+            return parse_map_cmd(parser, CMD_HGET);
+        case TOK_HDEL:
+            return parse_map_cmd(parser, CMD_HDEL);
+
+        case TOK_LOAD:
+        case TOK_LOADS: {
+            CommandType type = current_type(parser) == TOK_LOADS ? CMD_LOADS : CMD_LOAD;
             advance(parser);
+            Command *cmd = create_command(type);
+            if (!cmd) {
+                print_error(parser, "Failed to allocate memory for LOAD command.", NULL);
+                return NULL;
+            }
+
+            // load x0 <width> <address>, or loads with the same operands
+            if (!parse_variable_operand(parser, &cmd->destination)) {
+                print_error(parser, "Invalid destination operand for LOAD command.", cmd);
+                free_command(cmd);
+                return NULL;
+            }
+
+            if (!parse_imm(parser, &cmd->val_a)) {
+                print_error(parser, "Invalid width for LOAD command.", cmd);
+                free_command(cmd);
+                return NULL;
+            }
+            cmd->is_a_immediate = true;
+
+            // A full 8-byte word has no sign to extend
+            int64_t width = cmd->val_a.num_val;
+            if (type == CMD_LOADS && width != 1 && width != 2 && width != 4) {
+                print_error(parser, "Invalid width for LOADS command.", cmd);
+                free_command(cmd);
+                return NULL;
+            }
 
             bool is_immediate = false;
             if (!parse_var_or_imm(parser, &cmd->val_b, &is_immediate)) {
-                print_error(parser, "Invalid operand for PRINT command.", cmd);
+                print_error(parser, "Invalid address for LOAD command.", cmd);
+                free_command(cmd);
+                return NULL;
+            }
+            cmd->is_b_immediate = is_immediate;
+
+            if (!consume_newline(parser)) {
+                print_error(parser, "Unexpected token after LOAD command.", cmd);
+                free_command(cmd);
+                return NULL;
+            }
+            return cmd;
+        }
+
+        case TOK_STORE: {
+            advance(parser);
+            Command *cmd = create_command(CMD_STORE);
+            if (!cmd) {
+                print_error(parser, "Failed to allocate memory for STORE command.", NULL);
+                return NULL;
+            }
+
+            // store x0 <address> <width>; the stored register is kept in `destination`
+            if (!parse_variable_operand(parser, &cmd->destination)) {
+                print_error(parser, "Invalid source operand for STORE command.", cmd);
+                free_command(cmd);
+                return NULL;
+            }
+
+            bool is_immediate = false;
+            if (!parse_var_or_imm(parser, &cmd->val_a, &is_immediate)) {
+                print_error(parser, "Invalid address for STORE command.", cmd);
+                free_command(cmd);
+                return NULL;
+            }
+            cmd->is_a_immediate = is_immediate;
+
+            if (!parse_imm(parser, &cmd->val_b)) {
+                print_error(parser, "Invalid width for STORE command.", cmd);
+                free_command(cmd);
+                return NULL;
+            }
+            cmd->is_b_immediate = true;
+
+            if (!consume_newline(parser)) {
+                print_error(parser, "Unexpected token after STORE command.", cmd);
+                free_command(cmd);
+                return NULL;
+            }
+            return cmd;
+        }
+
+        case TOK_PUT: {
+            advance(parser);
+            Command *cmd = create_command(CMD_PUT);
+            if (!cmd) {
+                print_error(parser, "Failed to allocate memory for PUT command.", NULL);
+                return NULL;
+            }
+
+            if (current_type(parser) != TOK_STR) {
+                print_error(parser, "Invalid string for PUT command.", cmd);
                 free_command(cmd);
                 return NULL;
             }
 
+            cmd->val_a.str_val = strndup(current_lexeme(parser), current_length(parser));
+            if (!cmd->val_a.str_val) {
+                print_error(parser, "Failed to allocate memory for PUT command.", cmd);
+                free_command(cmd);
+                return NULL;
+            }
+            cmd->is_a_string = true;
+            advance(parser);
+
+            bool is_immediate = false;
+            if (!parse_var_or_imm(parser, &cmd->val_b, &is_immediate)) {
+                print_error(parser, "Invalid address for PUT command.", cmd);
+                free_command(cmd);
+                return NULL;
+            }
             cmd->is_b_immediate = is_immediate;
 
-            if (parser->current.type != TOK_NL && parser->current.type != TOK_EOF) {
-                print_error(parser, "Unexpected token after PRINT command.", cmd);
+            if (!consume_newline(parser)) {
+                print_error(parser, "Unexpected token after PUT command.", cmd);
+                free_command(cmd);
+                return NULL;
+            }
+            return cmd;
+        }
+
+        case TOK_BRANCH:
+        case TOK_BRANCH_EQ:
+        case TOK_BRANCH_NEQ:
+        case TOK_BRANCH_GT:
+        case TOK_BRANCH_LT:
+        case TOK_BRANCH_GE:
+        case TOK_BRANCH_LE: {
+            TokenType type = current_type(parser);
+            advance(parser);
+            Command *cmd = create_command(CMD_BRANCH);
+            if (!cmd) {
+                print_error(parser, "Failed to allocate memory for BRANCH command.", NULL);
+                return NULL;
+            }
+
+            switch (type) {
+                case TOK_BRANCH_EQ:
+                    cmd->branch_condition = BRANCH_EQUAL;
+                    break;
+                case TOK_BRANCH_NEQ:
+                    cmd->branch_condition = BRANCH_NOT_EQUAL;
+                    break;
+                case TOK_BRANCH_GT:
+                    cmd->branch_condition = BRANCH_GREATER;
+                    break;
+                case TOK_BRANCH_LT:
+                    cmd->branch_condition = BRANCH_LESS;
+                    break;
+                case TOK_BRANCH_GE:
+                    cmd->branch_condition = BRANCH_GREATER_EQUAL;
+                    break;
+                case TOK_BRANCH_LE:
+                    cmd->branch_condition = BRANCH_LESS_EQUAL;
+                    break;
+                default:
+                    cmd->branch_condition = BRANCH_ALWAYS;
+                    break;
+            }
+
+            if (type != TOK_BRANCH && current_type(parser) == TOK_LIKELY) {
+                parser->hint = HINT_LIKELY;
+                advance(parser);
+            } else if (type != TOK_BRANCH && current_type(parser) == TOK_UNLIKELY) {
+                parser->hint = HINT_UNLIKELY;
+                advance(parser);
+            }
+
+            if (!parse_label_operand(parser, &cmd->val_a)) {
+                print_error(parser, "Invalid label for BRANCH command.", cmd);
+                free_command(cmd);
+                return NULL;
+            }
+            cmd->is_a_string = true;
+
+            if (!consume_newline(parser)) {
+                print_error(parser, "Unexpected token after BRANCH command.", cmd);
+                free_command(cmd);
+                return NULL;
+            }
+            return cmd;
+        }
+
+        case TOK_CALL: {
+            advance(parser);
+            Command *cmd = create_command(CMD_CALL);
+            if (!cmd) {
+                print_error(parser, "Failed to allocate memory for CALL command.", NULL);
+                return NULL;
+            }
+
+            if (!parse_label_operand(parser, &cmd->val_a)) {
+                print_error(parser, "Invalid label for CALL command.", cmd);
+                free_command(cmd);
+                return NULL;
+            }
+            cmd->is_a_string = true;
+
+            if (!consume_newline(parser)) {
+                print_error(parser, "Unexpected token after CALL command.", cmd);
+                free_command(cmd);
+                return NULL;
+            }
+            return cmd;
+        }
+
+        case TOK_LOOP:
+            return parse_loop_cmd(parser);
+
+        case TOK_REP:
+            return parse_rep_cmd(parser);
+
+        case TOK_STRLEN:
+            return parse_string_cmd(parser, CMD_STRLEN);
+        case TOK_STRCHR:
+            return parse_string_cmd(parser, CMD_STRCHR);
+        case TOK_STRCMP:
+            return parse_string_cmd(parser, CMD_STRCMP);
+        case TOK_STRCPY:
+            return parse_string_cmd(parser, CMD_STRCPY);
+        case TOK_CRC32C:
+            return parse_string_cmd(parser, CMD_CRC32C);
+        case TOK_HASH64:
+            return parse_string_cmd(parser, CMD_HASH64);
+
+        case TOK_LDP:
+            return parse_multi_cmd(parser, CMD_LDP);
+        case TOK_STP:
+            return parse_multi_cmd(parser, CMD_STP);
+        case TOK_LDM:
+            return parse_multi_cmd(parser, CMD_LDM);
+        case TOK_STM:
+            return parse_multi_cmd(parser, CMD_STM);
+
+        case TOK_RBRACE: {
+            if (parser->rep_depth == 0) {
+                print_error(parser, "Unmatched } outside of a REP block.", NULL);
+                return NULL;
+            }
+
+            advance(parser);
+            parser->rep_depth--;
+            Command *cmd = create_command(CMD_REP_END);
+            if (!cmd) {
+                print_error(parser, "Failed to allocate memory for REP block end.", NULL);
+                return NULL;
+            }
+
+            if (!consume_newline(parser)) {
+                print_error(parser, "Unexpected token after }.", cmd);
                 free_command(cmd);
                 return NULL;
             }
+            return cmd;
+        }
 
+        case TOK_RET: {
             advance(parser);
+            Command *cmd = create_command(CMD_RET);
+            if (!cmd) {
+                print_error(parser, "Failed to allocate memory for RET command.", NULL);
+                return NULL;
+            }
+
+            if (!consume_newline(parser)) {
+                print_error(parser, "Unexpected token after RET command.", cmd);
+                free_command(cmd);
+                return NULL;
+            }
             return cmd;
         }
 
         default:
             print_error(parser, "Unrecognized command.", NULL);
-            while (parser->current.type != TOK_NL && parser->current.type != TOK_EOF) {
+            while (current_type(parser) != TOK_NL && current_type(parser) != TOK_EOF) {
                 advance(parser);
             }
             return NULL;
     }
 }
 
+/**
+ * @brief Parses a `.cold label` directive, which marks the block starting at
+ * the label as rarely run.
+ *
+ * @param parser A pointer to the parser positioned at the directive.
+ * @return The name of the label, or NULL on error.
+ */
+static char *parse_cold_directive(Parser *parser) {
+    advance(parser);
+
+    Operand label;
+    if (!parse_label_operand(parser, &label)) {
+        print_error(parser, "Invalid label for .cold directive.", NULL);
+        return NULL;
+    }
+
+    if (!consume_newline(parser)) {
+        print_error(parser, "Unexpected token after .cold directive.", NULL);
+        free(label.str_val);
+        return NULL;
+    }
+    return label.str_val;
+}
+
+/**
+ * @brief Marks the commands named by `.cold` directives as starting cold
+ * blocks. Labels that name no command are ignored, as hints never change what
+ * a program does.
+ *
+ * @param parser A pointer to the parser, whose label map holds every label of
+ * the program.
+ * @param names The names of the labels, freed by this function.
+ * @param count The number of entries in `names`.
+ */
+static void mark_cold_labels(Parser *parser, char **names, size_t count) {
+    for (size_t i = 0; i < count; i++) {
+        Entry *e = get_label(parser->label_map, names[i]);
+        if (parser->hints && e && e->command) {
+            layout_hints_add(parser->hints, e->command, HINT_COLD);
+        }
+        free(names[i]);
+    }
+}
+
 /**
  * @brief Parses commands into a linked list.
  *
@@ -648,25 +1474,120 @@ Command *parse_commands(Parser *parser) {
     Command *head = NULL;
     Command *tail = NULL;
 
+    // Labels seen since the last command; they all name the next command parsed
+    char  **pending       = NULL;
+    size_t  pending_count = 0;
+    size_t  pending_cap   = 0;
+
+    // Labels named by `.cold` directives, marked once every label is known
+    char  **cold       = NULL;
+    size_t  cold_count = 0;
+    size_t  cold_cap   = 0;
+
     while (!is_at_end(parser)) {
-        Command *cmd = parse_cmd(parser);
+        skip_nls(parser);
+        if (is_label_definition(parser)) {
+            if (pending_count == pending_cap) {
+                size_t new_cap     = pending_cap ? pending_cap * 2 : 4;
+                char **new_pending = realloc(pending, new_cap * sizeof(char *));
+                if (!new_pending) {
+                    print_error(parser, "Failed to allocate memory for label.", NULL);
+                    break;
+                }
+                pending     = new_pending;
+                pending_cap = new_cap;
+            }
+
+            pending[pending_count] = strndup(current_lexeme(parser), current_length(parser));
+            if (!pending[pending_count]) {
+                print_error(parser, "Failed to allocate memory for label.", NULL);
+                break;
+            }
+            pending_count++;
+            advance(parser);  // Label name
+            advance(parser);  // Colon
+            continue;
+        }
+
+        if (current_type(parser) == TOK_COLD) {
+            if (cold_count == cold_cap) {
+                size_t new_cap  = cold_cap ? cold_cap * 2 : 4;
+                char **new_cold = realloc(cold, new_cap * sizeof(char *));
+                if (!new_cold) {
+                    print_error(parser, "Failed to allocate memory for label.", NULL);
+                    break;
+                }
+                cold     = new_cold;
+                cold_cap = new_cap;
+            }
+
+            char *name = parse_cold_directive(parser);
+            if (name) {
+                cold[cold_count++] = name;
+                continue;
+            }
+        }
+
+        // A command on w registers parses as usual and then becomes its 32-bit variant
+        CommandType word_type = word_command(current_type(parser));
+        parser->word_regs     = word_type != CMD_ERR && names_word_register(parser);
+
+        parser->hint   = HINT_NONE;
+        size_t   start = parser->pos;
+        Command *cmd   = parser->had_error ? NULL : parse_cmd(parser);
+        if (cmd && parser->word_regs) {
+            cmd->type = word_type;
+        }
+        parser->word_regs = false;
 
         if (cmd) {
+            command_set_line(cmd, token_buffer_line(parser->tokens, start));
             if (!head) {
                 head = cmd;
             } else {
                 tail->next = cmd;
             }
             tail = cmd;
+
+            if (parser->hints && parser->hint != HINT_NONE) {
+                layout_hints_add(parser->hints, cmd, parser->hint);
+            }
+
+            for (size_t i = 0; i < pending_count; i++) {
+                put_label(parser->label_map, pending[i], cmd);
+                free(pending[i]);
+            }
+            pending_count = 0;
         }
 
         if (parser->had_error) {
-            while (parser->current.type != TOK_NL && parser->current.type != TOK_EOF) {
+            while (current_type(parser) != TOK_NL && current_type(parser) != TOK_EOF) {
                 advance(parser);
             }
             parser->had_error = false;
+            parser->recovered = true;
         }
     }
-    print_commands(head);
+
+    // Labels at the very end name no command; branching to them ends the program
+    for (size_t i = 0; i < pending_count; i++) {
+        put_label(parser->label_map, pending[i], NULL);
+        free(pending[i]);
+    }
+    free(pending);
+    mark_cold_labels(parser, cold, cold_count);
+    free(cold);
+    resolve_loop_targets(parser->label_map, head);
+
+    // An unclosed block has no end to jump back from; leave it to the caller
+    if (parser->rep_depth > 0) {
+        parser->had_error = true;
+    }
+
+    // Completes the "Parsed commands up to this point" diagnostic; a clean
+    // parse prints nothing so stdout carries only the program's output
+    if (parser->recovered && !parser->quiet) {
+        print_commands(head);
+    }
     return head;
 }
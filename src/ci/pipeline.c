@@ -0,0 +1,462 @@
+#define _GNU_SOURCE
+#include "pipeline.h"
+#include <pthread.h>
+#include <sched.h>
+#include <stdatomic.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "command_type.h"
+#include "label_map.h"
+#include "lexer.h"
+#include "parser.h"
+#include "token.h"
+#include "token_buffer.h"
+
+#define BATCH_LINES         256  // Lines a batch holds at least, unless the source ends first.
+#define QUEUE_SLOTS         8    // Batches a queue holds before its producer waits.
+#define BATCH_LABEL_BUCKETS 16   // Label map buckets per batch; batches hold few labels.
+
+/**
+ * @brief A batch of source lines and their tokens.
+ */
+typedef struct {
+    char       *text;    // The source of the batch, NUL-terminated.
+    TokenBuffer tokens;  // The tokens of `text`.
+} TokenBatch;
+
+/**
+ * @brief A batch of source lines, parsed.
+ */
+typedef struct {
+    Command    *head;    // The first command of the batch, NULL if it has none.
+    Command    *tail;    // The last command of the batch.
+    LabelMap    labels;  // The batch's labels; NULL ones name whatever follows the batch.
+    TokenBatch *tokens;  // Kept if parsing found errors, to report them in order; else NULL.
+    bool        failed;  // Whether the errors leave the batch without commands to run.
+} CodeBatch;
+
+/**
+ * @brief A bounded lock-free queue between one producing and one consuming
+ * thread. Both counters only grow and each is written by one side only, so a
+ * slot is read only after the release store that published it.
+ */
+typedef struct {
+    void         *slots[QUEUE_SLOTS];  // The queued batches; NULL ends the stream.
+    atomic_size_t head;                // Batches taken so far; written by the consumer.
+    atomic_size_t tail;                // Batches put so far; written by the producer.
+} BatchQueue;
+
+/**
+ * @brief The state the stages of a pipelined run share.
+ */
+typedef struct {
+    const char *src;            // The source of the program.
+    BatchQueue  lexed;          // From the lexer thread to the parser thread.
+    BatchQueue  parsed;         // From the parser thread to the running thread.
+    atomic_bool out_of_memory;  // Set when a stage could not allocate a batch.
+} Pipeline;
+
+/**
+ * @brief The program as far as it has been linked by the running thread.
+ */
+typedef struct {
+    Command    *await;     // The `CMD_AWAIT` ending the commands linked so far.
+    LabelMap   *labels;    // The labels of the program.
+    LabelMap    dangling;  // Labels naming the first command of the next batch that has one.
+    bool        failed;    // Whether a linked batch failed to parse.
+    bool        ended;     // Whether the parser thread has sent its last batch.
+} Program;
+
+static void        queue_init(BatchQueue *q);
+static void        queue_put(BatchQueue *q, void *batch);
+static void       *queue_take(BatchQueue *q);
+static size_t      batch_end(const char *src, size_t start, uint32_t *lines);
+static TokenBatch *lex_batch(const char *text, size_t length, uint32_t first_line);
+static void        free_token_batch(TokenBatch *batch);
+static CodeBatch  *parse_batch(TokenBatch *tokens);
+static void       *lex_stage(void *arg);
+static void       *parse_stage(void *arg);
+static Command    *make_await(void);
+static bool        move_labels(LabelMap *from, LabelMap *to, Command *command, bool dangling);
+static bool        link_batch(Program *prog, CodeBatch *batch);
+static void        report_errors(const CodeBatch *batch);
+static void        receive(Pipeline *pipe, Program *prog);
+
+static void queue_init(BatchQueue *q) {
+    atomic_init(&q->head, 0);
+    atomic_init(&q->tail, 0);
+}
+
+/**
+ * @brief Appends a batch to a queue, waiting while the queue is full. Only the
+ * producing thread may call this.
+ */
+static void queue_put(BatchQueue *q, void *batch) {
+    size_t tail = atomic_load_explicit(&q->tail, memory_order_relaxed);
+    while (tail - atomic_load_explicit(&q->head, memory_order_acquire) == QUEUE_SLOTS) {
+        sched_yield();
+    }
+    q->slots[tail % QUEUE_SLOTS] = batch;
+    atomic_store_explicit(&q->tail, tail + 1, memory_order_release);
+}
+
+/**
+ * @brief Takes the oldest batch off a queue, waiting while the queue is empty.
+ * Only the consuming thread may call this.
+ */
+static void *queue_take(BatchQueue *q) {
+    size_t head = atomic_load_explicit(&q->head, memory_order_relaxed);
+    while (atomic_load_explicit(&q->tail, memory_order_acquire) == head) {
+        sched_yield();
+    }
+    void *batch = q->slots[head % QUEUE_SLOTS];
+    atomic_store_explicit(&q->head, head + 1, memory_order_release);
+    return batch;
+}
+
+/**
+ * @brief Finds where the batch starting at `start` ends: at the first line
+ * boundary after `BATCH_LINES` lines where no `rep` block is open.
+ *
+ * @param src The source of the program.
+ * @param start The offset the batch starts at.
+ * @param lines Set to the number of lines in the batch.
+ * @return The offset the next batch starts at.
+ */
+static size_t batch_end(const char *src, size_t start, uint32_t *lines) {
+    size_t pos   = start;
+    int    depth = 0;
+    *lines       = 0;
+
+    while (src[pos] != '\0' && (*lines < BATCH_LINES || depth > 0)) {
+        const char *line   = src + pos;
+        const char *nl     = strchr(line, '\n');
+        size_t      length = nl ? (size_t) (nl - line) : strlen(line);
+        depth += lexer_brace_change(line, length);
+        pos += nl ? length + 1 : length;
+        (*lines)++;
+    }
+    return pos;
+}
+
+/**
+ * @brief Copies a batch of source lines and lexes it, numbering lines as in
+ * the whole program.
+ *
+ * @return The batch, or NULL if memory ran out.
+ */
+static TokenBatch *lex_batch(const char *text, size_t length, uint32_t first_line) {
+    TokenBatch *batch = calloc(1, sizeof(TokenBatch));
+    if (!batch) {
+        return NULL;
+    }
+    batch->text = strndup(text, length);
+    if (!batch->text) {
+        free(batch);
+        return NULL;
+    }
+
+    Lexer lex;
+    lexer_init(&lex, batch->text);
+    if (!token_buffer_init(&batch->tokens, batch->text) || !lexer_tokenize(&lex, &batch->tokens)) {
+        free_token_batch(batch);
+        return NULL;
+    }
+    batch->tokens.first_line = first_line;
+    return batch;
+}
+
+static void free_token_batch(TokenBatch *batch) {
+    if (!batch) {
+        return;
+    }
+    token_buffer_free(&batch->tokens);
+    free(batch->text);
+    free(batch);
+}
+
+/**
+ * @brief Parses a batch of tokens without reporting errors. A batch with errors
+ * keeps its tokens, so that the thread running the program can report them in
+ * order with its output; the tokens are freed otherwise.
+ *
+ * @return The parsed batch, or NULL if memory ran out.
+ */
+static CodeBatch *parse_batch(TokenBatch *tokens) {
+    CodeBatch *batch = calloc(1, sizeof(CodeBatch));
+    if (!batch || !label_map_init(&batch->labels, BATCH_LABEL_BUCKETS)) {
+        free(batch);
+        free_token_batch(tokens);
+        return NULL;
+    }
+
+    Parser p;
+    parser_init(&p, &tokens->tokens, &batch->labels);
+    p.quiet     = true;
+    batch->head = parse_commands(&p);
+    if (p.had_error) {
+        free_command(batch->head);
+        batch->head   = NULL;
+        batch->tokens = tokens;
+        batch->failed = true;
+        return batch;
+    }
+
+    if (p.recovered) {
+        batch->tokens = tokens;
+    } else {
+        free_token_batch(tokens);
+    }
+    for (Command *cmd = batch->head; cmd; cmd = cmd->next) {
+        batch->tail = cmd;
+    }
+    return batch;
+}
+
+/**
+ * @brief Runs the lexer stage: cuts the source into batches and lexes them.
+ */
+static void *lex_stage(void *arg) {
+    Pipeline   *pipe = arg;
+    const char *src  = pipe->src;
+    size_t      pos  = 0;
+    uint32_t    line = 1;
+
+    while (src[pos] != '\0') {
+        uint32_t    lines;
+        size_t      end   = batch_end(src, pos, &lines);
+        TokenBatch *batch = lex_batch(src + pos, end - pos, line);
+        if (!batch) {
+            atomic_store(&pipe->out_of_memory, true);
+            break;
+        }
+
+        queue_put(&pipe->lexed, batch);
+        pos = end;
+        line += lines;
+    }
+    queue_put(&pipe->lexed, NULL);
+    return NULL;
+}
+
+/**
+ * @brief Runs the parser stage. Stops parsing at the first batch that fails,
+ * but takes the lexer's batches until it ends so the lexer never waits on a
+ * full queue.
+ */
+static void *parse_stage(void *arg) {
+    Pipeline *pipe    = arg;
+    bool      parsing = true;
+    void     *item;
+
+    while ((item = queue_take(&pipe->lexed))) {
+        if (!parsing) {
+            free_token_batch(item);
+            continue;
+        }
+
+        CodeBatch *batch = parse_batch(item);
+        if (!batch) {
+            atomic_store(&pipe->out_of_memory, true);
+            parsing = false;
+            continue;
+        }
+        parsing = !batch->failed;
+        queue_put(&pipe->parsed, batch);
+    }
+    queue_put(&pipe->parsed, NULL);
+    return NULL;
+}
+
+/**
+ * @brief Creates the command that ends the part of a program linked so far.
+ *
+ * @return The command, or NULL if allocating it failed.
+ */
+static Command *make_await(void) {
+    Command *cmd = calloc(1, sizeof(Command));
+    if (cmd) {
+        cmd->type = CMD_AWAIT;
+    }
+    return cmd;
+}
+
+/**
+ * @brief Copies labels from one map to another.
+ *
+ * @param from The map to copy from.
+ * @param to The map to copy to.
+ * @param command The command the copied labels name instead of their own.
+ * @param dangling If true, copies only the labels naming no command and makes
+ * them name `command`; otherwise copies only the labels naming a command.
+ * @return True if every label was copied, false if memory ran out.
+ */
+static bool move_labels(LabelMap *from, LabelMap *to, Command *command, bool dangling) {
+    for (int b = 0; b < from->capacity; b++) {
+        for (Entry *e = from->entries[b]; e; e = e->next) {
+            if ((e->command == NULL) != dangling) {
+                continue;
+            }
+            if (!put_label(to, e->id, dangling ? command : e->command)) {
+                return false;
+            }
+        }
+    }
+    return true;
+}
+
+/**
+ * @brief Reports the errors found parsing a batch as a normal parse reports
+ * them, by parsing the batch again.
+ */
+static void report_errors(const CodeBatch *batch) {
+    LabelMap labels;
+    if (!label_map_init(&labels, BATCH_LABEL_BUCKETS)) {
+        printf("Unable to allocate label hashmap.\n");
+        return;
+    }
+
+    Parser p;
+    parser_init(&p, &batch->tokens->tokens, &labels);
+    Command *commands = parse_commands(&p);
+    if (batch->failed) {
+        printf("Parser encountered an error:\n");
+        printf("At ");
+        print_token(parser_current_token(&p));
+        printf("\nParsed commands up to this point:\n");
+        print_commands(commands);
+    }
+    free_command(commands);
+    label_map_free(&labels);
+}
+
+/**
+ * @brief Links a parsed batch to the end of the program and adds its labels
+ * to the program's, after reporting any errors found parsing it. Frees the
+ * batch.
+ *
+ * The `CMD_AWAIT` that ended the program falls through to the batch, so that
+ * anything that stopped there continues with it, and a new one ends the
+ * batch. Labels that named the end of an earlier batch now name the first
+ * command of this one.
+ *
+ * @return True if the batch was linked, false if memory ran out.
+ */
+static bool link_batch(Program *prog, CodeBatch *batch) {
+    if (batch->tokens) {
+        report_errors(batch);
+        free_token_batch(batch->tokens);
+    }
+
+    bool linked = true;
+    if (batch->failed) {
+        prog->failed = true;
+    } else if (batch->head) {
+        Command *await = make_await();
+        linked         = await && move_labels(&prog->dangling, prog->labels, batch->head, true);
+        if (linked) {
+            label_map_free(&prog->dangling);
+            linked = label_map_init(&prog->dangling, BATCH_LABEL_BUCKETS);
+        }
+        if (linked) {
+            prog->await->next = batch->head;
+            batch->tail->next = await;
+            prog->await       = await;
+        } else {
+            free(await);
+            free_command(batch->head);
+        }
+    }
+
+    if (linked && !batch->failed) {
+        linked = move_labels(&batch->labels, prog->labels, NULL, false) &&
+                 move_labels(&batch->labels, &prog->dangling, NULL, true);
+    }
+    label_map_free(&batch->labels);
+    free(batch);
+    return linked;
+}
+
+/**
+ * @brief Waits for the next parsed batch and links it into the program. Once
+ * the parser has sent its last batch, labels that still dangle name the end
+ * of the program.
+ */
+static void receive(Pipeline *pipe, Program *prog) {
+    CodeBatch *batch = queue_take(&pipe->parsed);
+    if (!batch) {
+        prog->ended = true;
+        if (!move_labels(&prog->dangling, prog->labels, NULL, true)) {
+            atomic_store(&pipe->out_of_memory, true);
+        }
+    } else if (!link_batch(prog, batch)) {
+        atomic_store(&pipe->out_of_memory, true);
+    }
+}
+
+bool pipeline_run(const char *src, Interpreter *intr, Command **commands) {
+    *commands = NULL;
+
+    Pipeline pipe;
+    pipe.src = src;
+    queue_init(&pipe.lexed);
+    queue_init(&pipe.parsed);
+    atomic_init(&pipe.out_of_memory, false);
+
+    Program prog = {make_await(), intr->label_map, {NULL, 0}, false, false};
+    if (!prog.await || !label_map_init(&prog.dangling, BATCH_LABEL_BUCKETS)) {
+        printf("Unable to allocate the program. Aborting\n");
+        free(prog.await);
+        return false;
+    }
+    *commands = prog.await;
+
+    pthread_t lexer, parser;
+    if (pthread_create(&lexer, NULL, lex_stage, &pipe) != 0) {
+        printf("Unable to start the lexer thread. Aborting\n");
+        label_map_free(&prog.dangling);
+        return false;
+    }
+    if (pthread_create(&parser, NULL, parse_stage, &pipe) != 0) {
+        printf("Unable to start the parser thread. Aborting\n");
+        void *batch;
+        while ((batch = queue_take(&pipe.lexed))) {
+            free_token_batch(batch);
+        }
+        pthread_join(lexer, NULL);
+        label_map_free(&prog.dangling);
+        return false;
+    }
+
+    // Batches are linked only as the program needs them, so that errors
+    // reported while parsing them show up at the same point of its output
+    // however fast the other stages run
+    intr->awaiting_code = true;
+    interpreter_start(intr, prog.await);
+    while (!interpret_slice(intr, UINT64_MAX)) {
+        if (!prog.ended && !prog.failed) {
+            receive(&pipe, &prog);
+        }
+        if (prog.failed || atomic_load(&pipe.out_of_memory)) {
+            intr->had_error = true;
+        } else if (prog.ended) {
+            intr->awaiting_code = false;
+        }
+    }
+    intr->awaiting_code = false;
+
+    // A program may finish before the end of its source; parse the rest all the same
+    while (!prog.ended) {
+        receive(&pipe, &prog);
+    }
+    pthread_join(lexer, NULL);
+    pthread_join(parser, NULL);
+
+    if (atomic_load(&pipe.out_of_memory)) {
+        printf("Unable to allocate the program. Aborting\n");
+    }
+    label_map_free(&prog.dangling);
+    return !prog.failed && !atomic_load(&pipe.out_of_memory);
+}
@@ -0,0 +1,456 @@
+#include "scan.h"
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define SCAN_X86
+#endif
+
+/**
+ * @brief One implementation of every scan.
+ */
+typedef struct {
+    size_t (*blanks)(const char *s);
+    size_t (*ident)(const char *s);
+    size_t (*string_end)(const char *s);
+    size_t (*line_end)(const char *s);
+    size_t (*nonzero)(const uint8_t *bytes, size_t length);
+    size_t (*nonzero_end)(const uint8_t *bytes, size_t length);
+    size_t (*either)(const uint8_t *bytes, size_t length, uint8_t a, uint8_t b);
+    size_t (*string_diff)(const uint8_t *a, const uint8_t *b, size_t length);
+} ScanKernels;
+
+static bool   is_blank(char c);
+static bool   is_ident(char c);
+static size_t blanks_scalar(const char *s);
+static size_t ident_scalar(const char *s);
+static size_t string_end_scalar(const char *s);
+static size_t line_end_scalar(const char *s);
+static size_t nonzero_scalar(const uint8_t *bytes, size_t length);
+static size_t nonzero_end_scalar(const uint8_t *bytes, size_t length);
+static size_t either_scalar(const uint8_t *bytes, size_t length, uint8_t a, uint8_t b);
+static size_t string_diff_scalar(const uint8_t *a, const uint8_t *b, size_t length);
+
+static const ScanKernels scalar_kernels = {
+    blanks_scalar,  ident_scalar,       string_end_scalar, line_end_scalar,
+    nonzero_scalar, nonzero_end_scalar, either_scalar,     string_diff_scalar,
+};
+
+static const ScanKernels *active = &scalar_kernels;  // The tier selected by `scan_select`.
+
+static bool is_blank(char c) {
+    return c == ' ' || c == ',' || c == '\t' || c == '\r';
+}
+
+static bool is_ident(char c) {
+    return (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || (c >= '0' && c <= '9') || c == '_' ||
+           c == '.';
+}
+
+static size_t blanks_scalar(const char *s) {
+    size_t i = 0;
+    while (is_blank(s[i])) {
+        i++;
+    }
+    return i;
+}
+
+static size_t ident_scalar(const char *s) {
+    size_t i = 0;
+    while (is_ident(s[i])) {
+        i++;
+    }
+    return i;
+}
+
+static size_t string_end_scalar(const char *s) {
+    size_t i = 0;
+    while (s[i] != '"' && s[i] != '\n' && s[i] != '\0') {
+        i++;
+    }
+    return i;
+}
+
+static size_t line_end_scalar(const char *s) {
+    size_t i = 0;
+    while (s[i] != '\n' && s[i] != '\0') {
+        i++;
+    }
+    return i;
+}
+
+static size_t nonzero_scalar(const uint8_t *bytes, size_t length) {
+    size_t i = 0;
+    while (i < length && bytes[i] == 0) {
+        i++;
+    }
+    return i;
+}
+
+static size_t nonzero_end_scalar(const uint8_t *bytes, size_t length) {
+    while (length > 0 && bytes[length - 1] == 0) {
+        length--;
+    }
+    return length;
+}
+
+static size_t either_scalar(const uint8_t *bytes, size_t length, uint8_t a, uint8_t b) {
+    size_t i = 0;
+    while (i < length && bytes[i] != a && bytes[i] != b) {
+        i++;
+    }
+    return i;
+}
+
+static size_t string_diff_scalar(const uint8_t *a, const uint8_t *b, size_t length) {
+    size_t i = 0;
+    while (i < length && a[i] == b[i] && a[i] != 0) {
+        i++;
+    }
+    return i;
+}
+
+#ifdef SCAN_X86
+
+/*
+ * The string scans look for the first byte a classifier marks as a stop byte.
+ * They read whole aligned blocks, which never cross a page boundary and so can
+ * safely run past the terminator, and mask off the bytes before the start.
+ * Every classifier stops at NUL. The sanitizer cannot tell such reads from
+ * overflows, so the kernels opt out of it.
+ */
+#define SCAN_KERNEL __attribute__((no_sanitize_address, always_inline)) static inline
+
+typedef __m128i (*Sse2Classifier)(__m128i v);
+typedef __m256i (*Avx2Classifier)(__m256i v);
+
+SCAN_KERNEL size_t scan_sse2(const char *s, Sse2Classifier stops) {
+    const char *block = (const char *) ((uintptr_t) s & ~(uintptr_t) 15);
+    uint32_t    mask  = UINT32_MAX << (s - block);
+    for (;;) {
+        __m128i  v   = _mm_load_si128((const __m128i *) block);
+        uint32_t hit = (uint32_t) _mm_movemask_epi8(stops(v)) & mask;
+        if (hit) {
+            return (size_t) (block - s) + (size_t) __builtin_ctz(hit);
+        }
+        block += 16;
+        mask = UINT32_MAX;
+    }
+}
+
+__attribute__((target("avx2"))) SCAN_KERNEL size_t scan_avx2(const char *s, Avx2Classifier stops) {
+    const char *block = (const char *) ((uintptr_t) s & ~(uintptr_t) 31);
+    uint32_t    mask  = UINT32_MAX << (s - block);
+    for (;;) {
+        __m256i  v   = _mm256_load_si256((const __m256i *) block);
+        uint32_t hit = (uint32_t) _mm256_movemask_epi8(stops(v)) & mask;
+        if (hit) {
+            return (size_t) (block - s) + (size_t) __builtin_ctz(hit);
+        }
+        block += 32;
+        mask = UINT32_MAX;
+    }
+}
+
+static inline __m128i eq_sse2(__m128i v, char c) {
+    return _mm_cmpeq_epi8(v, _mm_set1_epi8(c));
+}
+
+static inline __m128i between_sse2(__m128i v, char low, char high) {
+    return _mm_and_si128(_mm_cmpgt_epi8(v, _mm_set1_epi8((char) (low - 1))),
+                         _mm_cmplt_epi8(v, _mm_set1_epi8((char) (high + 1))));
+}
+
+static inline __m128i not_blank_sse2(__m128i v) {
+    __m128i blank = _mm_or_si128(_mm_or_si128(eq_sse2(v, ' '), eq_sse2(v, ',')),
+                                 _mm_or_si128(eq_sse2(v, '\t'), eq_sse2(v, '\r')));
+    return _mm_xor_si128(blank, _mm_set1_epi8(-1));
+}
+
+static inline __m128i not_ident_sse2(__m128i v) {
+    // Setting bit 5 folds upper case onto lower case and moves no other byte into a-z
+    __m128i letter = between_sse2(_mm_or_si128(v, _mm_set1_epi8(0x20)), 'a', 'z');
+    __m128i ident  = _mm_or_si128(_mm_or_si128(letter, between_sse2(v, '0', '9')),
+                                  _mm_or_si128(eq_sse2(v, '_'), eq_sse2(v, '.')));
+    return _mm_xor_si128(ident, _mm_set1_epi8(-1));
+}
+
+static inline __m128i string_stop_sse2(__m128i v) {
+    return _mm_or_si128(_mm_or_si128(eq_sse2(v, '"'), eq_sse2(v, '\n')), eq_sse2(v, '\0'));
+}
+
+static inline __m128i line_stop_sse2(__m128i v) {
+    return _mm_or_si128(eq_sse2(v, '\n'), eq_sse2(v, '\0'));
+}
+
+__attribute__((target("avx2"))) static inline __m256i eq_avx2(__m256i v, char c) {
+    return _mm256_cmpeq_epi8(v, _mm256_set1_epi8(c));
+}
+
+__attribute__((target("avx2"))) static inline __m256i between_avx2(__m256i v, char low, char high) {
+    return _mm256_andnot_si256(_mm256_cmpgt_epi8(_mm256_set1_epi8(low), v),
+                               _mm256_cmpgt_epi8(_mm256_set1_epi8((char) (high + 1)), v));
+}
+
+__attribute__((target("avx2"))) static inline __m256i not_blank_avx2(__m256i v) {
+    __m256i blank = _mm256_or_si256(_mm256_or_si256(eq_avx2(v, ' '), eq_avx2(v, ',')),
+                                    _mm256_or_si256(eq_avx2(v, '\t'), eq_avx2(v, '\r')));
+    return _mm256_xor_si256(blank, _mm256_set1_epi8(-1));
+}
+
+__attribute__((target("avx2"))) static inline __m256i not_ident_avx2(__m256i v) {
+    __m256i letter = between_avx2(_mm256_or_si256(v, _mm256_set1_epi8(0x20)), 'a', 'z');
+    __m256i ident  = _mm256_or_si256(_mm256_or_si256(letter, between_avx2(v, '0', '9')),
+                                     _mm256_or_si256(eq_avx2(v, '_'), eq_avx2(v, '.')));
+    return _mm256_xor_si256(ident, _mm256_set1_epi8(-1));
+}
+
+__attribute__((target("avx2"))) static inline __m256i string_stop_avx2(__m256i v) {
+    return _mm256_or_si256(_mm256_or_si256(eq_avx2(v, '"'), eq_avx2(v, '\n')), eq_avx2(v, '\0'));
+}
+
+__attribute__((target("avx2"))) static inline __m256i line_stop_avx2(__m256i v) {
+    return _mm256_or_si256(eq_avx2(v, '\n'), eq_avx2(v, '\0'));
+}
+
+__attribute__((no_sanitize_address)) static size_t blanks_sse2(const char *s) {
+    return scan_sse2(s, not_blank_sse2);
+}
+
+__attribute__((no_sanitize_address)) static size_t ident_sse2(const char *s) {
+    return scan_sse2(s, not_ident_sse2);
+}
+
+__attribute__((no_sanitize_address)) static size_t string_end_sse2(const char *s) {
+    return scan_sse2(s, string_stop_sse2);
+}
+
+__attribute__((no_sanitize_address)) static size_t line_end_sse2(const char *s) {
+    return scan_sse2(s, line_stop_sse2);
+}
+
+__attribute__((target("avx2"), no_sanitize_address)) static size_t blanks_avx2(const char *s) {
+    return scan_avx2(s, not_blank_avx2);
+}
+
+__attribute__((target("avx2"), no_sanitize_address)) static size_t ident_avx2(const char *s) {
+    return scan_avx2(s, not_ident_avx2);
+}
+
+__attribute__((target("avx2"), no_sanitize_address)) static size_t string_end_avx2(const char *s) {
+    return scan_avx2(s, string_stop_avx2);
+}
+
+__attribute__((target("avx2"), no_sanitize_address)) static size_t line_end_avx2(const char *s) {
+    return scan_avx2(s, line_stop_avx2);
+}
+
+/*
+ * The buffer scans know their length, so they use unaligned loads over whole
+ * blocks and finish the tail with the scalar loops.
+ */
+static size_t nonzero_sse2(const uint8_t *bytes, size_t length) {
+    size_t i = 0;
+    for (; i + 16 <= length; i += 16) {
+        __m128i  v    = _mm_loadu_si128((const __m128i *) (bytes + i));
+        uint32_t zero = (uint32_t) _mm_movemask_epi8(_mm_cmpeq_epi8(v, _mm_setzero_si128()));
+        if (zero != 0xFFFF) {
+            return i + (size_t) __builtin_ctz(~zero);
+        }
+    }
+    return i + nonzero_scalar(bytes + i, length - i);
+}
+
+static size_t nonzero_end_sse2(const uint8_t *bytes, size_t length) {
+    for (; length >= 16; length -= 16) {
+        __m128i  v    = _mm_loadu_si128((const __m128i *) (bytes + length - 16));
+        uint32_t zero = (uint32_t) _mm_movemask_epi8(_mm_cmpeq_epi8(v, _mm_setzero_si128()));
+        if (zero != 0xFFFF) {
+            return length - 16 + 32 - (size_t) __builtin_clz(~zero & 0xFFFF);
+        }
+    }
+    return nonzero_end_scalar(bytes, length);
+}
+
+__attribute__((target("avx2"))) static size_t nonzero_avx2(const uint8_t *bytes, size_t length) {
+    size_t i = 0;
+    for (; i + 32 <= length; i += 32) {
+        __m256i  v = _mm256_loadu_si256((const __m256i *) (bytes + i));
+        uint32_t zero =
+            (uint32_t) _mm256_movemask_epi8(_mm256_cmpeq_epi8(v, _mm256_setzero_si256()));
+        if (zero != UINT32_MAX) {
+            return i + (size_t) __builtin_ctz(~zero);
+        }
+    }
+    return i + nonzero_sse2(bytes + i, length - i);
+}
+
+__attribute__((target("avx2"))) static size_t nonzero_end_avx2(const uint8_t *bytes,
+                                                               size_t         length) {
+    for (; length >= 32; length -= 32) {
+        __m256i  v = _mm256_loadu_si256((const __m256i *) (bytes + length - 32));
+        uint32_t zero =
+            (uint32_t) _mm256_movemask_epi8(_mm256_cmpeq_epi8(v, _mm256_setzero_si256()));
+        if (zero != UINT32_MAX) {
+            return length - (size_t) __builtin_clz(~zero);
+        }
+    }
+    return nonzero_end_sse2(bytes, length);
+}
+
+static size_t either_sse2(const uint8_t *bytes, size_t length, uint8_t a, uint8_t b) {
+    __m128i first  = _mm_set1_epi8((char) a);
+    __m128i second = _mm_set1_epi8((char) b);
+    size_t  i      = 0;
+    for (; i + 16 <= length; i += 16) {
+        __m128i  v   = _mm_loadu_si128((const __m128i *) (bytes + i));
+        uint32_t hit = (uint32_t) _mm_movemask_epi8(
+            _mm_or_si128(_mm_cmpeq_epi8(v, first), _mm_cmpeq_epi8(v, second)));
+        if (hit) {
+            return i + (size_t) __builtin_ctz(hit);
+        }
+    }
+    return i + either_scalar(bytes + i, length - i, a, b);
+}
+
+static size_t string_diff_sse2(const uint8_t *a, const uint8_t *b, size_t length) {
+    size_t i = 0;
+    for (; i + 16 <= length; i += 16) {
+        __m128i  va    = _mm_loadu_si128((const __m128i *) (a + i));
+        __m128i  vb    = _mm_loadu_si128((const __m128i *) (b + i));
+        uint32_t equal = (uint32_t) _mm_movemask_epi8(_mm_cmpeq_epi8(va, vb));
+        uint32_t end   = (uint32_t) _mm_movemask_epi8(_mm_cmpeq_epi8(va, _mm_setzero_si128()));
+        uint32_t stop  = (~equal & 0xFFFF) | end;
+        if (stop) {
+            return i + (size_t) __builtin_ctz(stop);
+        }
+    }
+    return i + string_diff_scalar(a + i, b + i, length - i);
+}
+
+__attribute__((target("avx2"))) static size_t either_avx2(const uint8_t *bytes, size_t length,
+                                                          uint8_t a, uint8_t b) {
+    __m256i first  = _mm256_set1_epi8((char) a);
+    __m256i second = _mm256_set1_epi8((char) b);
+    size_t  i      = 0;
+    for (; i + 32 <= length; i += 32) {
+        __m256i  v   = _mm256_loadu_si256((const __m256i *) (bytes + i));
+        uint32_t hit = (uint32_t) _mm256_movemask_epi8(
+            _mm256_or_si256(_mm256_cmpeq_epi8(v, first), _mm256_cmpeq_epi8(v, second)));
+        if (hit) {
+            return i + (size_t) __builtin_ctz(hit);
+        }
+    }
+    return i + either_sse2(bytes + i, length - i, a, b);
+}
+
+__attribute__((target("avx2"))) static size_t string_diff_avx2(const uint8_t *a, const uint8_t *b,
+                                                               size_t length) {
+    size_t i = 0;
+    for (; i + 32 <= length; i += 32) {
+        __m256i  va    = _mm256_loadu_si256((const __m256i *) (a + i));
+        __m256i  vb    = _mm256_loadu_si256((const __m256i *) (b + i));
+        uint32_t equal = (uint32_t) _mm256_movemask_epi8(_mm256_cmpeq_epi8(va, vb));
+        uint32_t end =
+            (uint32_t) _mm256_movemask_epi8(_mm256_cmpeq_epi8(va, _mm256_setzero_si256()));
+        uint32_t stop = ~equal | end;
+        if (stop) {
+            return i + (size_t) __builtin_ctz(stop);
+        }
+    }
+    return i + string_diff_sse2(a + i, b + i, length - i);
+}
+
+static const ScanKernels sse2_kernels = {
+    blanks_sse2,  ident_sse2,       string_end_sse2, line_end_sse2,
+    nonzero_sse2, nonzero_end_sse2, either_sse2,     string_diff_sse2,
+};
+
+static const ScanKernels avx2_kernels = {
+    blanks_avx2,  ident_avx2,       string_end_avx2, line_end_avx2,
+    nonzero_avx2, nonzero_end_avx2, either_avx2,     string_diff_avx2,
+};
+
+#endif
+
+CpuTier scan_detect(void) {
+#ifdef SCAN_X86
+    // The builtins run cpuid once, and also check that the OS saves the AVX state
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2")) {
+        return CPU_AVX2;
+    }
+    if (__builtin_cpu_supports("sse2")) {
+        return CPU_SSE2;
+    }
+#endif
+    return CPU_SCALAR;
+}
+
+bool scan_select(CpuTier tier) {
+    CpuTier supported = scan_detect();
+    if (tier == CPU_AUTO) {
+        tier = supported;
+    }
+    if (tier > supported) {
+        return false;
+    }
+
+    switch (tier) {
+#ifdef SCAN_X86
+        case CPU_AVX2:
+            active = &avx2_kernels;
+            break;
+        case CPU_SSE2:
+            active = &sse2_kernels;
+            break;
+#endif
+        default:
+            active = &scalar_kernels;
+            break;
+    }
+    return true;
+}
+
+const char *scan_tier_name(CpuTier tier) {
+    switch (tier) {
+        case CPU_SCALAR:
+            return "scalar";
+        case CPU_SSE2:
+            return "sse2";
+        case CPU_AVX2:
+            return "avx2";
+        default:
+            return "auto";
+    }
+}
+
+size_t scan_blanks(const char *s) {
+    return active->blanks(s);
+}
+
+size_t scan_ident(const char *s) {
+    return active->ident(s);
+}
+
+size_t scan_string_end(const char *s) {
+    return active->string_end(s);
+}
+
+size_t scan_line_end(const char *s) {
+    return active->line_end(s);
+}
+
+size_t scan_nonzero(const uint8_t *bytes, size_t length) {
+    return active->nonzero(bytes, length);
+}
+
+size_t scan_nonzero_end(const uint8_t *bytes, size_t length) {
+    return active->nonzero_end(bytes, length);
+}
+
+size_t scan_either(const uint8_t *bytes, size_t length, uint8_t a, uint8_t b) {
+    return active->either(bytes, length, a, b);
+}
+
+size_t scan_string_diff(const uint8_t *a, const uint8_t *b, size_t length) {
+    return active->string_diff(a, b, length);
+}
@@ -0,0 +1,55 @@
+#include "scheduler.h"
+#include <stdlib.h>
+#include "worker_pool.h"
+
+/**
+ * @brief A guest scheduled on the pool.
+ */
+typedef struct {
+    Interpreter *intr;     // The guest's interpreter.
+    uint64_t     quantum;  // The length of each of its slices.
+} GreenThread;
+
+static bool run_slice(void *arg);
+
+/**
+ * @brief Pool task running one slice of a guest.
+ *
+ * @return True once the guest has finished, false if it was preempted.
+ */
+static bool run_slice(void *arg) {
+    GreenThread *thread = (GreenThread *) arg;
+    return interpret_slice(thread->intr, thread->quantum);
+}
+
+bool scheduler_run(Interpreter *instances, size_t count, int workers, uint64_t quantum) {
+    if (!instances || workers < 1 || quantum == 0) {
+        return false;
+    }
+
+    GreenThread *threads = calloc(count ? count : 1, sizeof(GreenThread));
+    if (!threads) {
+        return false;
+    }
+
+    WorkerPool pool;
+    if (!pool_init(&pool, workers)) {
+        free(threads);
+        return false;
+    }
+
+    bool ok = true;
+    for (size_t i = 0; i < count; i++) {
+        threads[i].intr    = &instances[i];
+        threads[i].quantum = quantum;
+        if (!pool_submit(&pool, run_slice, &threads[i])) {
+            ok = false;
+            break;
+        }
+    }
+
+    pool_wait(&pool);
+    pool_free(&pool);
+    free(threads);
+    return ok;
+}
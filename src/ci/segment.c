@@ -0,0 +1,387 @@
+#define _GNU_SOURCE
+#include "segment.h"
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "command_type.h"
+#include "worker_pool.h"
+
+#define MIN_REGION_COMMANDS 256  // Shorter regions run faster in turn than as tasks.
+#define MIN_TASK_COMMANDS   64   // Commands a part holds at least, unless the region ends first.
+#define TASKS_PER_THREAD    4    // Parts per running thread, so that uneven parts even out.
+
+/**
+ * @brief One run of a region, shared by the interpreter that reached it and
+ * the workers helping it.
+ */
+typedef struct {
+    const SegmentPlan *plan;      // The plan of the region.
+    Interpreter       *intrs;     // One interpreter per part.
+    char             **buffers;   // The output of each part.
+    size_t            *lengths;   // The length of each entry in `buffers`.
+    atomic_size_t      next;      // The next part to claim.
+    atomic_size_t      done;      // The number of parts finished.
+    pthread_mutex_t    lock;      // Guards waiting on `finished`.
+    pthread_cond_t     finished;  // Signalled by the part that finishes last.
+    atomic_int         refs;      // Held by the interpreter and by each helper task.
+} SegmentRun;
+
+static int        configured_workers = 0;      // Set by `segment_configure`.
+static WorkerPool pool;                        // Runs the helpers once started.
+static bool       pool_running       = false;  // Whether `pool` is started.
+
+static bool         is_straight(const Command *cmd, uint64_t *uses, uint64_t *defs);
+static size_t       region_length(const Command *first);
+static SegmentPlan *plan_region(Command *first, size_t length);
+static void         free_plan(SegmentPlan *plan);
+static void         run_part(SegmentRun *run, size_t index);
+static void         run_parts(SegmentRun *run);
+static bool         help(void *arg);
+static void         release(SegmentRun *run);
+
+/**
+ * @brief Determines whether a command may be part of a straight-line region:
+ * it only reads and writes registers and flags, or prints a number.
+ */
+static bool is_straight(const Command *cmd, uint64_t *uses, uint64_t *defs) {
+    if (command_registers(cmd, uses, defs)) {
+        return true;
+    }
+    if (cmd->type != CMD_PRINT) {
+        return false;
+    }
+
+    // Strings live in guest memory, which parts do not have
+    char base = (char) cmd->val_b.base;
+    *uses     = cmd->is_a_immediate ? 0 : 1ULL << cmd->val_a.base;
+    *defs     = 0;
+    return base == 'd' || base == 'x' || base == 'b';
+}
+
+/**
+ * @brief Returns the number of straight-line commands from `first` on.
+ */
+static size_t region_length(const Command *first) {
+    size_t   length = 0;
+    uint64_t uses, defs;
+    for (const Command *cmd = first; cmd && is_straight(cmd, &uses, &defs); cmd = cmd->next) {
+        length++;
+    }
+    return length;
+}
+
+/**
+ * @brief Splits a region into parts of about equal length, cutting only where
+ * nothing from there to the end of the region reads what the commands before
+ * the cut write.
+ *
+ * @param first The first command of the region.
+ * @param length The number of commands in the region.
+ * @return The plan, or NULL if the region does not split in two or memory ran
+ * out.
+ */
+static SegmentPlan *plan_region(Command *first, size_t length) {
+    uint64_t *live  = malloc((length + 1) * sizeof(uint64_t));
+    uint64_t *defs  = malloc(length * sizeof(uint64_t));
+    size_t   *cuts  = malloc(length * sizeof(size_t));
+    Command **order = malloc(length * sizeof(Command *));
+    if (!live || !defs || !cuts || !order) {
+        free(live);
+        free(defs);
+        free(cuts);
+        free(order);
+        return NULL;
+    }
+
+    // live[k]: the registers the region reads from command k on before writing them
+    Command *cmd = first;
+    for (size_t k = 0; k < length; k++, cmd = cmd->next) {
+        order[k] = cmd;
+        is_straight(cmd, &live[k], &defs[k]);
+    }
+    live[length] = 0;
+    for (size_t k = length; k-- > 0;) {
+        live[k] |= live[k + 1] & ~defs[k];
+    }
+
+    size_t threads = (size_t) configured_workers + 1;
+    size_t target  = length / (threads * TASKS_PER_THREAD);
+    if (target < MIN_TASK_COMMANDS) {
+        target = MIN_TASK_COMMANDS;
+    }
+
+    size_t   count   = 1;
+    uint64_t written = 0;
+    cuts[0]          = 0;
+    for (size_t k = 0; k < length; k++) {
+        if (k - cuts[count - 1] >= target && !(live[k] & written)) {
+            cuts[count++] = k;
+        }
+        written |= defs[k];
+    }
+
+    SegmentPlan *plan = NULL;
+    size_t       head = sizeof(SegmentPlan) + count * sizeof(SegmentTask);
+    if (count >= 2) {
+        plan = malloc(head + length * sizeof(Command));
+    }
+    if (plan) {
+        Command *copies  = (Command *) ((char *) plan + head);
+        plan->exit       = order[length - 1]->next;
+        plan->task_count = count;
+        for (size_t t = 0, k = 0; t < count; t++) {
+            size_t end         = t + 1 < count ? cuts[t + 1] : length;
+            plan->tasks[t]     = (SegmentTask) {&copies[k], 0};
+            for (; k < end; k++) {
+                copies[k]      = *order[k];
+                copies[k].next = k + 1 < end ? &copies[k + 1] : NULL;
+                plan->tasks[t].defs |= defs[k];
+                if (copies[k].type == CMD_PRINT) {
+                    command_set_line(&copies[k], command_line(order[k]));
+                }
+            }
+        }
+    }
+
+    free(live);
+    free(defs);
+    free(cuts);
+    free(order);
+    return plan;
+}
+
+/**
+ * @brief Frees a plan, forgetting the source lines of its copies of `print`
+ * commands.
+ */
+static void free_plan(SegmentPlan *plan) {
+    if (!plan) {
+        return;
+    }
+
+    for (size_t t = 0; t < plan->task_count; t++) {
+        for (Command *cmd = plan->tasks[t].head; cmd; cmd = cmd->next) {
+            command_set_line(cmd, 0);
+        }
+    }
+    free(plan);
+}
+
+void segment_configure(int workers) {
+    configured_workers = workers;
+}
+
+Command *segment_program(Command *commands) {
+    if (configured_workers <= 0) {
+        return commands;
+    }
+
+    bool     found = false;
+    Command *prev  = NULL;
+    Command *cmd   = commands;
+    while (cmd) {
+        size_t length = region_length(cmd);
+        if (length == 0) {
+            prev = cmd;
+            cmd  = cmd->next;
+            continue;
+        }
+
+        Command *last = cmd;
+        for (size_t k = 1; k < length; k++) {
+            last = last->next;
+        }
+
+        SegmentPlan *plan = length >= MIN_REGION_COMMANDS ? plan_region(cmd, length) : NULL;
+        Command     *seg  = plan ? calloc(1, sizeof(Command)) : NULL;
+        if (seg) {
+            seg->type             = CMD_SEGMENTS;
+            seg->branch_condition = BRANCH_NONE;
+            seg->segments         = plan;
+            seg->next             = cmd;
+            if (prev) {
+                prev->next = seg;
+            } else {
+                commands = seg;
+            }
+            found = true;
+        } else {
+            // The region still runs correctly in turn
+            free_plan(plan);
+        }
+
+        prev = last;
+        cmd  = last->next;
+    }
+
+    if (found && !pool_running) {
+        pool_running = pool_init(&pool, configured_workers);
+    }
+    return commands;
+}
+
+Command *unsegment_program(Command *commands) {
+    if (pool_running) {
+        // Helpers still queued or finishing read their run's plan until they have run
+        pool_wait(&pool);
+        pool_free(&pool);
+        pool_running = false;
+    }
+
+    Command **link = &commands;
+    while (*link) {
+        Command *cmd = *link;
+        if (cmd->type == CMD_SEGMENTS) {
+            *link         = cmd->next;
+            cmd->next     = NULL;
+            free_plan(cmd->segments);
+            cmd->segments = NULL;
+            free_command(cmd);
+        } else {
+            link = &cmd->next;
+        }
+    }
+    return commands;
+}
+
+/**
+ * @brief Runs one part into its own output buffer.
+ */
+static void run_part(SegmentRun *run, size_t index) {
+    Interpreter *part = &run->intrs[index];
+    FILE        *out  = open_memstream(&run->buffers[index], &run->lengths[index]);
+    if (!out) {
+        part->had_error = true;
+        return;
+    }
+
+    part->output = out;
+    interpret(part, run->plan->tasks[index].head);
+    if (fclose(out) != 0) {
+        part->had_error = true;
+    }
+}
+
+/**
+ * @brief Claims and runs parts until none are left.
+ */
+static void run_parts(SegmentRun *run) {
+    size_t index;
+    size_t count = run->plan->task_count;
+    while ((index = atomic_fetch_add(&run->next, 1)) < count) {
+        run_part(run, index);
+        if (atomic_fetch_add_explicit(&run->done, 1, memory_order_release) + 1 == count) {
+            pthread_mutex_lock(&run->lock);
+            pthread_cond_signal(&run->finished);
+            pthread_mutex_unlock(&run->lock);
+        }
+    }
+}
+
+/**
+ * @brief Runs parts of a region from the pool.
+ */
+static bool help(void *arg) {
+    SegmentRun *run = arg;
+    run_parts(run);
+    release(run);
+    return true;
+}
+
+/**
+ * @brief Drops a reference to a run, freeing it with the last one.
+ */
+static void release(SegmentRun *run) {
+    if (atomic_fetch_sub(&run->refs, 1) != 1) {
+        return;
+    }
+
+    for (size_t i = 0; i < run->plan->task_count; i++) {
+        interpreter_free(&run->intrs[i]);
+        free(run->buffers[i]);
+    }
+    pthread_cond_destroy(&run->finished);
+    pthread_mutex_destroy(&run->lock);
+    free(run->intrs);
+    free(run->buffers);
+    free(run->lengths);
+    free(run);
+}
+
+bool segments_run(const SegmentPlan *plan, Interpreter *intr, uint64_t *executed) {
+    if (!pool_running) {
+        return false;
+    }
+
+    size_t      count = plan->task_count;
+    SegmentRun *run   = calloc(1, sizeof(SegmentRun));
+    if (!run) {
+        return false;
+    }
+    run->intrs   = calloc(count, sizeof(Interpreter));
+    run->buffers = calloc(count, sizeof(char *));
+    run->lengths = calloc(count, sizeof(size_t));
+    if (!run->intrs || !run->buffers || !run->lengths) {
+        free(run->intrs);
+        free(run->buffers);
+        free(run->lengths);
+        free(run);
+        return false;
+    }
+
+    run->plan = plan;
+    atomic_init(&run->next, 0);
+    atomic_init(&run->done, 0);
+    atomic_init(&run->refs, 1);
+    pthread_mutex_init(&run->lock, NULL);
+    pthread_cond_init(&run->finished, NULL);
+    for (size_t i = 0; i < count; i++) {
+        interpreter_init_task(&run->intrs[i], intr);
+    }
+
+    // One helper per worker at most, and none for the part this thread takes
+    for (size_t h = 0; h < (size_t) configured_workers && h + 1 < count; h++) {
+        atomic_fetch_add(&run->refs, 1);
+        if (!pool_submit(&pool, help, run)) {
+            atomic_fetch_sub(&run->refs, 1);
+            break;
+        }
+    }
+    run_parts(run);
+    pthread_mutex_lock(&run->lock);
+    while (atomic_load_explicit(&run->done, memory_order_acquire) < count) {
+        pthread_cond_wait(&run->finished, &run->lock);
+    }
+    pthread_mutex_unlock(&run->lock);
+
+    bool ran = true;
+    for (size_t i = 0; i < count; i++) {
+        ran = ran && !run->intrs[i].had_error;
+    }
+    if (ran) {
+        *executed = 0;
+        for (size_t i = 0; i < count; i++) {
+            const Interpreter *part = &run->intrs[i];
+            uint64_t           defs = plan->tasks[i].defs;
+            fwrite(run->buffers[i], 1, run->lengths[i], intr->output);
+            *executed                += part->stats.commands;
+            intr->stats.output_bytes += run->lengths[i];
+
+            for (int r = 0; r < NUM_VARIABLES; r++) {
+                if (defs & (1ULL << r)) {
+                    intr->variables[r] = part->variables[r];
+                }
+            }
+            if (defs & FLAGS_MASK) {
+                intr->is_greater = part->is_greater;
+                intr->is_equal   = part->is_equal;
+                intr->is_less    = part->is_less;
+            }
+        }
+    }
+
+    release(run);
+    return ran;
+}
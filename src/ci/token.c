@@ -1,6 +1,12 @@
 #include "token.h"
 #include <stdio.h>
 
+static const char *const error_messages[] = {
+    [TOKEN_ERR_UNEXPECTED_CHAR] = "Unexpected character",
+    [TOKEN_ERR_BAD_BASE]        = "Either no or invalid digit in the specified base",
+    [TOKEN_ERR_BAD_NUMBER]      = "Invalid numeric literal",
+};
+
 void token_init(Token *tok, TokenType tok_type, const char *lexeme, int lexeme_length, int line,
                 int column) {
     if (!tok) {
@@ -14,6 +20,10 @@ void token_init(Token *tok, TokenType tok_type, const char *lexeme, int lexeme_l
     tok->column = column;
 }
 
+const char *token_error_message(TokenError error) {
+    return error_messages[error];
+}
+
 void print_token(Token tok) {
     printf("Token: ");
     if (tok.type == TOK_EOF) {
@@ -0,0 +1,162 @@
+#include "token_buffer.h"
+#include <stdlib.h>
+#include <string.h>
+
+#define INITIAL_CAPACITY 256
+
+static bool   grow(TokenBuffer *buf);
+static size_t lines_up_to(const TokenBuffer *buf, uint32_t offset);
+
+bool token_buffer_init(TokenBuffer *buf, const char *source) {
+    if (!buf) {
+        return false;
+    }
+
+    buf->source   = source;
+    buf->types    = NULL;
+    buf->offsets  = NULL;
+    buf->lengths  = NULL;
+    buf->values   = NULL;
+    buf->count    = 0;
+    buf->capacity = 0;
+
+    buf->line_starts   = NULL;
+    buf->line_count    = 0;
+    buf->line_capacity = 0;
+    buf->first_line    = 1;
+
+    return grow(buf);
+}
+
+void token_buffer_free(TokenBuffer *buf) {
+    if (!buf) {
+        return;
+    }
+
+    free(buf->types);
+    free(buf->offsets);
+    free(buf->lengths);
+    free(buf->values);
+    free(buf->line_starts);
+    buf->types    = NULL;
+    buf->offsets  = NULL;
+    buf->lengths  = NULL;
+    buf->values   = NULL;
+    buf->count    = 0;
+    buf->capacity = 0;
+
+    buf->line_starts   = NULL;
+    buf->line_count    = 0;
+    buf->line_capacity = 0;
+}
+
+/**
+ * @brief Doubles the capacity of every array in the buffer.
+ *
+ * @param buf Pointer to the token buffer to grow.
+ * @return True if every array was resized, false otherwise.
+ */
+static bool grow(TokenBuffer *buf) {
+    size_t new_capacity = buf->capacity ? buf->capacity * 2 : INITIAL_CAPACITY;
+
+    uint8_t *types = realloc(buf->types, new_capacity * sizeof(uint8_t));
+    if (!types) {
+        return false;
+    }
+    buf->types = types;
+
+    uint32_t *offsets = realloc(buf->offsets, new_capacity * sizeof(uint32_t));
+    if (!offsets) {
+        return false;
+    }
+    buf->offsets = offsets;
+
+    uint32_t *lengths = realloc(buf->lengths, new_capacity * sizeof(uint32_t));
+    if (!lengths) {
+        return false;
+    }
+    buf->lengths = lengths;
+
+    int64_t *values = realloc(buf->values, new_capacity * sizeof(int64_t));
+    if (!values) {
+        return false;
+    }
+    buf->values = values;
+
+    buf->capacity = new_capacity;
+    return true;
+}
+
+bool token_buffer_push(TokenBuffer *buf, TokenType type, uint32_t offset, uint32_t length,
+                       int64_t value) {
+    if (buf->count == buf->capacity && !grow(buf)) {
+        return false;
+    }
+
+    buf->types[buf->count]   = (uint8_t) type;
+    buf->offsets[buf->count] = offset;
+    buf->lengths[buf->count] = length;
+    buf->values[buf->count]  = value;
+    buf->count++;
+    return true;
+}
+
+bool token_buffer_push_line(TokenBuffer *buf, uint32_t offset) {
+    if (buf->line_count == buf->line_capacity) {
+        size_t    new_capacity = buf->line_capacity ? buf->line_capacity * 2 : INITIAL_CAPACITY;
+        uint32_t *line_starts  = realloc(buf->line_starts, new_capacity * sizeof(uint32_t));
+        if (!line_starts) {
+            return false;
+        }
+        buf->line_starts   = line_starts;
+        buf->line_capacity = new_capacity;
+    }
+
+    buf->line_starts[buf->line_count++] = offset;
+    return true;
+}
+
+/**
+ * @brief Binary searches for the number of recorded lines starting at or
+ * before `offset`.
+ *
+ * @param buf Pointer to the token buffer.
+ * @param offset The offset to look up.
+ * @return The number of entries of `line_starts` that are at most `offset`.
+ */
+static size_t lines_up_to(const TokenBuffer *buf, uint32_t offset) {
+    size_t lo = 0;
+    size_t hi = buf->line_count;
+    while (lo < hi) {
+        size_t mid = lo + (hi - lo) / 2;
+        if (buf->line_starts[mid] <= offset) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+    return lo;
+}
+
+uint32_t token_buffer_line(const TokenBuffer *buf, size_t index) {
+    return (uint32_t) lines_up_to(buf, buf->offsets[index]) + buf->first_line;
+}
+
+Token token_buffer_get(const TokenBuffer *buf, size_t index) {
+    Token       tok;
+    uint32_t    offset = buf->offsets[index];
+    const char *lexeme = buf->source + offset;
+    int         length = (int) buf->lengths[index];
+
+    size_t   lo         = lines_up_to(buf, offset);
+    uint32_t line_start = lo ? buf->line_starts[lo - 1] : 0;
+
+    if (buf->types[index] == TOK_ERR) {
+        lexeme = token_error_message((TokenError) buf->values[index]);
+        length = (int) strlen(lexeme);
+    }
+
+    token_init(&tok, (TokenType) buf->types[index], lexeme, length, (int) (lo + buf->first_line),
+               (int) (offset - line_start) + 1);
+    return tok;
+}
@@ -0,0 +1,447 @@
+#include "vectorize.h"
+#include <stdlib.h>
+#include <string.h>
+#include "command_type.h"
+
+#define VECTOR_BYTES 16    // Bytes processed per host SIMD operation.
+#define CHUNK_BYTES  4096  // Bytes copied before the operations run over them.
+
+typedef uint8_t  VecU8 __attribute__((vector_size(VECTOR_BYTES)));
+typedef uint16_t VecU16 __attribute__((vector_size(VECTOR_BYTES)));
+typedef uint32_t VecU32 __attribute__((vector_size(VECTOR_BYTES)));
+typedef uint64_t VecU64 __attribute__((vector_size(VECTOR_BYTES)));
+
+static bool     is_width(int64_t width);
+static bool     label_names(LabelMap *map, const Command *branch, const Command *head);
+static bool     match_op(const Command *cmd, int value_reg, VectorOp *op);
+static bool     is_pointer_bump(const Command *cmd, int reg, int width);
+static Command *match_back_edge(Command *cmd, Command *head, LabelMap *map, VectorLoop *loop);
+static Command *match_loop(Command *head, LabelMap *map, VectorLoop *loop);
+static bool     is_loop_reg(const VectorLoop *loop, int64_t reg);
+static uint64_t apply_scalar(VectorOpKind kind, uint64_t value, uint64_t operand);
+static VecU8    splat(uint64_t value, int width);
+static VecU8    apply_block(VecU8 block, VectorOpKind kind, VecU8 pattern, uint64_t operand,
+                            int width);
+static void     apply_op(uint8_t *data, size_t bytes, VectorOpKind kind, uint64_t operand,
+                         int width);
+
+/**
+ * @brief Determines if a value is a valid access width.
+ */
+static bool is_width(int64_t width) {
+    return width == 1 || width == 2 || width == 4 || width == 8;
+}
+
+/**
+ * @brief Determines if the label of a branch names the given command.
+ */
+static bool label_names(LabelMap *map, const Command *branch, const Command *head) {
+    Entry *label = get_label(map, branch->val_a.str_val);
+    return label && label->command == head;
+}
+
+/**
+ * @brief Matches `<op> xT xT <operand>` for one of the supported operations.
+ *
+ * @param cmd The command to match.
+ * @param value_reg The variable the loaded value lives in.
+ * @param op Set to the operation on success.
+ * @return True if the command is a supported operation on `value_reg`.
+ */
+static bool match_op(const Command *cmd, int value_reg, VectorOp *op) {
+    switch (cmd->type) {
+        case CMD_ADD:
+            op->kind = VECTOR_ADD;
+            break;
+        case CMD_SUB:
+            op->kind = VECTOR_SUB;
+            break;
+        case CMD_AND:
+            op->kind = VECTOR_AND;
+            break;
+        case CMD_ORR:
+            op->kind = VECTOR_ORR;
+            break;
+        case CMD_EOR:
+            op->kind = VECTOR_EOR;
+            break;
+        case CMD_LSL:
+            op->kind = VECTOR_LSL;
+            break;
+        default:
+            return false;
+    }
+
+    if (cmd->destination.base != value_reg || cmd->is_a_immediate ||
+        cmd->val_a.base != value_reg) {
+        return false;
+    }
+
+    op->is_immediate = cmd->is_b_immediate;
+    op->operand      = cmd->is_b_immediate ? cmd->val_b.num_val : cmd->val_b.base;
+    return true;
+}
+
+/**
+ * @brief Matches `add xR xR <width>`.
+ */
+static bool is_pointer_bump(const Command *cmd, int reg, int width) {
+    return cmd && cmd->type == CMD_ADD && cmd->destination.base == reg && !cmd->is_a_immediate &&
+           cmd->val_a.base == reg && cmd->is_b_immediate && cmd->val_b.num_val == width;
+}
+
+/**
+ * @brief Matches the back-edge of a loop starting at `head`, either
+ * `loop xC .l` or `sub xC xC 1`, `cmp xC 0`, `b.ne .l`.
+ *
+ * @param cmd The first command of the back-edge.
+ * @param head The first command of the loop.
+ * @param map The label map of the program.
+ * @param loop Receives the counter and the flag behaviour.
+ * @return The last command of the back-edge, or NULL if it does not match.
+ */
+static Command *match_back_edge(Command *cmd, Command *head, LabelMap *map, VectorLoop *loop) {
+    if (!cmd) {
+        return NULL;
+    }
+
+    if (cmd->type == CMD_LOOP) {
+        if (!label_names(map, cmd, head)) {
+            return NULL;
+        }
+        loop->count_reg  = cmd->destination.base;
+        loop->sets_flags = false;
+        loop->body_length++;
+        return cmd;
+    }
+
+    Command *cmp    = cmd->next;
+    Command *branch = cmp ? cmp->next : NULL;
+    int      reg    = cmd->destination.base;
+    if (cmd->type != CMD_SUB || cmd->is_a_immediate || cmd->val_a.base != reg ||
+        !cmd->is_b_immediate || cmd->val_b.num_val != 1) {
+        return NULL;
+    }
+    if (!branch || cmp->type != CMD_CMP || cmp->is_a_immediate || cmp->val_a.base != reg ||
+        !cmp->is_b_immediate || cmp->val_b.num_val != 0) {
+        return NULL;
+    }
+    if (branch->type != CMD_BRANCH || branch->branch_condition != BRANCH_NOT_EQUAL ||
+        !label_names(map, branch, head)) {
+        return NULL;
+    }
+
+    loop->count_reg  = reg;
+    loop->sets_flags = true;
+    loop->body_length += 3;
+    return branch;
+}
+
+/**
+ * @brief Determines if a variable is one of the variables the loop writes.
+ */
+static bool is_loop_reg(const VectorLoop *loop, int64_t reg) {
+    return reg == loop->value_reg || reg == loop->src_reg || reg == loop->dst_reg ||
+           reg == loop->count_reg;
+}
+
+/**
+ * @brief Matches a vectorizable loop starting at `head`.
+ *
+ * @param head The command that would be the first of the loop.
+ * @param map The label map of the program.
+ * @param loop Filled in with the plan of the loop on success.
+ * @return The last command of the loop, or NULL if it does not match.
+ */
+static Command *match_loop(Command *head, LabelMap *map, VectorLoop *loop) {
+    memset(loop, 0, sizeof(*loop));
+    if (head->type != CMD_LOAD || !is_width(head->val_a.num_val) || head->is_b_immediate) {
+        return NULL;
+    }
+    loop->width       = (int) head->val_a.num_val;
+    loop->value_reg   = head->destination.base;
+    loop->src_reg     = head->val_b.base;
+    loop->body_length = 1;
+
+    Command *cmd = head->next;
+    while (cmd && loop->op_count < VECTOR_MAX_OPS &&
+           match_op(cmd, loop->value_reg, &loop->ops[loop->op_count])) {
+        loop->op_count++;
+        loop->body_length++;
+        cmd = cmd->next;
+    }
+
+    if (!cmd || cmd->type != CMD_STORE || cmd->destination.base != loop->value_reg ||
+        cmd->is_a_immediate || cmd->val_b.num_val != loop->width) {
+        return NULL;
+    }
+    loop->dst_reg = cmd->val_a.base;
+    loop->body_length++;
+    cmd = cmd->next;
+
+    // One bump if both pointers are the same variable, otherwise one each in any order
+    if (loop->src_reg == loop->dst_reg) {
+        if (!is_pointer_bump(cmd, loop->src_reg, loop->width)) {
+            return NULL;
+        }
+        loop->body_length++;
+        cmd = cmd->next;
+    } else {
+        Command *second   = cmd ? cmd->next : NULL;
+        bool     in_order = is_pointer_bump(cmd, loop->src_reg, loop->width) &&
+                            is_pointer_bump(second, loop->dst_reg, loop->width);
+        bool     swapped  = is_pointer_bump(cmd, loop->dst_reg, loop->width) &&
+                            is_pointer_bump(second, loop->src_reg, loop->width);
+        if (!in_order && !swapped) {
+            return NULL;
+        }
+        loop->body_length += 2;
+        cmd = second->next;
+    }
+
+    Command *last = match_back_edge(cmd, head, map, loop);
+    if (!last) {
+        return NULL;
+    }
+
+    // The pointers and the value must be distinct from the counter and each
+    // other, and every operand variable must stay unchanged by the loop
+    if (loop->value_reg == loop->src_reg || loop->value_reg == loop->dst_reg ||
+        loop->count_reg == loop->value_reg || loop->count_reg == loop->src_reg ||
+        loop->count_reg == loop->dst_reg) {
+        return NULL;
+    }
+    for (size_t i = 0; i < loop->op_count; i++) {
+        if (!loop->ops[i].is_immediate && is_loop_reg(loop, loop->ops[i].operand)) {
+            return NULL;
+        }
+    }
+
+    loop->exit = last->next;
+    return last;
+}
+
+Command *vectorize_loops(Command *commands, LabelMap *map) {
+    Command *prev = NULL;
+    Command *cmd  = commands;
+    while (cmd) {
+        VectorLoop plan;
+        Command   *last = match_loop(cmd, map, &plan);
+        if (!last) {
+            prev = cmd;
+            cmd  = cmd->next;
+            continue;
+        }
+
+        Command    *vloop = calloc(1, sizeof(Command));
+        VectorLoop *copy  = malloc(sizeof(VectorLoop));
+        if (!vloop || !copy) {
+            // The scalar loop still runs correctly, just without the fast path
+            free(vloop);
+            free(copy);
+            return commands;
+        }
+
+        *copy                   = plan;
+        vloop->type             = CMD_VLOOP;
+        vloop->branch_condition = BRANCH_NONE;
+        vloop->vector           = copy;
+        vloop->next             = cmd;
+        if (prev) {
+            prev->next = vloop;
+        } else {
+            commands = vloop;
+        }
+
+        prev = last;
+        cmd  = last->next;
+    }
+
+    return commands;
+}
+
+Command *unvectorize_loops(Command *commands) {
+    Command **link = &commands;
+    while (*link) {
+        Command *cmd = *link;
+        if (cmd->type == CMD_VLOOP) {
+            *link     = cmd->next;
+            cmd->next = NULL;
+            free_command(cmd);
+        } else {
+            link = &cmd->next;
+        }
+    }
+    return commands;
+}
+
+/**
+ * @brief Applies an operation to a full 64-bit value, as the interpreter does.
+ */
+static uint64_t apply_scalar(VectorOpKind kind, uint64_t value, uint64_t operand) {
+    switch (kind) {
+        case VECTOR_ADD:
+            return value + operand;
+        case VECTOR_SUB:
+            return value - operand;
+        case VECTOR_AND:
+            return value & operand;
+        case VECTOR_ORR:
+            return value | operand;
+        case VECTOR_EOR:
+            return value ^ operand;
+        default:
+            return value << (operand & 63);
+    }
+}
+
+/**
+ * @brief Repeats the low `width` bytes of a value across a vector.
+ */
+static VecU8 splat(uint64_t value, int width) {
+    VecU8 pattern;
+    for (int i = 0; i < VECTOR_BYTES; i += width) {
+        memcpy((uint8_t *) &pattern + i, &value, (size_t) width);
+    }
+    return pattern;
+}
+
+/**
+ * @brief Applies an operation to every `width`-byte lane of a block.
+ *
+ * @param block The block of elements.
+ * @param kind The operation.
+ * @param pattern The operand repeated across the lanes.
+ * @param operand The operand itself, used as the shift amount.
+ * @param width The lane width in bytes.
+ * @return The transformed block.
+ */
+static VecU8 apply_block(VecU8 block, VectorOpKind kind, VecU8 pattern, uint64_t operand,
+                         int width) {
+    switch (kind) {
+        case VECTOR_AND:
+            return block & pattern;
+        case VECTOR_ORR:
+            return block | pattern;
+        case VECTOR_EOR:
+            return block ^ pattern;
+        case VECTOR_ADD:
+            switch (width) {
+                case 1:
+                    return block + pattern;
+                case 2:
+                    return (VecU8) ((VecU16) block + (VecU16) pattern);
+                case 4:
+                    return (VecU8) ((VecU32) block + (VecU32) pattern);
+                default:
+                    return (VecU8) ((VecU64) block + (VecU64) pattern);
+            }
+        case VECTOR_SUB:
+            switch (width) {
+                case 1:
+                    return block - pattern;
+                case 2:
+                    return (VecU8) ((VecU16) block - (VecU16) pattern);
+                case 4:
+                    return (VecU8) ((VecU32) block - (VecU32) pattern);
+                default:
+                    return (VecU8) ((VecU64) block - (VecU64) pattern);
+            }
+        default: {
+            // Shifting a lane by its width or more leaves none of its bits
+            unsigned shift = (unsigned) (operand & 63);
+            if (shift >= (unsigned) width * 8) {
+                return (VecU8) {0};
+            }
+            switch (width) {
+                case 1:
+                    return block << shift;
+                case 2:
+                    return (VecU8) ((VecU16) block << shift);
+                case 4:
+                    return (VecU8) ((VecU32) block << shift);
+                default:
+                    return (VecU8) ((VecU64) block << shift);
+            }
+        }
+    }
+}
+
+/**
+ * @brief Applies an operation in place to every element of a range.
+ *
+ * @param data The elements.
+ * @param bytes The length of the range, a multiple of `width`.
+ * @param kind The operation.
+ * @param operand The operand of the operation.
+ * @param width The element width in bytes.
+ */
+static void apply_op(uint8_t *data, size_t bytes, VectorOpKind kind, uint64_t operand,
+                     int width) {
+    VecU8  pattern = splat(operand, width);
+    size_t i       = 0;
+    for (; i + VECTOR_BYTES <= bytes; i += VECTOR_BYTES) {
+        VecU8 block;
+        memcpy(&block, data + i, VECTOR_BYTES);
+        block = apply_block(block, kind, pattern, operand, width);
+        memcpy(data + i, &block, VECTOR_BYTES);
+    }
+
+    // The tail is a whole number of elements, padded out to a block
+    if (i < bytes) {
+        VecU8 block = {0};
+        memcpy(&block, data + i, bytes - i);
+        block = apply_block(block, kind, pattern, operand, width);
+        memcpy(data + i, &block, bytes - i);
+    }
+}
+
+bool vector_loop_run(const VectorLoop *loop, int64_t *variables, Memory *memory,
+                     uint64_t *iterations) {
+    int64_t count = variables[loop->count_reg];
+    int64_t src   = variables[loop->src_reg];
+    int64_t dst   = variables[loop->dst_reg];
+    if (count <= 0 || src < 0 || dst < 0 ||
+        (uint64_t) count > memory->capacity / (uint64_t) loop->width) {
+        return false;
+    }
+
+    size_t bytes = (size_t) count * (size_t) loop->width;
+    if ((uint64_t) src > memory->capacity - bytes || (uint64_t) dst > memory->capacity - bytes) {
+        return false;
+    }
+    if (src != dst && src < dst + (int64_t) bytes && dst < src + (int64_t) bytes) {
+        return false;
+    }
+
+    uint64_t operands[VECTOR_MAX_OPS];
+    for (size_t i = 0; i < loop->op_count; i++) {
+        const VectorOp *op = &loop->ops[i];
+        operands[i] = (uint64_t) (op->is_immediate ? op->operand : variables[op->operand]);
+    }
+
+    // The value left in xT is the last element at full width, before the
+    // store truncates it; read it first as an in-place loop overwrites it
+    uint64_t last = 0;
+    memcpy(&last, &memory->bytes[src + (int64_t) bytes - loop->width], (size_t) loop->width);
+    for (size_t i = 0; i < loop->op_count; i++) {
+        last = apply_scalar(loop->ops[i].kind, last, operands[i]);
+    }
+
+    uint8_t       *out = mem_write_span(memory, (size_t) dst, bytes);
+    const uint8_t *in  = &memory->bytes[src];
+    for (size_t done = 0; done < bytes; done += CHUNK_BYTES) {
+        size_t chunk = bytes - done < CHUNK_BYTES ? bytes - done : CHUNK_BYTES;
+        memmove(out + done, in + done, chunk);
+        for (size_t i = 0; i < loop->op_count; i++) {
+            apply_op(out + done, chunk, loop->ops[i].kind, operands[i], loop->width);
+        }
+    }
+
+    variables[loop->value_reg] = (int64_t) last;
+    variables[loop->src_reg]   = (int64_t) ((uint64_t) src + bytes);
+    variables[loop->dst_reg]   = (int64_t) ((uint64_t) dst + bytes);
+    variables[loop->count_reg] = 0;
+    *iterations                = (uint64_t) count;
+    return true;
+}
@@ -0,0 +1,413 @@
+#define _GNU_SOURCE
+#include "watch.h"
+#include <errno.h>
+#include <poll.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/inotify.h>
+#include <unistd.h>
+#include "lexer.h"
+#include "parser.h"
+#include "token.h"
+#include "token_buffer.h"
+
+#define CHUNK_LABEL_BUCKETS 16    // Label map buckets per chunk; chunks hold few labels.
+#define EVENT_BUFFER_SIZE   4096  // Room for a batch of inotify events.
+#define SETTLE_MS           50    // Quiet period that ends a burst of writes.
+
+static uint64_t hash_text(const char *text, size_t length);
+static bool     is_blank(char c);
+static bool     is_ident_start(char c);
+static bool     is_ident(char c);
+static size_t   split_label_length(const char *line, size_t length);
+static bool     line_has_code(const char *line, size_t length, size_t label_length);
+static size_t   chunk_end(const char *src, size_t start, uint32_t *lines);
+static bool     parse_chunk(Chunk *chunk);
+static void     free_chunk(Chunk *chunk);
+static Chunk   *find_reusable(ChunkCache *cache, size_t hint, const char *text, size_t length,
+                              uint64_t *hash);
+static bool     name_matches(const FileWatch *watch, const char *buf, ssize_t length);
+
+/**
+ * @brief Computes the FNV-1a hash of a piece of text.
+ */
+static uint64_t hash_text(const char *text, size_t length) {
+    uint64_t hash = 14695981039346656037ULL;
+    for (size_t i = 0; i < length; i++) {
+        hash ^= (uint8_t) text[i];
+        hash *= 1099511628211ULL;
+    }
+    return hash;
+}
+
+static bool is_blank(char c) {
+    return c == ' ' || c == ',' || c == '\t' || c == '\r';
+}
+
+static bool is_ident_start(char c) {
+    return (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || c == '_';
+}
+
+static bool is_ident(char c) {
+    return is_ident_start(c) || (c >= '0' && c <= '9') || c == '.';
+}
+
+/**
+ * @brief Determines whether a line defines a label a chunk may start at: one
+ * that does not begin with a dot.
+ *
+ * @param line The line, without its newline.
+ * @param length The length of the line.
+ * @return The length of the label definition including its colon, or 0 if the
+ * line does not start with one.
+ */
+static size_t split_label_length(const char *line, size_t length) {
+    size_t i = 0;
+    while (i < length && is_blank(line[i])) {
+        i++;
+    }
+    if (i == length || !is_ident_start(line[i])) {
+        return 0;
+    }
+    while (i < length && is_ident(line[i])) {
+        i++;
+    }
+    while (i < length && is_blank(line[i])) {
+        i++;
+    }
+    return i < length && line[i] == ':' ? i + 1 : 0;
+}
+
+/**
+ * @brief Determines whether a line holds anything but blanks, a comment and
+ * a label definition.
+ *
+ * @param line The line, without its newline.
+ * @param length The length of the line.
+ * @param label_length The length of the label definition starting the line.
+ * @return True if the line holds code.
+ */
+static bool line_has_code(const char *line, size_t length, size_t label_length) {
+    size_t i = label_length;
+    while (i < length && (is_blank(line[i]) || line[i] == ':')) {
+        i++;
+    }
+    if (i == length) {
+        return false;
+    }
+    // Local labels never start a chunk, so they count as code
+    return !(line[i] == '/' && i + 1 < length && line[i + 1] == '/');
+}
+
+/**
+ * @brief Finds where the chunk starting at `start` ends: at the next line that
+ * starts a chunk, once the chunk holds code and no `rep` block is open.
+ *
+ * @param src The source of the program.
+ * @param start The offset the chunk starts at.
+ * @param lines Set to the number of lines in the chunk.
+ * @return The offset the next chunk starts at.
+ */
+static size_t chunk_end(const char *src, size_t start, uint32_t *lines) {
+    size_t pos      = start;
+    bool   has_code = false;
+    int    depth    = 0;
+    *lines          = 0;
+
+    while (src[pos] != '\0') {
+        const char *line   = src + pos;
+        const char *nl     = strchr(line, '\n');
+        size_t      length = nl ? (size_t) (nl - line) : strlen(line);
+        size_t      label  = split_label_length(line, length);
+        if (label && has_code && depth <= 0) {
+            break;
+        }
+
+        has_code = has_code || line_has_code(line, length, label);
+        depth += lexer_brace_change(line, length);
+        pos += nl ? length + 1 : length;
+        (*lines)++;
+    }
+    return pos;
+}
+
+/**
+ * @brief Parses the text of a chunk into its commands and labels, numbering
+ * lines as in the whole program.
+ *
+ * @param chunk The chunk, whose text and first line are set.
+ * @return True if the chunk parsed, false otherwise. Nothing is left to free
+ * but the text if parsing failed.
+ */
+static bool parse_chunk(Chunk *chunk) {
+    chunk->head = NULL;
+    chunk->tail = NULL;
+    if (!label_map_init(&chunk->labels, CHUNK_LABEL_BUCKETS)) {
+        printf("Unable to allocate label hashmap.\n");
+        return false;
+    }
+
+    Lexer       lex;
+    TokenBuffer tokens;
+    lexer_init(&lex, chunk->text);
+    if (!token_buffer_init(&tokens, chunk->text) || !lexer_tokenize(&lex, &tokens)) {
+        printf("Unable to allocate token buffer.\n");
+        token_buffer_free(&tokens);
+        label_map_free(&chunk->labels);
+        return false;
+    }
+    tokens.first_line = chunk->first_line;
+
+    Parser p;
+    parser_init(&p, &tokens, &chunk->labels);
+    chunk->head = parse_commands(&p);
+    if (p.had_error) {
+        printf("Parser encountered an error:\n");
+        printf("At ");
+        print_token(parser_current_token(&p));
+        printf("\n");
+        free_command(chunk->head);
+        chunk->head = NULL;
+        token_buffer_free(&tokens);
+        label_map_free(&chunk->labels);
+        return false;
+    }
+    token_buffer_free(&tokens);
+
+    for (Command *cmd = chunk->head; cmd; cmd = cmd->next) {
+        chunk->tail = cmd;
+    }
+    return true;
+}
+
+/**
+ * @brief Frees a chunk's text, commands and labels.
+ */
+static void free_chunk(Chunk *chunk) {
+    free(chunk->text);
+    free_command(chunk->head);
+    label_map_free(&chunk->labels);
+}
+
+/**
+ * @brief Finds a cached chunk with the given text that has not been reused
+ * yet. The chunk in the same position is compared directly, which is the
+ * common case; only otherwise is the text hashed to search the rest.
+ *
+ * @param hash Set to the hash of the text.
+ * @return The chunk, or NULL if there is none.
+ */
+static Chunk *find_reusable(ChunkCache *cache, size_t hint, const char *text, size_t length,
+                            uint64_t *hash) {
+    if (hint < cache->count) {
+        Chunk *chunk = &cache->chunks[hint];
+        if (chunk->text && chunk->length == length && memcmp(chunk->text, text, length) == 0) {
+            *hash = chunk->hash;
+            return chunk;
+        }
+    }
+
+    *hash = hash_text(text, length);
+    for (size_t i = 0; i < cache->count; i++) {
+        Chunk *chunk = &cache->chunks[i];
+        if (chunk->text && chunk->hash == *hash && chunk->length == length &&
+            memcmp(chunk->text, text, length) == 0) {
+            return chunk;
+        }
+    }
+    return NULL;
+}
+
+void chunk_cache_init(ChunkCache *cache) {
+    cache->chunks = NULL;
+    cache->count  = 0;
+}
+
+void chunk_cache_free(ChunkCache *cache) {
+    for (size_t i = 0; i < cache->count; i++) {
+        free_chunk(&cache->chunks[i]);
+    }
+    free(cache->chunks);
+    chunk_cache_init(cache);
+}
+
+bool chunk_cache_update(ChunkCache *cache, const char *src, size_t *parsed) {
+    Chunk   *chunks   = NULL;
+    size_t   count    = 0;
+    size_t   capacity = 0;
+    size_t   start    = 0;
+    uint32_t line     = 1;
+    bool     ok       = true;
+    *parsed           = 0;
+
+    while (src[start] != '\0') {
+        uint32_t lines;
+        size_t   end    = chunk_end(src, start, &lines);
+        size_t   length = end - start;
+        uint64_t hash;
+
+        if (count == capacity) {
+            size_t new_capacity = capacity ? capacity * 2 : 16;
+            Chunk *new_chunks   = realloc(chunks, new_capacity * sizeof(Chunk));
+            if (!new_chunks) {
+                printf("Unable to allocate chunks.\n");
+                ok = false;
+                break;
+            }
+            chunks   = new_chunks;
+            capacity = new_capacity;
+        }
+
+        Chunk *old = find_reusable(cache, count, src + start, length, &hash);
+        if (old) {
+            // Same text, so the same commands; only their line numbers move
+            int64_t shift = (int64_t) line - (int64_t) old->first_line;
+            for (Command *cmd = old->head; cmd; cmd = cmd->next) {
+                command_set_line(cmd, (uint32_t) ((int64_t) command_line(cmd) + shift));
+            }
+            chunks[count]            = *old;
+            chunks[count].first_line = line;
+            chunks[count++].text     = old->text;
+            old->text                = NULL;
+        } else {
+            Chunk *chunk      = &chunks[count];
+            chunk->text       = strndup(src + start, length);
+            chunk->length     = length;
+            chunk->hash       = hash;
+            chunk->first_line = line;
+            (*parsed)++;
+            if (chunk->text && parse_chunk(chunk)) {
+                count++;
+            } else {
+                free(chunk->text);
+                ok = false;
+            }
+        }
+
+        start = end;
+        line += lines;
+    }
+
+    // Whatever was not reused belongs to text that is gone
+    for (size_t i = 0; i < cache->count; i++) {
+        if (cache->chunks[i].text) {
+            free_chunk(&cache->chunks[i]);
+        }
+    }
+    free(cache->chunks);
+    cache->chunks = chunks;
+    cache->count  = count;
+    return ok;
+}
+
+Command *chunk_cache_link(ChunkCache *cache, LabelMap *map) {
+    Command *program = NULL;
+    Command *tail    = NULL;
+    for (size_t i = 0; i < cache->count; i++) {
+        Chunk *chunk = &cache->chunks[i];
+        if (!chunk->head) {
+            continue;
+        }
+        if (tail) {
+            tail->next = chunk->head;
+        } else {
+            program = chunk->head;
+        }
+        tail = chunk->tail;
+    }
+
+    // Walk backwards so trailing labels see the next chunk's first command;
+    // skipping labels already present keeps the last definition, as parsing does
+    Command *following = NULL;
+    for (size_t i = cache->count; i-- > 0;) {
+        Chunk *chunk = &cache->chunks[i];
+        for (int b = 0; b < chunk->labels.capacity; b++) {
+            for (Entry *e = chunk->labels.entries[b]; e; e = e->next) {
+                if (!get_label(map, e->id)) {
+                    put_label(map, e->id, e->command ? e->command : following);
+                }
+            }
+        }
+        if (chunk->head) {
+            following = chunk->head;
+        }
+    }
+
+    resolve_loop_targets(map, program);
+    return program;
+}
+
+void chunk_cache_unlink(ChunkCache *cache) {
+    for (size_t i = 0; i < cache->count; i++) {
+        if (cache->chunks[i].tail) {
+            cache->chunks[i].tail->next = NULL;
+        }
+    }
+}
+
+bool file_watch_init(FileWatch *watch, const char *path) {
+    const char *slash = strrchr(path, '/');
+    char       *dir   = slash ? strndup(path, (size_t) (slash - path) + 1) : strdup(".");
+    watch->name       = strdup(slash ? slash + 1 : path);
+    watch->fd         = inotify_init1(IN_CLOEXEC);
+
+    bool ok = dir && watch->name && watch->fd >= 0 &&
+              inotify_add_watch(watch->fd, dir, IN_CLOSE_WRITE | IN_MOVED_TO) >= 0;
+    free(dir);
+    if (!ok) {
+        file_watch_free(watch);
+    }
+    return ok;
+}
+
+/**
+ * @brief Determines whether a batch of inotify events names the watched file.
+ */
+static bool name_matches(const FileWatch *watch, const char *buf, ssize_t length) {
+    for (ssize_t pos = 0; pos < length;) {
+        const struct inotify_event *event = (const struct inotify_event *) (buf + pos);
+        if (event->len > 0 && strcmp(event->name, watch->name) == 0) {
+            return true;
+        }
+        pos += (ssize_t) (sizeof(struct inotify_event) + event->len);
+    }
+    return false;
+}
+
+bool file_watch_wait(FileWatch *watch) {
+    union {
+        struct inotify_event event;
+        char                 bytes[EVENT_BUFFER_SIZE];
+    } buf;
+
+    bool changed = false;
+    while (!changed) {
+        ssize_t length = read(watch->fd, buf.bytes, sizeof(buf.bytes));
+        if (length < 0 && errno == EINTR) {
+            continue;
+        }
+        if (length <= 0) {
+            return false;
+        }
+        changed = name_matches(watch, buf.bytes, length);
+    }
+
+    // Editors may write a file in several steps; take only the last
+    struct pollfd pfd = {watch->fd, POLLIN, 0};
+    while (poll(&pfd, 1, SETTLE_MS) > 0) {
+        if (read(watch->fd, buf.bytes, sizeof(buf.bytes)) <= 0) {
+            break;
+        }
+    }
+    return true;
+}
+
+void file_watch_free(FileWatch *watch) {
+    if (watch->fd >= 0) {
+        close(watch->fd);
+    }
+    free(watch->name);
+    watch->fd   = -1;
+    watch->name = NULL;
+}
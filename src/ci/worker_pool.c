@@ -0,0 +1,295 @@
+#include "worker_pool.h"
+#include <stdint.h>
+#include <stdlib.h>
+
+#define INITIAL_CAPACITY 64
+
+/**
+ * @brief Arguments of a worker thread.
+ */
+typedef struct {
+    WorkerPool *pool;  // The pool the worker belongs to.
+    int         id;    // The index of the worker's own queue.
+} WorkerArgs;
+
+// The pool and queue index of the worker running on this thread, if any
+static _Thread_local WorkerPool *current_pool   = NULL;
+static _Thread_local int         current_worker = -1;
+
+static bool  queue_init(WorkQueue *q);
+static void  queue_free(WorkQueue *q);
+static bool  queue_push_back(WorkQueue *q, PoolTask task);
+static bool  queue_pop_front(WorkQueue *q, PoolTask *task);
+static bool  queue_pop_back(WorkQueue *q, PoolTask *task);
+static bool  push_task(WorkerPool *pool, int queue, PoolTask task);
+static bool  find_task(WorkerPool *pool, int id, PoolTask *task);
+static void  wait_for_work(WorkerPool *pool);
+static void *worker_main(void *arg);
+
+static bool queue_init(WorkQueue *q) {
+    q->tasks    = malloc(INITIAL_CAPACITY * sizeof(PoolTask));
+    q->head     = 0;
+    q->count    = 0;
+    q->capacity = INITIAL_CAPACITY;
+    if (!q->tasks) {
+        return false;
+    }
+    if (pthread_mutex_init(&q->lock, NULL) != 0) {
+        free(q->tasks);
+        q->tasks = NULL;
+        return false;
+    }
+    return true;
+}
+
+static void queue_free(WorkQueue *q) {
+    pthread_mutex_destroy(&q->lock);
+    free(q->tasks);
+    q->tasks    = NULL;
+    q->count    = 0;
+    q->capacity = 0;
+}
+
+/**
+ * @brief Appends a task to the back of the queue, doubling the ring buffer
+ * when it is full.
+ */
+static bool queue_push_back(WorkQueue *q, PoolTask task) {
+    pthread_mutex_lock(&q->lock);
+    if (q->count == q->capacity) {
+        size_t    new_capacity = q->capacity * 2;
+        PoolTask *tasks        = malloc(new_capacity * sizeof(PoolTask));
+        if (!tasks) {
+            pthread_mutex_unlock(&q->lock);
+            return false;
+        }
+        for (size_t i = 0; i < q->count; i++) {
+            tasks[i] = q->tasks[(q->head + i) % q->capacity];
+        }
+        free(q->tasks);
+        q->tasks    = tasks;
+        q->head     = 0;
+        q->capacity = new_capacity;
+    }
+
+    q->tasks[(q->head + q->count) % q->capacity] = task;
+    q->count++;
+    pthread_mutex_unlock(&q->lock);
+    return true;
+}
+
+static bool queue_pop_front(WorkQueue *q, PoolTask *task) {
+    pthread_mutex_lock(&q->lock);
+    bool found = q->count > 0;
+    if (found) {
+        *task   = q->tasks[q->head];
+        q->head = (q->head + 1) % q->capacity;
+        q->count--;
+    }
+    pthread_mutex_unlock(&q->lock);
+    return found;
+}
+
+static bool queue_pop_back(WorkQueue *q, PoolTask *task) {
+    pthread_mutex_lock(&q->lock);
+    bool found = q->count > 0;
+    if (found) {
+        q->count--;
+        *task = q->tasks[(q->head + q->count) % q->capacity];
+    }
+    pthread_mutex_unlock(&q->lock);
+    return found;
+}
+
+bool pool_init(WorkerPool *pool, int workers) {
+    if (!pool || workers < 1) {
+        return false;
+    }
+
+    pool->queues       = calloc((size_t) workers, sizeof(WorkQueue));
+    pool->threads      = calloc((size_t) workers, sizeof(pthread_t));
+    pool->worker_count = 0;
+    pool->thread_count = 0;
+    atomic_init(&pool->queued, 0);
+    atomic_init(&pool->pending, 0);
+    atomic_init(&pool->sleeping, 0);
+    atomic_init(&pool->stop, false);
+    atomic_init(&pool->next_queue, 0);
+    pthread_mutex_init(&pool->idle_lock, NULL);
+    pthread_cond_init(&pool->idle_cond, NULL);
+    pthread_cond_init(&pool->done_cond, NULL);
+    if (!pool->queues || !pool->threads) {
+        pool_free(pool);
+        return false;
+    }
+
+    for (int i = 0; i < workers; i++) {
+        if (!queue_init(&pool->queues[i])) {
+            pool_free(pool);
+            return false;
+        }
+        pool->worker_count++;
+    }
+
+    // Every queue must exist before the first worker can try to steal
+    for (int i = 0; i < workers; i++) {
+        WorkerArgs *args = malloc(sizeof(WorkerArgs));
+        if (!args) {
+            pool_free(pool);
+            return false;
+        }
+        args->pool = pool;
+        args->id   = i;
+        if (pthread_create(&pool->threads[i], NULL, worker_main, args) != 0) {
+            free(args);
+            pool_free(pool);
+            return false;
+        }
+        pool->thread_count++;
+    }
+
+    return true;
+}
+
+void pool_free(WorkerPool *pool) {
+    if (!pool) {
+        return;
+    }
+
+    pthread_mutex_lock(&pool->idle_lock);
+    atomic_store(&pool->stop, true);
+    pthread_cond_broadcast(&pool->idle_cond);
+    pthread_mutex_unlock(&pool->idle_lock);
+
+    for (int i = 0; i < pool->thread_count; i++) {
+        pthread_join(pool->threads[i], NULL);
+    }
+    for (int i = 0; i < pool->worker_count; i++) {
+        queue_free(&pool->queues[i]);
+    }
+
+    free(pool->queues);
+    free(pool->threads);
+    pool->queues       = NULL;
+    pool->threads      = NULL;
+    pool->worker_count = 0;
+    pool->thread_count = 0;
+    pthread_mutex_destroy(&pool->idle_lock);
+    pthread_cond_destroy(&pool->idle_cond);
+    pthread_cond_destroy(&pool->done_cond);
+}
+
+/**
+ * @brief Queues a task on the given queue and wakes a sleeping worker.
+ */
+static bool push_task(WorkerPool *pool, int queue, PoolTask task) {
+    // Counted before it becomes visible so a thief can never take the count
+    // below zero; a woken worker may briefly find nothing and look again
+    atomic_fetch_add(&pool->queued, 1);
+    if (!queue_push_back(&pool->queues[queue], task)) {
+        atomic_fetch_sub(&pool->queued, 1);
+        return false;
+    }
+
+    // Pairs with the check in `wait_for_work`: either the sleeper sees the
+    // new count, or this sees the sleeper and signals it
+    if (atomic_load(&pool->sleeping) > 0) {
+        pthread_mutex_lock(&pool->idle_lock);
+        pthread_cond_signal(&pool->idle_cond);
+        pthread_mutex_unlock(&pool->idle_lock);
+    }
+    return true;
+}
+
+bool pool_submit(WorkerPool *pool, PoolTaskFn fn, void *arg) {
+    PoolTask task = {fn, arg};
+    int      queue;
+    if (current_pool == pool) {
+        queue = current_worker;
+    } else {
+        queue = (int) (atomic_fetch_add(&pool->next_queue, 1) % (unsigned) pool->worker_count);
+    }
+
+    atomic_fetch_add(&pool->pending, 1);
+    if (!push_task(pool, queue, task)) {
+        atomic_fetch_sub(&pool->pending, 1);
+        return false;
+    }
+    return true;
+}
+
+void pool_wait(WorkerPool *pool) {
+    pthread_mutex_lock(&pool->idle_lock);
+    while (atomic_load(&pool->pending) > 0) {
+        pthread_cond_wait(&pool->done_cond, &pool->idle_lock);
+    }
+    pthread_mutex_unlock(&pool->idle_lock);
+}
+
+/**
+ * @brief Takes a task from the worker's own queue, or steals one from the back
+ * of another worker's queue.
+ */
+static bool find_task(WorkerPool *pool, int id, PoolTask *task) {
+    if (queue_pop_front(&pool->queues[id], task)) {
+        atomic_fetch_sub(&pool->queued, 1);
+        return true;
+    }
+
+    for (int i = 1; i < pool->worker_count; i++) {
+        int victim = (id + i) % pool->worker_count;
+        if (queue_pop_back(&pool->queues[victim], task)) {
+            atomic_fetch_sub(&pool->queued, 1);
+            return true;
+        }
+    }
+    return false;
+}
+
+/**
+ * @brief Puts the worker to sleep until a task is queued or the pool stops.
+ */
+static void wait_for_work(WorkerPool *pool) {
+    pthread_mutex_lock(&pool->idle_lock);
+    atomic_fetch_add(&pool->sleeping, 1);
+    while (!atomic_load(&pool->stop) && atomic_load(&pool->queued) == 0) {
+        pthread_cond_wait(&pool->idle_cond, &pool->idle_lock);
+    }
+    atomic_fetch_sub(&pool->sleeping, 1);
+    pthread_mutex_unlock(&pool->idle_lock);
+}
+
+static void *worker_main(void *arg) {
+    WorkerArgs  args = *(WorkerArgs *) arg;
+    WorkerPool *pool = args.pool;
+    free(arg);
+
+    current_pool   = pool;
+    current_worker = args.id;
+
+    while (!atomic_load(&pool->stop)) {
+        PoolTask task;
+        if (!find_task(pool, args.id, &task)) {
+            wait_for_work(pool);
+            continue;
+        }
+
+        // A yielded task goes to the back of our own queue behind everything
+        // that was waiting, or keeps running if the queue cannot grow
+        bool done = task.fn(task.arg);
+        while (!done && !push_task(pool, args.id, task)) {
+            done = task.fn(task.arg);
+        }
+        if (!done) {
+            continue;
+        }
+
+        if (atomic_fetch_sub(&pool->pending, 1) == 1) {
+            pthread_mutex_lock(&pool->idle_lock);
+            pthread_cond_broadcast(&pool->done_cond);
+            pthread_mutex_unlock(&pool->idle_lock);
+        }
+    }
+
+    return NULL;
+}
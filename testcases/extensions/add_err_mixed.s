@@ -0,0 +1,4 @@
+start:
+    mov x1, 1
+    add x2, w1, x1
+    print x2, d
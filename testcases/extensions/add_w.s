@@ -0,0 +1,10 @@
+start:
+    mov x1, 4294967295
+    add w2, w1, 1
+    print x2, d
+    add x3, x1, 1
+    print x3, d
+    mov w4, 4294967296
+    print x4, d
+    add w5, w1, w1
+    print x5, x
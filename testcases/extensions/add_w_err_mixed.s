@@ -0,0 +1,4 @@
+start:
+    mov x1, 1
+    add w2, x1, w1
+    print x2, d
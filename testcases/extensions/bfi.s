@@ -0,0 +1,8 @@
+start:
+    mov x1, 0xffffffff
+    mov x2, 0x5
+    bfi x1, x2, 8, 4
+    print x1, x
+    mov x3, 0
+    bfi x3, x1, 60, 4
+    print x3, x
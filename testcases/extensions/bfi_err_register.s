@@ -0,0 +1,4 @@
+start:
+    mov x1, 5
+    bfi x2, 3, 0, 4
+    print x2, d
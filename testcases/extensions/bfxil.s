@@ -0,0 +1,5 @@
+start:
+    mov x1, 0xff00
+    mov x2, 0xabcd
+    bfxil x1, x2, 4, 8
+    print x1, x
@@ -0,0 +1,21 @@
+start:
+    mov x1, 2147483648
+    mov x2, 1
+    cmp w1, w2
+    b.lt .signed_ok
+    print 0, d
+.signed_ok:
+    cmp_u w1, w2
+    b.gt .unsigned_ok
+    print 0, d
+.unsigned_ok:
+    mov x3, 4294967297
+    cmp w3, 1
+    b.eq .low_ok
+    print 0, d
+.low_ok:
+    cmp x3, 1
+    b.ne .end
+    print 0, d
+.end:
+    print 1, d
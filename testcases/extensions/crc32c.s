@@ -0,0 +1,10 @@
+start:
+    put "123456789", 0
+    crc32c x0, 0, 9
+    print x0, x
+    mov x1, 512
+    mov x2, 32
+    crc32c x0, x1, x2
+    print x0, x
+    crc32c x0, 0, 0
+    print x0, x
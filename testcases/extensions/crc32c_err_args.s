@@ -0,0 +1,3 @@
+start:
+    crc32c x0, 0
+    print 1, d
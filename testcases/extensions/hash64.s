@@ -0,0 +1,20 @@
+start:
+    put "The quick brown fox jumps over the lazy dog", 0
+    hash64 x1, 0, 43
+    hash64 x2, 0, 43
+    cmp x1, x2
+    b.ne .wrong
+    hash64 x3, 0, 42
+    cmp x1, x3
+    b.eq .wrong
+    hash64 x4, 4, 5
+    put "quick", 64
+    hash64 x5, 64, 5
+    cmp x4, x5
+    b.ne .wrong
+    print x1, x
+    print x4, x
+    b .end
+.wrong:
+    print 0, d
+.end:
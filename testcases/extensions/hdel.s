@@ -0,0 +1,16 @@
+start:
+    hnew x1
+    hnew x2
+    hput x1, 3, 30
+    hput x2, 3, 33
+    hdel x1, 3
+    b.ne .missing
+    print 1, d
+.missing:
+    hdel x1, 3
+    b.eq .end
+    hget x3, x1, 3
+    print x3, d
+    hget x3, x2, 3
+    print x3, d
+.end:
@@ -0,0 +1,4 @@
+start:
+    mov x1, 5
+    hget x2, x1, 7
+    print 1, d
@@ -0,0 +1,17 @@
+start:
+    hnew x1
+    hput x1, 1, 5
+    hget x2, x1, 2
+    b.eq .found
+    print 0, d
+    b .end
+.found:
+    print 1, d
+.end:
+    hget x2, x1, 1
+    b.eq .found2
+    print 0, d
+    b .end2
+.found2:
+    print x2, d
+.end2:
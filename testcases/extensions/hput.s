@@ -0,0 +1,11 @@
+start:
+    hnew x1
+    hput x1, 7, 700
+    mov x2, 8
+    mov x3, 800
+    hput x1, x2, x3
+    hput x1, 7, 701
+    hget x4, x1, 7
+    print x4, d
+    hget x4, x1, x2
+    print x4, d
@@ -0,0 +1,4 @@
+start:
+    hnew x1
+    hput x1, 7
+    print 1, d
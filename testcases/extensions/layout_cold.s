@@ -0,0 +1,21 @@
+    .cold .error
+start:
+    mov x0, 5
+    call check
+    print x0, d
+    mov x0, 0
+    call check
+    print x0, d
+    b .end
+check:
+    cmp x0, 0
+    b.eq .error
+    add x0, x0, x0
+    ret
+.error:
+    mov x0, 99
+    print x0, d
+    ret
+.end:
+    mov x5, 1
+    print x5, d
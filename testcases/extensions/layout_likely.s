@@ -0,0 +1,17 @@
+start:
+    mov x1, 0
+    mov x2, 0
+    mov x4, 3
+.loop:
+    add x1, x1, 1
+    and x3, x1, x4
+    cmp x3, 0
+    b.ne.likely .skip
+    add x2, x2, 100
+    print x1, d
+.skip:
+    add x2, x2, 1
+    cmp x1, 20
+    b.lt.likely .loop
+    print x1, d
+    print x2, d
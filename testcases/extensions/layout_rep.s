@@ -0,0 +1,24 @@
+    .cold .rare
+start:
+    mov x1, 0
+    mov x2, 0
+    cmp x1, 0
+    b.eq.likely .after
+    rep 3 {
+        add x2, x2, 10
+    }
+.after:
+    add x1, x1, 1
+    cmp x1, 3
+    b.eq.unlikely .rare
+    b.lt .after
+    print x2, d
+    b .end
+.rare:
+    rep 2 {
+        add x2, x2, 1
+    }
+    print x2, d
+    b .after
+.end:
+    print x1, d
@@ -0,0 +1,19 @@
+start:
+    mov x1, 0
+    mov x2, 0
+.loop:
+    add x1, x1, 1
+    cmp x1, 7
+    b.eq.unlikely .rare
+.back:
+    add x2, x2, x1
+    cmp x1, 10
+    b.lt .loop
+    print x2, d
+    b .done
+.rare:
+    print x1, d
+    add x2, x2, 1000
+    b .back
+.done:
+    print x1, d
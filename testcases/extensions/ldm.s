@@ -0,0 +1,5 @@
+start:
+    mov x1, 9
+    store x1, 40, 8
+    ldm x2, x2, 40
+    print x2, d
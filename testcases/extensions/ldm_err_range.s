@@ -0,0 +1,3 @@
+start:
+    ldm x4, x1, 0
+    print 1, d
@@ -0,0 +1,9 @@
+start:
+    mov x1, 5
+    mov x2, 6
+    mov x9, 128
+    store x1, x9, 8
+    store x2, 136, 8
+    ldp x3, x4, x9
+    add x0, x3, x4
+    print x0, d
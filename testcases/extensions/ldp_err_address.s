@@ -0,0 +1,5 @@
+start:
+    mov x1, 0
+    sub x1, x1, 8
+    ldp x2, x3, x1
+    print 1, d
@@ -0,0 +1,3 @@
+start:
+    load w1, 8, 0
+    print 1, d
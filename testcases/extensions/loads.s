@@ -0,0 +1,14 @@
+start:
+    mov x1, 65408
+    store x1, 0, 8
+    loads x2, 1, 0
+    print x2, d
+    loads x2, 2, 0
+    print x2, d
+    loads x2, 4, 0
+    print x2, d
+    load x2, 1, 0
+    print x2, d
+    mov x3, 1
+    loads x2, 1, x3
+    print x2, d
@@ -0,0 +1,5 @@
+start:
+    mov x1, 0
+    sub x1, x1, 1
+    loads x2, 2, x1
+    print 1, d
@@ -0,0 +1,3 @@
+start:
+    loads x2, 8, 0
+    print 1, d
@@ -0,0 +1,8 @@
+start:
+    mov x1, 0
+    sub x1, x1, 2
+    store x1, 16, 4
+    loads x2, 4, 16
+    print x2, d
+    load x2, 4, 16
+    print x2, d
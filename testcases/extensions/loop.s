@@ -0,0 +1,8 @@
+start:
+    mov x0, 0
+    mov x1, 5
+.body:
+    add x0, x0, x1
+    loop x1, .body
+    print x0, d
+    print x1, d
@@ -0,0 +1,4 @@
+start:
+    mov x1, 2
+    loop x1, 5
+    print x1, d
@@ -0,0 +1,14 @@
+start:
+    mov x0, 0
+    mov x2, 3
+    rep x2 {
+        add x0, x0, 1
+        rep 4 {
+            add x0, x0, 10
+        }
+    }
+    print x0, d
+    rep 0 {
+        print 99, d
+    }
+    print x2, d
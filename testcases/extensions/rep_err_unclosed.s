@@ -0,0 +1,5 @@
+start:
+    mov x0, 0
+    rep 2 {
+        add x0, x0, 1
+    print x0, d
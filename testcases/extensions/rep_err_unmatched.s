@@ -0,0 +1,4 @@
+start:
+    mov x0, 0
+    }
+    print x0, d
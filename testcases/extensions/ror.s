@@ -0,0 +1,10 @@
+start:
+    mov x1, 0x1234
+    ror x2, x1, 4
+    print x2, x
+    ror x3, x1, 0
+    print x3, x
+    ror x4, x1, 64
+    print x4, x
+    ror x5, x2, 60
+    print x5, x
@@ -0,0 +1,4 @@
+start:
+    mov x1, 5
+    ror x2, x1, x1
+    print x2, d
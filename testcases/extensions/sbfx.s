@@ -0,0 +1,8 @@
+start:
+    mov x1, 0xabcd1234
+    sbfx x2, x1, 28, 4
+    print x2, d
+    sbfx x3, x1, 4, 4
+    print x3, d
+    sbfx x4, x1, 63, 1
+    print x4, d
@@ -0,0 +1,4 @@
+start:
+    mov x1, 5
+    sbfx x2, x1, 60, 8
+    print x2, d
@@ -0,0 +1,17 @@
+start:
+    mov w1, 1
+    lsl w2, w1, 31
+    print x2, x
+    asr w3, w2, 4
+    print x3, x
+    lsr w4, w2, 4
+    print x4, x
+    lsl w5, w1, 32
+    print x5, d
+    mov x6, 4294967295
+    eor w7, w6, w1
+    print x7, x
+    orr w8, w1, w2
+    print x8, x
+    and w9, w6, w2
+    print x9, x
@@ -0,0 +1,13 @@
+start:
+    mov x1, 1
+    mov x2, 2
+    mov x3, 3
+    mov x4, 4
+    stm x1, x4, 0
+    ldm x5, x8, 0
+    print x5, d
+    print x6, d
+    print x7, d
+    print x8, d
+    load x0, 8, 24
+    print x0, d
@@ -0,0 +1,3 @@
+start:
+    stm x9, x2, x1
+    print 1, d
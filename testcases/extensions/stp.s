@@ -0,0 +1,9 @@
+start:
+    mov x1, 11
+    mov x2, 22
+    stp x1, x2, 64
+    ldp x3, x4, 64
+    print x3, d
+    print x4, d
+    load x5, 8, 72
+    print x5, d
@@ -0,0 +1,4 @@
+start:
+    mov x1, 1
+    stp x1, 64
+    print 1, d
@@ -0,0 +1,10 @@
+start:
+    put "interpreter", 64
+    strchr x0, 64, 112
+    b.ne .missing
+    print x0, d
+    strchr x0, 64, 122
+    b.eq .end
+.missing:
+    print x0, d
+.end:
@@ -0,0 +1,15 @@
+start:
+    put "apple", 0
+    put "apply", 16
+    put "apple", 32
+    strcmp x0, 0, 16
+    b.ge .wrong
+    strcmp x0, 16, 0
+    b.le .wrong
+    strcmp x0, 0, 32
+    b.ne .wrong
+    print x0, d
+    b .end
+.wrong:
+    print 1, d
+.end:
@@ -0,0 +1,9 @@
+start:
+    put "copy me", 8
+    mov x1, 40
+    strcpy x1, 8
+    print x1, s
+    strlen x0, x1
+    print x0, d
+    strcmp x2, x1, 8
+    print x2, d
@@ -0,0 +1,6 @@
+start:
+    put "abc", 0
+    mov x1, 0
+    sub x1, x1, 1
+    strcpy x1, 0
+    print 1, d
@@ -0,0 +1,10 @@
+start:
+    put "hello, world", 100
+    strlen x0, 100
+    print x0, d
+    mov x1, 107
+    strlen x0, x1
+    print x0, d
+    put "", 200
+    strlen x0, 200
+    print x0, d
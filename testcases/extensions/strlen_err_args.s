@@ -0,0 +1,4 @@
+start:
+    put "abc", 0
+    strlen 0
+    print 1, d
@@ -0,0 +1,7 @@
+start:
+    mov w1, 0
+    sub w2, w1, 1
+    print x2, x
+    mov x3, 4294967301
+    sub w4, w3, 2
+    print x4, d
@@ -0,0 +1,8 @@
+start:
+    mov x1, 0xabcd1234
+    ubfx x2, x1, 8, 8
+    print x2, x
+    ubfx x3, x1, 28, 4
+    print x3, x
+    ubfx x4, x1, 0, 64
+    print x4, x
@@ -0,0 +1,4 @@
+start:
+    mov x1, 5
+    ubfx x2, x1, 70, 1
+    print x2, d
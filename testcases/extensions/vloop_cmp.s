@@ -0,0 +1,28 @@
+start:
+    mov x1, 0
+    mov x2, 7
+.fill:
+    store x2, x1, 1
+    add x2, x2, 13
+    add x1, x1, 1
+    cmp x1, 64
+    b.lt .fill
+    mov x1, 0
+    mov x3, 64
+    mov x5, 127
+.scale:
+    load x4, 1, x1
+    sub x4, x4, 100
+    and x4, x4, x5
+    store x4, x1, 1
+    add x1, x1, 1
+    sub x3, x3, 1
+    cmp x3, 0
+    b.ne .scale
+    print x4, d
+    print x1, d
+    print x3, d
+    load x6, 8, 0
+    print x6, x
+    load x6, 8, 56
+    print x6, x
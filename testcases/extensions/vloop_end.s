@@ -0,0 +1,14 @@
+start:
+    mov x1, 0
+    mov x2, 1000
+    mov x3, 3
+.copy:
+    load x4, 8, x1
+    add x4, x4, 1
+    store x4, x2, 8
+    add x1, x1, 8
+    add x2, x2, 8
+    loop x3, .copy
+    print x2, d
+    load x6, 8, 1016
+    print x6, d
@@ -0,0 +1,12 @@
+start:
+    mov x1, 0
+    mov x2, 512
+    mov x3, 0
+    print x3, d
+.copy:
+    load x4, 8, x1
+    store x4, x2, 8
+    add x1, x1, 8
+    add x2, x2, 8
+    loop x3, .copy
+    print x3, d
@@ -0,0 +1,24 @@
+start:
+    mov x1, 0
+    mov x2, 64
+    mov x3, 4
+    mov x5, 9
+    cmp x5, 1
+.copy:
+    load x4, 4, x1
+    orr x4, x4, x5
+    store x4, x2, 4
+    add x2, x2, 4
+    add x1, x1, 4
+    sub x3, x3, 1
+    cmp x3, 0
+    b.ne .copy
+    b.eq .equal
+    print x3, d
+.equal:
+    b.gt .greater
+    b.lt .greater
+    print x4, d
+    print x2, d
+.greater:
+    print x1, d
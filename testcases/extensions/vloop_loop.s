@@ -0,0 +1,32 @@
+start:
+    mov x1, 0
+    mov x2, 1
+.fill:
+    store x2, x1, 2
+    add x2, x2, 1
+    add x1, x1, 2
+    cmp x1, 200
+    b.lt .fill
+    mov x1, 0
+    mov x2, 256
+    mov x3, 100
+    mov x5, 3
+.copy:
+    load x4, 2, x1
+    add x4, x4, 65530
+    eor x4, x4, x5
+    lsl x4, x4, 1
+    store x4, x2, 2
+    add x1, x1, 2
+    add x2, x2, 2
+    loop x3, .copy
+    print x4, d
+    print x1, d
+    print x2, d
+    print x3, d
+    load x6, 8, 256
+    print x6, x
+    load x6, 8, 448
+    print x6, x
+    load x6, 2, 454
+    print x6, d
@@ -0,0 +1,24 @@
+start:
+    mov x1, 0
+    mov x2, 5
+.fill:
+    store x2, x1, 1
+    add x2, x2, 1
+    add x1, x1, 1
+    cmp x1, 16
+    b.lt .fill
+    mov x1, 0
+    mov x2, 1
+    mov x3, 15
+.shift:
+    load x4, 1, x1
+    add x4, x4, 1
+    store x4, x2, 1
+    add x1, x1, 1
+    add x2, x2, 1
+    loop x3, .shift
+    print x4, d
+    load x6, 8, 0
+    print x6, x
+    load x6, 8, 8
+    print x6, x